@@ -10,6 +10,7 @@ import os
 from PIL import Image
 import matplotlib.pyplot as plt
 import math
+import ctypes
 
 ### Result Visualization, provided by University
 def crop_images(images, upper, lower):
@@ -193,13 +194,64 @@ def visualize_k_means(kmeans, img_shape):
     plt.title('núvol de punts')
     plt.show()
 
+### Native engine: knn_native.c built into libknn.so (knn.dll on Windows) with make in this folder
+KNN_U8 = 0
+KNN_F32 = 1
+
+
+def load_native():
+    """The native library through ctypes, None if it is not built."""
+    name = "knn.dll" if os.name == "nt" else "libknn.so"
+    path = os.path.join(os.path.dirname(os.path.abspath(__file__)), name)
+    if not os.path.exists(path):
+        return None
+    try:
+        lib = ctypes.CDLL(path)
+    except OSError:
+        return None
+    lib.knn_create.restype = ctypes.c_void_p
+    lib.knn_create.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_size_t, ctypes.c_int]
+    lib.knn_free.restype = None
+    lib.knn_free.argtypes = [ctypes.c_void_p]
+    lib.knn_query.restype = ctypes.c_int
+    lib.knn_query.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t, ctypes.c_int, ctypes.c_int, ctypes.c_void_p]
+    lib.knn_use_kernel.restype = ctypes.c_int
+    lib.knn_use_kernel.argtypes = [ctypes.c_char_p]
+    lib.knn_kernel_name.restype = ctypes.c_char_p
+    lib.knn_kernel_name.argtypes = []
+    return lib
+
+
+NATIVE = load_native()
+
+
+def native_rows(data, dims):
+    """data as contiguous rows of dims values: uint8 when every value is an integer in 0..255
+    (the images), so the distances are exact, float32 otherwise."""
+    rows = np.asarray(data).reshape(len(data), dims)
+    if rows.dtype == np.uint8:
+        return np.ascontiguousarray(rows), KNN_U8
+    if rows.dtype.kind in "iub" or (rows.dtype.kind == "f" and np.array_equal(rows, np.floor(rows))):
+        if rows.size == 0 or (rows.min() >= 0 and rows.max() <= 255):
+            return np.ascontiguousarray(rows, dtype=np.uint8), KNN_U8
+    return np.ascontiguousarray(rows, dtype=np.float32), KNN_F32
+
+
 ### KNN Class
 class KNN:
-    def __init__(self, train_data, labels):
+    def __init__(self, train_data, labels, engine="auto"):
+        """engine: "native" (libknn through ctypes), "python" (cdist in processes), or
+        "auto": native when the library is built."""
         self.td_data = False
         self._init_train(train_data)
         self.labels = np.array(labels)
         self.runningProcesses = 0
+        if engine == "auto":
+            engine = "native" if NATIVE is not None else "python"
+        if engine == "native" and NATIVE is None:
+            raise RuntimeError("The native KNN library is not built (make in the KNN folder)")
+        self.engine = engine
+        self.nativeModels = {}
 
     def _init_train(self, train_data):
         if hasattr(train_data[0][0][0], "__len__"):
@@ -207,10 +259,38 @@ class KNN:
             self.td_data = True
         else:
             multi = 1
+        # The rows keep the type of the images, cdist converts them to float anyway
         self.train_data = train_data.reshape(len(train_data), len(train_data[0]) * len(train_data[0][0]) * multi)
-        for i in range(len(self.train_data)):
-            for j in range(len(self.train_data[0])):
-                self.train_data[i][j] = float(self.train_data[i][j])
+
+    def __del__(self):
+        for model in getattr(self, "nativeModels", {}).values():
+            NATIVE.knn_free(model)
+
+    def _native_model(self, rowType):
+        """The training set copied into the library once per row type."""
+        if rowType not in self.nativeModels:
+            dims = len(self.train_data[0])
+            rows = np.ascontiguousarray(self.train_data, dtype=np.uint8 if rowType == KNN_U8 else np.float32)
+            model = NATIVE.knn_create(rows.ctypes.data, len(rows), dims, rowType)
+            if not model:
+                raise MemoryError("knn_create failed")
+            self.nativeModels[rowType] = model
+        return self.nativeModels[rowType]
+
+    def get_k_neighbours_native(self, test_data, k, number_of_threads):
+        """Labels of the k nearest training images of every test image, nearest first, in one
+        call to the library: SIMD squared distances, a bounded heap per image, OpenMP threads."""
+        dims = len(self.train_data[0])
+        if k > len(self.train_data):
+            raise ValueError("k is larger than the training set")
+        queries, rowType = native_rows(test_data, dims)
+        if rowType == KNN_U8 and native_rows(self.train_data, dims)[1] != KNN_U8:
+            queries, rowType = np.ascontiguousarray(queries, dtype=np.float32), KNN_F32
+        neighbours = np.empty((len(queries), k), dtype=np.int32)
+        if NATIVE.knn_query(self._native_model(rowType), queries.ctypes.data, len(queries), k, number_of_threads,
+                            neighbours.ctypes.data) != 0:
+            raise MemoryError("knn_query failed")
+        return self.labels[neighbours].tolist()
     
     def get_k_neighbours(self, test_data, k, threadID, results):
         self.runningProcesses += 1
@@ -255,6 +335,9 @@ class KNN:
 
     
     def predict(self, test_data, k, number_of_threads):
+        if self.engine == "native":
+            self.neighbors = self.get_k_neighbours_native(test_data, k, number_of_threads)
+            return self.get_class(self.neighbors)
         images_per_process = math.floor(len(test_data) / number_of_threads)
     
         with Manager() as manager:
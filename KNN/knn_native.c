@@ -0,0 +1,396 @@
+#include "knn_native.h"
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KNN_X86 1
+#endif
+
+#define ROW_ALIGN 64                //rows start on a cache line and hold a multiple of 64 values
+#define QUERY_TILE 8                //queries of one task, their heaps stay in L1
+#define TRAIN_TILE_BYTES (256 << 10) //training rows of one tile, reused by every query of the task from L2
+
+struct KnnModel {
+    int type;
+    size_t count;
+    size_t dims;
+    size_t padded;                  //dims rounded up to a multiple of 64
+    size_t row_bytes;
+    unsigned char *rows;
+};
+
+//Squared L2 distances of one query to 4 training rows of padded values
+typedef void (*distance_function)(const void *query, const void *const rows[4], size_t padded, double out[4]);
+
+//Max-heap entry, ordered by distance, then by index
+typedef struct {
+    double distance;
+    int32_t index;
+} Neighbour;
+
+static void distances_u8_scalar(const void *query, const void *const rows[4], size_t padded, double out[4]) {
+    const uint8_t *q = (const uint8_t *)query;
+    for (int r = 0; r < 4; r++) {
+        const uint8_t *t = (const uint8_t *)rows[r];
+        uint32_t sum = 0;
+        for (size_t i = 0; i < padded; i++) {
+            int d = (int)q[i] - (int)t[i];
+            sum += (uint32_t)(d * d);
+        }
+        out[r] = sum;
+    }
+}
+
+static void distances_f32_scalar(const void *query, const void *const rows[4], size_t padded, double out[4]) {
+    const float *q = (const float *)query;
+    for (int r = 0; r < 4; r++) {
+        const float *t = (const float *)rows[r];
+        double sum = 0;
+        for (size_t i = 0; i < padded; i++) {
+            double d = (double)q[i] - (double)t[i];
+            sum += d * d;
+        }
+        out[r] = sum;
+    }
+}
+
+#ifdef KNN_X86
+//|a - b| of unsigned bytes, squared and summed pairwise into 32-bit lanes:
+//255^2 * 2 per lane and step, 14400 values stay far below 2^31
+__attribute__((target("avx2")))
+static inline __m256i squares_avx2(__m256i a, __m256i b) {
+    __m256i d = _mm256_or_si256(_mm256_subs_epu8(a, b), _mm256_subs_epu8(b, a));
+    __m256i lo = _mm256_unpacklo_epi8(d, _mm256_setzero_si256());
+    __m256i hi = _mm256_unpackhi_epi8(d, _mm256_setzero_si256());
+    return _mm256_add_epi32(_mm256_madd_epi16(lo, lo), _mm256_madd_epi16(hi, hi));
+}
+
+__attribute__((target("avx2")))
+static uint32_t sum_avx2(__m256i v) {
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (uint32_t)_mm_cvtsi128_si32(s);
+}
+
+//One load of the query serves the 4 rows
+__attribute__((target("avx2")))
+static void distances_u8_avx2(const void *query, const void *const rows[4], size_t padded, double out[4]) {
+    const uint8_t *q = (const uint8_t *)query;
+    const uint8_t *t0 = rows[0], *t1 = rows[1], *t2 = rows[2], *t3 = rows[3];
+    __m256i s0 = _mm256_setzero_si256(), s1 = s0, s2 = s0, s3 = s0;
+    for (size_t i = 0; i < padded; i += 32) {
+        __m256i a = _mm256_load_si256((const __m256i *)(q + i));
+        s0 = _mm256_add_epi32(s0, squares_avx2(a, _mm256_load_si256((const __m256i *)(t0 + i))));
+        s1 = _mm256_add_epi32(s1, squares_avx2(a, _mm256_load_si256((const __m256i *)(t1 + i))));
+        s2 = _mm256_add_epi32(s2, squares_avx2(a, _mm256_load_si256((const __m256i *)(t2 + i))));
+        s3 = _mm256_add_epi32(s3, squares_avx2(a, _mm256_load_si256((const __m256i *)(t3 + i))));
+    }
+    out[0] = sum_avx2(s0);
+    out[1] = sum_avx2(s1);
+    out[2] = sum_avx2(s2);
+    out[3] = sum_avx2(s3);
+}
+
+__attribute__((target("avx2,fma")))
+static double sum_pd_avx2(__m256d v) {
+    __m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+}
+
+__attribute__((target("avx2,fma")))
+static void distances_f32_avx2(const void *query, const void *const rows[4], size_t padded, double out[4]) {
+    const float *q = (const float *)query;
+    for (int r = 0; r < 4; r++) {
+        const float *t = (const float *)rows[r];
+        __m256d s = _mm256_setzero_pd();
+        for (size_t i = 0; i < padded; i += 4) {
+            __m256d d = _mm256_sub_pd(_mm256_cvtps_pd(_mm_load_ps(q + i)), _mm256_cvtps_pd(_mm_load_ps(t + i)));
+            s = _mm256_fmadd_pd(d, d, s);
+        }
+        out[r] = sum_pd_avx2(s);
+    }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static inline __m512i squares_avx512(__m512i a, __m512i b) {
+    __m512i d = _mm512_or_si512(_mm512_subs_epu8(a, b), _mm512_subs_epu8(b, a));
+    __m512i lo = _mm512_unpacklo_epi8(d, _mm512_setzero_si512());
+    __m512i hi = _mm512_unpackhi_epi8(d, _mm512_setzero_si512());
+    return _mm512_add_epi32(_mm512_madd_epi16(lo, lo), _mm512_madd_epi16(hi, hi));
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void distances_u8_avx512(const void *query, const void *const rows[4], size_t padded, double out[4]) {
+    const uint8_t *q = (const uint8_t *)query;
+    const uint8_t *t0 = rows[0], *t1 = rows[1], *t2 = rows[2], *t3 = rows[3];
+    __m512i s0 = _mm512_setzero_si512(), s1 = s0, s2 = s0, s3 = s0;
+    for (size_t i = 0; i < padded; i += 64) {
+        __m512i a = _mm512_load_si512((const void *)(q + i));
+        s0 = _mm512_add_epi32(s0, squares_avx512(a, _mm512_load_si512((const void *)(t0 + i))));
+        s1 = _mm512_add_epi32(s1, squares_avx512(a, _mm512_load_si512((const void *)(t1 + i))));
+        s2 = _mm512_add_epi32(s2, squares_avx512(a, _mm512_load_si512((const void *)(t2 + i))));
+        s3 = _mm512_add_epi32(s3, squares_avx512(a, _mm512_load_si512((const void *)(t3 + i))));
+    }
+    out[0] = (uint32_t)_mm512_reduce_add_epi32(s0);
+    out[1] = (uint32_t)_mm512_reduce_add_epi32(s1);
+    out[2] = (uint32_t)_mm512_reduce_add_epi32(s2);
+    out[3] = (uint32_t)_mm512_reduce_add_epi32(s3);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void distances_f32_avx512(const void *query, const void *const rows[4], size_t padded, double out[4]) {
+    const float *q = (const float *)query;
+    for (int r = 0; r < 4; r++) {
+        const float *t = (const float *)rows[r];
+        __m512d s = _mm512_setzero_pd();
+        for (size_t i = 0; i < padded; i += 8) {
+            __m512d d = _mm512_sub_pd(_mm512_cvtps_pd(_mm256_load_ps(q + i)), _mm512_cvtps_pd(_mm256_load_ps(t + i)));
+            s = _mm512_fmadd_pd(d, d, s);
+        }
+        out[r] = _mm512_reduce_add_pd(s);
+    }
+}
+#endif
+
+static distance_function active_u8 = NULL;
+static distance_function active_f32 = NULL;
+static const char *active_name = "scalar";
+
+static void set_kernel(distance_function u8, distance_function f32, const char *name) {
+    active_f32 = f32;
+    active_name = name;
+    active_u8 = u8;
+}
+
+//Pick the widest kernel the CPU supports
+static void knn_dispatch(void) {
+#ifdef KNN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw")) {
+        set_kernel(distances_u8_avx512, distances_f32_avx512, "avx512");
+        return;
+    } else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        set_kernel(distances_u8_avx2, distances_f32_avx2, "avx2");
+        return;
+    }
+#endif
+    set_kernel(distances_u8_scalar, distances_f32_scalar, "scalar");
+}
+
+int knn_use_kernel(const char *name) {
+    if (strcmp(name, "auto") == 0) {
+        knn_dispatch();
+        return 1;
+    }
+    if (strcmp(name, "scalar") == 0) {
+        set_kernel(distances_u8_scalar, distances_f32_scalar, "scalar");
+        return 1;
+    }
+#ifdef KNN_X86
+    __builtin_cpu_init();
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        set_kernel(distances_u8_avx2, distances_f32_avx2, "avx2");
+        return 1;
+    }
+    if (strcmp(name, "avx512") == 0 && __builtin_cpu_supports("avx512bw")) {
+        set_kernel(distances_u8_avx512, distances_f32_avx512, "avx512");
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+const char *knn_kernel_name(void) {
+    if (active_u8 == NULL) {
+        knn_dispatch();
+    }
+    return active_name;
+}
+
+static void *alloc_rows(size_t bytes) {
+#ifdef _WIN32
+    return _aligned_malloc(bytes, ROW_ALIGN);
+#else
+    return aligned_alloc(ROW_ALIGN, bytes);
+#endif
+}
+
+static void free_rows(void *rows) {
+#ifdef _WIN32
+    _aligned_free(rows);
+#else
+    free(rows);
+#endif
+}
+
+static size_t value_size(int type) {
+    return type == KNN_U8 ? sizeof(uint8_t) : sizeof(float);
+}
+
+//Copy rows into padded, aligned rows of model's layout
+static void copy_rows(const KnnModel *model, unsigned char *dst, const void *src, size_t count) {
+    size_t bytes = model->dims * value_size(model->type);
+    for (size_t i = 0; i < count; i++) {
+        memcpy(dst + i * model->row_bytes, (const unsigned char *)src + i * bytes, bytes);
+        memset(dst + i * model->row_bytes + bytes, 0, model->row_bytes - bytes);
+    }
+}
+
+KnnModel *knn_create(const void *rows, size_t count, size_t dims, int type) {
+    if (rows == NULL || count == 0 || dims == 0 || (type != KNN_U8 && type != KNN_F32)) {
+        return NULL;
+    }
+    KnnModel *model = (KnnModel *)calloc(1, sizeof(KnnModel));
+    if (model == NULL) {
+        return NULL;
+    }
+    model->type = type;
+    model->count = count;
+    model->dims = dims;
+    model->padded = (dims + ROW_ALIGN - 1) / ROW_ALIGN * ROW_ALIGN;
+    model->row_bytes = model->padded * value_size(type);
+    model->rows = (unsigned char *)alloc_rows(model->row_bytes * count);
+    if (model->rows == NULL) {
+        free(model);
+        return NULL;
+    }
+    copy_rows(model, model->rows, rows, count);
+    return model;
+}
+
+void knn_free(KnnModel *model) {
+    if (model != NULL) {
+        free_rows(model->rows);
+        free(model);
+    }
+}
+
+static int farther(const Neighbour *a, const Neighbour *b) {
+    return a->distance > b->distance || (a->distance == b->distance && a->index > b->index);
+}
+
+//Put item at the root of heap[0, size) and move it down to its place
+static void sift_down(Neighbour *heap, int size, Neighbour item) {
+    int i = 0;
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= size) {
+            break;
+        }
+        if (child + 1 < size && farther(&heap[child + 1], &heap[child])) {
+            child++;
+        }
+        if (!farther(&heap[child], &item)) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = item;
+}
+
+//Keep the k nearest in a max-heap of size *size: the farthest kept neighbour is heap[0]
+static void heap_offer(Neighbour *heap, int *size, int k, double distance, int32_t index) {
+    Neighbour item = {distance, index};
+    if (*size < k) {
+        int i = (*size)++;
+        while (i > 0 && farther(&item, &heap[(i - 1) / 2])) {
+            heap[i] = heap[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        heap[i] = item;
+    } else if (farther(&heap[0], &item)) {
+        sift_down(heap, k, item);
+    }
+}
+
+//Nearest first: move the farthest to the back until the heap is empty
+static void heap_sort(Neighbour *heap, int size) {
+    for (int end = size - 1; end > 0; end--) {
+        Neighbour top = heap[0];
+        sift_down(heap, end, heap[end]);
+        heap[end] = top;
+    }
+}
+
+int knn_query(const KnnModel *model, const void *queries, size_t count, int k, int threads, int32_t *neighbours) {
+    if (model == NULL || (queries == NULL && count > 0) || neighbours == NULL || k < 1 || (size_t)k > model->count) {
+        return -1;
+    }
+    if (active_u8 == NULL) {
+        knn_dispatch();
+    }
+    distance_function distances = model->type == KNN_U8 ? active_u8 : active_f32;
+    size_t train_tile = TRAIN_TILE_BYTES / model->row_bytes / 4 * 4;
+    if (train_tile < 4) {
+        train_tile = 4;
+    }
+    long long tasks = (long long)((count + QUERY_TILE - 1) / QUERY_TILE);
+    size_t query_bytes = model->dims * value_size(model->type);
+    int failed = 0;
+#ifdef _OPENMP
+    if (threads <= 0) {
+        threads = omp_get_max_threads();
+    }
+#else
+    (void)threads;
+#endif
+
+    #pragma omp parallel num_threads(threads)
+    {
+        unsigned char *tile = (unsigned char *)alloc_rows(model->row_bytes * QUERY_TILE);
+        Neighbour *heaps = (Neighbour *)malloc(sizeof(Neighbour) * QUERY_TILE * k);
+        if (tile == NULL || heaps == NULL) {
+            #pragma omp atomic write
+            failed = 1;
+        }
+        #pragma omp for schedule(dynamic)
+        for (long long task = 0; task < tasks; task++) {
+            if (tile == NULL || heaps == NULL) {
+                continue;
+            }
+            size_t first = (size_t)task * QUERY_TILE;
+            size_t n = count - first < QUERY_TILE ? count - first : QUERY_TILE;
+            int sizes[QUERY_TILE] = {0};
+            copy_rows(model, tile, (const unsigned char *)queries + first * query_bytes, n);
+            //Every tile of training rows is read from L2 by all queries of the task
+            for (size_t start = 0; start < model->count; start += train_tile) {
+                size_t end = start + train_tile < model->count ? start + train_tile : model->count;
+                for (size_t q = 0; q < n; q++) {
+                    const void *query = tile + q * model->row_bytes;
+                    for (size_t t = start; t < end; t += 4) {
+                        const void *rows[4];
+                        double out[4];
+                        for (int r = 0; r < 4; r++) {
+                            //Past the last row the last one is measured again and dropped
+                            size_t row = t + r < end ? t + r : end - 1;
+                            rows[r] = model->rows + row * model->row_bytes;
+                        }
+                        distances(query, rows, model->padded, out);
+                        for (int r = 0; r < 4 && t + r < end; r++) {
+                            heap_offer(heaps + q * k, &sizes[q], k, out[r], (int32_t)(t + r));
+                        }
+                    }
+                }
+            }
+            for (size_t q = 0; q < n; q++) {
+                heap_sort(heaps + q * k, sizes[q]);
+                for (int j = 0; j < k; j++) {
+                    neighbours[(first + q) * k + j] = heaps[q * k + j].index;
+                }
+            }
+        }
+        free_rows(tile);
+        free(heaps);
+    }
+    return failed ? -1 : 0;
+}
@@ -0,0 +1,28 @@
+#ifndef KNN_NATIVE_H
+#define KNN_NATIVE_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+//Row types of knn_create
+#define KNN_U8 0  //uint8 values (the images), distances are exact 32-bit integer sums
+#define KNN_F32 1 //float32 values, distances are summed in double like cdist
+
+//Training set copied into contiguous, 64-byte aligned rows padded with zeros
+typedef struct KnnModel KnnModel;
+
+//Copy count rows of dims values of type. Returns NULL on bad arguments or when out of memory.
+KnnModel *knn_create(const void *rows, size_t count, size_t dims, int type);
+void knn_free(KnnModel *model);
+//The k nearest training rows of every query row (same type and dims as the model) by squared
+//L2 distance, nearest first, equal distances by lower index. neighbours has count * k entries.
+//threads <= 0 uses OpenMP's default. Returns 0 on success, -1 on bad arguments.
+int knn_query(const KnnModel *model, const void *queries, size_t count, int k, int threads, int32_t *neighbours);
+
+//Distance kernel: "auto", "scalar", "avx2" or "avx512".
+//Returns 0 when the kernel is unknown or not supported by this CPU.
+int knn_use_kernel(const char *name);
+const char *knn_kernel_name(void);
+
+#endif
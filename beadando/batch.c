@@ -0,0 +1,374 @@
+/* batch.c */
+/* This file implements the batched Miller-Rabin tester declared in batch.h:
+   - Sieving a window of odd candidates with the small primes on the host
+   - Testing all survivors x witnesses in a single kernel launch
+   - Picking the first probable prime of the window in candidate order
+   - The window sieve and the walk over the range, shared with the native backend
+   - The Montgomery constants and the host reference test
+*/
+
+#include "batch.h"          // Include our header for function declarations
+#include <stdio.h>          // For error messages
+#include <stdlib.h>         // For memory allocation and rand()
+#include <string.h>         // For memset
+
+cl_ulong random64(void) {
+    cl_ulong value = 0;
+    for (int i = 0; i < 5; i++) {
+        value = (value << 15) ^ (cl_ulong)(rand() & 0x7FFF);
+    }
+    return value;
+}
+
+const cl_ulong witnessBases[NUM_WITNESSES] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+
+void montgomeryConstants(cl_ulong n, cl_ulong *nInv, cl_ulong *r2) {
+    // Newton's iteration for n^-1 mod 2^64: n is its own inverse mod 8 and every step
+    // doubles the correct bits, 3 -> 6 -> 12 -> 24 -> 48 -> 96
+    cl_ulong inv = n;
+    for (int i = 0; i < 5; i++) {
+        inv *= 2 - n * inv;
+    }
+    *nInv = 0 - inv;
+    cl_ulong r = (0 - n) % n;   // 2^64 mod n
+    *r2 = (cl_ulong)((unsigned __int128)r * r % n);
+}
+
+static unsigned long long hostModexp(unsigned long long base, unsigned long long exp, unsigned long long mod) {
+    unsigned long long result = 1;
+    base %= mod;
+    while (exp > 0) {
+        if (exp & 1) {
+            result = (unsigned long long)((unsigned __int128)result * base % mod);
+        }
+        exp >>= 1;
+        base = (unsigned long long)((unsigned __int128)base * base % mod);
+    }
+    return result;
+}
+
+int hostMillerRabin(unsigned long long n) {
+    if (n < 2) {
+        return 0;
+    }
+    for (int i = 0; i < NUM_WITNESSES; i++) {
+        if (n % witnessBases[i] == 0) {
+            return n == witnessBases[i];
+        }
+    }
+    unsigned long long d = n - 1;
+    int s = 0;
+    while ((d % 2) == 0) {
+        d /= 2;
+        s++;
+    }
+    for (int i = 0; i < NUM_WITNESSES; i++) {
+        unsigned long long x = hostModexp(witnessBases[i], d, n);
+        if (x == 1 || x == n - 1) {
+            continue;
+        }
+        int r;
+        for (r = 1; r < s; r++) {
+            x = (unsigned long long)((unsigned __int128)x * x % n);
+            if (x == n - 1) {
+                break;
+            }
+        }
+        if (r == s) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int sieveInit(WindowSieve *sieve, size_t window) {
+    unsigned char marked[SIEVE_LIMIT] = {0};
+    memset(sieve, 0, sizeof(*sieve));
+    sieve->window = window;
+    sieve->marks = (unsigned char *)malloc(window);
+    sieve->smallPrimes = (unsigned int *)malloc(sizeof(unsigned int) * SIEVE_LIMIT);
+    if (!sieve->marks || !sieve->smallPrimes) {
+        sieveRelease(sieve);
+        return 0;
+    }
+    // The odd primes below SIEVE_LIMIT, with a plain sieve of Eratosthenes
+    for (unsigned int p = 3; p < SIEVE_LIMIT; p += 2) {
+        if (marked[p]) {
+            continue;
+        }
+        sieve->smallPrimes[sieve->numSmallPrimes++] = p;
+        for (unsigned int m = p * p; m < SIEVE_LIMIT; m += 2 * p) {
+            marked[m] = 1;
+        }
+    }
+    return 1;
+}
+
+size_t sieveWindow(WindowSieve *sieve, cl_ulong start, size_t count, cl_ulong *survivors, cl_ulong *hostPrime) {
+    const cl_ulong limit = (cl_ulong)SIEVE_LIMIT * SIEVE_LIMIT;
+    // Mark the candidates start + 2i (i < count) that have a small prime factor.
+    // A candidate equal to a small prime is not marked.
+    memset(sieve->marks, 0, count);
+    for (int k = 0; k < sieve->numSmallPrimes; k++) {
+        cl_ulong p = sieve->smallPrimes[k];
+        // start + 2i = 0 (mod p)  <=>  i = (p - start mod p) * inverse of 2 (mod p)
+        cl_ulong i = ((p - start % p) % p) * ((p + 1) / 2) % p;
+        if (start + 2 * i == p) {
+            i += p;
+        }
+        for (; i < count; i += p) {
+            sieve->marks[i] = 1;
+        }
+    }
+    // Survivors below SIEVE_LIMIT^2 have no factor up to their square root: prime.
+    // Candidates are in increasing order, so the first of those ends the window.
+    size_t numSurvivors = 0;
+    *hostPrime = 0;
+    for (size_t i = 0; i < count; i++) {
+        cl_ulong candidate = start + 2 * i;
+        if (sieve->marks[i] || candidate < 3) {
+            continue;
+        }
+        if (candidate < limit) {
+            *hostPrime = candidate;
+            break;
+        }
+        survivors[numSurvivors++] = candidate;
+    }
+    return numSurvivors;
+}
+
+void sieveRelease(WindowSieve *sieve) {
+    free(sieve->marks);
+    free(sieve->smallPrimes);
+    memset(sieve, 0, sizeof(*sieve));
+}
+
+int batchInit(BatchTester *tester, cl_context context, cl_device_id device, cl_command_queue queue, cl_program program, size_t window) {
+    (void)device;
+    cl_int err;
+    memset(tester, 0, sizeof(*tester));
+    tester->queue = queue;
+    tester->window = window;
+    // Host side arrays, sized for a window where every candidate survives
+    tester->candidates = (cl_ulong *)malloc(sizeof(cl_ulong) * window);
+    tester->d = (cl_ulong *)malloc(sizeof(cl_ulong) * window);
+    tester->s = (cl_int *)malloc(sizeof(cl_int) * window);
+    tester->nInv = (cl_ulong *)malloc(sizeof(cl_ulong) * window);
+    tester->r2 = (cl_ulong *)malloc(sizeof(cl_ulong) * window);
+    tester->composite = (cl_int *)calloc(window, sizeof(cl_int));
+    if (!tester->candidates || !tester->d || !tester->s || !tester->nInv || !tester->r2 || !tester->composite || !sieveInit(&tester->sieve, window)) {
+        fprintf(stderr, "Error: Failed to allocate the batch arrays\n");
+        batchRelease(tester);
+        return 0;
+    }
+    // Device buffers, created once and rewritten for every window
+    tester->candidateBuffer = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(cl_ulong) * window, NULL, &err);
+    if (err == CL_SUCCESS) tester->dBuffer = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(cl_ulong) * window, NULL, &err);
+    if (err == CL_SUCCESS) tester->sBuffer = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(cl_int) * window, NULL, &err);
+    if (err == CL_SUCCESS) tester->nInvBuffer = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(cl_ulong) * window, NULL, &err);
+    if (err == CL_SUCCESS) tester->r2Buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(cl_ulong) * window, NULL, &err);
+    if (err == CL_SUCCESS) tester->witnessBuffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(witnessBases), (void *)witnessBases, &err);
+    if (err == CL_SUCCESS) tester->compositeBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_int) * window, NULL, &err);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error: Failed to create the batch buffers (%d)\n", err);
+        batchRelease(tester);
+        return 0;
+    }
+    tester->kernel = clCreateKernel(program, "millerRabinBatch", &err);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error: Failed to create the batch kernel (%d)\n", err);
+        batchRelease(tester);
+        return 0;
+    }
+    // The buffers never change, so the arguments are set only once
+    err = clSetKernelArg(tester->kernel, 0, sizeof(cl_mem), &tester->candidateBuffer);
+    err |= clSetKernelArg(tester->kernel, 1, sizeof(cl_mem), &tester->dBuffer);
+    err |= clSetKernelArg(tester->kernel, 2, sizeof(cl_mem), &tester->sBuffer);
+    err |= clSetKernelArg(tester->kernel, 3, sizeof(cl_mem), &tester->nInvBuffer);
+    err |= clSetKernelArg(tester->kernel, 4, sizeof(cl_mem), &tester->r2Buffer);
+    err |= clSetKernelArg(tester->kernel, 5, sizeof(cl_mem), &tester->witnessBuffer);
+    err |= clSetKernelArg(tester->kernel, 6, sizeof(cl_mem), &tester->compositeBuffer);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error: Failed to set the batch kernel arguments\n");
+        batchRelease(tester);
+        return 0;
+    }
+    return 1;
+}
+
+// Store candidate as device slot index with its d, s and Montgomery constants
+static void addCandidate(BatchTester *tester, size_t index, cl_ulong candidate) {
+    // Decompose candidate-1 into d * 2^s, where d is odd
+    cl_ulong d = candidate - 1;
+    int s = 0;
+    while ((d % 2) == 0) {
+        d /= 2;
+        s++;
+    }
+    tester->candidates[index] = candidate;
+    tester->d[index] = d;
+    tester->s[index] = s;
+    montgomeryConstants(candidate, &tester->nInv[index], &tester->r2[index]);
+}
+
+// Test the first count stored candidates with every witness in one launch and read
+// back tester->composite. Returns 1 on success, 0 on an OpenCL error.
+static int launchCandidates(BatchTester *tester, size_t count) {
+    memset(tester->composite, 0, sizeof(cl_int) * count);
+    // Non-blocking writes: the in-order queue runs them before the kernel, and
+    // the blocking read at the end keeps the host arrays alive until then
+    cl_int err = clEnqueueWriteBuffer(tester->queue, tester->candidateBuffer, CL_FALSE, 0, sizeof(cl_ulong) * count, tester->candidates, 0, NULL, NULL);
+    err |= clEnqueueWriteBuffer(tester->queue, tester->dBuffer, CL_FALSE, 0, sizeof(cl_ulong) * count, tester->d, 0, NULL, NULL);
+    err |= clEnqueueWriteBuffer(tester->queue, tester->sBuffer, CL_FALSE, 0, sizeof(cl_int) * count, tester->s, 0, NULL, NULL);
+    err |= clEnqueueWriteBuffer(tester->queue, tester->nInvBuffer, CL_FALSE, 0, sizeof(cl_ulong) * count, tester->nInv, 0, NULL, NULL);
+    err |= clEnqueueWriteBuffer(tester->queue, tester->r2Buffer, CL_FALSE, 0, sizeof(cl_ulong) * count, tester->r2, 0, NULL, NULL);
+    err |= clEnqueueWriteBuffer(tester->queue, tester->compositeBuffer, CL_FALSE, 0, sizeof(cl_int) * count, tester->composite, 0, NULL, NULL);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error: Failed to write the batch buffers\n");
+        return 0;
+    }
+    // One work-item per candidate and witness
+    size_t global_work_size[2] = {count, NUM_WITNESSES};
+    err = clEnqueueNDRangeKernel(tester->queue, tester->kernel, 2, NULL, global_work_size, NULL, 0, NULL, NULL);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error: Failed to enqueue the batch kernel (%d)\n", err);
+        return 0;
+    }
+    err = clEnqueueReadBuffer(tester->queue, tester->compositeBuffer, CL_TRUE, 0, sizeof(cl_int) * count, tester->composite, 0, NULL, NULL);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error: Failed to read the batch results\n");
+        return 0;
+    }
+    tester->launches++;
+    tester->tested += count;
+    return 1;
+}
+
+// Test one window: returns 1 and the prime if the window has one, 0 if not, -1 on error
+static int testWindow(void *context, cl_ulong start, size_t count, unsigned long long *prime) {
+    BatchTester *tester = (BatchTester *)context;
+    cl_ulong hostPrime;
+    size_t survivors = sieveWindow(&tester->sieve, start, count, tester->candidates, &hostPrime);
+    if (survivors > 0) {
+        for (size_t i = 0; i < survivors; i++) {
+            addCandidate(tester, i, tester->candidates[i]);
+        }
+        if (!launchCandidates(tester, survivors)) {
+            return -1;
+        }
+        // The device survivors all lie before hostPrime, the first one left is the answer
+        for (size_t i = 0; i < survivors; i++) {
+            if (!tester->composite[i]) {
+                *prime = tester->candidates[i];
+                return 1;
+            }
+        }
+    }
+    if (hostPrime != 0) {
+        *prime = hostPrime;
+        return 1;
+    }
+    return 0;
+}
+
+int batchTestNumbers(BatchTester *tester, const unsigned long long *numbers, size_t count, int *isPrime) {
+    for (size_t first = 0; first < count; first += tester->window) {
+        size_t chunk = count - first < tester->window ? count - first : tester->window;
+        for (size_t i = 0; i < chunk; i++) {
+            addCandidate(tester, i, numbers[first + i]);
+        }
+        if (!launchCandidates(tester, chunk)) {
+            return 0;
+        }
+        for (size_t i = 0; i < chunk; i++) {
+            isPrime[first + i] = !tester->composite[i];
+        }
+    }
+    return 1;
+}
+
+void windowWalkInit(WindowWalk *walk, size_t window, unsigned long long start, unsigned long long lower_bound, unsigned long long upper_bound) {
+    walk->window = window;
+    walk->upper = upper_bound;
+    walk->first = (lower_bound | 1ULL) > 3 ? (lower_bound | 1ULL) : 3;
+    if (start < walk->first || start > upper_bound) {
+        start = walk->first;
+    }
+    walk->start = start;
+    walk->candidate = start | 1ULL;
+    walk->wrapped = 0;
+    walk->done = 0;
+}
+
+int windowWalkNext(WindowWalk *walk, cl_ulong *start, size_t *count) {
+    if (walk->done) {
+        return 0;
+    }
+    if (walk->candidate > walk->upper) {
+        // Every candidate was composite: there is no prime of this size
+        if (walk->wrapped) {
+            return 0;
+        }
+        walk->wrapped = 1;
+        walk->candidate = walk->first;
+    }
+    cl_ulong candidate = walk->candidate;
+    size_t n = (size_t)((walk->upper - candidate) / 2 + 1);
+    if (n > walk->window) {
+        n = walk->window;
+    }
+    if (walk->wrapped && candidate < walk->start && (walk->start - candidate) / 2 < n) {
+        n = (size_t)((walk->start - candidate) / 2);
+    }
+    // The last window ends exactly at upper_bound, stepping past it could overflow 2^64
+    int last = n == (walk->upper - candidate) / 2 + 1;
+    *start = candidate;
+    *count = n;
+    if (walk->wrapped && (last || candidate + 2 * (cl_ulong)n >= walk->start)) {
+        walk->done = 1;
+    } else if (last) {
+        walk->wrapped = 1;
+        walk->candidate = walk->first;
+    } else {
+        walk->candidate = candidate + 2 * (cl_ulong)n;
+    }
+    return 1;
+}
+
+int windowFindPrime(size_t window, WindowTest test, void *tester, unsigned long long start, unsigned long long lower_bound, unsigned long long upper_bound, unsigned long long *prime) {
+    WindowWalk walk;
+    cl_ulong candidate;
+    size_t count;
+    windowWalkInit(&walk, window, start, lower_bound, upper_bound);
+    while (windowWalkNext(&walk, &candidate, &count)) {
+        int found = test(tester, candidate, count, prime);
+        if (found != 0) {
+            return found > 0;
+        }
+    }
+    return 0;
+}
+
+int batchFindPrime(BatchTester *tester, unsigned long long start, unsigned long long lower_bound, unsigned long long upper_bound, unsigned long long *prime) {
+    return windowFindPrime(tester->window, testWindow, tester, start, lower_bound, upper_bound, prime);
+}
+
+void batchRelease(BatchTester *tester) {
+    if (tester->candidateBuffer) clReleaseMemObject(tester->candidateBuffer);
+    if (tester->dBuffer) clReleaseMemObject(tester->dBuffer);
+    if (tester->sBuffer) clReleaseMemObject(tester->sBuffer);
+    if (tester->nInvBuffer) clReleaseMemObject(tester->nInvBuffer);
+    if (tester->r2Buffer) clReleaseMemObject(tester->r2Buffer);
+    if (tester->witnessBuffer) clReleaseMemObject(tester->witnessBuffer);
+    if (tester->compositeBuffer) clReleaseMemObject(tester->compositeBuffer);
+    if (tester->kernel) clReleaseKernel(tester->kernel);
+    free(tester->candidates);
+    free(tester->d);
+    free(tester->s);
+    free(tester->nInv);
+    free(tester->r2);
+    free(tester->composite);
+    sieveRelease(&tester->sieve);
+    memset(tester, 0, sizeof(*tester));
+}
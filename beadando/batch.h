@@ -0,0 +1,114 @@
+/* batch.h */
+/* This header file declares the batched Miller-Rabin tester:
+   - The host sieves a window of consecutive odd candidates with small primes
+   - One kernel launch tests every survivor with every witness
+   - The device buffers are created once and reused for every window
+   - The Montgomery constants of every candidate are computed on the host
+*/
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <CL/cl.h>
+
+#define NUM_WITNESSES 12            // The first 12 primes, a deterministic witness set for every 64-bit n
+#define DEFAULT_WINDOW 8192         // Odd candidates sieved and tested per launch
+#define SIEVE_LIMIT 2048            // The window is sieved with the odd primes below this
+
+// Sieve of a window of consecutive odd candidates with the odd primes below SIEVE_LIMIT
+typedef struct {
+    size_t window;                  // Largest window
+    unsigned char *marks;           // 1 = has a small prime factor
+    unsigned int *smallPrimes;      // Odd primes below SIEVE_LIMIT
+    int numSmallPrimes;
+} WindowSieve;
+
+// Tests the window of count odd candidates from start: returns 1 and the first probable
+// prime of the window, 0 if the window has none, -1 on error
+typedef int (*WindowTest)(void *tester, cl_ulong start, size_t count, unsigned long long *prime);
+
+// Walk over the windows of a range from start, wrapping from upper_bound back to lower_bound
+// until the window before start
+typedef struct {
+    size_t window;                  // Odd candidates per window
+    cl_ulong first;                 // First odd candidate of the range (at least 3)
+    cl_ulong start;                 // Where the walk began
+    cl_ulong candidate;             // Start of the next window
+    cl_ulong upper;                 // upper_bound
+    int wrapped;                    // 1 after the wrap to first
+    int done;                       // 1 after the last window
+} WindowWalk;
+
+// State of the batched tester, kept between windows
+typedef struct {
+    cl_command_queue queue;         // Queue the windows are tested on
+    cl_kernel kernel;               // "millerRabinBatch" kernel, its arguments are set once
+    cl_mem candidateBuffer;         // Survivors of the sieve
+    cl_mem dBuffer;                 // d of candidate - 1 = d * 2^s, per survivor
+    cl_mem sBuffer;                 // s of candidate - 1 = d * 2^s, per survivor
+    cl_mem nInvBuffer;              // -candidate^-1 mod 2^64, per survivor
+    cl_mem r2Buffer;                // 2^128 mod candidate, per survivor
+    cl_mem witnessBuffer;           // witnessBases, written once
+    cl_mem compositeBuffer;         // Early-exit flag per survivor, set by the first failing witness
+    size_t window;                  // Odd candidates per window
+    cl_ulong *candidates;           // Host copies of the buffers above
+    cl_ulong *d;
+    cl_int *s;
+    cl_ulong *nInv;
+    cl_ulong *r2;
+    cl_int *composite;
+    WindowSieve sieve;
+    unsigned long long launches;    // Kernel launches so far
+    unsigned long long tested;      // Candidates sent to the device so far
+} BatchTester;
+
+// Allocate a sieve for windows of up to window candidates. Returns 1 on success.
+int sieveInit(WindowSieve *sieve, size_t window);
+
+// Sieve the count odd candidates from start and store the ones that need a Miller-Rabin
+// test in survivors, in increasing order; returns their number. The first survivor below
+// SIEVE_LIMIT^2 is prime without a test: it ends the window and goes to *hostPrime (else 0).
+size_t sieveWindow(WindowSieve *sieve, cl_ulong start, size_t count, cl_ulong *survivors, cl_ulong *hostPrime);
+
+void sieveRelease(WindowSieve *sieve);
+
+// Start a walk at start (odd), moved to the first odd candidate when outside the range
+void windowWalkInit(WindowWalk *walk, size_t window, unsigned long long start, unsigned long long lower_bound, unsigned long long upper_bound);
+
+// The next window of the walk: its first candidate and the number of odd candidates.
+// Returns 0 when the whole range has been walked.
+int windowWalkNext(WindowWalk *walk, cl_ulong *start, size_t *count);
+
+// Walk the range window by window from start with test, wrapping from upper_bound back to
+// lower_bound. Returns 1 and the prime, 0 if there is none or test failed.
+int windowFindPrime(size_t window, WindowTest test, void *tester, unsigned long long start, unsigned long long lower_bound, unsigned long long upper_bound, unsigned long long *prime);
+
+// Create the persistent buffers and the kernel, and set the kernel arguments.
+// Returns 1 on success, 0 on failure.
+int batchInit(BatchTester *tester, cl_context context, cl_device_id device, cl_command_queue queue, cl_program program, size_t window);
+
+// Find the first probable prime at or after start (odd), wrapping from upper_bound
+// back to lower_bound like the single candidate loop. Returns 1 on success.
+int batchFindPrime(BatchTester *tester, unsigned long long start, unsigned long long lower_bound, unsigned long long upper_bound, unsigned long long *prime);
+
+// Test count arbitrary odd numbers (>= 3) on the device, in windows of at most
+// tester->window numbers. isPrime[i] is set to 1 for the probable primes.
+// Returns 1 on success, 0 on an OpenCL error.
+int batchTestNumbers(BatchTester *tester, const unsigned long long *numbers, size_t count, int *isPrime);
+
+// Release the buffers, the kernel and the host arrays
+void batchRelease(BatchTester *tester);
+
+// 64 random bits from rand(), which may only give 15
+cl_ulong random64(void);
+
+// The Miller-Rabin witnesses: the primes 2..37 decide every n < 3.3 * 10^24
+extern const cl_ulong witnessBases[NUM_WITNESSES];
+
+// Montgomery constants of odd n for the kernels: nInv = -n^-1 mod 2^64, r2 = 2^128 mod n
+void montgomeryConstants(cl_ulong n, cl_ulong *nInv, cl_ulong *r2);
+
+// Host reference: the same deterministic Miller-Rabin test with 128-bit products
+int hostMillerRabin(unsigned long long n);
+
+#endif // BATCH_H
@@ -0,0 +1,237 @@
+/* bignum.cl */
+/* This file contains the OpenCL kernels of the multi-precision Miller-Rabin test:
+   - Numbers are LIMBS little-endian 32-bit limbs, LIMBS is set when the program is built (-DLIMBS=...)
+   - bigMillerRabinItem: one work-item per candidate and witness, Montgomery (CIOS) in private memory
+   - bigMillerRabinGroup: one work-group of LIMBS work-items per candidate and witness, every
+     work-item owns one limb and the numbers live in local memory
+*/
+
+#ifndef LIMBS
+#define LIMBS 8
+#endif
+
+// Montgomery product r = a * b / 2^(32 LIMBS) mod n (CIOS), for a, b < n and odd n.
+// nInv = -n^-1 mod 2^32. r may be the same array as a or b.
+void bigMontMul(uint *r, const uint *a, const uint *b, const uint *n, uint nInv) {
+    uint t[LIMBS + 2];
+    for(int j = 0; j < LIMBS + 2; j++)
+        t[j] = 0;
+    for(int i = 0; i < LIMBS; i++) {
+        // t += a * b[i]
+        ulong carry = 0;
+        for(int j = 0; j < LIMBS; j++) {
+            ulong s = (ulong)a[j] * b[i] + t[j] + carry;
+            t[j] = (uint)s;
+            carry = s >> 32;
+        }
+        ulong s = (ulong)t[LIMBS] + carry;
+        t[LIMBS] = (uint)s;
+        t[LIMBS + 1] = (uint)(s >> 32);
+        // t = (t + m * n) / 2^32, m makes the lowest limb 0
+        uint m = t[0] * nInv;
+        s = (ulong)m * n[0] + t[0];
+        carry = s >> 32;
+        for(int j = 1; j < LIMBS; j++) {
+            s = (ulong)m * n[j] + t[j] + carry;
+            t[j - 1] = (uint)s;
+            carry = s >> 32;
+        }
+        s = (ulong)t[LIMBS] + carry;
+        t[LIMBS - 1] = (uint)s;
+        t[LIMBS] = t[LIMBS + 1] + (uint)(s >> 32);
+    }
+    // t < 2n: subtract n once if t >= n
+    uint d[LIMBS];
+    long borrow = 0;
+    for(int j = 0; j < LIMBS; j++) {
+        long s = (long)t[j] - n[j] + borrow;
+        d[j] = (uint)s;
+        borrow = s >> 32;
+    }
+    int subtract = t[LIMBS] != 0 || borrow == 0;
+    for(int j = 0; j < LIMBS; j++)
+        r[j] = subtract ? d[j] : t[j];
+}
+
+int bigEqual(const uint *a, const uint *b) {
+    for(int j = 0; j < LIMBS; j++)
+        if(a[j] != b[j])
+            return 0;
+    return 1;
+}
+
+// One Miller-Rabin round of witness w (2 <= w < n - 1) on odd n, r2 = 2^(64 LIMBS) mod n.
+// n - 1 = d * 2^s is walked bit by bit, so d and s are not stored.
+// Returns 1 if n passes (probably prime), 0 if w proves n composite.
+int bigRound(const uint *n, const uint *r2, uint nInv, const uint *w) {
+    uint a[LIMBS], x[LIMBS], one[LIMBS], minusOne[LIMBS];
+    for(int j = 0; j < LIMBS; j++)
+        one[j] = j == 0;
+    bigMontMul(one, one, r2, n, nInv);          // 1 in Montgomery form (2^(32 LIMBS) mod n)
+    long borrow = 0;
+    for(int j = 0; j < LIMBS; j++) {            // n - 1 in Montgomery form
+        long s = (long)n[j] - one[j] + borrow;
+        minusOne[j] = (uint)s;
+        borrow = s >> 32;
+    }
+    bigMontMul(a, w, r2, n, nInv);              // Witness in Montgomery form
+    // s = trailing zero bits of n - 1 (n is odd, so those of n with bit 0 cleared)
+    int s = 1;
+    while(((n[s / 32] >> (s % 32)) & 1) == 0)
+        s++;
+    int top = LIMBS * 32 - 1;
+    while(((n[top / 32] >> (top % 32)) & 1) == 0)
+        top--;
+    // x = w^d mod n, left to right over the bits of d = (n - 1) >> s
+    for(int j = 0; j < LIMBS; j++)
+        x[j] = a[j];
+    for(int bit = top - 1; bit >= s; bit--) {
+        bigMontMul(x, x, x, n, nInv);
+        if((n[bit / 32] >> (bit % 32)) & 1)
+            bigMontMul(x, x, a, n, nInv);
+    }
+    if(bigEqual(x, one) || bigEqual(x, minusOne))   // The test passes for this witness
+        return 1;
+    for(int r = 1; r < s; r++) {
+        bigMontMul(x, x, x, n, nInv);           // Square x modulo n
+        if(bigEqual(x, minusOne))               // n-1 reached: the test passes
+            return 1;
+        if(bigEqual(x, one))                    // 1 before n-1: composite
+            return 0;
+    }
+    return 0;
+}
+
+// Work-item (i, j) runs witness j on candidate i, like millerRabinBatch in sample.cl.
+__kernel void bigMillerRabinItem(__global const uint *candidates, __global const uint *r2s, __global const uint *nInvs,
+                                 __global const uint *witnesses, __global volatile int *composite) {
+    int i = get_global_id(0);   // Candidate of this work-item
+    int w = get_global_id(1);   // Witness of this work-item
+    if(composite[i])            // Another witness already failed the candidate
+        return;
+    uint n[LIMBS], r2[LIMBS], witness[LIMBS];
+    for(int j = 0; j < LIMBS; j++) {
+        n[j] = candidates[i * LIMBS + j];
+        r2[j] = r2s[i * LIMBS + j];
+        witness[j] = witnesses[w * LIMBS + j];
+    }
+    if(!bigRound(n, r2, nInvs[i], witness))
+        composite[i] = 1;       // Every writer stores 1, no atomic is needed
+}
+
+// Montgomery product in a work-group, work-item j owns limb j. The partial product is
+// kept as LIMBS 64-bit column sums (a carry-save form), so the work-items never wait
+// for each other's carries: row i adds the low halves of a[i] * b[j] and m * n[j] to
+// column j and the high halves to column j + 1, then every column moves down by one.
+// Both steps are done at once into the other accumulator, one barrier per row.
+// The carries are resolved by work-item 0 at the end. r may be the same array as a or b.
+void groupMontMul(__local uint *r, __local const uint *a, __local const uint *b, __local const uint *n, uint nInv,
+                  __local ulong *accA, __local ulong *accB, int j) {
+    __local ulong *old = accA;
+    __local ulong *acc = accB;
+    old[j] = 0;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for(int i = 0; i < LIMBS; i++) {
+        uint ai = a[i];
+        uint m = ((uint)old[0] + ai * b[0]) * nInv;    // Same m in every work-item
+        ulong p = (ulong)ai * b[j];
+        ulong q = (ulong)m * n[j];
+        ulong column = (p >> 32) + (q >> 32);           // High halves of column j go to column j + 1
+        if(j + 1 < LIMBS) {
+            ulong p1 = (ulong)ai * b[j + 1];
+            ulong q1 = (ulong)m * n[j + 1];
+            column += old[j + 1] + (uint)p1 + (uint)q1;
+        }
+        if(j == 0)                                      // Column 0 is 0 mod 2^32 now, its carry moves up
+            column += (old[0] + (uint)p + (uint)q) >> 32;
+        acc[j] = column;
+        __local ulong *swap = old;
+        old = acc;
+        acc = swap;
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    if(j == 0) {
+        // Resolve the carries, then subtract n once if the result is >= n
+        uint t[LIMBS];
+        ulong carry = 0;
+        for(int k = 0; k < LIMBS; k++) {
+            ulong s = old[k] + carry;
+            t[k] = (uint)s;
+            carry = s >> 32;
+        }
+        long borrow = 0;
+        uint d[LIMBS];
+        for(int k = 0; k < LIMBS; k++) {
+            long s = (long)t[k] - n[k] + borrow;
+            d[k] = (uint)s;
+            borrow = s >> 32;
+        }
+        int subtract = carry != 0 || borrow == 0;
+        for(int k = 0; k < LIMBS; k++)
+            r[k] = subtract ? d[k] : t[k];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+}
+
+// Work-group (i, w) of LIMBS work-items runs witness w on candidate i.
+__kernel void bigMillerRabinGroup(__global const uint *candidates, __global const uint *r2s, __global const uint *nInvs,
+                                  __global const uint *witnesses, __global volatile int *composite) {
+    int j = get_local_id(0);    // Limb of this work-item
+    int i = get_group_id(0);    // Candidate of this work-group
+    int w = get_group_id(1);    // Witness of this work-group
+    __local uint n[LIMBS], r2[LIMBS], a[LIMBS], x[LIMBS], one[LIMBS], minusOne[LIMBS];
+    __local ulong accA[LIMBS], accB[LIMBS];
+    __local int result;         // Shared decision, so every work-item takes the same branches
+    if(j == 0)
+        result = composite[i] ? 0 : -1;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if(result == 0)             // Another witness already failed the candidate
+        return;
+    uint nInv = nInvs[i];
+    n[j] = candidates[i * LIMBS + j];
+    r2[j] = r2s[i * LIMBS + j];
+    x[j] = witnesses[w * LIMBS + j];
+    one[j] = j == 0;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    groupMontMul(one, one, r2, n, nInv, accA, accB, j);    // 1 in Montgomery form
+    groupMontMul(a, x, r2, n, nInv, accA, accB, j);        // Witness in Montgomery form
+    if(j == 0) {
+        long borrow = 0;
+        for(int k = 0; k < LIMBS; k++) {                    // n - 1 in Montgomery form
+            long s = (long)n[k] - one[k] + borrow;
+            minusOne[k] = (uint)s;
+            borrow = s >> 32;
+        }
+    }
+    x[j] = a[j];
+    barrier(CLK_LOCAL_MEM_FENCE);
+    int s = 1;
+    while(((n[s / 32] >> (s % 32)) & 1) == 0)
+        s++;
+    int top = LIMBS * 32 - 1;
+    while(((n[top / 32] >> (top % 32)) & 1) == 0)
+        top--;
+    for(int bit = top - 1; bit >= s; bit--) {
+        groupMontMul(x, x, x, n, nInv, accA, accB, j);
+        if((n[bit / 32] >> (bit % 32)) & 1)
+            groupMontMul(x, x, a, n, nInv, accA, accB, j);
+    }
+    for(int r = 0; r < s; r++) {
+        if(r > 0)
+            groupMontMul(x, x, x, n, nInv, accA, accB, j);
+        if(j == 0) {
+            int isOne = 1, isMinusOne = 1;
+            for(int k = 0; k < LIMBS; k++) {
+                isOne &= x[k] == one[k];
+                isMinusOne &= x[k] == minusOne[k];
+            }
+            // n-1 passes; 1 passes only as w^d itself (r = 0), later it proves n composite
+            result = isMinusOne || (isOne && r == 0) ? 1 : (isOne ? 0 : -1);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if(result >= 0)
+            break;
+    }
+    if(j == 0 && result != 1)
+        composite[i] = 1;       // Every writer stores 1, no atomic is needed
+}
@@ -0,0 +1,525 @@
+/* bigprime.c */
+/* This file implements the multi-precision prime generator declared in bigprime.h:
+   - Limb arithmetic on the host: small additions, remainders by small primes, Montgomery constants
+   - Incremental sieving: every stream keeps its base mod the small primes, so a window
+     of candidates is sieved without touching the big numbers
+   - Two launches per window: one base-2 round on every survivor, then the remaining rounds
+     only on the first survivor of every stream that passed it
+*/
+
+#ifdef _WIN32
+#define _CRT_RAND_S         // For rand_s
+#endif
+#include "bigprime.h"       // Include our header for function declarations
+#include "kernel_loader.h"  // For building "bignum.cl" with -DLIMBS
+#include <stdlib.h>         // For memory allocation and rand_s
+#include <string.h>         // For memset and memcpy
+
+// Miller-Rabin rounds for a random candidate of the given size: the error stays below
+// 2^-80 (the table of Damgard, Landrock and Pomerance, as used by OpenSSL)
+static int roundsForBits(int bits) {
+    return bits >= 3747 ? 3 : bits >= 1345 ? 4 : bits >= 476 ? 5 : bits >= 400 ? 6 : bits >= 347 ? 7 : bits >= 308 ? 8 : 27;
+}
+
+// x += value, returns the carry out of the top limb
+static cl_uint bigAddSmall(cl_uint *x, int limbs, unsigned long long value) {
+    unsigned long long carry = value;
+    for (int j = 0; j < limbs && carry != 0; j++) {
+        unsigned long long s = (unsigned long long)x[j] + (carry & 0xFFFFFFFFULL);
+        x[j] = (cl_uint)s;
+        carry = (carry >> 32) + (s >> 32);
+    }
+    return (cl_uint)carry;
+}
+
+// x mod p for a small p
+static unsigned int bigModSmall(const cl_uint *x, int limbs, unsigned int p) {
+    unsigned long long r = 0;
+    for (int j = limbs - 1; j >= 0; j--) {
+        r = ((r << 32) | x[j]) % p;
+    }
+    return (unsigned int)r;
+}
+
+int bigBitLength(const cl_uint *x, int limbs) {
+    for (int j = limbs - 1; j >= 0; j--) {
+        if (x[j] != 0) {
+            int bits = 32 * j;
+            for (cl_uint v = x[j]; v != 0; v >>= 1) {
+                bits++;
+            }
+            return bits;
+        }
+    }
+    return 0;
+}
+
+// nInv = -n^-1 mod 2^32 and r2 = 2^(64 limbs) mod n for odd n
+static void bigMontgomeryConstants(const cl_uint *n, int limbs, cl_uint *nInv, cl_uint *r2) {
+    // Newton's iteration: n is its own inverse mod 8, 3 -> 6 -> 12 -> 24 -> 48 bits
+    cl_uint inv = n[0];
+    for (int i = 0; i < 4; i++) {
+        inv *= 2 - n[0] * inv;
+    }
+    *nInv = 0 - inv;
+    // Start from the top bit of n, which is already below n, and double up to 2^(64 limbs)
+    int top = bigBitLength(n, limbs) - 1;
+    memset(r2, 0, sizeof(cl_uint) * limbs);
+    r2[top / 32] = 1U << (top % 32);
+    for (int step = top; step < 64 * limbs; step++) {
+        cl_uint carry = 0;
+        for (int j = 0; j < limbs; j++) {
+            cl_uint next = r2[j] >> 31;
+            r2[j] = (r2[j] << 1) | carry;
+            carry = next;
+        }
+        // Subtract n if 2x overflowed or is >= n
+        int greater = carry != 0;
+        if (!greater) {
+            greater = 1;    // Equal counts as >= n
+            for (int j = limbs - 1; j >= 0; j--) {
+                if (r2[j] != n[j]) {
+                    greater = r2[j] > n[j];
+                    break;
+                }
+            }
+        }
+        if (greater) {
+            long long borrow = 0;
+            for (int j = 0; j < limbs; j++) {
+                long long s = (long long)r2[j] - n[j] + borrow;
+                r2[j] = (cl_uint)s;
+                borrow = s < 0 ? -1 : 0;
+            }
+        }
+    }
+}
+
+// splitmix64, spreads a 64-bit seed over the generator state
+static unsigned long long splitMix(unsigned long long *x) {
+    unsigned long long z = (*x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Fill the generator state from seed, or from the operating system if seed is NULL.
+// Returns 0 if the random source cannot be read.
+static int seedGenerator(BigTester *tester, const unsigned long long *seed) {
+    if (seed != NULL) {
+        unsigned long long x = *seed;
+        for (int i = 0; i < 4; i++) {
+            tester->rng[i] = splitMix(&x);
+        }
+        return 1;
+    }
+#ifdef _WIN32
+    unsigned int *words = (unsigned int *)tester->rng;
+    for (int i = 0; i < 8; i++) {
+        if (rand_s(&words[i]) != 0) {
+            return 0;
+        }
+    }
+#else
+    FILE *source = fopen("/dev/urandom", "rb");
+    size_t got = source != NULL ? fread(tester->rng, sizeof(tester->rng), 1, source) : 0;
+    if (source != NULL) {
+        fclose(source);
+    }
+    if (got != 1) {
+        return 0;
+    }
+#endif
+    // The all-zero state would only give zeros
+    if ((tester->rng[0] | tester->rng[1] | tester->rng[2] | tester->rng[3]) == 0) {
+        tester->rng[0] = 1;
+    }
+    return 1;
+}
+
+static unsigned long long rotateLeft(unsigned long long x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+// xoshiro256**: the next 64 random bits
+static unsigned long long bigRandom(BigTester *tester) {
+    unsigned long long *s = tester->rng;
+    unsigned long long result = rotateLeft(s[1] * 5, 7) * 9;
+    unsigned long long t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotateLeft(s[3], 45);
+    return result;
+}
+
+// Random odd number of exactly bits bits, and its residues for the sieve
+static void seedStream(BigTester *tester, BigStream *stream) {
+    memset(stream->base, 0, sizeof(stream->base));
+    for (int j = 0; j < tester->limbs; j++) {
+        stream->base[j] = (cl_uint)bigRandom(tester);
+    }
+    int top = tester->bits - 1;
+    if (top % 32 != 31) {
+        stream->base[top / 32] &= (1U << (top % 32 + 1)) - 1;
+    }
+    stream->base[top / 32] |= 1U << (top % 32);
+    stream->base[0] |= 1;
+    for (int k = 0; k < tester->numSmallPrimes; k++) {
+        stream->residues[k] = bigModSmall(stream->base, tester->limbs, tester->smallPrimes[k]);
+    }
+    stream->position = 0;
+}
+
+// Random witness in [2, 2^(bits-1)), below every candidate
+static void randomWitness(BigTester *tester, cl_uint *witness) {
+    int topLimb = (tester->bits - 1) / 32;
+    memset(witness, 0, sizeof(cl_uint) * tester->limbs);
+    for (int j = 0; j < topLimb; j++) {
+        witness[j] = (cl_uint)bigRandom(tester);
+    }
+    if (topLimb == 0 || bigBitLength(witness, tester->limbs) < 2) {
+        witness[0] = 2;
+    }
+}
+
+int bigInit(BigTester *tester, cl_context context, cl_device_id device, cl_command_queue queue, int bits, int perGroup, size_t window,
+            const unsigned long long *seed) {
+    cl_int err;
+    memset(tester, 0, sizeof(*tester));
+    if (!seedGenerator(tester, seed)) {
+        fprintf(stderr, "Error: Failed to read the random source, give a seed with --seed\n");
+        return 0;
+    }
+    tester->bits = bits;
+    tester->limbs = (bits + 31) / 32;
+    tester->rounds = roundsForBits(bits);
+    tester->queue = queue;
+    // Every stream gets about bits odd candidates per launch, enough to hold a prime most of the time
+    tester->numStreams = window / bits > 0 ? (int)(window / bits) : 1;
+    tester->window = window / tester->numStreams > (size_t)bits ? window / tester->numStreams : (size_t)bits;
+    tester->capacity = tester->window * tester->numStreams;
+    if (perGroup < 0) {
+        // Work-groups pay off where private memory is scarce: big candidates on a GPU.
+        // A CPU runtime runs a work-group's barriers serially, there a work-item is faster.
+        cl_device_type type = CL_DEVICE_TYPE_DEFAULT;
+        clGetDeviceInfo(device, CL_DEVICE_TYPE, sizeof(type), &type, NULL);
+        perGroup = bits >= 1024 && !(type & CL_DEVICE_TYPE_CPU);
+    }
+    tester->perGroup = perGroup;
+
+    // Host side arrays
+    size_t limbs = tester->limbs;
+    tester->candidates = (cl_uint *)malloc(sizeof(cl_uint) * limbs * tester->capacity);
+    tester->r2 = (cl_uint *)malloc(sizeof(cl_uint) * limbs * tester->capacity);
+    tester->nInv = (cl_uint *)malloc(sizeof(cl_uint) * tester->capacity);
+    tester->witnesses = (cl_uint *)malloc(sizeof(cl_uint) * limbs * tester->rounds);
+    tester->composite = (cl_int *)malloc(sizeof(cl_int) * tester->capacity);
+    tester->owner = (int *)malloc(sizeof(int) * tester->capacity);
+    tester->offset = (unsigned long long *)malloc(sizeof(unsigned long long) * tester->capacity);
+    tester->sieve = (unsigned char *)malloc(tester->window);
+    tester->smallPrimes = (unsigned int *)malloc(sizeof(unsigned int) * (BIG_SIEVE_LIMIT / 2));
+    tester->streams = (BigStream *)calloc(tester->numStreams, sizeof(BigStream));
+    unsigned char *marked = (unsigned char *)calloc(BIG_SIEVE_LIMIT, 1);
+    if (!tester->candidates || !tester->r2 || !tester->nInv || !tester->witnesses || !tester->composite || !tester->owner ||
+        !tester->offset || !tester->sieve || !tester->smallPrimes || !tester->streams || !marked) {
+        fprintf(stderr, "Error: Failed to allocate the big number arrays\n");
+        free(marked);
+        bigRelease(tester);
+        return 0;
+    }
+    for (unsigned int p = 3; p < BIG_SIEVE_LIMIT; p += 2) {
+        if (marked[p]) {
+            continue;
+        }
+        tester->smallPrimes[tester->numSmallPrimes++] = p;
+        for (unsigned int m = p * p; m < BIG_SIEVE_LIMIT; m += 2 * p) {
+            marked[m] = 1;
+        }
+    }
+    free(marked);
+    for (int i = 0; i < tester->numStreams; i++) {
+        tester->streams[i].residues = (unsigned int *)malloc(sizeof(unsigned int) * tester->numSmallPrimes);
+        if (!tester->streams[i].residues) {
+            fprintf(stderr, "Error: Failed to allocate the sieve residues\n");
+            bigRelease(tester);
+            return 0;
+        }
+        seedStream(tester, &tester->streams[i]);
+    }
+
+    // The kernels are compiled for this number of limbs
+    char options[64];
+    snprintf(options, sizeof(options), "-DLIMBS=%d", tester->limbs);
+    tester->program = createAndBuildProgramWithOptions(context, device, "bignum.cl", options);
+    if (tester->program == NULL) {
+        bigRelease(tester);
+        return 0;
+    }
+    if (tester->perGroup) {
+        tester->kernel = clCreateKernel(tester->program, "bigMillerRabinGroup", &err);
+        size_t groupSize = 0;
+        if (err == CL_SUCCESS) {
+            clGetKernelWorkGroupInfo(tester->kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(groupSize), &groupSize, NULL);
+        }
+        if (err == CL_SUCCESS && groupSize < limbs) {
+            fprintf(stderr, "Warning: work-groups of %zu work-items are too small for %d limbs, using one work-item per candidate\n", groupSize, tester->limbs);
+            clReleaseKernel(tester->kernel);
+            tester->kernel = NULL;
+            tester->perGroup = 0;
+        }
+    }
+    if (!tester->perGroup) {
+        tester->kernel = clCreateKernel(tester->program, "bigMillerRabinItem", &err);
+    }
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error: Failed to create the big number kernel (%d)\n", err);
+        bigRelease(tester);
+        return 0;
+    }
+
+    // Device buffers, created once and rewritten for every launch
+    tester->candidateBuffer = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(cl_uint) * limbs * tester->capacity, NULL, &err);
+    if (err == CL_SUCCESS) tester->r2Buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(cl_uint) * limbs * tester->capacity, NULL, &err);
+    if (err == CL_SUCCESS) tester->nInvBuffer = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(cl_uint) * tester->capacity, NULL, &err);
+    if (err == CL_SUCCESS) tester->witnessBuffer = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(cl_uint) * limbs * tester->rounds, NULL, &err);
+    if (err == CL_SUCCESS) tester->compositeBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_int) * tester->capacity, NULL, &err);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error: Failed to create the big number buffers (%d)\n", err);
+        bigRelease(tester);
+        return 0;
+    }
+    err = clSetKernelArg(tester->kernel, 0, sizeof(cl_mem), &tester->candidateBuffer);
+    err |= clSetKernelArg(tester->kernel, 1, sizeof(cl_mem), &tester->r2Buffer);
+    err |= clSetKernelArg(tester->kernel, 2, sizeof(cl_mem), &tester->nInvBuffer);
+    err |= clSetKernelArg(tester->kernel, 3, sizeof(cl_mem), &tester->witnessBuffer);
+    err |= clSetKernelArg(tester->kernel, 4, sizeof(cl_mem), &tester->compositeBuffer);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error: Failed to set the big number kernel arguments\n");
+        bigRelease(tester);
+        return 0;
+    }
+    return 1;
+}
+
+// Test the first count stored candidates with the first rows witnesses, one launch.
+// Returns 1 on success, 0 on an OpenCL error.
+static int launchBig(BigTester *tester, size_t count, int rows) {
+    size_t limbs = tester->limbs;
+    for (size_t i = 0; i < count; i++) {
+        bigMontgomeryConstants(&tester->candidates[i * limbs], tester->limbs, &tester->nInv[i], &tester->r2[i * limbs]);
+    }
+    memset(tester->composite, 0, sizeof(cl_int) * count);
+    cl_int err = clEnqueueWriteBuffer(tester->queue, tester->candidateBuffer, CL_FALSE, 0, sizeof(cl_uint) * limbs * count, tester->candidates, 0, NULL, NULL);
+    err |= clEnqueueWriteBuffer(tester->queue, tester->r2Buffer, CL_FALSE, 0, sizeof(cl_uint) * limbs * count, tester->r2, 0, NULL, NULL);
+    err |= clEnqueueWriteBuffer(tester->queue, tester->nInvBuffer, CL_FALSE, 0, sizeof(cl_uint) * count, tester->nInv, 0, NULL, NULL);
+    err |= clEnqueueWriteBuffer(tester->queue, tester->witnessBuffer, CL_FALSE, 0, sizeof(cl_uint) * limbs * rows, tester->witnesses, 0, NULL, NULL);
+    err |= clEnqueueWriteBuffer(tester->queue, tester->compositeBuffer, CL_FALSE, 0, sizeof(cl_int) * count, tester->composite, 0, NULL, NULL);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error: Failed to write the big number buffers\n");
+        return 0;
+    }
+    // One work-item, or one work-group of limbs work-items, per candidate and witness
+    size_t global_work_size[2] = {tester->perGroup ? count * limbs : count, (size_t)rows};
+    size_t local_work_size[2] = {limbs, 1};
+    err = clEnqueueNDRangeKernel(tester->queue, tester->kernel, 2, NULL, global_work_size, tester->perGroup ? local_work_size : NULL, 0, NULL, NULL);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error: Failed to enqueue the big number kernel (%d)\n", err);
+        return 0;
+    }
+    err = clEnqueueReadBuffer(tester->queue, tester->compositeBuffer, CL_TRUE, 0, sizeof(cl_int) * count, tester->composite, 0, NULL, NULL);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error: Failed to read the big number results\n");
+        return 0;
+    }
+    tester->launches++;
+    tester->tested += count;
+    return 1;
+}
+
+// Append the survivors of the next window of a stream, returns the new count
+static size_t sieveStream(BigTester *tester, int index, size_t count) {
+    BigStream *stream = &tester->streams[index];
+    size_t limbs = tester->limbs;
+    memset(tester->sieve, 0, tester->window);
+    for (int k = 0; k < tester->numSmallPrimes; k++) {
+        unsigned long long p = tester->smallPrimes[k];
+        // base + 2 (position + i) = 0 (mod p)  <=>  i = -(base + 2 position) / 2 (mod p)
+        unsigned long long r = (stream->residues[k] + 2 * (stream->position % p)) % p;
+        unsigned long long i = (p - r) % p * ((p + 1) / 2) % p;
+        for (; i < tester->window; i += p) {
+            tester->sieve[i] = 1;
+        }
+    }
+    tester->sieved += tester->window;
+    for (size_t i = 0; i < tester->window; i++) {
+        if (tester->sieve[i]) {
+            continue;
+        }
+        cl_uint *candidate = &tester->candidates[count * limbs];
+        memcpy(candidate, stream->base, sizeof(cl_uint) * limbs);
+        if (bigAddSmall(candidate, tester->limbs, 2 * (stream->position + i)) != 0 || bigBitLength(candidate, tester->limbs) > tester->bits) {
+            break;  // Ran past 2^bits, the caller sees the window end early
+        }
+        tester->owner[count] = index;
+        tester->offset[count] = stream->position + i;
+        count++;
+    }
+    return count;
+}
+
+int bigFindPrimes(BigTester *tester, int count, cl_uint *primes) {
+    size_t limbs = tester->limbs;
+    int found = 0;
+    int *leader = (int *)malloc(sizeof(int) * tester->numStreams);
+    if (!leader) {
+        return 0;
+    }
+    while (found < count) {
+        int active = count - found < tester->numStreams ? count - found : tester->numStreams;
+        // Round 1: base 2 on every survivor of every stream's window
+        size_t survivors = 0;
+        for (int s = 0; s < active; s++) {
+            survivors = sieveStream(tester, s, survivors);
+        }
+        memset(tester->witnesses, 0, sizeof(cl_uint) * limbs);
+        tester->witnesses[0] = 2;
+        if (survivors > 0 && !launchBig(tester, survivors, 1)) {
+            free(leader);
+            return 0;
+        }
+        // The first survivor of a stream that passed is its only prime candidate left.
+        // They are moved to the front for the remaining rounds.
+        for (int s = 0; s < active; s++) {
+            leader[s] = -1;
+        }
+        size_t leaders = 0;
+        for (size_t i = 0; i < survivors; i++) {
+            int s = tester->owner[i];
+            if (tester->composite[i] || leader[s] >= 0) {
+                continue;
+            }
+            leader[s] = (int)leaders;
+            memmove(&tester->candidates[leaders * limbs], &tester->candidates[i * limbs], sizeof(cl_uint) * limbs);
+            tester->owner[leaders] = s;
+            tester->offset[leaders] = tester->offset[i];
+            leaders++;
+        }
+        // Rounds 2..rounds: random witnesses, on the leaders only
+        if (leaders > 0 && tester->rounds > 1) {
+            for (int w = 0; w < tester->rounds - 1; w++) {
+                randomWitness(tester, &tester->witnesses[w * limbs]);
+            }
+            if (!launchBig(tester, leaders, tester->rounds - 1)) {
+                free(leader);
+                return 0;
+            }
+        } else {
+            memset(tester->composite, 0, sizeof(cl_int) * leaders);
+        }
+        for (int s = 0; s < active; s++) {
+            BigStream *stream = &tester->streams[s];
+            if (leader[s] < 0) {
+                // No prime in this window: move on, or start over when the window hit 2^bits
+                stream->position += tester->window;
+                cl_uint next[BIG_MAX_LIMBS];
+                memcpy(next, stream->base, sizeof(cl_uint) * limbs);
+                if (bigAddSmall(next, tester->limbs, 2 * stream->position) != 0 || bigBitLength(next, tester->limbs) > tester->bits) {
+                    seedStream(tester, stream);
+                }
+            } else if (tester->composite[leader[s]]) {
+                // A base-2 pseudoprime: continue right after it
+                stream->position = tester->offset[leader[s]] + 1;
+            } else {
+                memcpy(&primes[found * limbs], &tester->candidates[leader[s] * limbs], sizeof(cl_uint) * limbs);
+                found++;
+                seedStream(tester, stream);
+            }
+        }
+    }
+    free(leader);
+    return 1;
+}
+
+int bigTestNumbers(BigTester *tester, const cl_uint *numbers, size_t count, int *isPrime) {
+    size_t limbs = tester->limbs;
+    memset(tester->witnesses, 0, sizeof(cl_uint) * limbs);
+    tester->witnesses[0] = 2;
+    for (int w = 1; w < tester->rounds; w++) {
+        randomWitness(tester, &tester->witnesses[w * limbs]);
+    }
+    for (size_t first = 0; first < count; first += tester->capacity) {
+        size_t chunk = count - first < tester->capacity ? count - first : tester->capacity;
+        memcpy(tester->candidates, &numbers[first * limbs], sizeof(cl_uint) * limbs * chunk);
+        if (!launchBig(tester, chunk, tester->rounds)) {
+            return 0;
+        }
+        for (size_t i = 0; i < chunk; i++) {
+            isPrime[first + i] = !tester->composite[i];
+        }
+    }
+    return 1;
+}
+
+void bigRelease(BigTester *tester) {
+    if (tester->candidateBuffer) clReleaseMemObject(tester->candidateBuffer);
+    if (tester->r2Buffer) clReleaseMemObject(tester->r2Buffer);
+    if (tester->nInvBuffer) clReleaseMemObject(tester->nInvBuffer);
+    if (tester->witnessBuffer) clReleaseMemObject(tester->witnessBuffer);
+    if (tester->compositeBuffer) clReleaseMemObject(tester->compositeBuffer);
+    if (tester->kernel) clReleaseKernel(tester->kernel);
+    if (tester->program) clReleaseProgram(tester->program);
+    for (int i = 0; tester->streams && i < tester->numStreams; i++) {
+        free(tester->streams[i].residues);
+    }
+    free(tester->streams);
+    free(tester->candidates);
+    free(tester->r2);
+    free(tester->nInv);
+    free(tester->witnesses);
+    free(tester->composite);
+    free(tester->owner);
+    free(tester->offset);
+    free(tester->sieve);
+    free(tester->smallPrimes);
+    memset(tester, 0, sizeof(*tester));
+}
+
+void bigPrintHex(FILE *out, const cl_uint *number, int limbs) {
+    int top = limbs - 1;
+    while (top > 0 && number[top] == 0) {
+        top--;
+    }
+    fprintf(out, "0x%x", number[top]);
+    for (int j = top - 1; j >= 0; j--) {
+        fprintf(out, "%08x", number[j]);
+    }
+    fprintf(out, "\n");
+}
+
+int bigParseHex(const char *text, cl_uint *number, int limbs) {
+    if (text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+        text += 2;
+    }
+    size_t length = strcspn(text, " \t\r\n");
+    if (length == 0) {
+        return 0;
+    }
+    memset(number, 0, sizeof(cl_uint) * limbs);
+    for (size_t k = 0; k < length; k++) {
+        char c = text[length - 1 - k];
+        cl_uint digit;
+        if (c >= '0' && c <= '9') digit = c - '0';
+        else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+        else return 0;
+        if (k / 8 >= (size_t)limbs) {
+            if (digit != 0) return 0;   // Too big for limbs
+            continue;
+        }
+        number[k / 8] |= digit << (4 * (k % 8));
+    }
+    return 1;
+}
@@ -0,0 +1,89 @@
+/* bigprime.h */
+/* This header file declares the multi-precision prime generator:
+   - Candidates of up to BIG_MAX_BITS bits as little-endian 32-bit limbs
+   - Several independent random starting points ("streams") sieved incrementally on the host
+   - The sieve survivors tested on the device by the kernels of "bignum.cl", one candidate
+     per work-item or per work-group
+*/
+
+#ifndef BIGPRIME_H
+#define BIGPRIME_H
+
+#include <CL/cl.h>
+#include <stdio.h>
+
+#define BIG_MAX_BITS 4096           // Largest candidate size
+#define BIG_MAX_LIMBS (BIG_MAX_BITS / 32)
+#define BIG_SIEVE_LIMIT 65536       // Candidates are sieved with the odd primes below this
+
+// One random starting point, walked upwards two at a time until it reaches a prime
+typedef struct {
+    cl_uint base[BIG_MAX_LIMBS];    // Random odd number with the top bit set
+    unsigned int *residues;         // base mod every sieving prime
+    unsigned long long position;    // Odd steps done from base
+} BigStream;
+
+typedef struct {
+    int bits;                       // Size of the candidates
+    int limbs;                      // 32-bit limbs per candidate
+    int rounds;                     // Miller-Rabin rounds per candidate
+    int perGroup;                   // 1: one work-group per candidate, 0: one work-item
+    cl_command_queue queue;
+    cl_program program;             // "bignum.cl" built with -DLIMBS=limbs
+    cl_kernel kernel;               // bigMillerRabinGroup or bigMillerRabinItem
+    cl_mem candidateBuffer;         // Candidates, limbs each
+    cl_mem r2Buffer;                // 2^(64 limbs) mod candidate, limbs each
+    cl_mem nInvBuffer;              // -candidate^-1 mod 2^32
+    cl_mem witnessBuffer;           // Witnesses of a launch, limbs each
+    cl_mem compositeBuffer;         // Early-exit flag per candidate
+    size_t capacity;                // Candidates per launch
+    size_t window;                  // Odd candidates sieved per stream and launch
+    cl_uint *candidates;            // Host copies of the buffers above
+    cl_uint *r2;
+    cl_uint *nInv;
+    cl_uint *witnesses;
+    cl_int *composite;
+    int *owner;                     // Stream of every candidate of a launch
+    unsigned long long *offset;     // Odd steps of every candidate from its stream's base
+    unsigned char *sieve;
+    unsigned int *smallPrimes;      // Odd primes below BIG_SIEVE_LIMIT
+    int numSmallPrimes;
+    BigStream *streams;
+    int numStreams;
+    unsigned long long launches;    // Kernel launches so far
+    unsigned long long tested;      // Candidates sent to the device so far
+    unsigned long long sieved;      // Odd candidates sieved so far
+    unsigned long long rng[4];      // xoshiro256** state of the starting points and witnesses
+} BigTester;
+
+// Build "bignum.cl" for bits-bit candidates and create the buffers. perGroup is 1 or 0,
+// or -1 to choose by size and device. window is the number of odd candidates sieved
+// per launch over all streams. The random starting points and witnesses come from a
+// generator seeded with *seed, or with 256 bits of the operating system's random source
+// if seed is NULL. Returns 1 on success, 0 on failure.
+// The generator is xoshiro256**: statistically good, but not a cryptographic generator,
+// so the primes must not be used as secret keys.
+int bigInit(BigTester *tester, cl_context context, cl_device_id device, cl_command_queue queue, int bits, int perGroup, size_t window,
+            const unsigned long long *seed);
+
+// Find count primes of tester->bits bits, each from its own random starting point.
+// primes receives count * tester->limbs limbs. Returns 1 on success, 0 on an OpenCL error.
+int bigFindPrimes(BigTester *tester, int count, cl_uint *primes);
+
+// Run every round on count odd numbers of exactly bits bits (limbs each), isPrime[i] = 1 for
+// the probable primes. Returns 1 on success, 0 on an OpenCL error.
+int bigTestNumbers(BigTester *tester, const cl_uint *numbers, size_t count, int *isPrime);
+
+// Release the kernel, the program, the buffers and the host arrays
+void bigRelease(BigTester *tester);
+
+// Number of significant bits of a number
+int bigBitLength(const cl_uint *number, int limbs);
+
+// Print a number in hexadecimal (0x...) followed by a newline
+void bigPrintHex(FILE *out, const cl_uint *number, int limbs);
+
+// Parse a hexadecimal number (with or without 0x) into limbs. Returns 1 on success.
+int bigParseHex(const char *text, cl_uint *number, int limbs);
+
+#endif // BIGPRIME_H
@@ -1,67 +1,219 @@
-/* kernel_loader.c */
-/* This file implements functions declared in kernel_loader.h to:
-   - Load the kernel source from a file into a dynamically allocated string
-   - Create and build an OpenCL program from the loaded kernel source
-*/
-
-#include "kernel_loader.h"  // Include our header for function declarations
-#include <stdio.h>          // For file I/O and error messages
-#include <stdlib.h>         // For memory allocation
-
-// Function to load the kernel source code from a given file.
-char* loadKernelSource(const char *filename) {
-    // Open the kernel source file for reading
-    FILE *fp = fopen(filename, "r");
-    if (!fp) {
-        fprintf(stderr, "Error: Failed to open kernel source file: %s\n", filename);
-        return NULL;
-    }
-    // Seek to the end of the file to determine its size
-    fseek(fp, 0, SEEK_END);
-    size_t source_size = ftell(fp);
-    rewind(fp);  // Rewind the file pointer to the beginning
-
-    // Allocate memory for the source code plus a null terminator
-    char *source_str = (char*)malloc(source_size + 1);
-    if (!source_str) {
-        fprintf(stderr, "Error: Failed to allocate memory for kernel source\n");
-        fclose(fp);
-        return NULL;
-    }
-    // Read the entire file into the allocated buffer
-    fread(source_str, 1, source_size, fp);
-    source_str[source_size] = '\0';  // Null-terminate the string
-    fclose(fp);
-    return source_str;
-}
-
-// Function to create and build an OpenCL program from a kernel source file.
-cl_program createAndBuildProgram(cl_context context, cl_device_id device, const char *filename) {
-    // Load the kernel source code from the specified file
-    char *source_str = loadKernelSource(filename);
-    if (!source_str) {
-        return NULL;
-    }
-    cl_int err;
-    // Create the OpenCL program from the loaded source code
-    cl_program program = clCreateProgramWithSource(context, 1, (const char **)&source_str, NULL, &err);
-    free(source_str);  // Free the memory allocated for the source code
-    if(err != CL_SUCCESS) {
-        fprintf(stderr, "Error: Failed to create program with source (%d)\n", err);
-        return NULL;
-    }
-    // Build (compile) the OpenCL program for the specified device
-    err = clBuildProgram(program, 1, &device, NULL, NULL, NULL);
-    if(err != CL_SUCCESS) {
-        // If build fails, retrieve and print the build log for debugging
-        size_t log_size;
-        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
-        char *log = (char *)malloc(log_size);
-        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, log_size, log, NULL);
-        fprintf(stderr, "Error in kernel build:\n%s\n", log);
-        free(log);
-        clReleaseProgram(program);
-        return NULL;
-    }
-    return program;
-}
+/* kernel_loader.c */
+/* This file implements functions declared in kernel_loader.h to:
+   - Load the kernel source from a file into a dynamically allocated string
+   - Create and build an OpenCL program from the loaded kernel source, optionally with build options
+   - Keep the built program binaries in an on-disk cache, so later runs skip the compiler
+*/
+
+#include "kernel_loader.h"  // Include our header for function declarations
+#include <stdio.h>          // For file I/O and error messages
+#include <stdlib.h>         // For memory allocation
+#include <string.h>         // For strlen, strrchr
+#include <sys/time.h>       // For the build times
+#include <sys/stat.h>       // For mkdir
+#include <unistd.h>         // For getpid
+#ifdef _WIN32
+#include <direct.h>         // For _mkdir, MinGW has no mkdir with a mode
+#endif
+
+#define CACHE_MAGIC "CLBIN 1\n"  // First 8 bytes of a cache file
+
+static const char *cacheDir = DEFAULT_CACHE_DIR;  // NULL = no cache
+static ProgramLoadInfo lastLoad;
+
+void setProgramCacheDir(const char *directory) {
+    cacheDir = directory;
+}
+
+const ProgramLoadInfo *lastProgramLoad(void) {
+    return &lastLoad;
+}
+
+static double nowSeconds(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// 64-bit FNV-1a of a string, continued from hash, the terminating zero included
+// so that "ab" + "c" and "a" + "bc" differ
+static cl_ulong fnv1a(cl_ulong hash, const char *text) {
+    do {
+        hash ^= (unsigned char)*text;
+        hash *= 0x100000001B3ULL;
+    } while (*text++ != '\0');
+    return hash;
+}
+
+// Hash of a device info string, "" if it cannot be queried
+static cl_ulong hashDeviceInfo(cl_ulong hash, cl_device_id device, cl_device_info param) {
+    char value[256] = "";
+    clGetDeviceInfo(device, param, sizeof(value) - 1, value, NULL);
+    return fnv1a(hash, value);
+}
+
+// Cache key of a program: kernel source, build options, device name, driver and OpenCL version
+static cl_ulong cacheKey(cl_device_id device, const char *source, const char *options) {
+    cl_ulong hash = 0xCBF29CE484222325ULL;
+    hash = fnv1a(hash, source);
+    hash = fnv1a(hash, options ? options : "");
+    hash = hashDeviceInfo(hash, device, CL_DEVICE_NAME);
+    hash = hashDeviceInfo(hash, device, CL_DRIVER_VERSION);
+    hash = hashDeviceInfo(hash, device, CL_DEVICE_VERSION);
+    return hash;
+}
+
+// Cache file of a kernel file and build options: one file per source name and options, so a
+// changed source or driver overwrites its own entry instead of piling up new ones
+static void cachePath(char *path, size_t size, const char *filename, const char *options) {
+    const char *name = strrchr(filename, '/');
+    name = name ? name + 1 : filename;
+    snprintf(path, size, "%s/%.*s-%016llx.bin", cacheDir, (int)strcspn(name, "."), name,
+             (unsigned long long)fnv1a(0xCBF29CE484222325ULL, options ? options : ""));
+}
+
+// Create and build the program from the cache file if it has the right key.
+// Returns NULL on a miss or on any failure, the caller then builds from source.
+static cl_program loadCachedProgram(cl_context context, cl_device_id device, const char *path, cl_ulong key, const char *options) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return NULL;
+    }
+    char magic[8];
+    cl_ulong fileKey, size;
+    unsigned char *binary = NULL;
+    cl_program program = NULL;
+    if (fread(magic, 1, 8, fp) == 8 && memcmp(magic, CACHE_MAGIC, 8) == 0 &&
+        fread(&fileKey, sizeof(fileKey), 1, fp) == 1 && fileKey == key &&
+        fread(&size, sizeof(size), 1, fp) == 1 && size > 0 &&
+        (binary = (unsigned char *)malloc(size)) != NULL && fread(binary, 1, size, fp) == size) {
+        cl_int err, status;
+        size_t length = (size_t)size;
+        program = clCreateProgramWithBinary(context, 1, &device, &length, (const unsigned char **)&binary, &status, &err);
+        if (err != CL_SUCCESS || status != CL_SUCCESS) {
+            program = NULL;
+        } else if (clBuildProgram(program, 1, &device, options, NULL, NULL) != CL_SUCCESS) {
+            // A binary the driver no longer accepts: rebuild from source
+            clReleaseProgram(program);
+            program = NULL;
+        }
+    }
+    free(binary);
+    fclose(fp);
+    return program;
+}
+
+// Write the binary of a built program to the cache. A temporary file is renamed into
+// place, so concurrent runs never read a half written entry. Returns 1 on success.
+static int saveCachedProgram(cl_program program, const char *path, cl_ulong key) {
+    size_t size = 0;
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size), &size, NULL) != CL_SUCCESS || size == 0) {
+        return 0;
+    }
+    unsigned char *binary = (unsigned char *)malloc(size);
+    if (!binary || clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(binary), &binary, NULL) != CL_SUCCESS) {
+        free(binary);
+        return 0;
+    }
+#ifdef _WIN32
+    _mkdir(cacheDir);
+#else
+    mkdir(cacheDir, 0755);
+#endif
+    char temporary[1024 + 32];
+    snprintf(temporary, sizeof(temporary), "%s.%d.tmp", path, (int)getpid());
+    FILE *fp = fopen(temporary, "wb");
+    cl_ulong length = size;
+    int ok = fp != NULL && fwrite(CACHE_MAGIC, 1, 8, fp) == 8 && fwrite(&key, sizeof(key), 1, fp) == 1 &&
+             fwrite(&length, sizeof(length), 1, fp) == 1 && fwrite(binary, 1, size, fp) == size;
+    if (fp != NULL && fclose(fp) != 0) {
+        ok = 0;
+    }
+    free(binary);
+    if (!ok || rename(temporary, path) != 0) {
+        remove(temporary);
+        return 0;
+    }
+    return 1;
+}
+
+// Function to load the kernel source code from a given file.
+char* loadKernelSource(const char *filename) {
+    // Open the kernel source file for reading
+    FILE *fp = fopen(filename, "r");
+    if (!fp) {
+        fprintf(stderr, "Error: Failed to open kernel source file: %s\n", filename);
+        return NULL;
+    }
+    // Seek to the end of the file to determine its size
+    fseek(fp, 0, SEEK_END);
+    size_t source_size = ftell(fp);
+    rewind(fp);  // Rewind the file pointer to the beginning
+
+    // Allocate memory for the source code plus a null terminator
+    char *source_str = (char*)malloc(source_size + 1);
+    if (!source_str) {
+        fprintf(stderr, "Error: Failed to allocate memory for kernel source\n");
+        fclose(fp);
+        return NULL;
+    }
+    // Read the entire file into the allocated buffer
+    fread(source_str, 1, source_size, fp);
+    source_str[source_size] = '\0';  // Null-terminate the string
+    fclose(fp);
+    return source_str;
+}
+
+// Function to create and build an OpenCL program from a kernel source file.
+cl_program createAndBuildProgram(cl_context context, cl_device_id device, const char *filename) {
+    return createAndBuildProgramWithOptions(context, device, filename, NULL);
+}
+
+// Function to create and build an OpenCL program from a kernel source file with build options.
+// The program comes from the binary cache when it has an entry with the same key.
+cl_program createAndBuildProgramWithOptions(cl_context context, cl_device_id device, const char *filename, const char *options) {
+    double started = nowSeconds();
+    // Load the kernel source code from the specified file
+    char *source_str = loadKernelSource(filename);
+    if (!source_str) {
+        return NULL;
+    }
+    cl_ulong key = cacheKey(device, source_str, options);
+    char path[1024];
+    memset(&lastLoad, 0, sizeof(lastLoad));
+    if (cacheDir != NULL) {
+        cachePath(path, sizeof(path), filename, options);
+        cl_program cached = loadCachedProgram(context, device, path, key, options);
+        if (cached != NULL) {
+            free(source_str);
+            lastLoad.fromCache = 1;
+            lastLoad.seconds = nowSeconds() - started;
+            return cached;
+        }
+    }
+    cl_int err;
+    // Create the OpenCL program from the loaded source code
+    cl_program program = clCreateProgramWithSource(context, 1, (const char **)&source_str, NULL, &err);
+    free(source_str);  // Free the memory allocated for the source code
+    if(err != CL_SUCCESS) {
+        fprintf(stderr, "Error: Failed to create program with source (%d)\n", err);
+        return NULL;
+    }
+    // Build (compile) the OpenCL program for the specified device
+    err = clBuildProgram(program, 1, &device, options, NULL, NULL);
+    if(err != CL_SUCCESS) {
+        // If build fails, retrieve and print the build log for debugging
+        size_t log_size;
+        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
+        char *log = (char *)malloc(log_size);
+        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, log_size, log, NULL);
+        fprintf(stderr, "Error in kernel build:\n%s\n", log);
+        free(log);
+        clReleaseProgram(program);
+        return NULL;
+    }
+    // A failed save only costs the next run a build
+    lastLoad.saved = cacheDir != NULL && saveCachedProgram(program, path, key);
+    lastLoad.seconds = nowSeconds() - started;
+    return program;
+}
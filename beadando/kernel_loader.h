@@ -1,7 +1,9 @@
 /* kernel_loader.h */
 /* This header file declares functions to:
    - Load an OpenCL kernel source code from a file into a string
-   - Create and build an OpenCL program from a kernel source file
+   - Create and build an OpenCL program from a kernel source file, optionally with build options
+   - Cache the program binaries on disk (clCreateProgramWithBinary), keyed by a hash of the
+     source, the build options, the device name and the driver version
 */
 
 #ifndef KERNEL_LOADER_H
@@ -9,6 +11,15 @@
 
 #include <CL/cl.h>
 
+#define DEFAULT_CACHE_DIR "kernel_cache"   // Program binary cache, relative to the working directory
+
+// How the last createAndBuildProgram(WithOptions) call got its program
+typedef struct {
+    int fromCache;                  // 1 = loaded from the binary cache, 0 = built from source
+    int saved;                      // 1 = built from source and written to the cache
+    double seconds;                 // Time of the load or the build, reading the source included
+} ProgramLoadInfo;
+
 // Function to load the kernel source code from a file.
 // Returns a dynamically allocated string containing the source code, or NULL on failure.
 char* loadKernelSource(const char *filename);
@@ -18,4 +29,15 @@ char* loadKernelSource(const char *filename);
 // Returns the built cl_program, or NULL on failure.
 cl_program createAndBuildProgram(cl_context context, cl_device_id device, const char *filename);
 
+// Same as createAndBuildProgram, with build options for clBuildProgram (e.g. "-DLIMBS=32").
+// options may be NULL.
+cl_program createAndBuildProgramWithOptions(cl_context context, cl_device_id device, const char *filename, const char *options);
+
+// Directory of the program binary cache, NULL turns the cache off. The directory is
+// created on the first save. The default is DEFAULT_CACHE_DIR.
+void setProgramCacheDir(const char *directory);
+
+// Where the program of the last successful createAndBuildProgram(WithOptions) call came from
+const ProgramLoadInfo *lastProgramLoad(void);
+
 #endif // KERNEL_LOADER_H
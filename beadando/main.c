@@ -1,213 +1,729 @@
 /* main.c */
 /* This file contains the main function that:
    - Initializes OpenCL (platform, device, context, command queue)
-   - Loads and builds the kernel from "sample.cl" using functions from kernel_loader
+   - Loads and builds the kernels from "sample.cl" using functions from kernel_loader, from the
+     binary cache when an earlier run saved them, and reports the startup time
    - Reads user input (number of bits) and generates an n‑bit candidate prime
-   - Uses the Miller‑Rabin test kernel to check the candidate’s primality
+   - Uses the Miller‑Rabin test kernel to check the candidate’s primality, either one
+     candidate per launch (--loop) or a sieved window of candidates per launch (default)
    - Iterates until a prime candidate is found, then prints it
+   - With --pipeline, keeps several windows in flight so the host sieves while the device tests,
+     and prints the profiled time of every stage
+   - With --bench N, finds N consecutive primes with every mode and compares their speed
+   - With --verify N, checks both kernels and the native backend against the host reference
+   - With --big, finds primes of 65..4096 bits with the multi-precision kernels of "bignum.cl"
+   - With --range, counts or lists every prime of a range with the segmented sieve of range.c,
+     on the CPU, and checks the count against the known values of pi(x)
+   - Without an OpenCL platform (or with --backend native), tests on the CPU with the
+     multi-threaded SIMD backend of native.c instead
 */
 
 #include <stdio.h>                  // Standard I/O for printing and scanning
 #include <stdlib.h>                 // Standard library for memory allocation, etc.
+#include <string.h>                 // String comparison for the command line switches
 #include <time.h>                   // Time functions for random seed
+#include <sys/time.h>               // Wall clock time for the candidates/s figures
 #include <CL/cl.h>                  // OpenCL header for API functions and types
 #include <math.h>                   // Math functions (if needed)
 #include "kernel_loader.h"          // Header for kernel loading functions
+#include "batch.h"                  // Batched tester, also defines NUM_WITNESSES
+#include "bigprime.h"               // Multi-precision prime generator
+#include "native.h"                 // Native CPU backend
+#include "pipeline.h"               // Pipelined batched tester
+#include "range.h"                  // Segmented sieve of the range mode
 
-#define NUM_WITNESSES 10            // Number of witnesses used in the Miller-Rabin test
+// Values of --backend
+#define BACKEND_AUTO -1                   // OpenCL if there is a platform, native otherwise
+#define BACKEND_OPENCL 0
+#define BACKEND_NATIVE 1
 
-int main() {
+// Wall clock time in seconds
+static double nowSeconds(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// Print the time from started (the start of main) to the first test, and whether the
+// program of file came from the binary cache or from the compiler
+static void printStartup(double started, const char *file) {
+    const ProgramLoadInfo *load = lastProgramLoad();
+    printf("Startup: %.6f s (%s %s in %.6f s%s)\n", nowSeconds() - started, file,
+           load->fromCache ? "loaded from the binary cache" : "built from source", load->seconds, load->saved ? ", binary cached" : "");
+}
+
+// Print where the time of the pipelined mode went, from the profiled events and the host clock
+static void printPipelineStages(const PipelineTester *pipeline) {
+    printf("pipeline stages (%d windows in flight, %llu launches): device: queued %.3f ms, submit %.3f ms, execute %.3f ms, transfer %.3f ms; host: prepare %.3f ms, wait %.3f ms\n",
+           pipeline->depth, pipeline->launches, pipeline->queuedNs / 1e6, pipeline->submitNs / 1e6, pipeline->executeNs / 1e6,
+           pipeline->transferNs / 1e6, pipeline->prepareSeconds * 1e3, pipeline->waitSeconds * 1e3);
+}
+
+// Number of odd candidates from start up to and including prime, with the wrap
+// from upper_bound back to the first odd number of the range
+static unsigned long long oddCandidates(unsigned long long start, unsigned long long prime, unsigned long long lower_bound, unsigned long long upper_bound) {
+    if(prime >= start)
+        return (prime - start) / 2 + 1;
+    return (upper_bound - start) / 2 + 1 + (prime - (lower_bound | 1ULL)) / 2 + 1;
+}
+
+// The original test: one candidate per kernel launch with NUM_WITNESSES work-items.
+// Returns 1 and sets *is_prime, or 0 on an OpenCL error.
+static int loopIsPrime(cl_context context, cl_command_queue command_queue, cl_kernel kernel, unsigned long long candidate, int *is_prime) {
+    cl_int err;                     // Variable to hold error codes from OpenCL calls
+    // Decompose candidate-1 into d * 2^s, where d is odd
+    unsigned long long d = candidate - 1;
+    int s = 0;
+    while((d % 2) == 0) {
+        d /= 2;
+        s++;
+    }
+    // Montgomery constants of the candidate for the kernel
+    cl_ulong nInv, r2;
+    montgomeryConstants(candidate, &nInv, &r2);
+
+    int results[NUM_WITNESSES];                  // Array to store kernel test results
+
+    // Create OpenCL buffer for the candidate number
+    cl_mem candidateBuffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                            sizeof(unsigned long long), &candidate, &err);
+    if(err != CL_SUCCESS) {
+        printf("Failed to create buffer for candidate.\n");
+        return 0;
+    }
+    // Create OpenCL buffer for the witness array
+    cl_mem witnessBuffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                          sizeof(witnessBases), (void *)witnessBases, &err);
+    if(err != CL_SUCCESS) {
+        printf("Failed to create buffer for witnesses.\n");
+        return 0;
+    }
+    // Create OpenCL buffer for storing the results of the kernel tests
+    cl_mem resultBuffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY,
+                                         sizeof(int) * NUM_WITNESSES, NULL, &err);
+    if(err != CL_SUCCESS) {
+        printf("Failed to create buffer for results.\n");
+        return 0;
+    }
+
+    // Set kernel arguments: candidate, witnesses, d, s, Montgomery constants and result buffer
+    err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &candidateBuffer);
+    if(err != CL_SUCCESS) {
+        printf("Failed to set kernel argument 0.\n");
+        return 0;
+    }
+    err = clSetKernelArg(kernel, 1, sizeof(cl_mem), &witnessBuffer);
+    if(err != CL_SUCCESS) {
+        printf("Failed to set kernel argument 1.\n");
+        return 0;
+    }
+    err = clSetKernelArg(kernel, 2, sizeof(unsigned long long), &d);
+    if(err != CL_SUCCESS) {
+        printf("Failed to set kernel argument 2.\n");
+        return 0;
+    }
+    err = clSetKernelArg(kernel, 3, sizeof(int), &s);
+    if(err != CL_SUCCESS) {
+        printf("Failed to set kernel argument 3.\n");
+        return 0;
+    }
+    err = clSetKernelArg(kernel, 4, sizeof(cl_ulong), &nInv);
+    if(err != CL_SUCCESS) {
+        printf("Failed to set kernel argument 4.\n");
+        return 0;
+    }
+    err = clSetKernelArg(kernel, 5, sizeof(cl_ulong), &r2);
+    if(err != CL_SUCCESS) {
+        printf("Failed to set kernel argument 5.\n");
+        return 0;
+    }
+    err = clSetKernelArg(kernel, 6, sizeof(cl_mem), &resultBuffer);
+    if(err != CL_SUCCESS) {
+        printf("Failed to set kernel argument 6.\n");
+        return 0;
+    }
+
+    // Define the global work size equal to the number of witnesses
+    size_t global_work_size = NUM_WITNESSES;
+    // Enqueue the kernel for execution on the device
+    err = clEnqueueNDRangeKernel(command_queue, kernel, 1, NULL, &global_work_size, NULL, 0, NULL, NULL);
+    if(err != CL_SUCCESS) {
+        printf("Failed to enqueue kernel.\n");
+        return 0;
+    }
+
+    // Wait for the kernel execution to complete
+    clFinish(command_queue);
+
+    // Read back the results from the device into the host array 'results'
+    err = clEnqueueReadBuffer(command_queue, resultBuffer, CL_TRUE, 0,
+                              sizeof(int) * NUM_WITNESSES, results, 0, NULL, NULL);
+    if(err != CL_SUCCESS) {
+        printf("Failed to read results from buffer.\n");
+        return 0;
+    }
+
+    // Assume candidate is prime; if any result is 0, it is composite
+    *is_prime = 1;
+    for(int i = 0; i < NUM_WITNESSES; i++) {
+        if(results[i] == 0) {
+            *is_prime = 0;
+            break;
+        }
+    }
+
+    // Release the OpenCL buffers for this candidate
+    clReleaseMemObject(candidateBuffer);
+    clReleaseMemObject(witnessBuffer);
+    clReleaseMemObject(resultBuffer);
+    return 1;
+}
+
+// The original search: test candidates one by one until a prime is found.
+// Returns 1 and the prime in *prime, or 0 on an OpenCL error.
+static int loopFindPrime(cl_context context, cl_command_queue command_queue, cl_kernel kernel, unsigned long long candidate,
+                         unsigned long long lower_bound, unsigned long long upper_bound, unsigned long long *prime) {
+    int is_prime = 0;  // Flag indicating whether the candidate is prime
+    // Continue testing candidates until a prime is found
+    while(!is_prime) {
+        if(!loopIsPrime(context, command_queue, kernel, candidate, &is_prime))
+            return 0;
+        // If candidate is composite, try the next odd candidate
+        if(!is_prime) {
+            if(candidate > upper_bound - 2)   // Also keeps candidate + 2 from overflowing at 64 bits
+                candidate = lower_bound | 1ULL; // Ensure candidate remains odd
+            else
+                candidate += 2;
+        }
+    }
+    *prime = candidate;
+    return 1;
+}
+
+// Compare both kernels (when batch is not NULL) and the native backend with the host reference
+// on known hard cases and random odd numbers of the range. Returns the number of disagreements,
+// or -1 on an error.
+static int verifyKernels(cl_context context, cl_command_queue command_queue, cl_kernel kernel, BatchTester *batch, NativeTester *native,
+                         int count, unsigned long long lower_bound, unsigned long long upper_bound) {
+    static const unsigned long long hardCases[] = {
+        3, 5, 9, 15, 25, 37, 39, 561, 1105, 2047, 1373653, 25326001, 3215031751ULL,   // Small primes, Carmichael numbers, strong pseudoprimes to the first bases
+        4294967291ULL, 4294967297ULL, 2305843009213693951ULL,                           // Around 2^32, 2^61 - 1
+        3825123056546413051ULL,                                                         // Strong pseudoprime to the bases 2..23
+        18446744030759878681ULL, 18446744030759878669ULL,                               // 4294967291^2 and 4294967291 * 4294967279
+        18446744073709551557ULL, 18446744073709551615ULL                                // Largest 64-bit prime, 2^64 - 1
+    };
+    int numHard = sizeof(hardCases) / sizeof(hardCases[0]);
+    int total = numHard + count;
+    unsigned long long *numbers = (unsigned long long *)malloc(sizeof(unsigned long long) * total);
+    int *batchPrime = (int *)malloc(sizeof(int) * total);
+    int *nativePrime = (int *)malloc(sizeof(int) * total);
+    if(numbers == NULL || batchPrime == NULL || nativePrime == NULL) {
+        free(numbers);
+        free(batchPrime);
+        free(nativePrime);
+        return -1;
+    }
+    for(int i = 0; i < total; i++) {
+        numbers[i] = i < numHard ? hardCases[i] : (lower_bound + random64() % (upper_bound - lower_bound + 1)) | 1ULL;
+    }
+    int mismatches = 0, primes = 0;
+    nativeTestNumbers(native, numbers, total, nativePrime);
+    if(batch != NULL && !batchTestNumbers(batch, numbers, total, batchPrime)) {
+        free(numbers);
+        free(batchPrime);
+        free(nativePrime);
+        return -1;
+    }
+    for(int i = 0; i < total; i++) {
+        int expected = hostMillerRabin(numbers[i]);
+        int loopPrime = expected;
+        if(batch == NULL) {
+            batchPrime[i] = expected;       // No OpenCL, only the native backend is checked
+        } else if(!loopIsPrime(context, command_queue, kernel, numbers[i], &loopPrime)) {
+            free(numbers);
+            free(batchPrime);
+            free(nativePrime);
+            return -1;
+        }
+        if(batchPrime[i] != expected || loopPrime != expected || nativePrime[i] != expected) {
+            printf("Mismatch: %llu host %d, batch %d, loop %d, native %d\n", numbers[i], expected, batchPrime[i], loopPrime, nativePrime[i]);
+            mismatches++;
+        }
+        primes += expected;
+    }
+    printf("verify: %d numbers (%d hard cases), %d primes, %d mismatches%s\n", total, numHard, primes, mismatches,
+           batch == NULL ? " (native backend only)" : "");
+    free(numbers);
+    free(batchPrime);
+    free(nativePrime);
+    return mismatches;
+}
+
+// The --big mode: find count primes of bits bits, or with checkPath, run the test on
+// the numbers of that file (one hexadecimal number per line). The starting points come
+// from seed, or from the operating system's random source if it is NULL. Returns the exit code.
+static int runBig(cl_context context, cl_device_id device_id, cl_command_queue command_queue, int bits, size_t window,
+                  int per_group, int count, const unsigned long long *seed, const char *outPath, const char *checkPath, double started) {
+    BigTester big;
+    if(!bigInit(&big, context, device_id, command_queue, bits, per_group, window, seed)) {
+        printf("Failed to set up the big number test.\n");
+        return 1;
+    }
+    printStartup(started, "bignum.cl");
+    FILE *out = stdout;
+    if(outPath != NULL && (out = fopen(outPath, "w")) == NULL) {
+        printf("Failed to open %s.\n", outPath);
+        bigRelease(&big);
+        return 1;
+    }
+    int status = 0;
+    if(checkPath != NULL) {
+        // Test the given numbers with every round and print "number 1|0"
+        FILE *in = fopen(checkPath, "r");
+        char line[BIG_MAX_BITS / 4 + 16];
+        size_t total = 0, capacity = 64;
+        cl_uint *numbers = (cl_uint *)malloc(sizeof(cl_uint) * big.limbs * capacity);
+        int *isPrime = NULL;
+        while(in != NULL && numbers != NULL && fgets(line, sizeof(line), in) != NULL) {
+            if(line[0] == '\n' || line[0] == '#')
+                continue;
+            if(total == capacity) {
+                capacity *= 2;
+                cl_uint *grown = (cl_uint *)realloc(numbers, sizeof(cl_uint) * big.limbs * capacity);
+                if(grown == NULL)
+                    break;
+                numbers = grown;
+            }
+            cl_uint *number = &numbers[total * big.limbs];
+            if(!bigParseHex(line, number, big.limbs) || (number[0] & 1) == 0 || bigBitLength(number, big.limbs) != bits) {
+                printf("Not an odd %d-bit number: %s", bits, line);
+                status = 1;
+                break;
+            }
+            total++;
+        }
+        if(in == NULL || numbers == NULL) {
+            printf("Failed to read %s.\n", checkPath);
+            status = 1;
+        }
+        if(status == 0 && (isPrime = (int *)malloc(sizeof(int) * (total + 1))) != NULL && bigTestNumbers(&big, numbers, total, isPrime)) {
+            for(size_t i = 0; i < total; i++) {
+                fprintf(out, "%d ", isPrime[i]);
+                bigPrintHex(out, &numbers[i * big.limbs], big.limbs);
+            }
+        } else if(status == 0) {
+            printf("Failed to test the numbers.\n");
+            status = 1;
+        }
+        if(in != NULL)
+            fclose(in);
+        free(numbers);
+        free(isPrime);
+    } else {
+        cl_uint *primes = (cl_uint *)malloc(sizeof(cl_uint) * big.limbs * count);
+        double started = nowSeconds();
+        if(primes == NULL || !bigFindPrimes(&big, count, primes)) {
+            printf("Failed to find the primes.\n");
+            status = 1;
+        } else {
+            double seconds = nowSeconds() - started;
+            for(int i = 0; i < count; i++)
+                bigPrintHex(out, &primes[i * big.limbs], big.limbs);
+            printf("Found %d primes of %d bits in %.3f s: %.3f primes/s (%llu launches, %llu of %llu sieved candidates tested on the device, %d rounds, one candidate per work-%s)\n",
+                   count, bits, seconds, count / seconds, big.launches, big.tested, big.sieved, big.rounds, big.perGroup ? "group" : "item");
+        }
+        free(primes);
+    }
+    if(out != stdout)
+        fclose(out);
+    bigRelease(&big);
+    return status;
+}
+
+// Parse a bound of --range: a decimal number, a power of ten like 1e12, or a sum of them
+// like 1e12+1e10. Returns 1 on success.
+static int parseBound(const char *text, unsigned long long *value) {
+    *value = 0;
+    while(1) {
+        char *end;
+        unsigned long long term = strtoull(text, &end, 10);
+        if(end == text)
+            return 0;
+        if(*end == 'e') {
+            text = end + 1;
+            unsigned long long exponent = strtoull(text, &end, 10);
+            if(end == text || exponent > 19)
+                return 0;
+            while(exponent-- > 0) {
+                if(term > ~0ULL / 10)
+                    return 0;
+                term *= 10;
+            }
+        }
+        if(*value > ~0ULL - term)
+            return 0;
+        *value += term;
+        if(*end == '\0')
+            return 1;
+        if(*end != '+')
+            return 0;
+        text = end + 1;
+    }
+}
+
+// The --range mode: count or write every prime of [low, high]. Returns the exit code.
+static int runRange(unsigned long long low, unsigned long long high, int segmentKb, int threads, int format, const char *outPath) {
+    static const char *formatNames[3] = {"count", "list", "delta"};
+    FILE *out = stdout;
+    if(format == RANGE_DELTA && outPath == NULL) {
+        printf("--format delta needs --out.\n");
+        return 1;
+    }
+    if(format != RANGE_COUNT && outPath != NULL && (out = fopen(outPath, format == RANGE_DELTA ? "wb" : "w")) == NULL) {
+        printf("Failed to open %s.\n", outPath);
+        return 1;
+    }
+    if(out != stdout)
+        setvbuf(out, NULL, _IOFBF, 1 << 20);
+    RangeStats stats;
+    int ok = rangeSieve(low, high, (size_t)segmentKb * 1024, threads, format, out, &stats);
+    if(out != stdout && fclose(out) != 0)
+        ok = 0;
+    if(!ok) {
+        printf("Failed to sieve the range.\n");
+        return 1;
+    }
+    double numbers = (double)(high - low) + 1;
+    double seconds = stats.seconds > 0 ? stats.seconds : 1e-9;
+    printf("Range [%llu, %llu]: %llu primes in %.3f s, %.0f numbers/s, %.0f primes/s (%s, %llu segments of %zu kB, %d threads, %llu base primes in %.3f s",
+           low, high, stats.count, stats.seconds, numbers / seconds, stats.count / seconds, formatNames[format],
+           stats.segments, stats.segmentBytes / 1024, stats.threads, stats.basePrimes, stats.baseSeconds);
+    if(format != RANGE_COUNT)
+        printf(", %llu bytes written", stats.written);
+    printf(")\n");
+
+    // pi(high) of the table, for the ranges that start at the beginning
+    unsigned long long known = low <= 2 ? knownPrimeCount(high) : 0;
+    if(known != 0) {
+        printf("check: pi(%llu) = %llu, %s\n", high, known, known == stats.count ? "matches" : "DIFFERS");
+        if(known != stats.count)
+            return 1;
+    }
+    return 0;
+}
+
+// Get the first platform and device, and create a context and a command queue on it.
+// Returns 1 on success, 0 with a message when there is no usable OpenCL device.
+static int openclSetup(cl_device_id *device_id, cl_context *context, cl_command_queue *command_queue) {
     cl_int err;                           // Variable to hold error codes from OpenCL calls
     cl_platform_id platform_id = NULL;     // Variable to store the selected OpenCL platform
     cl_uint num_platforms;                // Number of available OpenCL platforms
-    cl_device_id device_id = NULL;         // Variable to store the selected OpenCL device
     cl_uint num_devices;                  // Number of available OpenCL devices
-    cl_context context = NULL;            // OpenCL context for managing devices
-    cl_command_queue command_queue = NULL;// Command queue to schedule OpenCL operations
-    cl_program program = NULL;            // OpenCL program object containing our kernel
-    cl_kernel kernel = NULL;              // OpenCL kernel object for executing our function
 
     // Obtain the first available OpenCL platform
     err = clGetPlatformIDs(1, &platform_id, &num_platforms);
-    if(err != CL_SUCCESS) {
+    if(err != CL_SUCCESS || num_platforms == 0) {
         printf("Failed to get OpenCL platform.\n");
-        return 1;
+        return 0;
     }
 
     // Obtain the first available device on the selected platform
-    err = clGetDeviceIDs(platform_id, CL_DEVICE_TYPE_DEFAULT, 1, &device_id, &num_devices);
+    err = clGetDeviceIDs(platform_id, CL_DEVICE_TYPE_DEFAULT, 1, device_id, &num_devices);
     if(err != CL_SUCCESS) {
         printf("Failed to get OpenCL device.\n");
-        return 1;
+        return 0;
     }
 
     // Create an OpenCL context for the selected device
-    context = clCreateContext(NULL, 1, &device_id, NULL, NULL, &err);
+    *context = clCreateContext(NULL, 1, device_id, NULL, NULL, &err);
     if(err != CL_SUCCESS) {
         printf("Failed to create OpenCL context.\n");
-        return 1;
+        return 0;
     }
 
     // Create a command queue for scheduling operations on the device
-    command_queue = clCreateCommandQueue(context, device_id, 0, &err);
+    *command_queue = clCreateCommandQueue(*context, *device_id, 0, &err);
     if(err != CL_SUCCESS) {
         printf("Failed to create command queue.\n");
-        return 1;
+        clReleaseContext(*context);
+        return 0;
     }
+    return 1;
+}
 
-    // Load, create, and build the OpenCL program from the kernel source file "sample.cl"
-    program = createAndBuildProgram(context, device_id, "sample.cl");
-    if(program == NULL) {
-        printf("Failed to create and build program.\n");
-        return 1;
-    }
+int main(int argc, char *argv[]) {
+    double started = nowSeconds();        // Start of the run, for the startup time
+    cl_int err;                           // Variable to hold error codes from OpenCL calls
+    cl_device_id device_id = NULL;         // Variable to store the selected OpenCL device
+    cl_context context = NULL;            // OpenCL context for managing devices
+    cl_command_queue command_queue = NULL;// Command queue to schedule OpenCL operations
+    cl_program program = NULL;            // OpenCL program object containing our kernel
+    cl_kernel kernel = NULL;              // OpenCL kernel object for executing our function
+    BatchTester batch;                    // Persistent buffers of the batched mode
+    PipelineTester pipeline;              // Slots of the pipelined mode
+    NativeTester native;                  // Sieve and arrays of the native backend
 
-    // Create the kernel object from the built program using the function name "millerRabinTest"
-    kernel = clCreateKernel(program, "millerRabinTest", &err);
-    if(err != CL_SUCCESS) {
-        printf("Failed to create OpenCL kernel.\n");
-        return 1;
+    // Command line: [--backend opencl|native] [--threads N] [--simd auto|generic|avx2|avx512] [--loop | --pipeline [--depth N]] [--window N] [--bench N] [--verify N] [bits]
+    //               --big [--count N] [--seed N] [--per item|group] [--out file] [--check file] [bits]
+    //               --range low high [--format count|list|delta] [--segment kB] [--threads N] [--out file]
+    //               and in both modes [--cache directory | --no-cache]
+    int backend = BACKEND_AUTO;           // OpenCL, or native when there is no OpenCL platform
+    int threads = 0;                      // Threads of the native backend, 0 = all cores
+    const char *simd = "auto";            // --simd: vector kernel of the native backend, auto = the widest the CPU has
+    int use_loop = 0;                     // Test one candidate per launch, like the original
+    int use_pipeline = 0;                 // Keep several windows in flight
+    int depth = DEFAULT_PIPELINE_DEPTH;   // Windows in flight in the pipelined mode
+    size_t window = DEFAULT_WINDOW;       // Odd candidates per batched launch
+    int bench_primes = 0;                 // Primes to find with every mode in --bench
+    int verify_count = -1;                // Random numbers to check in --verify
+    int big_mode = 0;                     // Multi-precision candidates (--big)
+    int big_count = 1;                    // Primes to find in --big
+    int per_group = -1;                   // --per: 1 work-group or 1 work-item per candidate, -1 by size
+    const char *out_path = NULL;          // --out: where the --big primes go instead of stdout
+    const char *check_path = NULL;        // --check: numbers to test in --big
+    int use_seed = 0;                     // --seed: reproducible --big primes instead of the OS random source
+    unsigned long long seed = 0;
+    int range_mode = 0;                   // Every prime of [range_low, range_high] (--range)
+    unsigned long long range_low = 0, range_high = 0;
+    int range_format = RANGE_COUNT;       // --format: count, list or delta
+    int segment_kb = 0;                   // --segment: kB per sieve segment, 0 = by the size of high
+    int n = 0;                            // Number of bits, asked for when not given
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--backend") == 0 && i + 1 < argc && (strcmp(argv[i + 1], "opencl") == 0 || strcmp(argv[i + 1], "native") == 0)) {
+            backend = strcmp(argv[++i], "native") == 0 ? BACKEND_NATIVE : BACKEND_OPENCL;
+        } else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--simd") == 0 && i + 1 < argc) {
+            simd = argv[++i];
+        } else if(strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            setProgramCacheDir(argv[++i]);
+        } else if(strcmp(argv[i], "--no-cache") == 0) {
+            setProgramCacheDir(NULL);
+        } else if(strcmp(argv[i], "--loop") == 0) {
+            use_loop = 1;
+        } else if(strcmp(argv[i], "--pipeline") == 0) {
+            use_pipeline = 1;
+        } else if(strcmp(argv[i], "--depth") == 0 && i + 1 < argc) {
+            depth = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+            window = (size_t)atol(argv[++i]);
+        } else if(strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+            bench_primes = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--verify") == 0 && i + 1 < argc) {
+            verify_count = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--big") == 0) {
+            big_mode = 1;
+        } else if(strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+            big_count = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            use_seed = 1;
+            seed = strtoull(argv[++i], NULL, 0);
+        } else if(strcmp(argv[i], "--per") == 0 && i + 1 < argc && (strcmp(argv[i + 1], "item") == 0 || strcmp(argv[i + 1], "group") == 0)) {
+            per_group = strcmp(argv[++i], "group") == 0;
+        } else if(strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if(strcmp(argv[i], "--check") == 0 && i + 1 < argc) {
+            check_path = argv[++i];
+        } else if(strcmp(argv[i], "--range") == 0 && i + 2 < argc) {
+            range_mode = parseBound(argv[i + 1], &range_low) && parseBound(argv[i + 2], &range_high) ? 1 : -1;
+            i += 2;
+        } else if(strcmp(argv[i], "--format") == 0 && i + 1 < argc && (strcmp(argv[i + 1], "count") == 0 || strcmp(argv[i + 1], "list") == 0 || strcmp(argv[i + 1], "delta") == 0)) {
+            i++;
+            range_format = strcmp(argv[i], "count") == 0 ? RANGE_COUNT : strcmp(argv[i], "list") == 0 ? RANGE_LIST : RANGE_DELTA;
+        } else if(strcmp(argv[i], "--segment") == 0 && i + 1 < argc) {
+            segment_kb = atoi(argv[++i]);
+        } else if(argv[i][0] != '-') {
+            n = atoi(argv[i]);
+        } else {
+            printf("Usage: %s [--backend opencl|native] [--threads N] [--simd auto|generic|avx2|avx512] [--loop | --pipeline [--depth N]] [--window N] [--bench primes] [--verify numbers] [bits]\n", argv[0]);
+            printf("       %s --big [--window N] [--count primes] [--seed N] [--per item|group] [--out file] [--check file] [bits]\n", argv[0]);
+            printf("       %s --range low high [--format count|list|delta] [--segment kB] [--threads N] [--out file]\n", argv[0]);
+            printf("       --cache directory | --no-cache: where the kernel binaries are cached (default %s)\n", DEFAULT_CACHE_DIR);
+            return 1;
+        }
     }
-
-    // Prompt the user to enter the number of bits for the prime number
-    int n;
-    printf("Enter the number of bits for the prime number: ");
-    scanf("%d", &n);
-    if(n < 2) {
-        printf("Number of bits must be at least 2.\n");
+    if(window == 0 || big_count < 1 || threads < 0 || depth < 1 || depth > MAX_PIPELINE_DEPTH) {
+        printf("The window and --count must be at least 1, --threads at least 0, --depth between 1 and %d.\n", MAX_PIPELINE_DEPTH);
         return 1;
     }
 
-    // Calculate the lower bound (2^(n-1)) and upper bound (2^n - 1) for an n-bit number
-    unsigned long long lower_bound = 1ULL << (n - 1);
-    unsigned long long upper_bound = (1ULL << n) - 1;
-
-    // Seed the random number generator with the current time
-    srand(time(NULL));
-    // Generate a random candidate in the range [lower_bound, upper_bound]
-    unsigned long long candidate = lower_bound + rand() % (upper_bound - lower_bound + 1);
-    // Ensure candidate is odd (even numbers, except 2, cannot be prime)
-    if(candidate % 2 == 0)
-        candidate++;
-
-    int is_prime = 0;  // Flag indicating whether the candidate is prime
-    // Continue testing candidates until a prime is found
-    while(!is_prime) {
-        // Decompose candidate-1 into d * 2^s, where d is odd
-        unsigned long long d = candidate - 1;
-        int s = 0;
-        while((d % 2) == 0) {
-            d /= 2;
-            s++;
+    // The range mode only needs the CPU
+    if(range_mode) {
+        if(range_mode < 0 || range_low > range_high || range_high > RANGE_MAX || segment_kb < 0) {
+            printf("--range needs low <= high <= %llu (numbers like 1e12 or 1e12+1e10), --segment at least 0.\n", RANGE_MAX);
+            return 1;
         }
+        return runRange(range_low, range_high, segment_kb, threads, range_format, out_path);
+    }
 
-        unsigned long long witnesses[NUM_WITNESSES]; // Array for witness values
-        int results[NUM_WITNESSES];                  // Array to store kernel test results
-
-        // Generate random witnesses in the range [2, candidate - 2]
-        for(int i = 0; i < NUM_WITNESSES; i++) {
-            witnesses[i] = 2 + rand() % (candidate - 3);
-        }
+    // OpenCL setup; in the default mode a machine without a platform falls back to the native backend
+    int use_opencl = backend != BACKEND_NATIVE && openclSetup(&device_id, &context, &command_queue);
+    if(!use_opencl && (backend == BACKEND_OPENCL || big_mode || use_loop || use_pipeline)) {
+        printf("--big, --loop, --pipeline and --backend opencl need an OpenCL device.\n");
+        return 1;
+    }
+    if(!use_opencl && backend == BACKEND_AUTO)
+        printf("OpenCL is not available, using the native backend.\n");
 
-        // Create OpenCL buffer for the candidate number
-        cl_mem candidateBuffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
-                                                sizeof(unsigned long long), &candidate, &err);
-        if(err != CL_SUCCESS) {
-            printf("Failed to create buffer for candidate.\n");
-            return 1;
+    if(big_mode) {
+        // The multi-precision mode builds its own program from "bignum.cl"
+        if(n == 0) {
+            printf("Enter the number of bits for the prime number: ");
+            scanf("%d", &n);
         }
-        // Create OpenCL buffer for the witness array
-        cl_mem witnessBuffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
-                                              sizeof(unsigned long long) * NUM_WITNESSES, witnesses, &err);
-        if(err != CL_SUCCESS) {
-            printf("Failed to create buffer for witnesses.\n");
-            return 1;
-        }
-        // Create OpenCL buffer for storing the results of the kernel tests
-        cl_mem resultBuffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY,
-                                             sizeof(int) * NUM_WITNESSES, NULL, &err);
-        if(err != CL_SUCCESS) {
-            printf("Failed to create buffer for results.\n");
+        if(n < 65 || n > BIG_MAX_BITS) {
+            printf("Number of bits must be between 65 and %d with --big.\n", BIG_MAX_BITS);
             return 1;
         }
+        int status = runBig(context, device_id, command_queue, n, window, per_group, big_count, use_seed ? &seed : NULL, out_path, check_path, started);
+        clReleaseCommandQueue(command_queue);
+        clReleaseContext(context);
+        return status;
+    }
 
-        // Set kernel arguments: candidate, witnesses, d, s, and result buffer
-        err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &candidateBuffer);
-        if(err != CL_SUCCESS) {
-            printf("Failed to set kernel argument 0.\n");
-            return 1;
-        }
-        err = clSetKernelArg(kernel, 1, sizeof(cl_mem), &witnessBuffer);
-        if(err != CL_SUCCESS) {
-            printf("Failed to set kernel argument 1.\n");
-            return 1;
-        }
-        err = clSetKernelArg(kernel, 2, sizeof(unsigned long long), &d);
-        if(err != CL_SUCCESS) {
-            printf("Failed to set kernel argument 2.\n");
+    if(use_opencl) {
+        // Load, create, and build the OpenCL program from the kernel source file "sample.cl"
+        program = createAndBuildProgram(context, device_id, "sample.cl");
+        if(program == NULL) {
+            printf("Failed to create and build program.\n");
             return 1;
         }
-        err = clSetKernelArg(kernel, 3, sizeof(int), &s);
+
+        // Create the kernel object from the built program using the function name "millerRabinTest"
+        kernel = clCreateKernel(program, "millerRabinTest", &err);
         if(err != CL_SUCCESS) {
-            printf("Failed to set kernel argument 3.\n");
+            printf("Failed to create OpenCL kernel.\n");
             return 1;
         }
-        err = clSetKernelArg(kernel, 4, sizeof(cl_mem), &resultBuffer);
-        if(err != CL_SUCCESS) {
-            printf("Failed to set kernel argument 4.\n");
+
+        // Create the batched kernel and its buffers once, they are reused for every window
+        if(!batchInit(&batch, context, device_id, command_queue, program, window)) {
+            printf("Failed to set up the batched test.\n");
             return 1;
         }
 
-        // Define the global work size equal to the number of witnesses
-        size_t global_work_size = NUM_WITNESSES;
-        // Enqueue the kernel for execution on the device
-        err = clEnqueueNDRangeKernel(command_queue, kernel, 1, NULL, &global_work_size, NULL, 0, NULL, NULL);
-        if(err != CL_SUCCESS) {
-            printf("Failed to enqueue kernel.\n");
+        // The slots of the pipelined mode, with their own profiling queues
+        if(!pipelineInit(&pipeline, context, device_id, program, window, depth)) {
+            printf("Failed to set up the pipelined test.\n");
             return 1;
         }
+        printStartup(started, "sample.cl");
+    }
 
-        // Wait for the kernel execution to complete
-        clFinish(command_queue);
+    // The native backend only needs host memory, it also serves --bench and --verify next to OpenCL
+    if(!nativeUseKernel(simd)) {
+        printf("The %s vector kernel is unknown or not supported by this CPU.\n", simd);
+        return 1;
+    }
+    if(!nativeInit(&native, window, threads)) {
+        printf("Failed to set up the native backend.\n");
+        return 1;
+    }
 
-        // Read back the results from the device into the host array 'results'
-        err = clEnqueueReadBuffer(command_queue, resultBuffer, CL_TRUE, 0,
-                                  sizeof(int) * NUM_WITNESSES, results, 0, NULL, NULL);
-        if(err != CL_SUCCESS) {
-            printf("Failed to read results from buffer.\n");
+    // Prompt the user to enter the number of bits for the prime number
+    if(n == 0) {
+        printf("Enter the number of bits for the prime number: ");
+        scanf("%d", &n);
+    }
+    if(n < 2 || n > 64) {
+        printf("Number of bits must be between 2 and 64.\n");
+        return 1;
+    }
+
+    // Calculate the lower bound (2^(n-1)) and upper bound (2^n - 1) for an n-bit number
+    unsigned long long lower_bound = 1ULL << (n - 1);
+    unsigned long long upper_bound = n == 64 ? ~0ULL : (1ULL << n) - 1;
+
+    // Seed the random number generator with the current time
+    srand(time(NULL));
+    // Generate a random candidate in the range [lower_bound, upper_bound]
+    unsigned long long candidate = lower_bound + random64() % (upper_bound - lower_bound + 1);
+    // Ensure candidate is odd (even numbers, except 2, cannot be prime)
+    if(candidate % 2 == 0)
+        candidate++;
+    if(verify_count >= 0) {
+        int mismatches = verifyKernels(context, command_queue, kernel, use_opencl ? &batch : NULL, &native, verify_count, lower_bound, upper_bound);
+        if(mismatches != 0) {
+            printf(mismatches < 0 ? "Failed to verify the kernels.\n" : "The kernels disagree with the host reference.\n");
             return 1;
         }
-
-        // Assume candidate is prime; if any result is 0, it is composite
-        is_prime = 1;
-        for(int i = 0; i < NUM_WITNESSES; i++) {
-            if(results[i] == 0) {
-                is_prime = 0;
-                break;
+    } else if(bench_primes > 0) {
+        // Find the same run of consecutive primes with every available mode, from the same start
+        static const char *modeNames[4] = {"loop    ", "batch   ", "pipeline", "native  "};
+        double seconds[4] = {0, 0, 0, 0};        // Time taken by the loop, the batched and pipelined modes and the native backend
+        unsigned long long covered[4] = {0, 0, 0, 0};  // Odd candidates passed over by each mode
+        int mismatches = 0;                      // Primes the modes disagree on
+        int reference = -1;                      // First mode run, the others are compared with it
+        unsigned long long *primes = (unsigned long long *)malloc(sizeof(unsigned long long) * bench_primes);
+        for(int mode = use_opencl ? 0 : 3; mode < 4; mode++) {
+            unsigned long long start = candidate;
+            double started = nowSeconds();
+            for(int k = 0; k < bench_primes; k++) {
+                unsigned long long prime;
+                int ok = mode == 0 ? loopFindPrime(context, command_queue, kernel, start, lower_bound, upper_bound, &prime)
+                       : mode == 1 ? batchFindPrime(&batch, start, lower_bound, upper_bound, &prime)
+                       : mode == 2 ? pipelineFindPrime(&pipeline, start, lower_bound, upper_bound, &prime)
+                                   : nativeFindPrime(&native, start, lower_bound, upper_bound, &prime);
+                if(!ok) {
+                    printf("Failed to find a prime.\n");
+                    return 1;
+                }
+                covered[mode] += oddCandidates(start, prime, lower_bound, upper_bound);
+                if(reference < 0)
+                    primes[k] = prime;
+                else if(primes[k] != prime)
+                    mismatches++;
+                // Continue after the prime, wrapping around like the search does
+                start = prime > upper_bound - 2 ? (lower_bound | 1ULL) : prime + 2;
             }
+            seconds[mode] = nowSeconds() - started;
+            if(reference < 0)
+                reference = mode;
+            printf("%s: %d primes, %llu odd candidates in %.3f s, %.0f candidates/s", modeNames[mode], bench_primes, covered[mode], seconds[mode], covered[mode] / seconds[mode]);
+            if(mode == 1)
+                printf(" (%llu launches, %llu sieve survivors tested on the device)", batch.launches, batch.tested);
+            if(mode == 2)
+                printf(" (%llu launches, %llu sieve survivors tested on the device)", pipeline.launches, pipeline.tested);
+            if(mode == 3)
+                printf(" (%d threads, %llu sieve survivors tested in %d-lane %s vectors)", nativeThreads(&native), native.tested, nativeLanes(), nativeKernelName());
+            printf("\n");
         }
-
-        // Release the OpenCL buffers for this iteration
-        clReleaseMemObject(candidateBuffer);
-        clReleaseMemObject(witnessBuffer);
-        clReleaseMemObject(resultBuffer);
-
-        // If candidate is composite, try the next odd candidate
-        if(!is_prime) {
-            candidate += 2;
-            if(candidate > upper_bound)
-                candidate = lower_bound | 1ULL; // Ensure candidate remains odd
+        if(use_opencl) {
+            printPipelineStages(&pipeline);
+            printf("speedup over the loop: batch %.1fx, pipeline %.1fx, native %.1fx, %d differing primes\n",
+                   seconds[0] / seconds[1], seconds[0] / seconds[2], seconds[0] / seconds[3], mismatches);
+        }
+        free(primes);
+    } else {
+        unsigned long long prime;
+        double started = nowSeconds();
+        int ok = !use_opencl ? nativeFindPrime(&native, candidate, lower_bound, upper_bound, &prime)
+               : use_loop ? loopFindPrime(context, command_queue, kernel, candidate, lower_bound, upper_bound, &prime)
+               : use_pipeline ? pipelineFindPrime(&pipeline, candidate, lower_bound, upper_bound, &prime)
+                              : batchFindPrime(&batch, candidate, lower_bound, upper_bound, &prime);
+        double seconds = nowSeconds() - started;
+        if(!ok) {
+            printf("Failed to find a prime.\n");
+            return 1;
         }
+        // Print the prime number that was found
+        printf("Found prime number: %llu\n", prime);
+        unsigned long long covered = oddCandidates(candidate, prime, lower_bound, upper_bound);
+        printf("%llu odd candidates in %.6f s, %.0f candidates/s\n", covered, seconds, seconds > 0 ? covered / seconds : 0.0);
+        if(use_pipeline)
+            printPipelineStages(&pipeline);
     }
 
-    // Print the prime number that was found
-    printf("Found prime number: %llu\n", candidate);
-
-    // Release OpenCL resources
-    clReleaseKernel(kernel);
-    clReleaseProgram(program);
-    clReleaseCommandQueue(command_queue);
-    clReleaseContext(context);
+    // Release the native backend and the OpenCL resources
+    nativeRelease(&native);
+    if(use_opencl) {
+        pipelineRelease(&pipeline);
+        batchRelease(&batch);
+        clReleaseKernel(kernel);
+        clReleaseProgram(program);
+        clReleaseCommandQueue(command_queue);
+        clReleaseContext(context);
+    }
 
     return 0;
 }
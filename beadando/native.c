@@ -0,0 +1,272 @@
+/* native.c */
+/* This file implements the native Miller-Rabin backend declared in native.h:
+   - Montgomery multiplication on 2, 4 or 8 candidates at once with GCC vector extensions,
+     the 64 x 64 bit products are built from 32 x 32 bit ones (pmuludq)
+   - The vector kernel (native_kernel.h) is compiled for generic vectors, AVX2 and AVX-512
+     with target attributes, the widest one the CPU supports is picked at run time
+   - The modular exponentiation of every lane runs to the longest d of the group,
+     the lanes with a shorter d or s are masked
+   - A base 2 round (multiplying by doubling) on every survivor first, then the other
+     witnesses on the packed survivors that pass it
+   - OpenMP threads test the lane groups of a window in chunks, the first chunk with a
+     prime ends the window, so the search does not sieve or test far past the prime
+*/
+
+#include "native.h"         // Include our header for function declarations
+#include <stdlib.h>         // For memory allocation
+#include <string.h>         // For memset
+#ifdef _OPENMP
+#include <omp.h>            // For the thread count
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>      // For _mm256_mul_epu32 and _mm512_mul_epu32
+#define NATIVE_X86 1
+#endif
+
+#define CHUNK_GROUPS 4      // Lane groups per thread in one chunk of a window
+
+// The kernel of native_kernel.h for every instruction set: 16-byte generic vectors (SSE2, or
+// whatever the target has), AVX2 and AVX-512, the last two only compiled for their own functions
+#define LANES 2
+#define KERNEL(name) name##Generic
+#define KERNEL_TARGET
+#define KERNEL_MUL32 0
+#include "native_kernel.h"
+#undef LANES
+#undef KERNEL
+#undef KERNEL_TARGET
+#undef KERNEL_MUL32
+
+#ifdef NATIVE_X86
+#define LANES 4
+#define KERNEL(name) name##Avx2
+#define KERNEL_TARGET __attribute__((target("avx2")))
+#define KERNEL_MUL32 256
+#include "native_kernel.h"
+#undef LANES
+#undef KERNEL
+#undef KERNEL_TARGET
+#undef KERNEL_MUL32
+
+#define LANES 8
+#define KERNEL(name) name##Avx512
+#define KERNEL_TARGET __attribute__((target("avx512f")))
+#define KERNEL_MUL32 512
+#include "native_kernel.h"
+#undef LANES
+#undef KERNEL
+#undef KERNEL_TARGET
+#undef KERNEL_MUL32
+#endif
+
+typedef struct {
+    const char *name;
+    int lanes;
+    void (*testLanes)(const cl_ulong *numbers, int first, int *isPrime);
+    void (*testLanesBase2)(const cl_ulong *numbers, int *isPrime);
+} NativeKernel;
+
+static const NativeKernel genericKernel = {"generic", 2, testLanesGeneric, testLanesBase2Generic};
+#ifdef NATIVE_X86
+static const NativeKernel avx2Kernel = {"avx2", 4, testLanesAvx2, testLanesBase2Avx2};
+static const NativeKernel avx512Kernel = {"avx512", 8, testLanesAvx512, testLanesBase2Avx512};
+#endif
+static const NativeKernel *activeKernel = NULL;
+
+// Pick the widest kernel the CPU supports
+static void nativeDispatch(void) {
+#ifdef NATIVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        activeKernel = &avx512Kernel;
+        return;
+    } else if (__builtin_cpu_supports("avx2")) {
+        activeKernel = &avx2Kernel;
+        return;
+    }
+#endif
+    activeKernel = &genericKernel;
+}
+
+int nativeUseKernel(const char *name) {
+    if (strcmp(name, "auto") == 0) {
+        nativeDispatch();
+        return 1;
+    }
+    if (strcmp(name, "generic") == 0) {
+        activeKernel = &genericKernel;
+        return 1;
+    }
+#ifdef NATIVE_X86
+    __builtin_cpu_init();
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        activeKernel = &avx2Kernel;
+        return 1;
+    }
+    if (strcmp(name, "avx512") == 0 && __builtin_cpu_supports("avx512f")) {
+        activeKernel = &avx512Kernel;
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+const char *nativeKernelName(void) {
+    if (activeKernel == NULL) {
+        nativeDispatch();
+    }
+    return activeKernel->name;
+}
+
+int nativeLanes(void) {
+    if (activeKernel == NULL) {
+        nativeDispatch();
+    }
+    return activeKernel->lanes;
+}
+
+// Run pass (0 = base 2, 1 = the other witnesses) on count numbers, spread over the threads
+static void testPass(NativeTester *tester, int pass, const cl_ulong *numbers, size_t count, int *isPrime) {
+    const NativeKernel *kernel = activeKernel;
+    int width = kernel->lanes;
+    long groups = (long)((count + width - 1) / width);
+    #pragma omp parallel for schedule(dynamic, 4) num_threads(nativeThreads(tester))
+    for (long g = 0; g < groups; g++) {
+        size_t first = (size_t)g * width;
+        cl_ulong lanes[NATIVE_MAX_LANES];
+        int verdicts[NATIVE_MAX_LANES];
+        // Fill the lanes after the last number with copies of it
+        for (int k = 0; k < width; k++) {
+            lanes[k] = numbers[first + k < count ? first + k : count - 1];
+        }
+        if (pass == 0) {
+            kernel->testLanesBase2(lanes, verdicts);
+        } else {
+            kernel->testLanes(lanes, 1, verdicts);
+        }
+        memcpy(&isPrime[first], verdicts, sizeof(int) * (first + width <= count ? (size_t)width : count - first));
+    }
+}
+
+// Test count numbers that testLanes accepts. Most composites fail the base 2 round, so that round
+// runs on every number and the other witnesses only on the packed numbers that pass it, which keeps
+// the lanes of the long pass full.
+static void testSurvivors(NativeTester *tester, const cl_ulong *numbers, size_t count, int *isPrime) {
+    size_t passed = 0;
+    testPass(tester, 0, numbers, count, isPrime);
+    for (size_t i = 0; i < count; i++) {
+        if (isPrime[i]) {
+            tester->slots[passed] = i;
+            tester->passed[passed++] = numbers[i];
+        }
+    }
+    if (passed > 0) {
+        testPass(tester, 1, tester->passed, passed, tester->passedPrime);
+        for (size_t k = 0; k < passed; k++) {
+            isPrime[tester->slots[k]] = tester->passedPrime[k];
+        }
+    }
+    tester->tested += count;
+}
+
+int nativeInit(NativeTester *tester, size_t window, int threads) {
+    memset(tester, 0, sizeof(*tester));
+    if (activeKernel == NULL) {
+        nativeDispatch();
+    }
+    tester->window = window;
+    tester->threads = threads;
+    tester->survivors = (cl_ulong *)malloc(sizeof(cl_ulong) * window);
+    tester->isPrime = (int *)malloc(sizeof(int) * window);
+    tester->passed = (cl_ulong *)malloc(sizeof(cl_ulong) * window);
+    tester->passedPrime = (int *)malloc(sizeof(int) * window);
+    tester->slots = (size_t *)malloc(sizeof(size_t) * window);
+    if (!tester->survivors || !tester->isPrime || !tester->passed || !tester->passedPrime || !tester->slots || !sieveInit(&tester->sieve, window)) {
+        nativeRelease(tester);
+        return 0;
+    }
+    return 1;
+}
+
+int nativeThreads(const NativeTester *tester) {
+#ifdef _OPENMP
+    return tester->threads > 0 ? tester->threads : omp_get_max_threads();
+#else
+    (void)tester;
+    return 1;
+#endif
+}
+
+// Test one window: returns 1 and the prime if the window has one, 0 if not.
+// The window is sieved and tested in parts of about one chunk of survivors (a sixth to a
+// seventh of the odd numbers survive the sieve), in order, so the search stops soon after
+// the first prime instead of sieving and testing the whole window.
+static int testWindow(void *context, cl_ulong start, size_t count, unsigned long long *prime) {
+    NativeTester *tester = (NativeTester *)context;
+    size_t chunk = (size_t)nativeThreads(tester) * nativeLanes() * CHUNK_GROUPS;
+    size_t part = chunk * 6;
+    for (size_t offset = 0; offset < count; offset += part) {
+        size_t length = count - offset < part ? count - offset : part;
+        cl_ulong hostPrime;
+        size_t survivors = sieveWindow(&tester->sieve, start + 2 * offset, length, tester->survivors, &hostPrime);
+        // The survivors are in increasing order, the first prime of the first chunk that has one is the answer
+        for (size_t first = 0; first < survivors; first += chunk) {
+            size_t tested = survivors - first < chunk ? survivors - first : chunk;
+            testSurvivors(tester, &tester->survivors[first], tested, &tester->isPrime[first]);
+            for (size_t i = first; i < first + tested; i++) {
+                if (tester->isPrime[i]) {
+                    *prime = tester->survivors[i];
+                    return 1;
+                }
+            }
+        }
+        if (hostPrime != 0) {
+            *prime = hostPrime;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int nativeFindPrime(NativeTester *tester, unsigned long long start, unsigned long long lower_bound, unsigned long long upper_bound, unsigned long long *prime) {
+    return windowFindPrime(tester->window, testWindow, tester, start, lower_bound, upper_bound, prime);
+}
+
+void nativeTestNumbers(NativeTester *tester, const unsigned long long *numbers, size_t count, int *isPrime) {
+    size_t queued = 0;                  // Numbers waiting in tester->survivors
+    size_t *slots = (size_t *)malloc(sizeof(size_t) * tester->window);   // Their index in numbers
+    for (size_t i = 0; i <= count; i++) {
+        if (i < count) {
+            unsigned long long n = numbers[i];
+            int small = n < 41 || n % 2 == 0;
+            for (int j = 0; j < NUM_WITNESSES && !small; j++) {
+                small = n % witnessBases[j] == 0;
+            }
+            if (small || slots == NULL) {
+                // Decided without the vector test: a small number, or a multiple of a witness
+                isPrime[i] = hostMillerRabin(n);
+                continue;
+            }
+            slots[queued] = i;
+            tester->survivors[queued++] = n;
+        }
+        if (queued > 0 && (queued == tester->window || i == count)) {
+            testSurvivors(tester, tester->survivors, queued, tester->isPrime);
+            for (size_t k = 0; k < queued; k++) {
+                isPrime[slots[k]] = tester->isPrime[k];
+            }
+            queued = 0;
+        }
+    }
+    free(slots);
+}
+
+void nativeRelease(NativeTester *tester) {
+    free(tester->survivors);
+    free(tester->isPrime);
+    free(tester->passed);
+    free(tester->passedPrime);
+    free(tester->slots);
+    sieveRelease(&tester->sieve);
+    memset(tester, 0, sizeof(*tester));
+}
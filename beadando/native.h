@@ -0,0 +1,53 @@
+/* native.h */
+/* This header file declares the native (CPU) Miller-Rabin backend:
+   - The same window sieve and walk over the range as the batched OpenCL mode
+   - The survivors are tested 2 (generic vectors), 4 (AVX2) or 8 (AVX-512) at a time with vectorized
+     Montgomery multiplication, first with the base 2 only, then the ones that pass it with the
+     other witnesses. The instruction set is picked at run time, the binary needs no -march
+   - The lane groups are spread over the threads with OpenMP
+   - It needs no OpenCL platform, main falls back to it when there is none
+*/
+
+#ifndef NATIVE_H
+#define NATIVE_H
+
+#include "batch.h"                  // WindowSieve, windowFindPrime, witnessBases
+
+#define NATIVE_MAX_LANES 8          // Candidates per vector of the widest kernel, 8 x 64 bits fill an AVX-512 register
+
+// State of the native tester, kept between windows
+typedef struct {
+    WindowSieve sieve;
+    size_t window;                  // Odd candidates per window
+    int threads;                    // OpenMP threads, 0 = OpenMP's default
+    cl_ulong *survivors;            // Survivors of the sieve, then the numbers of nativeTestNumbers
+    int *isPrime;                   // Verdict per survivor
+    cl_ulong *passed;               // Survivors that pass the base 2 round, packed
+    int *passedPrime;               // Their verdict with the other witnesses
+    size_t *slots;                  // Their index among the survivors
+    unsigned long long tested;      // Candidates tested with Miller-Rabin so far
+} NativeTester;
+
+// Allocate the sieve and the per window arrays. Returns 1 on success, 0 on failure.
+int nativeInit(NativeTester *tester, size_t window, int threads);
+
+// Find the first probable prime at or after start (odd), wrapping from upper_bound
+// back to lower_bound, like batchFindPrime. Returns 1 on success.
+int nativeFindPrime(NativeTester *tester, unsigned long long start, unsigned long long lower_bound, unsigned long long upper_bound, unsigned long long *prime);
+
+// Test count arbitrary numbers, isPrime[i] is set to 1 for the primes
+void nativeTestNumbers(NativeTester *tester, const unsigned long long *numbers, size_t count, int *isPrime);
+
+// Number of threads the tests run on
+int nativeThreads(const NativeTester *tester);
+
+// Vector kernel: "auto" (the widest the CPU supports), "generic", "avx2" or "avx512".
+// Returns 0 when the kernel is unknown or not supported by this CPU.
+int nativeUseKernel(const char *name);
+const char *nativeKernelName(void);
+// Candidates per vector of the kernel in use
+int nativeLanes(void);
+
+void nativeRelease(NativeTester *tester);
+
+#endif // NATIVE_H
@@ -0,0 +1,186 @@
+/* native_kernel.h */
+/* The vector Miller-Rabin kernel of native.c, included by it once per instruction set:
+   - Before every inclusion native.c defines LANES (candidates per vector), KERNEL(name) (the
+     suffixed name of every type and function), KERNEL_TARGET (the target attribute, or nothing
+     for the generic kernel) and KERNEL_MUL32 (0, 256 or 512: which pmuludq to use)
+   - Only KERNEL(testLanes) and KERNEL(testLanesBase2) are called from outside, the dispatch
+     in native.c picks the set of the widest instruction set the CPU supports at run time
+   - No include guard on purpose, every inclusion defines a new set of functions
+*/
+
+#define u64v KERNEL(U64v)
+#define i64v KERNEL(I64v)
+#define Lanes KERNEL(Lanes)
+#define mul32 KERNEL(mul32)
+#define mulWide KERNEL(mulWide)
+#define mulLo KERNEL(mulLo)
+#define montMulV KERNEL(montMulV)
+#define selectLanes KERNEL(selectLanes)
+#define loadLanes KERNEL(loadLanes)
+#define compositeLanes KERNEL(compositeLanes)
+
+typedef unsigned long long u64v __attribute__((vector_size(8 * LANES)));
+typedef long long i64v __attribute__((vector_size(8 * LANES)));   // Comparison results, -1 or 0 per lane
+
+// Products of the low 32 bits of the lanes. GCC turns the masked vector product into a full
+// 64-bit multiply (vpmullq or worse), the intrinsics are one pmuludq per register.
+KERNEL_TARGET
+static inline u64v mul32(u64v a, u64v b) {
+#if KERNEL_MUL32 == 512
+    u64v p;
+    for (int h = 0; h < LANES / 8; h++) {
+        ((__m512i *)&p)[h] = _mm512_mul_epu32(((__m512i *)&a)[h], ((__m512i *)&b)[h]);
+    }
+    return p;
+#elif KERNEL_MUL32 == 256
+    u64v p;
+    for (int h = 0; h < LANES / 4; h++) {
+        ((__m256i *)&p)[h] = _mm256_mul_epu32(((__m256i *)&a)[h], ((__m256i *)&b)[h]);
+    }
+    return p;
+#else
+    return (a & 0xFFFFFFFFULL) * (b & 0xFFFFFFFFULL);
+#endif
+}
+
+// 128-bit products a * b lane by lane from four 32 x 32 bit products: the low half goes to *lo
+KERNEL_TARGET
+static inline u64v mulWide(u64v a, u64v b, u64v *lo) {
+    u64v aHi = a >> 32, bHi = b >> 32;
+    u64v ll = mul32(a, b), lh = mul32(a, bHi), hl = mul32(aHi, b), hh = mul32(aHi, bHi);
+    u64v mid = (ll >> 32) + (lh & 0xFFFFFFFFULL) + (hl & 0xFFFFFFFFULL);   // At most 3 * (2^32 - 1)
+    *lo = (mid << 32) | (ll & 0xFFFFFFFFULL);
+    return hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+}
+
+// Low half of the products a * b, three 32 x 32 bit products
+KERNEL_TARGET
+static inline u64v mulLo(u64v a, u64v b) {
+    return mul32(a, b) + ((mul32(a, b >> 32) + mul32(a >> 32, b)) << 32);
+}
+
+// Montgomery product a * b / 2^64 mod n per lane, the montMul of sample.cl
+KERNEL_TARGET
+static inline u64v montMulV(u64v a, u64v b, u64v n, u64v nInv) {
+    u64v lo, mnLo;
+    u64v hi = mulWide(a, b, &lo);
+    u64v m = mulLo(lo, nInv);
+    u64v u = mulWide(m, n, &mnLo) - (u64v)(lo != 0);    // + 1 where lo != 0
+    u64v t = hi + u;
+    return t - (n & (u64v)((t < hi) | (t >= n)));
+}
+
+// Keep a where mask is set, b elsewhere
+KERNEL_TARGET
+static inline u64v selectLanes(i64v mask, u64v a, u64v b) {
+    return (a & (u64v)mask) | (b & ~(u64v)mask);
+}
+
+// Montgomery constants, d and s of LANES odd numbers, the s and the bits of d of the longest lane
+typedef struct {
+    u64v n, nInv, r2, one, minusOne, d, s;
+    int dBits, maxS;
+} Lanes;
+
+KERNEL_TARGET
+static void loadLanes(Lanes *lanes, const cl_ulong *numbers) {
+    cl_ulong maxD = 0;
+    lanes->maxS = 0;
+    for (int k = 0; k < LANES; k++) {
+        cl_ulong n = numbers[k];
+        int s = __builtin_ctzll(n - 1);
+        lanes->n[k] = n;
+        lanes->one[k] = (0 - n) % n;     // 2^64 mod n
+        lanes->d[k] = (n - 1) >> s;
+        lanes->s[k] = s;
+        maxD |= lanes->d[k];
+        lanes->maxS = s > lanes->maxS ? s : lanes->maxS;
+    }
+    lanes->dBits = 64 - __builtin_clzll(maxD);
+    // The constants of montgomeryConstants, on all lanes at once: Newton's iteration for n^-1
+    // mod 2^64, and 2^128 mod n by doubling 2^64 mod n 64 times
+    u64v n = lanes->n, inv = lanes->n, r2 = lanes->one;
+    for (int i = 0; i < 5; i++) {
+        inv = mulLo(inv, 2 - mulLo(n, inv));
+    }
+    lanes->nInv = 0 - inv;
+    for (int i = 0; i < 64; i++) {
+        u64v twice = r2 + r2;
+        r2 = twice - (n & (u64v)((twice < r2) | (twice >= n)));
+    }
+    lanes->r2 = r2;
+    lanes->minusOne = n - lanes->one;
+}
+
+// One Miller-Rabin round of witness on every lane: returns -1 in the lanes it proves composite.
+// The exponent is walked from the top bit of the longest d, the shorter ones square 1 until
+// their own top bit. The base 2 multiplies by doubling.
+KERNEL_TARGET
+static i64v compositeLanes(const Lanes *lanes, cl_ulong witness) {
+    u64v n = lanes->n, nInv = lanes->nInv;
+    u64v base = montMulV(n - n + witness, lanes->r2, n, nInv);
+    u64v x = lanes->one;
+    for (int bit = lanes->dBits - 1; bit >= 0; bit--) {
+        x = montMulV(x, x, n, nInv);
+        i64v set = (i64v)((lanes->d >> bit) & 1) != 0;
+        u64v product;
+        if (witness == 2) {
+            product = x + x;
+            product -= n & (u64v)((product < x) | (product >= n));
+        } else {
+            product = montMulV(x, base, n, nInv);
+        }
+        x = selectLanes(set, product, x);
+    }
+    // Passes if x is 1, or n - 1 in one of the next s - 1 squarings
+    i64v passed = (x == lanes->one) | (x == lanes->minusOne);
+    for (int r = 1; r < lanes->maxS; r++) {
+        x = montMulV(x, x, n, nInv);
+        passed |= (x == lanes->minusOne) & (lanes->s > (u64v){0} + r);
+    }
+    return ~passed;
+}
+
+// Miller-Rabin with the witnesses from first on LANES odd numbers above 37 without a factor
+// below 41. Every witness is below the numbers, so no lane needs the a % n == 0 case of the kernel.
+KERNEL_TARGET
+static void KERNEL(testLanes)(const cl_ulong *numbers, int first, int *isPrime) {
+    Lanes lanes;
+    loadLanes(&lanes, numbers);
+    i64v composite = (i64v)(lanes.n - lanes.n);
+    for (int j = first; j < NUM_WITNESSES; j++) {
+        composite |= compositeLanes(&lanes, witnessBases[j]);
+        int all = 1;
+        for (int k = 0; k < LANES; k++) {
+            all &= composite[k] != 0;
+        }
+        if (all) {
+            break;
+        }
+    }
+    for (int k = 0; k < LANES; k++) {
+        isPrime[k] = composite[k] == 0;
+    }
+}
+
+// The base 2 round only, the cheap filter of the first pass
+KERNEL_TARGET
+static void KERNEL(testLanesBase2)(const cl_ulong *numbers, int *isPrime) {
+    Lanes lanes;
+    loadLanes(&lanes, numbers);
+    i64v composite = compositeLanes(&lanes, 2);
+    for (int k = 0; k < LANES; k++) {
+        isPrime[k] = composite[k] == 0;
+    }
+}
+
+#undef u64v
+#undef i64v
+#undef Lanes
+#undef mul32
+#undef mulWide
+#undef mulLo
+#undef montMulV
+#undef selectLanes
+#undef loadLanes
+#undef compositeLanes
@@ -0,0 +1,267 @@
+/* pipeline.c */
+/* This file implements the pipelined Miller-Rabin tester declared in pipeline.h:
+   - Submitting a window: sieve it, map the pinned input buffers, write the survivors and their
+     constants, unmap, enqueue the kernel after the unmaps and a non-blocking map of the results
+   - Collecting the oldest window: wait for its result map, pick the first probable prime, unmap
+   - Keeping depth windows in flight, in range order, so the answer is the one of batchFindPrime;
+     a search starts with a single window and fills the pipeline after the first empty one
+   - Summing the profiled queue, submit, execute and transfer times of every launch
+*/
+
+#include "pipeline.h"       // Include our header for function declarations
+#include <stdio.h>          // For error messages
+#include <stdlib.h>         // For memory allocation
+#include <string.h>         // For memset
+#include <sys/time.h>       // For the host side times
+
+#define COMPOSITE_BUFFER 5  // Index of the composite flags among the slot buffers
+
+// Bytes per survivor of the slot buffers: candidates, d, s, nInv, r2, composite
+static const size_t elementSizes[PIPELINE_BUFFERS] = {
+    sizeof(cl_ulong), sizeof(cl_ulong), sizeof(cl_int), sizeof(cl_ulong), sizeof(cl_ulong), sizeof(cl_int)
+};
+
+static double nowSeconds(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// Nanoseconds between two profiling points of a finished command, 0 if they are not available
+static cl_ulong eventNs(cl_event event, cl_profiling_info from, cl_profiling_info to) {
+    cl_ulong begin = 0, end = 0;
+    if (clGetEventProfilingInfo(event, from, sizeof(begin), &begin, NULL) != CL_SUCCESS ||
+        clGetEventProfilingInfo(event, to, sizeof(end), &end, NULL) != CL_SUCCESS) {
+        return 0;
+    }
+    return end > begin ? end - begin : 0;
+}
+
+// Add the run time of the slot's finished maps and unmaps to the transfer time and release them
+static void profileTransfers(PipelineTester *tester, PipelineSlot *slot) {
+    for (int i = 0; i < slot->numTransfers; i++) {
+        tester->transferNs += eventNs(slot->transfers[i], CL_PROFILING_COMMAND_START, CL_PROFILING_COMMAND_END);
+        clReleaseEvent(slot->transfers[i]);
+    }
+    slot->numTransfers = 0;
+}
+
+int pipelineInit(PipelineTester *tester, cl_context context, cl_device_id device, cl_program program, size_t window, int depth) {
+    cl_int err;
+    memset(tester, 0, sizeof(*tester));
+    if (depth < 1 || depth > MAX_PIPELINE_DEPTH) {
+        fprintf(stderr, "Error: The pipeline depth must be between 1 and %d\n", MAX_PIPELINE_DEPTH);
+        return 0;
+    }
+    tester->depth = depth;
+    tester->window = window;
+    if (!sieveInit(&tester->sieve, window)) {
+        fprintf(stderr, "Error: Failed to allocate the pipeline sieve\n");
+        return 0;
+    }
+    tester->witnessBuffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(witnessBases), (void *)witnessBases, &err);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error: Failed to create the witness buffer (%d)\n", err);
+        pipelineRelease(tester);
+        return 0;
+    }
+    for (int i = 0; i < depth; i++) {
+        PipelineSlot *slot = &tester->slots[i];
+        slot->queue = clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &err);
+        if (err != CL_SUCCESS) {
+            fprintf(stderr, "Error: Failed to create the command queue of slot %d (%d)\n", i, err);
+            pipelineRelease(tester);
+            return 0;
+        }
+        // Host allocated buffers: pinned memory for the maps of a discrete GPU, no copy at all on a CPU
+        for (int b = 0; b < PIPELINE_BUFFERS && err == CL_SUCCESS; b++) {
+            cl_mem_flags flags = CL_MEM_ALLOC_HOST_PTR | (b == COMPOSITE_BUFFER ? CL_MEM_READ_WRITE : CL_MEM_READ_ONLY);
+            slot->buffers[b] = clCreateBuffer(context, flags, elementSizes[b] * window, NULL, &err);
+        }
+        if (err == CL_SUCCESS) {
+            slot->kernel = clCreateKernel(program, "millerRabinBatch", &err);
+        }
+        if (err != CL_SUCCESS) {
+            fprintf(stderr, "Error: Failed to create the buffers and kernel of slot %d (%d)\n", i, err);
+            pipelineRelease(tester);
+            return 0;
+        }
+        // Arguments 0..4 are the inputs, 5 the witnesses and 6 the composite flags
+        for (int b = 0; b < COMPOSITE_BUFFER; b++) {
+            err |= clSetKernelArg(slot->kernel, b, sizeof(cl_mem), &slot->buffers[b]);
+        }
+        err |= clSetKernelArg(slot->kernel, 5, sizeof(cl_mem), &tester->witnessBuffer);
+        err |= clSetKernelArg(slot->kernel, 6, sizeof(cl_mem), &slot->buffers[COMPOSITE_BUFFER]);
+        slot->candidates = (cl_ulong *)malloc(sizeof(cl_ulong) * window);
+        if (err != CL_SUCCESS || !slot->candidates) {
+            fprintf(stderr, "Error: Failed to set up slot %d\n", i);
+            pipelineRelease(tester);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Sieve the window into the slot and start its test. Returns 1 on success, 0 on an OpenCL error.
+static int submitWindow(PipelineTester *tester, PipelineSlot *slot, cl_ulong start, size_t count) {
+    double started = nowSeconds();
+    slot->count = sieveWindow(&tester->sieve, start, count, slot->candidates, &slot->hostPrime);
+    if (slot->count == 0) {
+        tester->prepareSeconds += nowSeconds() - started;
+        return 1;
+    }
+    // The slot's queue is idle (its last window was collected), so the blocking maps do not wait on the device
+    cl_int err = CL_SUCCESS;
+    void *mapped[PIPELINE_BUFFERS];
+    for (int b = 0; b < PIPELINE_BUFFERS; b++) {
+        mapped[b] = clEnqueueMapBuffer(slot->queue, slot->buffers[b], CL_TRUE, CL_MAP_WRITE, 0, elementSizes[b] * slot->count,
+                                       0, NULL, &slot->transfers[slot->numTransfers++], &err);
+        if (err != CL_SUCCESS) {
+            fprintf(stderr, "Error: Failed to map the pipeline inputs (%d)\n", err);
+            return 0;
+        }
+    }
+    cl_ulong *candidates = (cl_ulong *)mapped[0], *d = (cl_ulong *)mapped[1], *nInv = (cl_ulong *)mapped[3], *r2 = (cl_ulong *)mapped[4];
+    cl_int *s = (cl_int *)mapped[2];
+    for (size_t i = 0; i < slot->count; i++) {
+        cl_ulong n = slot->candidates[i];
+        candidates[i] = n;
+        s[i] = __builtin_ctzll(n - 1);
+        d[i] = (n - 1) >> s[i];
+        montgomeryConstants(n, &nInv[i], &r2[i]);
+    }
+    memset(mapped[COMPOSITE_BUFFER], 0, sizeof(cl_int) * slot->count);
+    // The kernel waits for the unmaps, then the results are mapped back without blocking the host
+    cl_event unmapped[PIPELINE_BUFFERS];
+    for (int b = 0; b < PIPELINE_BUFFERS; b++) {
+        err |= clEnqueueUnmapMemObject(slot->queue, slot->buffers[b], mapped[b], 0, NULL, &unmapped[b]);
+        slot->transfers[slot->numTransfers++] = unmapped[b];
+    }
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error: Failed to unmap the pipeline inputs\n");
+        return 0;
+    }
+    size_t global_work_size[2] = {slot->count, NUM_WITNESSES};
+    err = clEnqueueNDRangeKernel(slot->queue, slot->kernel, 2, NULL, global_work_size, NULL, PIPELINE_BUFFERS, unmapped, &slot->kernelEvent);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error: Failed to enqueue the pipeline kernel (%d)\n", err);
+        return 0;
+    }
+    slot->composite = (cl_int *)clEnqueueMapBuffer(slot->queue, slot->buffers[COMPOSITE_BUFFER], CL_FALSE, CL_MAP_READ, 0,
+                                                   sizeof(cl_int) * slot->count, 1, &slot->kernelEvent, &slot->resultEvent, &err);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error: Failed to map the pipeline results (%d)\n", err);
+        clReleaseEvent(slot->kernelEvent);
+        slot->composite = NULL;
+        return 0;
+    }
+    clFlush(slot->queue);
+    tester->prepareSeconds += nowSeconds() - started;
+    return 1;
+}
+
+// Wait for the slot's window and release its results: returns 1 and the prime if the window
+// has one, 0 if not, -1 on an error
+static int collectWindow(PipelineTester *tester, PipelineSlot *slot, unsigned long long *prime) {
+    int found = 0;
+    if (slot->count > 0) {
+        double started = nowSeconds();
+        cl_int err = clWaitForEvents(1, &slot->resultEvent);
+        tester->waitSeconds += nowSeconds() - started;
+        if (err != CL_SUCCESS) {
+            fprintf(stderr, "Error: Failed to wait for the pipeline results (%d)\n", err);
+            found = -1;
+        }
+        // The survivors are in increasing order, the first one left is the answer
+        for (size_t i = 0; i < slot->count && found == 0; i++) {
+            if (!slot->composite[i]) {
+                *prime = slot->candidates[i];
+                found = 1;
+            }
+        }
+        // Everything before the result map has finished: profile it
+        tester->queuedNs += eventNs(slot->kernelEvent, CL_PROFILING_COMMAND_QUEUED, CL_PROFILING_COMMAND_SUBMIT);
+        tester->submitNs += eventNs(slot->kernelEvent, CL_PROFILING_COMMAND_SUBMIT, CL_PROFILING_COMMAND_START);
+        tester->executeNs += eventNs(slot->kernelEvent, CL_PROFILING_COMMAND_START, CL_PROFILING_COMMAND_END);
+        tester->transferNs += eventNs(slot->resultEvent, CL_PROFILING_COMMAND_START, CL_PROFILING_COMMAND_END);
+        clReleaseEvent(slot->kernelEvent);
+        clReleaseEvent(slot->resultEvent);
+        profileTransfers(tester, slot);
+        // The unmap is profiled with the next window of the slot
+        clEnqueueUnmapMemObject(slot->queue, slot->buffers[COMPOSITE_BUFFER], slot->composite, 0, NULL, &slot->transfers[slot->numTransfers++]);
+        clFlush(slot->queue);
+        slot->composite = NULL;
+        tester->launches++;
+        tester->tested += slot->count;
+        slot->count = 0;
+    }
+    if (found == 0 && slot->hostPrime != 0) {
+        *prime = slot->hostPrime;
+        found = 1;
+    }
+    return found;
+}
+
+int pipelineFindPrime(PipelineTester *tester, unsigned long long start, unsigned long long lower_bound, unsigned long long upper_bound, unsigned long long *prime) {
+    WindowWalk walk;
+    int head = 0;                   // Slot of the oldest window in flight
+    int inFlight = 0;
+    int more = 1;                   // The walk has windows left
+    int target = 1;                 // Windows to keep in flight
+    int found = 0;
+    windowWalkInit(&walk, tester->window, start, lower_bound, upper_bound);
+    while (found == 0) {
+        // Keep the windows in flight: the host sieves these while the device tests the older ones.
+        // A window usually holds the prime, so the first one goes alone and the pipeline only
+        // fills up once a window came back without a prime.
+        while (more && inFlight < target) {
+            cl_ulong candidate;
+            size_t count;
+            more = windowWalkNext(&walk, &candidate, &count);
+            if (more) {
+                PipelineSlot *slot = &tester->slots[(head + inFlight) % tester->depth];
+                inFlight++;
+                if (!submitWindow(tester, slot, candidate, count)) {
+                    slot->count = 0;    // Nothing of it to collect
+                    found = -1;
+                    break;
+                }
+            }
+        }
+        if (inFlight == 0 || found != 0) {
+            break;
+        }
+        found = collectWindow(tester, &tester->slots[head], prime);
+        head = (head + 1) % tester->depth;
+        inFlight--;
+        target = tester->depth;
+    }
+    // Windows after the answer were tested in vain, drain them
+    for (; inFlight > 0; inFlight--) {
+        unsigned long long ignored;
+        if (collectWindow(tester, &tester->slots[head], &ignored) < 0) {
+            found = -1;
+        }
+        head = (head + 1) % tester->depth;
+    }
+    return found > 0;
+}
+
+void pipelineRelease(PipelineTester *tester) {
+    for (int i = 0; i < MAX_PIPELINE_DEPTH; i++) {
+        PipelineSlot *slot = &tester->slots[i];
+        if (slot->queue) clFinish(slot->queue);
+        for (int t = 0; t < slot->numTransfers; t++) {
+            clReleaseEvent(slot->transfers[t]);
+        }
+        for (int b = 0; b < PIPELINE_BUFFERS; b++) {
+            if (slot->buffers[b]) clReleaseMemObject(slot->buffers[b]);
+        }
+        if (slot->kernel) clReleaseKernel(slot->kernel);
+        if (slot->queue) clReleaseCommandQueue(slot->queue);
+        free(slot->candidates);
+    }
+    if (tester->witnessBuffer) clReleaseMemObject(tester->witnessBuffer);
+    sieveRelease(&tester->sieve);
+    memset(tester, 0, sizeof(*tester));
+}
@@ -0,0 +1,65 @@
+/* pipeline.h */
+/* This header file declares the pipelined Miller-Rabin tester:
+   - The windows of the batched mode, with several of them in flight at once
+   - Every slot has its own in-order command queue, kernel and pinned (host allocated) buffers,
+     so the host sieves and maps the next windows while the device tests the earlier ones
+   - Unmapping the inputs, the kernel and mapping the results are chained with events
+   - The queues are created with CL_QUEUE_PROFILING_ENABLE, the time of every stage is summed
+*/
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "batch.h"                  // WindowSieve, WindowWalk, witnessBases
+
+#define DEFAULT_PIPELINE_DEPTH 3    // Windows in flight
+#define MAX_PIPELINE_DEPTH 16
+#define PIPELINE_BUFFERS 6          // candidates, d, s, nInv, r2 and composite of a slot
+#define MAX_SLOT_TRANSFERS (2 * PIPELINE_BUFFERS + 2)
+
+// One window in flight
+typedef struct {
+    cl_command_queue queue;         // In-order queue of the slot, with profiling
+    cl_kernel kernel;               // "millerRabinBatch" on the buffers of the slot
+    cl_mem buffers[PIPELINE_BUFFERS];
+    cl_ulong *candidates;           // Host copy of the survivors
+    size_t count;                   // Survivors on the device
+    cl_ulong hostPrime;             // Prime of the window found by the sieve, 0 if none
+    cl_event kernelEvent;
+    cl_event resultEvent;           // Map of the composite flags for reading
+    cl_event transfers[MAX_SLOT_TRANSFERS];  // Maps and unmaps, profiled when the slot is collected
+    int numTransfers;
+    cl_int *composite;              // Mapped composite flags, between the result map and the unmap
+} PipelineSlot;
+
+// State of the pipelined tester, kept between searches
+typedef struct {
+    PipelineSlot slots[MAX_PIPELINE_DEPTH];
+    int depth;                      // Slots in use
+    size_t window;                  // Odd candidates per window
+    cl_mem witnessBuffer;           // witnessBases, shared by the slots
+    WindowSieve sieve;
+    unsigned long long launches;    // Kernel launches so far
+    unsigned long long tested;      // Candidates sent to the device so far
+    // Sums of the profiled stages, in nanoseconds
+    cl_ulong queuedNs;              // Kernels waiting in their queue (QUEUED -> SUBMIT)
+    cl_ulong submitNs;              // Kernels submitted, waiting for the device (SUBMIT -> START)
+    cl_ulong executeNs;             // Kernels running (START -> END)
+    cl_ulong transferNs;            // Maps and unmaps running (START -> END)
+    // Host side, in seconds
+    double prepareSeconds;          // Sieving, Montgomery constants and writing the inputs
+    double waitSeconds;             // Blocked on the oldest window's results
+} PipelineTester;
+
+// Create the queues, kernels and buffers of depth slots (1..MAX_PIPELINE_DEPTH).
+// Returns 1 on success, 0 on failure.
+int pipelineInit(PipelineTester *tester, cl_context context, cl_device_id device, cl_program program, size_t window, int depth);
+
+// Find the first probable prime at or after start (odd), wrapping from upper_bound
+// back to lower_bound, like batchFindPrime. Returns 1 on success.
+int pipelineFindPrime(PipelineTester *tester, unsigned long long start, unsigned long long lower_bound, unsigned long long upper_bound, unsigned long long *prime);
+
+// Wait for the queues and release everything
+void pipelineRelease(PipelineTester *tester);
+
+#endif // PIPELINE_H
@@ -0,0 +1,419 @@
+/* range.c */
+/* This file implements the segmented sieve of range.h:
+   - A segment starts as a copy of the pattern of the multiples of 7, 11 and 13 (the pattern
+     repeats every 1001 bytes), then every base prime from 17 crosses out its multiples from
+     its square on: the multiples p * k with k in one residue class mod 30 are p bytes apart
+     and share one bit, so every prime runs 8 strided loops per segment
+   - The base primes are found with a plain odd-only sieve up to sqrt(high)
+   - Every segment is sieved into its own buffer, the count mode only adds up popcounts
+   - In the list and delta formats the threads sieve and encode a round of segments in
+     parallel, then the round is written in order, so the output streams with bounded memory
+*/
+
+#include "range.h"          // Include our header for function declarations
+#include <stdlib.h>         // For memory allocation
+#include <string.h>         // For memcpy and memset
+#include <sys/time.h>       // For the timings
+#ifdef _OPENMP
+#include <omp.h>            // For the thread count
+#endif
+
+#define PRESIEVE_BYTES (7 * 11 * 13)  // Period of the multiples of 7, 11 and 13 in wheel bytes
+#define ROUND_SEGMENTS 4              // Segments per thread between two writes of the output
+#define MAX_DIGITS 20                 // Decimal digits of a 64-bit number
+#define MAX_VARINT 10                 // Bytes of a 64-bit varint
+
+// The numbers of a wheel byte: 30 * byte + wheelResidue[bit]
+static const unsigned char wheelResidue[8] = {1, 7, 11, 13, 17, 19, 23, 29};
+// The bit of every residue mod 30, 0 for the residues with a factor 2, 3 or 5
+static const unsigned char wheelBit[30] = {
+    0, 0x01, 0, 0, 0, 0, 0, 0x02, 0, 0, 0, 0x04, 0, 0x08, 0, 0, 0, 0x10, 0, 0x20, 0, 0, 0, 0x40, 0, 0, 0, 0, 0, 0x80
+};
+static const unsigned long long smallPrimes[3] = {2, 3, 5};  // Not on the wheel
+
+// Shared, read-only state of one range
+typedef struct {
+    unsigned long long low, high;
+    unsigned long long firstByte;       // Wheel byte of low
+    unsigned long long lastByte;        // Wheel byte of high
+    size_t segmentBytes;
+    unsigned int *primes;               // Base primes from 17 up to sqrt(high)
+    size_t numPrimes;
+    unsigned char presieve[PRESIEVE_BYTES];  // Wheel bytes of 0 .. 30029 without the multiples of 7, 11 and 13
+    // For p = 30 * q + wheelResidue[c] and k = 30 * t + wheelResidue[w], p * k is in wheel byte
+    // p * t + q * wheelResidue[w] + carry[c][w] with bit mask[c][w], so no division per residue
+    unsigned char carry[8][8];
+    unsigned char mask[8][8];
+    unsigned char wheelIndex[30];       // c of p % 30
+} RangeSieve;
+
+// One segment of a round in the list and delta formats
+typedef struct {
+    unsigned char *sieve;               // Bits of the segment
+    unsigned char *data;                // Its primes, encoded
+    size_t length;                      // Bytes of data
+    size_t capacity;
+    unsigned long long first, last;     // First and last prime of the segment, 0 if it has none
+    unsigned long long count;           // Primes of the segment
+} SegmentOutput;
+
+static double nowSeconds(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static unsigned long long squareRoot(unsigned long long x) {
+    unsigned long long root = x, next = (x + 1) / 2;
+    while (next < root) {
+        root = next;
+        next = (root + x / root) / 2;
+    }
+    return root;
+}
+
+static unsigned char *writeVarint(unsigned char *out, unsigned long long value) {
+    while (value >= 0x80) {
+        *out++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (unsigned char)value;
+    return out;
+}
+
+static unsigned char *writeDecimal(unsigned char *out, unsigned long long value) {
+    unsigned char digits[MAX_DIGITS];
+    int n = 0;
+    do {
+        digits[n++] = (unsigned char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    while (n > 0) {
+        *out++ = digits[--n];
+    }
+    *out++ = '\n';
+    return out;
+}
+
+// Odd-only sieve of the primes up to limit, keeps the ones from 17 on. Returns the number
+// of primes up to limit (with 2 .. 13), 0 on failure.
+static unsigned long long sieveBasePrimes(RangeSieve *range, unsigned long long limit) {
+    size_t half = (size_t)(limit / 2 + 1);        // Index i stands for 2 * i + 1
+    unsigned char *composite = (unsigned char *)calloc(half, 1);
+    if (composite == NULL) {
+        return 0;
+    }
+    for (size_t i = 1; (2 * i + 1) * (2 * i + 1) <= limit; i++) {
+        if (!composite[i]) {
+            for (size_t j = (2 * i + 1) * (2 * i + 1) / 2; j < half; j += 2 * i + 1) {
+                composite[j] = 1;
+            }
+        }
+    }
+    size_t count = 0;
+    for (size_t i = 8; i < half; i++) {
+        count += !composite[i];
+    }
+    range->primes = (unsigned int *)malloc(sizeof(unsigned int) * (count + 1));
+    if (range->primes == NULL) {
+        free(composite);
+        return 0;
+    }
+    for (size_t i = 8; i < half; i++) {
+        if (!composite[i]) {
+            range->primes[range->numPrimes++] = (unsigned int)(2 * i + 1);
+        }
+    }
+    free(composite);
+    static const unsigned int below17[6] = {2, 3, 5, 7, 11, 13};
+    unsigned long long total = range->numPrimes;
+    for (int i = 0; i < 6; i++) {
+        total += below17[i] <= limit;
+    }
+    return total;
+}
+
+// Sieve segment s into bits and clip it to [low, high]; returns its first wheel byte and *bytes
+static unsigned long long sieveSegment(const RangeSieve *range, unsigned long long s, unsigned char *bits, size_t *bytes) {
+    unsigned long long byte = range->firstByte + s * range->segmentBytes;
+    size_t count = range->lastByte - byte + 1 < range->segmentBytes ? (size_t)(range->lastByte - byte + 1) : range->segmentBytes;
+    *bytes = count;
+
+    size_t offset = (size_t)(byte % PRESIEVE_BYTES);
+    for (size_t done = 0; done < count;) {
+        size_t n = PRESIEVE_BYTES - offset < count - done ? PRESIEVE_BYTES - offset : count - done;
+        memcpy(bits + done, range->presieve + offset, n);
+        done += n;
+        offset = 0;
+    }
+    if (byte == 0) {
+        bits[0] = (unsigned char)((bits[0] & ~0x01) | 0x02 | 0x04 | 0x08);  // 1 is not a prime, 7, 11 and 13 are
+    }
+
+    unsigned long long lowNumber = byte * 30, endNumber = (byte + count) * 30;
+    for (size_t j = 0; j < range->numPrimes; j++) {
+        unsigned long long p = range->primes[j];
+        if (p * p >= endNumber) {
+            break;
+        }
+        unsigned long long kMin = (lowNumber + p - 1) / p;   // Multiples p * k in the segment, from p * p
+        if (kMin < p) {
+            kMin = p;
+        }
+        unsigned long long t = kMin / 30, q = p / 30;
+        unsigned int c = range->wheelIndex[p % 30], fromT = (unsigned int)(kMin - t * 30);
+        unsigned long long first = p * t - byte;   // Byte of p * 30 * t, relative to the segment
+        for (int w = 0; w < 8; w++) {
+            size_t i = (size_t)(first + q * wheelResidue[w] + range->carry[c][w] + (wheelResidue[w] < fromT ? p : 0));
+            unsigned char mask = range->mask[c][w];
+            for (; i < count; i += p) {
+                bits[i] &= mask;
+            }
+        }
+    }
+
+    // The numbers of the first and last byte outside the range
+    for (int b = 0; b < 8; b++) {
+        if (byte == range->firstByte && range->firstByte * 30 + wheelResidue[b] < range->low) {
+            bits[0] &= (unsigned char)~(1 << b);
+        }
+        if (byte + count - 1 == range->lastByte && range->lastByte * 30 + wheelResidue[b] > range->high) {
+            bits[count - 1] &= (unsigned char)~(1 << b);
+        }
+    }
+    return byte;
+}
+
+static unsigned long long countBits(const unsigned char *bits, size_t bytes) {
+    unsigned long long count = 0;
+    size_t i = 0;
+    for (; i + 8 <= bytes; i += 8) {
+        unsigned long long word;
+        memcpy(&word, bits + i, 8);
+        count += __builtin_popcountll(word);
+    }
+    for (; i < bytes; i++) {
+        count += __builtin_popcount(bits[i]);
+    }
+    return count;
+}
+
+// Encode the primes of a sieved segment: decimal lines, or the gaps after the first prime
+// as varints (the gap before the first one is only known when the round is written)
+static int encodeSegment(SegmentOutput *segment, unsigned long long byte, size_t bytes, int format) {
+    unsigned long long count = countBits(segment->sieve, bytes);
+    segment->count = count;
+    size_t need = (size_t)count * (format == RANGE_LIST ? MAX_DIGITS + 1 : MAX_VARINT);
+    if (need > segment->capacity) {
+        unsigned char *grown = (unsigned char *)realloc(segment->data, need);
+        if (grown == NULL) {
+            return 0;
+        }
+        segment->data = grown;
+        segment->capacity = need;
+    }
+    unsigned char *out = segment->data;
+    unsigned long long previous = 0;
+    segment->first = 0;
+    for (size_t i = 0; i < bytes; i += 8) {
+        unsigned long long word = 0;
+        memcpy(&word, segment->sieve + i, bytes - i < 8 ? bytes - i : 8);
+        while (word != 0) {
+            int bit = __builtin_ctzll(word);
+            word &= word - 1;
+            unsigned long long prime = (byte + i + bit / 8) * 30 + wheelResidue[bit % 8];
+            if (format == RANGE_LIST) {
+                out = writeDecimal(out, prime);
+            } else if (previous != 0) {
+                out = writeVarint(out, prime - previous);
+            }
+            if (previous == 0) {
+                segment->first = prime;
+            }
+            previous = prime;
+        }
+    }
+    segment->last = previous;
+    segment->length = (size_t)(out - segment->data);
+    return 1;
+}
+
+// Write prime after *previous in format
+static int writePrime(FILE *out, int format, unsigned long long prime, unsigned long long *previous, RangeStats *stats) {
+    unsigned char buffer[MAX_DIGITS + 1];
+    unsigned char *end = format == RANGE_LIST ? writeDecimal(buffer, prime) : writeVarint(buffer, prime - *previous);
+    *previous = prime;
+    stats->written += end - buffer;
+    return fwrite(buffer, 1, end - buffer, out) == (size_t)(end - buffer);
+}
+
+static int sieveCount(const RangeSieve *range, int threads, RangeStats *stats) {
+    unsigned long long count = 0;
+    int failed = 0;
+#ifndef _OPENMP
+    (void)threads;
+#endif
+    #pragma omp parallel num_threads(threads) reduction(+:count)
+    {
+        unsigned char *bits = (unsigned char *)malloc(range->segmentBytes);
+        if (bits == NULL) {
+            #pragma omp atomic write
+            failed = 1;
+        }
+        #pragma omp for schedule(dynamic)
+        for (long long s = 0; s < (long long)stats->segments; s++) {
+            size_t bytes;
+            if (bits != NULL) {
+                sieveSegment(range, (unsigned long long)s, bits, &bytes);
+                count += countBits(bits, bytes);
+            }
+        }
+        free(bits);
+    }
+    stats->count += count;
+    return !failed;
+}
+
+static int sieveWrite(const RangeSieve *range, int threads, int format, FILE *out, RangeStats *stats) {
+    size_t slots = (size_t)threads * ROUND_SEGMENTS;
+    SegmentOutput *segments = (SegmentOutput *)calloc(slots, sizeof(SegmentOutput));
+    int ok = segments != NULL;
+    for (size_t i = 0; ok && i < slots; i++) {
+        ok = (segments[i].sieve = (unsigned char *)malloc(range->segmentBytes)) != NULL;
+    }
+
+    unsigned long long previous = range->low;   // The delta format starts from low
+    if (ok && format == RANGE_DELTA) {
+        unsigned char header[8 + MAX_VARINT];
+        memcpy(header, RANGE_MAGIC, 8);
+        unsigned char *end = writeVarint(header + 8, range->low);
+        stats->written += end - header;
+        ok = fwrite(header, 1, end - header, out) == (size_t)(end - header);
+    }
+    for (int i = 0; ok && i < 3; i++) {
+        if (smallPrimes[i] >= range->low && smallPrimes[i] <= range->high) {
+            ok = writePrime(out, format, smallPrimes[i], &previous, stats);
+            stats->count++;
+        }
+    }
+
+    for (unsigned long long round = 0; ok && round < stats->segments; round += slots) {
+        long long n = (long long)(stats->segments - round < slots ? stats->segments - round : slots);
+        int failed = 0;
+        #pragma omp parallel for schedule(dynamic) num_threads(threads)
+        for (long long i = 0; i < n; i++) {
+            size_t bytes;
+            unsigned long long byte = sieveSegment(range, round + i, segments[i].sieve, &bytes);
+            if (!encodeSegment(&segments[i], byte, bytes, format)) {
+                #pragma omp atomic write
+                failed = 1;
+            }
+        }
+        ok = !failed;
+        // Write the round in order, the delta format gets the gap before every first prime here
+        for (long long i = 0; ok && i < n; i++) {
+            SegmentOutput *segment = &segments[i];
+            if (segment->count == 0) {
+                continue;
+            }
+            if (format == RANGE_DELTA) {
+                ok = writePrime(out, format, segment->first, &previous, stats);
+            }
+            ok = ok && fwrite(segment->data, 1, segment->length, out) == segment->length;
+            stats->written += segment->length;
+            stats->count += segment->count;
+            previous = segment->last;
+        }
+    }
+
+    for (size_t i = 0; segments != NULL && i < slots; i++) {
+        free(segments[i].sieve);
+        free(segments[i].data);
+    }
+    free(segments);
+    return ok && fflush(out) == 0;
+}
+
+int rangeSieve(unsigned long long low, unsigned long long high, size_t segmentBytes, int threads, int format, FILE *out, RangeStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (segmentBytes == 0) {
+        segmentBytes = (size_t)squareRoot(high);
+        segmentBytes = segmentBytes < MIN_SEGMENT_KB * 1024 ? MIN_SEGMENT_KB * 1024
+                     : segmentBytes > MAX_SEGMENT_KB * 1024 ? MAX_SEGMENT_KB * 1024 : segmentBytes & ~(size_t)1023;
+    }
+    if (low > high || high > RANGE_MAX || segmentBytes < 64) {
+        fprintf(stderr, "Error: the range must be low <= high <= %llu, with segments of at least 64 bytes\n", RANGE_MAX);
+        return 0;
+    }
+    double started = nowSeconds();
+#ifdef _OPENMP
+    threads = threads > 0 ? threads : omp_get_max_threads();
+#else
+    threads = 1;
+#endif
+
+    RangeSieve range;
+    memset(&range, 0, sizeof(range));
+    range.low = low;
+    range.high = high;
+    range.firstByte = low / 30;
+    range.lastByte = high / 30;
+    range.segmentBytes = segmentBytes;
+    memset(range.presieve, 0xFF, sizeof(range.presieve));
+    for (unsigned long long q = 7; q <= 13; q += q == 7 ? 4 : 2) {
+        for (unsigned long long m = q; m < PRESIEVE_BYTES * 30; m += q) {
+            range.presieve[m / 30] &= (unsigned char)~wheelBit[m % 30];
+        }
+    }
+    for (int c = 0; c < 8; c++) {
+        range.wheelIndex[wheelResidue[c]] = (unsigned char)c;
+        for (int w = 0; w < 8; w++) {
+            unsigned int product = wheelResidue[c] * wheelResidue[w];
+            range.carry[c][w] = (unsigned char)(product / 30);
+            range.mask[c][w] = (unsigned char)~wheelBit[product % 30];
+        }
+    }
+    stats->basePrimes = sieveBasePrimes(&range, squareRoot(high));
+    stats->baseSeconds = nowSeconds() - started;
+    if (range.primes == NULL) {
+        fprintf(stderr, "Error: failed to allocate the base primes\n");
+        return 0;
+    }
+    stats->segments = (range.lastByte - range.firstByte) / segmentBytes + 1;
+    stats->segmentBytes = segmentBytes;
+    stats->threads = threads;
+
+    int ok;
+    if (format == RANGE_COUNT) {
+        for (int i = 0; i < 3; i++) {
+            stats->count += smallPrimes[i] >= low && smallPrimes[i] <= high;
+        }
+        ok = sieveCount(&range, threads, stats);
+    } else {
+        ok = sieveWrite(&range, threads, format, out, stats);
+    }
+    if (!ok) {
+        fprintf(stderr, "Error: failed to sieve or write the range\n");
+    }
+    free(range.primes);
+    stats->seconds = nowSeconds() - started;
+    return ok;
+}
+
+unsigned long long knownPrimeCount(unsigned long long x) {
+    // pi(10^k) for k = 1 .. 16
+    static const unsigned long long powersOfTen[16] = {
+        4ULL, 25ULL, 168ULL, 1229ULL, 9592ULL, 78498ULL, 664579ULL, 5761455ULL, 50847534ULL, 455052511ULL,
+        4118054813ULL, 37607912018ULL, 346065536839ULL, 3204941750802ULL, 29844570422669ULL, 279238341033925ULL
+    };
+    if (x == 4294967296ULL) {
+        return 203280221ULL;    // pi(2^32)
+    }
+    unsigned long long power = 10;
+    for (int k = 0; k < 16; k++, power *= 10) {
+        if (x == power) {
+            return powersOfTen[k];
+        }
+    }
+    return 0;
+}
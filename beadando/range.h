@@ -0,0 +1,49 @@
+/* range.h */
+/* This header file declares the range mode, a segmented sieve of Eratosthenes:
+   - Every prime of [low, high] is found, not one random candidate tested with Miller-Rabin
+   - The range is sieved in cache-sized segments, a byte holds the 8 numbers of 30 that are
+     coprime to 2, 3 and 5 (mod 30 wheel), so a 32 kB segment covers 983040 numbers
+   - The base primes up to sqrt(high) are sieved once and shared read-only by the threads
+   - The segments are spread over the OpenMP threads, the primes are counted, or written
+     in order as a decimal list or a delta-encoded file
+*/
+
+#ifndef RANGE_H
+#define RANGE_H
+
+#include <stdio.h>                  // FILE
+
+// Output formats
+#define RANGE_COUNT 0               // Only the number of primes
+#define RANGE_LIST 1                // One decimal prime per line
+#define RANGE_DELTA 2               // RANGE_MAGIC, then low and the gap before every prime as varints
+
+#define RANGE_MAGIC "PRIMEGAP"      // First 8 bytes of a delta file
+#define MIN_SEGMENT_KB 32           // Smallest automatic segment: the L1 data cache of most cores
+#define MAX_SEGMENT_KB 1024         // Largest automatic segment: the L2 cache of most cores
+#define RANGE_MAX 10000000000000000ULL  // 10^16, the base primes stay below 10^8
+
+// What a range run did
+typedef struct {
+    unsigned long long count;       // Primes in the range
+    unsigned long long segments;    // Segments sieved
+    size_t segmentBytes;            // Bytes per segment
+    int threads;                    // OpenMP threads
+    unsigned long long basePrimes;  // Sieving primes up to sqrt(high)
+    double baseSeconds;             // Time of sieving the base primes
+    double seconds;                 // Time of everything, with the output
+    unsigned long long written;     // Bytes written in the list and delta formats
+} RangeStats;
+
+// Sieve [low, high] (high at most RANGE_MAX) with segments of segmentBytes bytes on threads
+// threads (0 = OpenMP's default). With segmentBytes 0 a segment gets about sqrt(high) bytes
+// between MIN_SEGMENT_KB and MAX_SEGMENT_KB, so the largest base primes still hit every
+// segment a few times. The primes go to out in format, out is not used with
+// RANGE_COUNT. Returns 1 on success, 0 on failure.
+int rangeSieve(unsigned long long low, unsigned long long high, size_t segmentBytes, int threads, int format, FILE *out, RangeStats *stats);
+
+// The number of primes up to x if it is in the table of known values (the powers of ten
+// up to 10^16 and 2^32), 0 otherwise
+unsigned long long knownPrimeCount(unsigned long long x);
+
+#endif // RANGE_H
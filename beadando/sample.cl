@@ -1,44 +1,80 @@
 /* sample.cl */
 /* This file contains the OpenCL kernel source code that implements the Miller-Rabin primality test.
-   It includes a function for modular exponentiation and a kernel to test a candidate number with a witness.
+   It includes Montgomery multiplication and exponentiation, which are exact for the whole 64-bit range,
+   a kernel to test a candidate number with a witness and a kernel to test many candidates at once.
 */
 
 #pragma OPENCL EXTENSION cl_khr_int64 : enable  // Enable support for 64-bit integers
 
-// Function to perform modular exponentiation: computes (base^exp) mod mod
-ulong modexp(ulong base, ulong exp, ulong mod) {
-    ulong result = 1;         // Initialize result to 1
-    base = base % mod;        // Reduce base modulo mod
+// Montgomery product a * b / 2^64 mod n, for a, b < n and odd n.
+// nInv = -n^-1 mod 2^64 is precomputed on the host. The 128-bit products are
+// split into mul_hi (high half) and the plain ulong product (low half).
+ulong montMul(ulong a, ulong b, ulong n, ulong nInv) {
+    ulong lo = a * b;           // Low half of a * b
+    ulong hi = mul_hi(a, b);    // High half of a * b
+    ulong m = lo * nInv;        // a * b + m * n is divisible by 2^64
+    // The low halves cancel: lo + low(m * n) is 0 or 2^64, so it carries one unless lo is 0
+    ulong u = mul_hi(m, n) + (lo != 0);
+    ulong t = hi + u;           // (a * b + m * n) / 2^64 < 2n, may overflow 64 bits
+    if(t < hi || t >= n)        // Bring it back below n
+        t -= n;
+    return t;
+}
+
+// Function to perform modular exponentiation in Montgomery form: computes base^exp,
+// where base and the result are in Montgomery form and one is 2^64 mod n
+ulong montModexp(ulong base, ulong exp, ulong n, ulong nInv, ulong one) {
+    ulong result = one;       // Initialize result to 1 (in Montgomery form)
     while(exp > 0) {          // Loop until exponent becomes 0
         if(exp & 1)         // If the lowest bit of exp is 1
-            result = (result * base) % mod;  // Multiply result by base modulo mod
+            result = montMul(result, base, n, nInv);  // Multiply result by base modulo n
         exp = exp >> 1;      // Shift exponent right by 1 bit (divide by 2)
-        base = (base * base) % mod;  // Square the base modulo mod
+        base = montMul(base, base, n, nInv);  // Square the base modulo n
     }
     return result;            // Return the final result of modular exponentiation
 }
 
-// Kernel to perform the Miller-Rabin test for one witness
-__kernel void millerRabinTest(__global const ulong *p, __global const ulong *witness, const ulong d, const int s, __global int *results) {
-    int i = get_global_id(0);   // Get the unique ID of the work-item
-    ulong candidate = p[0];     // Retrieve the candidate prime number from global memory
-    ulong a = witness[i];       // Retrieve the witness value corresponding to this work-item
-    ulong x = modexp(a, d, candidate);  // Compute x = a^d mod candidate
-    if(x == 1 || x == candidate - 1) {   // If x is 1 or candidate-1, the test passes for this witness
-        results[i] = 1;        // Mark result as 'probably prime' for this witness
-        return;                // Exit the kernel
-    }
+// One Miller-Rabin round of witness a on odd n > 2, where n - 1 = d * 2^s and r2 = 2^128 mod n.
+// Returns 1 if n passes (probably prime), 0 if a proves n composite.
+int millerRabinRound(ulong n, ulong a, ulong d, int s, ulong nInv, ulong r2) {
+    a = a % n;
+    if(a == 0)                  // Only for a base that is a multiple of n, it proves nothing
+        return 1;
+    ulong one = montMul(1, r2, n, nInv);        // 1 in Montgomery form (2^64 mod n)
+    ulong minusOne = n - one;                   // n - 1 in Montgomery form
+    ulong x = montModexp(montMul(a, r2, n, nInv), d, n, nInv, one);  // Compute x = a^d mod n
+    if(x == one || x == minusOne)   // If x is 1 or n-1, the test passes for this witness
+        return 1;
     // Loop from r = 1 to s-1 to perform further checks
     for(int r = 1; r < s; r++) {
-        x = (x * x) % candidate;  // Square x modulo candidate
-        if(x == candidate - 1) {    // If x becomes candidate-1, the test passes
-            results[i] = 1;         // Mark result as 'probably prime'
-            return;                 // Exit the kernel
-        }
-        if(x == 1) {                // If x becomes 1 before candidate-1, candidate is composite
-            results[i] = 0;         // Mark result as composite
-            return;                 // Exit the kernel
-        }
+        x = montMul(x, x, n, nInv); // Square x modulo n
+        if(x == minusOne)           // If x becomes n-1, the test passes
+            return 1;
+        if(x == one)                // If x becomes 1 before n-1, n is composite
+            return 0;
     }
-    results[i] = 0;  // If none of the conditions are met, mark candidate as composite
+    return 0;  // If none of the conditions are met, n is composite
+}
+
+// Kernel to perform the Miller-Rabin test for one witness
+__kernel void millerRabinTest(__global const ulong *p, __global const ulong *witness, const ulong d, const int s,
+                              const ulong nInv, const ulong r2, __global int *results) {
+    int i = get_global_id(0);   // Get the unique ID of the work-item
+    ulong candidate = p[0];     // Retrieve the candidate prime number from global memory
+    // Mark result as 'probably prime' (1) or composite (0) for this witness
+    results[i] = millerRabinRound(candidate, witness[i], d, s, nInv, r2);
+}
+
+// Kernel to test many candidates in one launch: work-item (i, j) runs witness j on candidate i.
+// composite[i] is set by the first witness that proves candidate i composite, the work-items
+// of that candidate that start later see the flag and skip their test.
+__kernel void millerRabinBatch(__global const ulong *candidates, __global const ulong *ds, __global const int *ss,
+                               __global const ulong *nInvs, __global const ulong *r2s,
+                               __global const ulong *witnesses, __global volatile int *composite) {
+    int i = get_global_id(0);   // Candidate of this work-item
+    int j = get_global_id(1);   // Witness of this work-item
+    if(composite[i])            // Another witness already failed the candidate
+        return;
+    if(!millerRabinRound(candidates[i], witnesses[j], ds[i], ss[i], nInvs[i], r2s[i]))
+        composite[i] = 1;       // Every writer stores 1, no atomic is needed
 }
@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+"""Benchmark of the native KNN engine (KNN/libknn.so) against the Python path of knn.py.
+
+A synthetic data set of 80x60x3 uint8 images (one noisy copy of a random
+prototype per class, plus exact duplicates for equal distances) is classified
+with KNN.predict: once with the Python path (cdist and the repeated minimum
+search, in processes) for every thread count, and once with the native engine
+for every distance kernel the CPU supports. The predicted classes and the
+neighbour lists of every native run have to match the Python path exactly.
+"""
+
+import argparse
+import json
+import os
+import platform
+import sys
+import time
+
+import numpy as np
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path.insert(0, os.path.join(ROOT, "KNN"))
+import knn  # noqa: E402
+
+CLASSES = ["Handbags", "Sandals", "Jeans", "Dresses", "Heels", "Socks", "Flip Flops", "Shirts"]
+KERNELS = ["scalar", "avx2", "avx512"]
+
+
+def generate(train, test, seed):
+    """Train and test images of noisy class prototypes, some test images copied from the training set."""
+    rng = np.random.default_rng(seed)
+    prototypes = rng.integers(0, 256, (len(CLASSES), 80, 60, 3))
+
+    def images(count):
+        classes = rng.integers(0, len(CLASSES), count)
+        noise = rng.integers(-96, 97, (count, 80, 60, 3))
+        return np.clip(prototypes[classes] + noise, 0, 255).astype(np.uint8), np.array(CLASSES)[classes]
+
+    train_imgs, train_labels = images(train)
+    test_imgs, _ = images(test)
+    # Equal distances: duplicated training images, and test images that are exact copies of them
+    for i in range(0, min(train, test) // 8 * 8, 8):
+        train_imgs[i + 1] = train_imgs[i]
+        test_imgs[i] = train_imgs[i]
+    return train_imgs, train_labels, test_imgs
+
+
+def timed_predict(model, test_imgs, k, threads, runs):
+    """Best time of runs predictions, with the classes and neighbours of the last one."""
+    best = None
+    for _ in range(runs):
+        start = time.perf_counter()
+        classes = model.predict(test_imgs, k, threads)
+        seconds = time.perf_counter() - start
+        best = seconds if best is None else min(best, seconds)
+    return best, classes.tolist(), model.neighbors
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--train", type=int, default=2000, help="training images")
+    parser.add_argument("--test", type=int, default=200, help="test images")
+    parser.add_argument("--k", default="2 5", help="neighbour counts (knn.py uses 2)")
+    parser.add_argument("--threads", default="1 4", help="processes of the Python path and threads of the native engine")
+    parser.add_argument("--runs", type=int, default=3, help="native runs per configuration, the best counts")
+    parser.add_argument("--out", default=os.path.join(ROOT, "bench", "results_knn"), help="writes OUT.json")
+    args = parser.parse_args()
+    if knn.NATIVE is None:
+        print("KNN/libknn.so is not built, run make in the KNN folder")
+        return 1
+
+    train_imgs, train_labels, test_imgs = generate(args.train, args.test, 7)
+    print("KNN: %d training and %d test images of 80x60x3" % (args.train, args.test))
+    python_model = knn.KNN(train_imgs, train_labels, engine="python")
+    native_model = knn.KNN(train_imgs, train_labels, engine="native")
+    results = []
+    failures = 0
+    for k in map(int, args.k.split()):
+        for threads in map(int, args.threads.split()):
+            python_s, classes, neighbours = timed_predict(python_model, test_imgs, k, threads, 1)
+            results.append(dict(engine="python", kernel="", k=k, threads=threads, seconds=python_s, speedup=1.0, same=True))
+            print("python      k=%d %2d thr: %.3f s, %.1f images/s" % (k, threads, python_s, args.test / python_s))
+            for kernel in KERNELS:
+                if not knn.NATIVE.knn_use_kernel(kernel.encode()):
+                    continue
+                native_s, native_classes, native_neighbours = timed_predict(native_model, test_imgs, k, threads, args.runs)
+                same = native_classes == classes and native_neighbours == neighbours
+                failures += not same
+                results.append(dict(engine="native", kernel=kernel, k=k, threads=threads, seconds=native_s,
+                                    speedup=python_s / native_s, same=same))
+                print("native %-6s k=%d %2d thr: %.3f s, %.1f images/s, %.1fx over python%s" % (
+                    kernel, k, threads, native_s, args.test / native_s, python_s / native_s,
+                    "" if same else "  PREDICTIONS DIFFER"))
+                sys.stdout.flush()
+            knn.NATIVE.knn_use_kernel(b"auto")
+
+    report = {
+        "host": {"machine": platform.machine(), "system": platform.platform(), "cpus": os.cpu_count()},
+        "time": time.strftime("%Y-%m-%dT%H:%M:%S"),
+        "train": args.train,
+        "test": args.test,
+        "results": results,
+    }
+    with open(args.out + ".json", "w") as out:
+        json.dump(report, out, indent=1)
+    print("Results written to %s.json" % args.out)
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
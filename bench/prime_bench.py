@@ -0,0 +1,412 @@
+#!/usr/bin/env python3
+"""Benchmark and cross-check of the multi-precision prime finder (beadando --big).
+
+For every bit size the prime finder is run with each engine (one candidate per
+work-item or per work-group) and its primes/s are recorded. Every prime it
+reports is checked with Python's own big integers: exact bit length, no small
+factor and a Miller-Rabin test with independent random bases. Then the kernels'
+verdicts (--check) are compared with Python on sieve-surviving random odd
+numbers, the primes found and products of two primes of half the size.
+
+With --backends the 64-bit modes are compared instead: for every bit width
+main.exe --bench finds the same run of consecutive primes with the OpenCL
+loop, the batched OpenCL kernel, the pipelined batches and the native SIMD
+backend, and their candidates/s are recorded. Without an OpenCL platform only the native backend
+runs.
+
+With --startup the program binary cache is measured: every kernel program
+(sample.cl, and bignum.cl at each size) is started once with an empty cache
+(built from source) and then --runs times with the cache filled.
+
+With --range the segmented sieve (main.exe --range) counts the primes of every
+range with every segment size, and its numbers/s are recorded. Ranges from 0
+to a power of ten are checked against pi(x) by main.exe itself, and the first
+million numbers of every range are written in the delta format, decoded and
+compared with a sieve in Python.
+"""
+
+import argparse
+import csv
+import json
+import math
+import os
+import platform
+import random
+import re
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+BEADANDO = os.path.join(ROOT, "beadando")
+BINARY = os.path.join(BEADANDO, "main.exe")
+SMALL_PRIMES = [p for p in range(3, 65536, 2) if all(p % q for q in range(3, int(p ** 0.5) + 1, 2))]
+PRIMORIAL = 1
+for _p in SMALL_PRIMES:
+    PRIMORIAL *= _p
+
+#engine name -> extra command line switches
+ENGINES = {
+    "item": ["--per", "item"],
+    "group": ["--per", "group"],
+    "auto": [],
+}
+BENCH_PATTERN = r"^(loop|batch|pipeline|native) *: (\d+) primes, (\d+) odd candidates in ([0-9.]+) s, ([0-9.]+) candidates/s"
+DIFFERING_PATTERN = r"(\d+) differing primes"
+STARTUP_PATTERN = r"Startup: ([0-9.]+) s \((\S+) (loaded from the binary cache|built from source) in ([0-9.]+) s"
+RANGE_PATTERN = (r"Range \[(\d+), (\d+)\]: (\d+) primes in ([0-9.]+) s, ([0-9.]+) numbers/s, ([0-9.]+) primes/s "
+                 r"\((\w+), (\d+) segments of (\d+) kB, (\d+) threads")
+CHECK_PATTERN = r"check: pi\((\d+)\) = (\d+), (matches|DIFFERS)"
+FOUND_PATTERN = r"Found (\d+) primes of (\d+) bits in ([0-9.]+) s: ([0-9.]+) primes/s \((\d+) launches, (\d+) of (\d+) sieved"
+
+
+def is_probable_prime(n, rounds, rng):
+    """Reference Miller-Rabin on Python integers, with its own random bases."""
+    if n < 2 or n % 2 == 0:
+        return n == 2
+    d, s = n - 1, 0
+    while d % 2 == 0:
+        d //= 2
+        s += 1
+    for _ in range(rounds):
+        x = pow(rng.randrange(2, n - 1), d, n)
+        if x in (1, n - 1):
+            continue
+        for _ in range(s - 1):
+            x = x * x % n
+            if x == n - 1:
+                break
+        else:
+            return False
+    return True
+
+
+def run_engine(binary, engine, bits, count, window, out_path):
+    command = [binary, "--big", "--count", str(count), "--window", str(window), "--out", out_path] + ENGINES[engine] + [str(bits)]
+    start = time.perf_counter()
+    result = subprocess.run(command, cwd=BEADANDO, capture_output=True, text=True)
+    wall = time.perf_counter() - start
+    match = re.search(FOUND_PATTERN, result.stdout)
+    if result.returncode != 0 or not match:
+        raise RuntimeError("%s failed: %s" % (" ".join(command), result.stdout + result.stderr))
+    with open(out_path) as f:
+        primes = [int(line, 16) for line in f if line.strip()]
+    return {
+        "seconds": float(match.group(3)),
+        "wall_s": wall,
+        "primes_per_s": float(match.group(4)),
+        "launches": int(match.group(5)),
+        "tested": int(match.group(6)),
+        "sieved": int(match.group(7)),
+    }, primes
+
+
+def check_primes(primes, bits, rng):
+    """Number of reported primes that are wrong."""
+    wrong = 0
+    for p in primes:
+        if p.bit_length() != bits or math.gcd(p, PRIMORIAL) != 1 or not is_probable_prime(p, 8, rng):
+            wrong += 1
+    return wrong
+
+
+def check_verdicts(binary, engine, bits, numbers, rng, work_dir):
+    """Numbers on which the kernel and Python disagree."""
+    in_path = os.path.join(work_dir, "check_%d.txt" % bits)
+    with open(in_path, "w") as f:
+        f.writelines("%x\n" % n for n in numbers)
+    out_path = os.path.join(work_dir, "verdicts_%d.txt" % bits)
+    command = [binary, "--big", "--check", in_path, "--out", out_path] + ENGINES[engine] + [str(bits)]
+    result = subprocess.run(command, cwd=BEADANDO, capture_output=True, text=True)
+    if result.returncode != 0:
+        raise RuntimeError("%s failed: %s" % (" ".join(command), result.stdout + result.stderr))
+    mismatches = []
+    with open(out_path) as f:
+        for line in f:
+            verdict, number = line.split()
+            n = int(number, 16)
+            if int(verdict) != is_probable_prime(n, 8, rng):
+                mismatches.append(n)
+    return mismatches
+
+
+def sieved_random(bits, rng):
+    """Random odd number of exactly bits bits without a factor below 65536."""
+    while True:
+        n = rng.getrandbits(bits) | (1 << (bits - 1)) | 1
+        if math.gcd(n, PRIMORIAL) == 1:
+            return n
+
+
+def run_backends(binary, bits, primes, window, threads, depth):
+    """candidates/s of every backend main.exe --bench runs, and the primes they disagree on."""
+    command = [binary, "--bench", str(primes), "--window", str(window), "--depth", str(depth)]
+    if threads:
+        command += ["--threads", str(threads)]
+    command.append(str(bits))
+    result = subprocess.run(command, cwd=BEADANDO, capture_output=True, text=True)
+    rows = [dict(backend=m.group(1), bits=bits, primes=int(m.group(2)), candidates=int(m.group(3)),
+                 seconds=float(m.group(4)), candidates_per_s=float(m.group(5)))
+            for m in re.finditer(BENCH_PATTERN, result.stdout, re.MULTILINE)]
+    if result.returncode != 0 or not rows:
+        raise RuntimeError("%s failed: %s" % (" ".join(command), result.stdout + result.stderr))
+    differing = re.search(DIFFERING_PATTERN, result.stdout)
+    return rows, int(differing.group(1)) if differing else 0
+
+
+def bench_backends(args):
+    """The --backends sweep over the 64-bit widths."""
+    results = []
+    failures = 0
+    for bits in map(int, args.widths.split()):
+        rows, differing = run_backends(args.binary, bits, args.primes, args.window, args.threads, args.depth)
+        failures += differing != 0
+        for row in rows:
+            row["speedup"] = row["candidates_per_s"] / rows[0]["candidates_per_s"]
+            results.append(row)
+            print("%-6s %2d bits: %d primes, %d odd candidates in %.3f s, %.0f candidates/s, %.1fx over %s" % (
+                row["backend"], bits, row["primes"], row["candidates"], row["seconds"], row["candidates_per_s"],
+                row["speedup"], rows[0]["backend"]))
+        if differing:
+            print("%2d bits: %d differing primes" % (bits, differing))
+        sys.stdout.flush()
+
+    write_report(args, dict(primes=args.primes, window=args.window, threads=args.threads, depth=args.depth), results,
+                 ["backend", "bits", "primes", "candidates", "seconds", "candidates_per_s", "speedup"])
+    return 1 if failures else 0
+
+
+def run_startup(binary, arguments, cache_dir):
+    """Startup time, program load or build time and whether the program came from the cache."""
+    command = [binary, "--cache", cache_dir] + arguments
+    result = subprocess.run(command, cwd=BEADANDO, capture_output=True, text=True)
+    match = re.search(STARTUP_PATTERN, result.stdout)
+    if result.returncode != 0 or not match:
+        raise RuntimeError("%s failed: %s" % (" ".join(command), result.stdout + result.stderr))
+    return float(match.group(1)), float(match.group(4)), match.group(3).startswith("loaded")
+
+
+def bench_startup(args, work_dir):
+    """The --startup comparison of cold (empty cache) and warm starts."""
+    cases = [("sample.cl", 64, ["--verify", "0", "64"])]
+    cases += [("bignum.cl", bits, ["--big", "--count", "1", str(bits)]) for bits in map(int, args.sizes.split())]
+    results = []
+    failures = 0
+    for program, bits, arguments in cases:
+        cache_dir = tempfile.mkdtemp(dir=work_dir)
+        cold, cold_build, cold_cached = run_startup(args.binary, arguments, cache_dir)
+        warm_runs = [run_startup(args.binary, arguments, cache_dir) for _ in range(args.runs)]
+        warm = statistics.median(run[0] for run in warm_runs)
+        warm_load = statistics.median(run[1] for run in warm_runs)
+        hits = sum(run[2] for run in warm_runs)
+        failures += cold_cached or hits != args.runs
+        row = dict(program=program, bits=bits, cold_s=cold, cold_build_s=cold_build, warm_s=warm, warm_load_s=warm_load,
+                   warm_hits=hits, runs=args.runs)
+        results.append(row)
+        print("%-9s %4d bits: cold %.3f s (build %.3f s), warm %.3f s (load %.3f s), %.1fx, %d of %d warm runs from the cache" % (
+            program, bits, cold, cold_build, warm, warm_load, cold / warm if warm > 0 else 0.0, hits, args.runs))
+        sys.stdout.flush()
+    write_report(args, dict(runs=args.runs), results,
+                 ["program", "bits", "cold_s", "cold_build_s", "warm_s", "warm_load_s", "warm_hits", "runs"])
+    return 1 if failures else 0
+
+
+def parse_bound(text):
+    """A bound like main.exe --range takes it: 1000, 1e12 or 1e12+1e10."""
+    total = 0
+    for term in text.split("+"):
+        base, _, exponent = term.partition("e")
+        total += int(base) * 10 ** int(exponent or 0)
+    return total
+
+
+def primes_between(low, high):
+    """The primes of [low, high] with a plain segment sieve on Python integers."""
+    limit = math.isqrt(high)
+    base = bytearray([1]) * (limit + 1)
+    for i in range(2, math.isqrt(limit) + 1):
+        if base[i]:
+            base[i * i::i] = bytes(len(range(i * i, limit + 1, i)))
+    marks = bytearray([1]) * (high - low + 1)
+    for n in range(low, min(2, high + 1)):
+        marks[n - low] = 0
+    for p in range(2, limit + 1):
+        if base[p]:
+            start = max(p * p, (low + p - 1) // p * p)
+            marks[start - low::p] = bytes(len(range(start, high + 1, p)))
+    return [low + i for i, mark in enumerate(marks) if mark]
+
+
+def read_delta(path):
+    """The primes of a main.exe --format delta file."""
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[:8] != b"PRIMEGAP":
+        raise RuntimeError("%s is not a delta file" % path)
+    values, value, shift = [], 0, 0
+    for byte in data[8:]:
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            values.append(value)
+            value, shift = 0, 0
+    primes, previous = [], values[0]
+    for gap in values[1:]:
+        previous += gap
+        primes.append(previous)
+    return primes
+
+
+def run_range(binary, low, high, segment, threads, extra):
+    command = [binary, "--range", str(low), str(high), "--segment", str(segment)] + extra
+    if threads:
+        command += ["--threads", str(threads)]
+    result = subprocess.run(command, cwd=BEADANDO, capture_output=True, text=True)
+    match = re.search(RANGE_PATTERN, result.stdout)
+    if result.returncode != 0 or not match:
+        raise RuntimeError("%s failed: %s" % (" ".join(command), result.stdout + result.stderr))
+    check = re.search(CHECK_PATTERN, result.stdout)
+    return dict(low=low, high=high, count=int(match.group(3)), seconds=float(match.group(4)),
+                numbers_per_s=float(match.group(5)), primes_per_s=float(match.group(6)), segments=int(match.group(8)),
+                segment_kb=int(match.group(9)), threads=int(match.group(10)),
+                checked=check.group(3) if check else "")
+
+
+def bench_range(args, work_dir):
+    """The --range sweep over the ranges and segment sizes."""
+    results = []
+    failures = 0
+    for text in args.ranges.split():
+        low, high = (parse_bound(bound) for bound in text.split(":"))
+        counts = set()
+        for segment in map(int, args.segments.split()):
+            row = run_range(args.binary, low, high, segment, args.threads, [])
+            counts.add(row["count"])
+            results.append(row)
+            print("[%d, %d] %4d kB segments: %d primes in %.3f s, %.0f numbers/s%s" % (
+                low, high, row["segment_kb"], row["count"], row["seconds"], row["numbers_per_s"],
+                ", pi(x) " + row["checked"] if row["checked"] else ""))
+            sys.stdout.flush()
+        # The delta output of the first million numbers against Python
+        sample_high = min(high, low + 10 ** 6 - 1)
+        delta_path = os.path.join(work_dir, "range.bin")
+        run_range(args.binary, low, sample_high, 0, args.threads, ["--format", "delta", "--out", delta_path])
+        wrong = read_delta(delta_path) != primes_between(low, sample_high)
+        failures += len(counts) != 1 or wrong
+        print("[%d, %d]: %s, delta output of [%d, %d] %s" % (
+            low, high, "same count with every segment size" if len(counts) == 1 else "COUNTS DIFFER",
+            low, sample_high, "DIFFERS from Python" if wrong else "matches Python"))
+    write_report(args, dict(threads=args.threads), results,
+                 ["low", "high", "count", "seconds", "numbers_per_s", "primes_per_s", "segments", "segment_kb", "threads", "checked"])
+    return 1 if failures else 0
+
+
+def write_report(args, settings, results, columns):
+    """OUT.json with the host and the settings, OUT.csv with the given columns."""
+    report = {
+        "host": {
+            "machine": platform.machine(),
+            "system": platform.platform(),
+            "cpus": os.cpu_count(),
+        },
+        "time": time.strftime("%Y-%m-%dT%H:%M:%S"),
+    }
+    report.update(settings)
+    report["results"] = results
+    with open(args.out + ".json", "w") as out:
+        json.dump(report, out, indent=1)
+    with open(args.out + ".csv", "w", newline="") as out:
+        writer = csv.writer(out)
+        writer.writerow(columns)
+        for row in results:
+            writer.writerow(["%.6f" % row[c] if isinstance(row[c], float) else row[c] for c in columns])
+    print("Results written to %s.json and %s.csv" % (args.out, args.out))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--sizes", default="256 512 1024 2048 4096", help="bit sizes")
+    parser.add_argument("--engines", default="item group")
+    parser.add_argument("--count", type=int, default=16, help="primes per run")
+    parser.add_argument("--window", type=int, default=8192, help="odd candidates sieved per launch")
+    parser.add_argument("--check", type=int, default=32, help="random numbers per size for --check")
+    parser.add_argument("--binary", default=BINARY)
+    parser.add_argument("--out", default=os.path.join(ROOT, "bench", "results_primes"), help="writes OUT.json and OUT.csv")
+    parser.add_argument("--backends", action="store_true", help="compare the 64-bit backends instead")
+    parser.add_argument("--widths", default="16 32 48 64", help="bit widths of --backends")
+    parser.add_argument("--primes", type=int, default=1000, help="consecutive primes per width in --backends")
+    parser.add_argument("--threads", type=int, default=0, help="threads of the native backend, 0 = all cores")
+    parser.add_argument("--depth", type=int, default=3, help="windows in flight in the pipelined mode")
+    parser.add_argument("--startup", action="store_true", help="compare cold and warm starts of the binary cache instead")
+    parser.add_argument("--runs", type=int, default=5, help="warm starts per program in --startup")
+    parser.add_argument("--range", action="store_true", help="measure the segmented range sieve instead")
+    parser.add_argument("--ranges", default="0:1e9 1e12:1e12+1e9", help="low:high ranges of --range")
+    parser.add_argument("--segments", default="0 32 256 1024", help="segment sizes of --range in kB, 0 = automatic")
+    args = parser.parse_args()
+    if args.backends:
+        return bench_backends(args)
+    if args.range:
+        with tempfile.TemporaryDirectory() as work_dir:
+            return bench_range(args, work_dir)
+    if args.startup:
+        with tempfile.TemporaryDirectory() as work_dir:
+            return bench_startup(args, work_dir)
+
+    rng = random.Random(11)
+    results = []
+    failures = 0
+    sizes = list(map(int, args.sizes.split()))
+    with tempfile.TemporaryDirectory() as work_dir:
+        for bits in sizes:
+            found = []
+            for engine in args.engines.split():
+                stats, primes = run_engine(args.binary, engine, bits, args.count, args.window, os.path.join(work_dir, "primes.txt"))
+                wrong = check_primes(primes, bits, rng)
+                found += primes
+                failures += wrong != 0 or len(primes) != args.count
+                row = dict(engine=engine, bits=bits, count=len(primes), wrong=wrong, **stats)
+                results.append(row)
+                print("%-6s %5d bits: %3d primes in %.3f s, %.3f primes/s, %d launches, %d of %d sieved tested%s" % (
+                    engine, bits, len(primes), stats["seconds"], stats["primes_per_s"], stats["launches"], stats["tested"],
+                    stats["sieved"], "" if wrong == 0 else "  %d NOT PRIME" % wrong))
+                sys.stdout.flush()
+            #products of two primes of half the size, kept when they have exactly bits bits
+            semiprimes = []
+            if bits // 2 >= 65:
+                _, halves = run_engine(args.binary, args.engines.split()[0], bits // 2, 8, args.window, os.path.join(work_dir, "halves.txt"))
+                semiprimes = [p * q for p, q in zip(halves[0::2], halves[1::2]) if (p * q).bit_length() == bits]
+            numbers = [sieved_random(bits, rng) for _ in range(args.check)] + found[:args.check] + semiprimes
+            for engine in args.engines.split():
+                mismatches = check_verdicts(args.binary, engine, bits, numbers, rng, work_dir)
+                failures += len(mismatches) != 0
+                print("%-6s %5d bits: --check on %d numbers (%d semiprimes), %d disagree with Python%s" % (
+                    engine, bits, len(numbers), len(semiprimes), len(mismatches),
+                    "".join("\n  0x%x" % n for n in mismatches[:4])))
+
+    report = {
+        "host": {
+            "machine": platform.machine(),
+            "system": platform.platform(),
+            "cpus": os.cpu_count(),
+        },
+        "time": time.strftime("%Y-%m-%dT%H:%M:%S"),
+        "count": args.count,
+        "window": args.window,
+        "results": results,
+    }
+    with open(args.out + ".json", "w") as out:
+        json.dump(report, out, indent=1)
+    with open(args.out + ".csv", "w", newline="") as out:
+        writer = csv.writer(out)
+        writer.writerow(["engine", "bits", "count", "wrong", "seconds", "primes_per_s", "launches", "tested", "sieved"])
+        for row in results:
+            writer.writerow([row["engine"], row["bits"], row["count"], row["wrong"], "%.6f" % row["seconds"],
+                             "%.4f" % row["primes_per_s"], row["launches"], row["tested"], row["sieved"]])
+    print("Results written to %s.json and %s.csv" % (args.out, args.out))
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,199 @@
+#!/usr/bin/env python3
+"""Benchmark sweep of the text finder engines (serial, pthreads, pthreads pool, OpenMP).
+
+Inputs are generated once per (size, pattern length, density) and cached in the
+data directory: random lowercase text with the target planted a known number of
+times, so every run is also checked against the expected count. Every
+configuration gets warm-up runs (which also warm the page cache) followed by the
+measured runs. Load (mapping) and scan time are taken from the engines' own
+output, wall time is measured around the process.
+"""
+
+import argparse
+import csv
+import json
+import os
+import platform
+import random
+import re
+import subprocess
+import sys
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+POSIX = os.path.join(ROOT, "posix", "posix")
+OPENMP = os.path.join(ROOT, "openmp", "openmp")
+
+#base text alphabet, the planted targets use upper case letters so they never occur by chance
+TEXT_TABLE = bytes((b"abcdefghijklmnopqrstuvwxyz     \n" * 8)[:256])
+TARGET_ALPHABET = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+
+#engine name -> (command builder, patterns for load time, scan time, count)
+POSIX_PATTERNS = (r"Total time taken for mapping file: ([0-9.]+)", r"^Total time taken: ([0-9.]+)", r"Total instances found: (\d+)")
+LINES_PATTERNS = (r"Total time taken for splitting up text: ([0-9.]+)", r"^Total time taken: ([0-9.]+)", r"Total instances found: (\d+)")
+OPENMP_PATTERNS = (r"Time taken for mapping file: ([0-9.]+)", r"Time taken for searching: ([0-9.]+)", r"Total instances found: (\d+)")
+ENGINES = {
+    "serial": (lambda target, threads, path: [POSIX, "--mmap", target, "1", path], POSIX_PATTERNS),
+    "pthreads": (lambda target, threads, path: [POSIX, "--mmap", target, str(threads), path], POSIX_PATTERNS),
+    "pool": (lambda target, threads, path: [POSIX, "--pool", target, str(threads), path], POSIX_PATTERNS),
+    "openmp": (lambda target, threads, path: [OPENMP, target, str(threads), path], OPENMP_PATTERNS),
+    "lines": (lambda target, threads, path: [POSIX, target, str(threads), path], LINES_PATTERNS),
+}
+#pinned variants of the pthreads engines: pthreads-compact, pool-scatter, lines-compact, ...
+for _engine in ("pthreads", "pool", "lines"):
+    for _pin in ("compact", "scatter"):
+        ENGINES["%s-%s" % (_engine, _pin)] = (
+            lambda target, threads, path, build=ENGINES[_engine][0], pin=_pin: build(target, threads, path)[:1] + ["--pin=" + pin] + build(target, threads, path)[1:],
+            ENGINES[_engine][1])
+
+
+def make_target(length, seed):
+    rng = random.Random(seed)
+    return "".join(rng.choice(TARGET_ALPHABET) for _ in range(length))
+
+
+def generate_input(data_dir, size_mb, target, density):
+    """size_mb MB of text with density matches per MB, returns (path, expected count)."""
+    size = size_mb * 1024 * 1024
+    count = min(int(density * size_mb), size // (2 * len(target)))
+    path = os.path.join(data_dir, "text_%dmb_%s_%g.txt" % (size_mb, target, density))
+    if os.path.exists(path) and os.path.getsize(path) == size:
+        return path, count
+    rng = random.Random("%d-%s-%g" % (size_mb, target, density))
+    text = bytearray(rng.randbytes(size).translate(TEXT_TABLE))
+    #one planted target in a random place of every slot, slots never overlap
+    encoded = target.encode()
+    if count > 0:
+        slot = size // count
+        for i in range(count):
+            offset = i * slot + rng.randrange(slot - len(encoded) + 1)
+            text[offset:offset + len(encoded)] = encoded
+    os.makedirs(data_dir, exist_ok=True)
+    with open(path + ".tmp", "wb") as out:
+        out.write(text)
+    os.replace(path + ".tmp", path)
+    return path, count
+
+
+def run_once(engine, target, threads, path):
+    build_command, patterns = ENGINES[engine]
+    start = time.perf_counter()
+    result = subprocess.run(build_command(target, threads, path), capture_output=True, text=True)
+    wall = time.perf_counter() - start
+    if result.returncode != 0:
+        raise RuntimeError("%s failed: %s" % (engine, result.stdout + result.stderr))
+    values = []
+    for pattern in patterns:
+        match = re.search(pattern, result.stdout, re.MULTILINE)
+        if match is None:
+            raise RuntimeError("%s: no '%s' in output:\n%s" % (engine, pattern, result.stdout))
+        values.append(float(match.group(1)))
+    return values[0], values[1], int(values[2]), wall
+
+
+def percentile(values, p):
+    ordered = sorted(values)
+    index = min(len(ordered) - 1, max(0, int(round(p / 100.0 * (len(ordered) - 1)))))
+    return ordered[index]
+
+
+def summarize(values):
+    return {
+        "median": percentile(values, 50),
+        "p95": percentile(values, 95),
+        "min": min(values),
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--sizes", default="16 256", help="input sizes in MB")
+    parser.add_argument("--threads", default="1 2 4 8", help="thread counts of the parallel engines")
+    parser.add_argument("--lengths", default="4 16 64", help="target lengths")
+    parser.add_argument("--densities", default="0 10 1000", help="planted matches per MB")
+    parser.add_argument("--engines", default="serial pthreads pool openmp")
+    parser.add_argument("--warmup", type=int, default=1)
+    parser.add_argument("--runs", type=int, default=5)
+    parser.add_argument("--data-dir", default=os.path.join(ROOT, "bench", "data"))
+    parser.add_argument("--out", default=os.path.join(ROOT, "bench", "results"), help="writes OUT.json and OUT.csv")
+    args = parser.parse_args()
+
+    engines = args.engines.split()
+    for engine in engines:
+        if engine not in ENGINES:
+            sys.exit("Unknown engine: %s" % engine)
+    results = []
+    failures = 0
+    for size_mb in map(int, args.sizes.split()):
+        for length in map(int, args.lengths.split()):
+            target = make_target(length, length)
+            for density in map(float, args.densities.split()):
+                path, expected = generate_input(args.data_dir, size_mb, target, density)
+                for engine in engines:
+                    thread_counts = [1] if engine == "serial" else map(int, args.threads.split())
+                    for threads in thread_counts:
+                        for _ in range(args.warmup):
+                            run_once(engine, target, threads, path)
+                        loads, scans, walls = [], [], []
+                        counts = set()
+                        for _ in range(args.runs):
+                            load, scan, count, wall = run_once(engine, target, threads, path)
+                            loads.append(load)
+                            scans.append(scan)
+                            walls.append(wall)
+                            counts.add(count)
+                        correct = counts == {expected}
+                        failures += not correct
+                        scan = summarize(scans)
+                        row = {
+                            "engine": engine,
+                            "threads": threads,
+                            "size_mb": size_mb,
+                            "target_len": length,
+                            "density_per_mb": density,
+                            "expected": expected,
+                            "found": sorted(counts),
+                            "correct": correct,
+                            "runs": args.runs,
+                            "load_s": summarize(loads),
+                            "scan_s": scan,
+                            "wall_s": summarize(walls),
+                            "gbps": {
+                                "median": size_mb / 1024.0 / scan["median"] if scan["median"] > 0 else 0.0,
+                                "best": size_mb / 1024.0 / scan["min"] if scan["min"] > 0 else 0.0,
+                            },
+                        }
+                        results.append(row)
+                        print("%-16s %3d thr %5d MB len %3d dens %6g: scan median %.6f s p95 %.6f s min %.6f s, %.2f GB/s, load %.6f s%s" % (
+                            engine, threads, size_mb, length, density, scan["median"], scan["p95"], scan["min"],
+                            row["gbps"]["median"], row["load_s"]["median"], "" if correct else "  WRONG COUNT %s, expected %d" % (sorted(counts), expected)))
+                        sys.stdout.flush()
+
+    report = {
+        "host": {
+            "machine": platform.machine(),
+            "system": platform.platform(),
+            "cpus": os.cpu_count(),
+        },
+        "time": time.strftime("%Y-%m-%dT%H:%M:%S"),
+        "warmup": args.warmup,
+        "runs": args.runs,
+        "results": results,
+    }
+    with open(args.out + ".json", "w") as out:
+        json.dump(report, out, indent=1)
+    with open(args.out + ".csv", "w", newline="") as out:
+        writer = csv.writer(out)
+        writer.writerow(["engine", "threads", "size_mb", "target_len", "density_per_mb", "expected", "correct",
+                         "load_median_s", "scan_median_s", "scan_p95_s", "scan_min_s", "wall_median_s", "gbps_median", "gbps_best"])
+        for row in results:
+            writer.writerow([row["engine"], row["threads"], row["size_mb"], row["target_len"], row["density_per_mb"],
+                             row["expected"], int(row["correct"]), row["load_s"]["median"], row["scan_s"]["median"],
+                             row["scan_s"]["p95"], row["scan_s"]["min"], "%.6f" % row["wall_s"]["median"],
+                             "%.4f" % row["gbps"]["median"], "%.4f" % row["gbps"]["best"]])
+    print("Results written to %s.json and %s.csv" % (args.out, args.out))
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+"""Benchmark of the recursive search on a generated directory tree.
+
+The tree mixes many small files with a few large ones (sizes drawn from a
+long-tailed distribution plus a handful of big files), every file with a known
+number of planted targets. Each engine searches the whole tree with --recursive
+and is compared with the old way: one process per file. Per-file counts are
+checked against the planted ones.
+"""
+
+import argparse
+import json
+import os
+import random
+import re
+import subprocess
+import sys
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+POSIX = os.path.join(ROOT, "posix", "posix")
+OPENMP = os.path.join(ROOT, "openmp", "openmp")
+TARGET = "NEEDLE"
+TEXT_TABLE = bytes((b"abcdefghijklmnopqrstuvwxyz     \n" * 8)[:256])
+
+ENGINES = {
+    "posix": lambda threads, root: [POSIX, "--recursive", TARGET, str(threads), root],
+    "openmp": lambda threads, root: [OPENMP, "--recursive", TARGET, str(threads), root],
+}
+
+
+def generate_tree(root, num_files, big_files, big_mb, seed):
+    """Returns {path: planted count}, reuses the tree when the manifest matches."""
+    manifest_path = os.path.join(root, "manifest.json")
+    settings = [num_files, big_files, big_mb, seed]
+    if os.path.exists(manifest_path):
+        with open(manifest_path) as f:
+            manifest = json.load(f)
+        if manifest["settings"] == settings:
+            return manifest["files"]
+    rng = random.Random(seed)
+    files = {}
+    for i in range(num_files + big_files):
+        depth = rng.randrange(1, 4)
+        directory = os.path.join(root, "tree", *("d%d" % rng.randrange(8) for _ in range(depth)))
+        os.makedirs(directory, exist_ok=True)
+        if i < big_files:
+            size = big_mb * 1024 * 1024
+        else:
+            #most files are a few kB, some reach a few hundred kB
+            size = min(int(rng.paretovariate(1.2) * 2048), 512 * 1024)
+        text = bytearray(rng.randbytes(size).translate(TEXT_TABLE))
+        count = rng.randrange(0, 4) + size // (256 * 1024)
+        count = min(count, size // (2 * len(TARGET)))
+        if count > 0:
+            slot = size // count
+            for c in range(count):
+                offset = c * slot + rng.randrange(slot - len(TARGET) + 1)
+                text[offset:offset + len(TARGET)] = TARGET.encode()
+        path = os.path.join(directory, "f%05d.txt" % i)
+        with open(path, "wb") as out:
+            out.write(text)
+        files[path] = count
+    with open(manifest_path, "w") as f:
+        json.dump({"settings": settings, "files": files}, f)
+    return files
+
+
+def run_tree(engine, threads, root):
+    start = time.perf_counter()
+    result = subprocess.run(ENGINES[engine](threads, root), capture_output=True, text=True)
+    wall = time.perf_counter() - start
+    if result.returncode != 0:
+        raise RuntimeError("%s failed: %s" % (engine, result.stdout + result.stderr))
+    counts = {path: int(count) for path, count in re.findall(r"^(.+): (\d+)$", result.stdout, re.MULTILINE) if path.startswith(root)}
+    return wall, counts, result.stdout
+
+
+def run_per_file(files, threads):
+    """The old way: one process per file, same thread count."""
+    start = time.perf_counter()
+    for path in files:
+        subprocess.run([POSIX, "--mmap", TARGET, str(threads), path], capture_output=True, check=True)
+    return time.perf_counter() - start
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--files", type=int, default=5000, help="number of small files")
+    parser.add_argument("--big-files", type=int, default=3)
+    parser.add_argument("--big-mb", type=int, default=128, help="size of each big file")
+    parser.add_argument("--threads", default="1 2 4 8")
+    parser.add_argument("--engines", default="posix openmp")
+    parser.add_argument("--runs", type=int, default=3)
+    parser.add_argument("--data-dir", default=os.path.join(ROOT, "bench", "data", "tree"))
+    args = parser.parse_args()
+
+    files = generate_tree(args.data_dir, args.files, args.big_files, args.big_mb, 7)
+    root = os.path.join(args.data_dir, "tree")
+    total_bytes = sum(os.path.getsize(path) for path in files)
+    print("Tree: %d files, %.1f MB, %d planted targets" % (len(files), total_bytes / 1e6, sum(files.values())))
+    failures = 0
+    for engine in args.engines.split():
+        for threads in map(int, args.threads.split()):
+            run_tree(engine, threads, root)
+            walls = []
+            for _ in range(args.runs):
+                wall, counts, _ = run_tree(engine, threads, root)
+                walls.append(wall)
+            correct = counts == files and list(counts) == sorted(counts)
+            failures += not correct
+            best = min(walls)
+            print("%-7s %3d thr: median %.4f s, best %.4f s, %.2f GB/s%s" % (
+                engine, threads, sorted(walls)[len(walls) // 2], best, total_bytes / best / 1e9,
+                "" if correct else "  WRONG COUNTS OR ORDER"))
+            sys.stdout.flush()
+    threads = max(map(int, args.threads.split()))
+    per_file = run_per_file(files, threads)
+    print("one process per file, %d thr: %.4f s, %.2f GB/s" % (threads, per_file, total_bytes / per_file / 1e9))
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <sys/time.h>
+#include "scan.h"
+
+static const char *kernels[] = {"scalar", "sse2", "avx2", "avx512"};
+#define NUM_KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+static const int modes[] = {0, SCAN_IGNORE_CASE, SCAN_WHOLE_WORD, SCAN_IGNORE_CASE | SCAN_WHOLE_WORD};
+static const char *mode_names[] = {"exact", "ignore-case", "word", "both"};
+#define NUM_MODES (sizeof(modes) / sizeof(modes[0]))
+
+static double now_seconds(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+//Reference count: the strstr loop the search engines used before
+static size_t strstr_count(const char *text, const char *target) {
+    size_t count = 0;
+    size_t target_len = strlen(target);
+    const char *pos = text;
+    while ((pos = strstr(pos, target)) != NULL) {
+        pos += target_len;
+        count++;
+    }
+    return count;
+}
+
+//Reference for the matching modes: try every position, skip a counted match
+static size_t reference_count(const char *text, size_t text_len, const char *target, size_t target_len, int flags) {
+    size_t count = 0;
+    size_t pos = 0;
+    while (pos + target_len <= text_len) {
+        int match = (flags & SCAN_IGNORE_CASE) ? strncasecmp(text + pos, target, target_len) == 0 : memcmp(text + pos, target, target_len) == 0;
+        if (match && (flags & SCAN_WHOLE_WORD)) {
+            char before = pos > 0 ? text[pos - 1] : ' ';
+            char after = pos + target_len < text_len ? text[pos + target_len] : ' ';
+            match = !(isalnum((unsigned char)before) || before == '_') && !(isalnum((unsigned char)after) || after == '_');
+        }
+        if (match) {
+            count++;
+            pos += target_len;
+        } else {
+            pos++;
+        }
+    }
+    return count;
+}
+
+//Random texts over small alphabets, so there are many candidates and overlaps
+static int differential_check(int cases) {
+    char text[700];
+    char target[12];
+    const char *alphabets[] = {"ab", "abc", "ab \n", "abcdefghijklmnopqrstuvwxyz ", "aAb", "aA@`_ ", "Ab9 _"};
+    int num_alphabets = sizeof(alphabets) / sizeof(alphabets[0]);
+    srand(12345);
+    for (int c = 0; c < cases; c++) {
+        const char *alphabet = alphabets[c % num_alphabets];
+        size_t alphabet_len = strlen(alphabet);
+        size_t text_len = rand() % (sizeof(text) - 1);
+        size_t target_len = 1 + rand() % (sizeof(target) - 1);
+        for (size_t i = 0; i < text_len; i++) {
+            text[i] = alphabet[rand() % alphabet_len];
+        }
+        text[text_len] = '\0';
+        for (size_t i = 0; i < target_len; i++) {
+            target[i] = alphabet[rand() % (alphabet_len < 3 ? alphabet_len : 3)];
+        }
+        target[target_len] = '\0';
+        for (size_t m = 0; m < NUM_MODES; m++) {
+            size_t expected = modes[m] == 0 ? strstr_count(text, target) : reference_count(text, text_len, target, target_len, modes[m]);
+            for (size_t k = 0; k < NUM_KERNELS; k++) {
+                if (!scan_use_kernel(kernels[k])) {
+                    continue;
+                }
+                ScanPattern pattern;
+                scan_pattern_init_flags(&pattern, target, target_len, modes[m]);
+                size_t got = scan_count(&pattern, text, text_len);
+                if (got != expected) {
+                    fprintf(stderr, "Mismatch in %s kernel, %s mode: '%s' in \"%s\" found %zu, reference found %zu\n", kernels[k], mode_names[m], target, text, got, expected);
+                    return 0;
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    size_t size_mb = argc > 1 ? (size_t)atol(argv[1]) : 256;
+    const char *target = argc > 2 ? argv[2] : "person";
+    int repeats = 5;
+
+    if (!differential_check(20000)) {
+        return EXIT_FAILURE;
+    }
+    printf("Differential check against strstr and the mode reference: 20000 cases OK\n");
+
+	//lorem-like text: random words with a planted target every ~4 kB, every
+	//second one capitalized and every fourth one glued to the next word
+    size_t size = size_mb * 1024 * 1024;
+    char *text = malloc(size + 1);
+    if (text == NULL) {
+        perror("Error allocating benchmark buffer");
+        return EXIT_FAILURE;
+    }
+    srand(42);
+    for (size_t i = 0; i < size; i++) {
+        text[i] = (rand() % 6 == 0) ? ' ' : 'a' + rand() % 26;
+    }
+    size_t target_len = strlen(target);
+    for (size_t i = 1, n = 0; i + target_len + 1 < size; i += 4096, n++) {
+        text[i - 1] = ' ';
+        memcpy(text + i, target, target_len);
+        if (n % 2 == 1) {
+            text[i] = toupper((unsigned char)text[i]);
+        }
+        text[i + target_len] = (n % 4 == 3) ? 'x' : ' ';
+    }
+    text[size] = '\0';
+
+    printf("Buffer: %zu MB, target: '%s'\n", size_mb, target);
+    double start = now_seconds();
+    size_t expected = strstr_count(text, target);
+    double elapsed = now_seconds() - start;
+    printf("%-8s %10zu matches %8.3f GB/s\n", "strstr", expected, size / elapsed / 1e9);
+
+	//each mode against exact matching with the same kernel
+    printf("%-8s", "");
+    for (size_t m = 0; m < NUM_MODES; m++) {
+        printf(" %24s", mode_names[m]);
+    }
+    printf("\n");
+    for (size_t k = 0; k < NUM_KERNELS; k++) {
+        if (!scan_use_kernel(kernels[k])) {
+            printf("%-8s not supported on this CPU\n", kernels[k]);
+            continue;
+        }
+        printf("%-8s", kernels[k]);
+        double exact_best = 0.0;
+        for (size_t m = 0; m < NUM_MODES; m++) {
+            ScanPattern pattern;
+            scan_pattern_init_flags(&pattern, target, target_len, modes[m]);
+            double best = 0.0;
+            size_t found = 0;
+            for (int r = 0; r < repeats; r++) {
+                start = now_seconds();
+                found = scan_count(&pattern, text, size);
+                elapsed = now_seconds() - start;
+                if (r == 0 || elapsed < best) {
+                    best = elapsed;
+                }
+            }
+            if (m == 0) {
+                exact_best = best;
+            }
+            size_t reference = (m == 0) ? expected : reference_count(text, size, target, target_len, modes[m]);
+            printf(" %7zu %6.2f GB/s %+4.0f%%%s", found, size / best / 1e9, 100.0 * (exact_best / best - 1.0), found == reference ? "" : " MISMATCH");
+        }
+        printf("\n");
+    }
+    printf("(matches, GB/s per core and throughput change against exact matching)\n");
+    free(text);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,46 @@
+#ifndef AUTOMATON_H
+#define AUTOMATON_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+//Aho-Corasick automaton over many targets. Bytes are mapped to a few classes
+//(one per byte used by the targets, everything else is class 0), so the
+//transition table is a flat num_states x num_classes array that stays small.
+typedef struct {
+    int num_patterns;
+    const char **patterns;
+    size_t *lengths;
+    size_t max_len;
+    int num_states;
+    int num_classes;
+    uint8_t byte_class[256];
+    int32_t *next;       //next[state * num_classes + class]
+    int32_t *out_start;  //targets ending in a state: out_list[out_start[s] .. out_start[s + 1])
+    int32_t *out_list;
+    int flags;           //SCAN_IGNORE_CASE, SCAN_WHOLE_WORD
+} Automaton;
+
+//Per range state of a multi-target scan, one slot per target
+typedef struct {
+    size_t *counts;
+    size_t *first_match; //offset of the first counted match, SIZE_MAX if none
+    size_t *last_end;    //offset right after the last counted match
+} AutomatonCounts;
+
+int load_patterns(const char *file_name, char ***patterns, int *num_patterns);
+void free_patterns(char **patterns, int num_patterns);
+
+//flags are the scan.h matching modes, both cases of a letter share a byte class
+int automaton_build(Automaton *automaton, const char **patterns, int num_patterns, int flags);
+void automaton_free(Automaton *automaton);
+
+int automaton_counts_init(AutomatonCounts *counts, int num_patterns);
+void automaton_counts_free(AutomatonCounts *counts);
+//Count the non-overlapping matches of every target that start in [begin, end),
+//reading up to limit. last_end is the carry-in from the previous range.
+//data[0, size) is all readable data, for the word boundary checks.
+void automaton_scan(const Automaton *automaton, const char *data, size_t size, size_t begin, size_t end, size_t limit, AutomatonCounts *counts);
+
+#endif
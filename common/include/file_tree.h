@@ -0,0 +1,62 @@
+#ifndef FILE_TREE_H
+#define FILE_TREE_H
+
+
+#include <stddef.h>
+#include "mapped_file.h"
+#include "scan.h"
+
+//Files up to this size are one task, larger ones are split into byte ranges
+#define TREE_SPLIT_SIZE (1024 * 1024)
+//Decompressed block of a .gz file searched in one go
+#define GZIP_BLOCK_SIZE (1024 * 1024)
+
+//A file to search or a directory to walk
+typedef struct {
+    char *path;
+    size_t size;
+    int is_dir;
+} TreeEntry;
+
+//A file found by the walk, with its result
+typedef struct {
+    char *path;
+    size_t size;
+    size_t count;
+    int failed;
+    MappedFile map;   //large files only, mapped while their ranges are searched
+    int num_chunks;
+    void *chunks;     //the engine's range array of a large file
+} TreeFile;
+
+//Files in the order they were found, sorted by path before the report
+typedef struct {
+    TreeFile **files;
+    int num_files;
+    int capacity;
+} TreeList;
+
+//A command line path: a file, a directory or a glob pattern of those
+int tree_expand(const char *pattern, TreeEntry **entries, int *num_entries);
+//Regular files and subdirectories of a directory, symbolic links are not followed
+int tree_read_dir(const char *dir, TreeEntry **entries, int *num_entries);
+void tree_entries_free(TreeEntry *entries, int num_entries);
+
+//Not thread safe, the engines call it under their own lock
+TreeFile *tree_list_add(TreeList *list, const char *path, size_t size);
+void tree_list_sort(TreeList *list);
+//Print "path: count" per file, returns the total count
+size_t tree_list_report(const TreeList *list, int print);
+void tree_list_free(TreeList *list);
+
+//Read a small file in one go and count its matches
+int tree_count_file(const ScanPattern *pattern, TreeFile *file);
+
+//gzip input (by the magic bytes, not the name). Built with zlib unless
+//TF_NO_ZLIB is defined (make NOZLIB=1), then .gz files are searched as they are.
+int file_is_gzip(const char *path);
+//Decompress block by block and count the matches of the whole stream; gzip
+//members follow each other. Adds the time spent in each stage.
+int tree_count_gzip(const ScanPattern *pattern, TreeFile *file, double *inflate_time, double *scan_time);
+
+#endif
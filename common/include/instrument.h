@@ -0,0 +1,55 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+
+#include <stdio.h>
+#include <stdint.h>
+
+//Per-thread search statistics. Built only with -DTF_INSTRUMENT (make INSTRUMENT=1),
+//hardware counters also need -DTF_PERF_EVENTS (make PERF=1) and a Linux kernel
+//that allows perf_event_open. Without TF_INSTRUMENT every macro below is empty.
+typedef struct {
+    uint64_t bytes;      //bytes examined by the matchers
+    uint64_t candidates; //SIMD filter hits that went to memcmp
+    uint64_t matches;
+    double wall;         //time spent inside instrumented work
+    double io_wait;      //time spent reading or waiting for data
+    uint64_t major_faults;
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t llc_misses;
+    int active;
+} ThreadStats;
+
+#ifdef TF_INSTRUMENT
+
+extern __thread ThreadStats *instrument_current;
+
+//Reset the table for a search run by num_slots threads
+void instrument_begin(int num_slots);
+//Attribute the calling thread's work to slot until instrument_leave
+void instrument_enter(int slot);
+void instrument_leave(void);
+void instrument_io_wait(double seconds);
+//Per-thread table and load-imbalance summary
+void instrument_report(FILE *out, const char *engine);
+
+#define INSTRUMENT_BEGIN(num_slots) instrument_begin(num_slots)
+#define INSTRUMENT_ENTER(slot) instrument_enter(slot)
+#define INSTRUMENT_LEAVE() instrument_leave()
+#define INSTRUMENT_ADD(field, n) do { if (instrument_current != NULL) instrument_current->field += (n); } while (0)
+#define INSTRUMENT_IO_WAIT(seconds) instrument_io_wait(seconds)
+#define INSTRUMENT_REPORT(engine) instrument_report(stdout, engine)
+
+#else
+
+#define INSTRUMENT_BEGIN(num_slots) ((void)0)
+#define INSTRUMENT_ENTER(slot) ((void)0)
+#define INSTRUMENT_LEAVE() ((void)0)
+#define INSTRUMENT_ADD(field, n) ((void)0)
+#define INSTRUMENT_IO_WAIT(seconds) ((void)0)
+#define INSTRUMENT_REPORT(engine) ((void)0)
+
+#endif
+
+#endif
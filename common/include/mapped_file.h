@@ -0,0 +1,25 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//Read-only view of a whole file (mmap, or one read on platforms without it)
+typedef struct {
+    const char *data;
+    size_t size;
+    int is_mapped;
+} MappedFile;
+
+int map_file(const char *file_name, MappedFile *file);
+void unmap_file(MappedFile *file);
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef MATCHES_H
+#define MATCHES_H
+
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "scan.h"
+
+#define WRITER_BUFFER_SIZE (1 << 20)
+
+//One match. While a chunk is being searched only offset is set; line and column
+//are filled in afterwards and are relative to the chunk until it is written:
+//line counts the newlines since the chunk begin, and on line 0 the column counts
+//the bytes since the chunk begin.
+typedef struct {
+    uint64_t offset;
+    uint64_t line;
+    uint64_t column;
+} MatchRecord;
+
+//Growable per-thread (per-chunk) record arena, never shared while searching
+typedef struct {
+    MatchRecord *records;
+    size_t count;
+    size_t capacity;
+} MatchBuffer;
+
+//Where a chunk starts: newlines before it and bytes since the last of them
+typedef struct {
+    uint64_t line;
+    uint64_t column;
+} FilePosition;
+
+typedef enum {
+    REPORT_TEXT,
+    REPORT_CSV,
+    REPORT_BINARY
+} ReportFormat;
+
+//Large buffered writer, records are formatted without printf
+typedef struct {
+    FILE *file;
+    int close_file;
+    ReportFormat format;
+    char *buffer;
+    size_t used;
+    size_t written;
+} MatchWriter;
+
+void match_buffer_grow(MatchBuffer *buffer);
+void match_buffer_free(MatchBuffer *buffer);
+
+static inline void match_buffer_push(MatchBuffer *buffer, uint64_t offset) {
+    if (buffer->count == buffer->capacity) {
+        match_buffer_grow(buffer);
+    }
+    buffer->records[buffer->count++].offset = offset;
+}
+
+//scan_count_owned that also appends the offset of every counted match
+size_t scan_collect_owned(const ScanPattern *pattern, const char *data, size_t size, size_t from, size_t end, size_t *first_match, size_t *last_end, MatchBuffer *matches);
+//Fill in the chunk relative line and column of the records and count the chunk's newlines.
+//last_newline is SIZE_MAX when the chunk has none.
+void match_buffer_locate(MatchBuffer *buffer, const char *data, size_t begin, size_t end, size_t *newlines, size_t *last_newline);
+void file_position_advance(FilePosition *position, size_t begin, size_t end, size_t newlines, size_t last_newline);
+
+int parse_report_format(const char *name, ReportFormat *format);
+//path "-" writes to stdout
+int match_writer_open(MatchWriter *writer, const char *path, ReportFormat format);
+void match_writer_write(MatchWriter *writer, const MatchBuffer *buffer, const FilePosition *start);
+int match_writer_close(MatchWriter *writer);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+//Matching modes
+#define SCAN_IGNORE_CASE 1 //ASCII letters match in either case
+#define SCAN_WHOLE_WORD 2  //counted matches have no letter, digit or '_' right before or after them
+
+//Target text prepared once, searched in explicit-length buffers (no NUL needed)
+typedef struct {
+    const char *text;
+    size_t len;
+    int flags;
+} ScanPattern;
+
+static inline int scan_is_word_byte(uint8_t c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+void scan_pattern_init(ScanPattern *pattern, const char *text, size_t len);
+void scan_pattern_init_flags(ScanPattern *pattern, const char *text, size_t len, int flags);
+//Word boundary check of a candidate at data[offset], data[0, size) is everything
+//readable around it. scan_find only honours SCAN_IGNORE_CASE, the counting
+//functions below skip the candidates that fail this check in SCAN_WHOLE_WORD mode.
+int scan_word_match(const ScanPattern *pattern, const char *data, size_t size, size_t offset);
+//First match starting in buf[0, len), NULL if there is none
+const char *scan_find(const ScanPattern *pattern, const char *buf, size_t len);
+//Number of non-overlapping matches, same result as a strstr loop
+size_t scan_count(const ScanPattern *pattern, const char *buf, size_t len);
+//Count the matches that start in [from, end) of data[0, size). A match may run up
+//to len - 1 bytes past end, that overlap is read but owned by the next range.
+//first_match is SIZE_MAX when nothing was found, last_end is the offset after the last match.
+size_t scan_count_owned(const ScanPattern *pattern, const char *data, size_t size, size_t from, size_t end, size_t *first_match, size_t *last_end);
+
+//Kernel selection: "auto", "scalar", "sse2", "avx2" or "avx512".
+//Returns 0 when the kernel is unknown or not supported by this CPU.
+int scan_use_kernel(const char *name);
+const char *scan_kernel_name(void);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef TUNER_H
+#define TUNER_H
+
+
+#include <stdio.h>
+#include <stddef.h>
+
+//Machine constants measured once and cached in a small key=value file
+//($TEXTFINDER_CALIBRATION, or ~/.textfinder_calibration). The file is measured
+//again when the number of online cores or the SIMD kernel changes.
+typedef struct {
+    double scan_bandwidth;      //bytes/s of one thread scanning memory
+    double parallel_bandwidth;  //bytes/s of all cores scanning together
+    double spawn_seconds;       //starting and joining one thread
+    int cores;
+    char kernel[16];
+    char path[512];
+    int cached;                 //loaded from the file, not measured now
+} TunerCalibration;
+
+//Thread count and chunk size picked for one input
+typedef struct {
+    int threads;
+    size_t chunk_size;      //work unit of the pool / dynamic schedule
+    size_t input_size;
+    int online_cores;
+    int requested;          //threads given on the command line, 0 for auto
+    double predicted;       //seconds with the chosen thread count
+    double predicted_single;
+    const char *reason;
+    TunerCalibration calibration;
+} TunerPlan;
+
+//Cached calibration, measured and saved when missing or stale
+int tuner_calibrate(TunerCalibration *calibration);
+//requested_threads 0 picks the count, otherwise only the chunk size is chosen
+int tuner_plan(const char *path, int requested_threads, TunerPlan *plan);
+void tuner_explain(FILE *out, const TunerPlan *plan);
+
+#endif
@@ -0,0 +1,276 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "automaton.h"
+#include "instrument.h"
+#include "scan.h"
+
+//Read one target per line, empty lines are skipped
+int load_patterns(const char *file_name, char ***patterns, int *num_patterns) {
+    FILE *file = fopen(file_name, "r");
+    if (file == NULL) {
+        perror("Error opening pattern file");
+        return 0;
+    }
+    char **list = NULL;
+    int count = 0;
+    int capacity = 0;
+    char *line = NULL;
+    size_t line_capacity = 0;
+    ssize_t line_len;
+    while ((line_len = getline(&line, &line_capacity, file)) != -1) {
+        while (line_len > 0 && (line[line_len - 1] == '\n' || line[line_len - 1] == '\r')) {
+            line[--line_len] = '\0';
+        }
+        if (line_len == 0) {
+            continue;
+        }
+        if (count >= capacity) {
+            int new_capacity = (capacity == 0) ? 16 : capacity * 2;
+            char **grown = realloc(list, new_capacity * sizeof(char *));
+            if (grown == NULL) {
+                break;
+            }
+            list = grown;
+            capacity = new_capacity;
+        }
+        if ((list[count] = strdup(line)) == NULL) {
+            break;
+        }
+        count++;
+    }
+    int complete = feof(file) && !ferror(file);
+    free(line);
+    fclose(file);
+    if (!complete) {
+        fprintf(stderr, "Error loading pattern file %s\n", file_name);
+        free_patterns(list, count);
+        return 0;
+    }
+    if (count == 0) {
+        fprintf(stderr, "Pattern file %s contains no patterns.\n", file_name);
+        free(list);
+        return 0;
+    }
+    *patterns = list;
+    *num_patterns = count;
+    return 1;
+}
+
+void free_patterns(char **patterns, int num_patterns) {
+    for (int i = 0; i < num_patterns; i++) {
+        free(patterns[i]);
+    }
+    free(patterns);
+}
+
+//Release the work arrays and the half-built automaton after a failed allocation
+static int build_failed(Automaton *automaton, int32_t *next, int32_t *fail, int32_t *terminal, int32_t *same_end, int32_t *queue, int32_t *out_count) {
+    fprintf(stderr, "Error allocating automaton\n");
+    free(next);
+    free(fail);
+    free(terminal);
+    free(same_end);
+    free(queue);
+    free(out_count);
+    automaton_free(automaton);
+    return 0;
+}
+
+int automaton_build(Automaton *automaton, const char **patterns, int num_patterns, int flags) {
+    memset(automaton, 0, sizeof(*automaton));
+    automaton->flags = flags;
+    automaton->num_patterns = num_patterns;
+    automaton->patterns = patterns;
+    automaton->lengths = malloc(num_patterns * sizeof(size_t));
+    if (automaton->lengths == NULL) {
+        return build_failed(automaton, NULL, NULL, NULL, NULL, NULL, NULL);
+    }
+
+	//byte classes: every byte used by a target gets its own class
+    size_t total_len = 0;
+    int num_classes = 1;
+    for (int p = 0; p < num_patterns; p++) {
+        automaton->lengths[p] = strlen(patterns[p]);
+        total_len += automaton->lengths[p];
+        if (automaton->lengths[p] > automaton->max_len) {
+            automaton->max_len = automaton->lengths[p];
+        }
+        for (size_t i = 0; i < automaton->lengths[p]; i++) {
+            uint8_t c = (uint8_t)patterns[p][i];
+            if (automaton->byte_class[c] == 0) {
+                automaton->byte_class[c] = num_classes++;
+                if ((flags & SCAN_IGNORE_CASE) && ((c | 0x20) >= 'a' && (c | 0x20) <= 'z')) {
+                    automaton->byte_class[c ^ 0x20] = automaton->byte_class[c];
+                }
+            }
+        }
+    }
+    automaton->num_classes = num_classes;
+
+	//trie, at most one state per target byte plus the root
+    int max_states = (int)total_len + 1;
+    int32_t *next = malloc((size_t)max_states * num_classes * sizeof(int32_t));
+    int32_t *fail = malloc(max_states * sizeof(int32_t));
+    int32_t *terminal = malloc(max_states * sizeof(int32_t)); //first target ending here, -1 if none
+    int32_t *same_end = malloc(num_patterns * sizeof(int32_t)); //duplicate targets ending in the same state
+    if (next == NULL || fail == NULL || terminal == NULL || same_end == NULL) {
+        return build_failed(automaton, next, fail, terminal, same_end, NULL, NULL);
+    }
+    for (int c = 0; c < num_classes; c++) {
+        next[c] = -1;
+    }
+    terminal[0] = -1;
+    int num_states = 1;
+    for (int p = 0; p < num_patterns; p++) {
+        int state = 0;
+        for (size_t i = 0; i < automaton->lengths[p]; i++) {
+            int c = automaton->byte_class[(uint8_t)patterns[p][i]];
+            if (next[state * num_classes + c] < 0) {
+                for (int k = 0; k < num_classes; k++) {
+                    next[num_states * num_classes + k] = -1;
+                }
+                terminal[num_states] = -1;
+                next[state * num_classes + c] = num_states++;
+            }
+            state = next[state * num_classes + c];
+        }
+        same_end[p] = terminal[state];
+        terminal[state] = p;
+    }
+
+	//breadth first order, so fail links point to already finished states and the
+	//missing transitions can be filled in from them (full DFA, no fail loop at scan time)
+    int32_t *queue = malloc(num_states * sizeof(int32_t));
+    if (queue == NULL) {
+        return build_failed(automaton, next, fail, terminal, same_end, NULL, NULL);
+    }
+    int head = 0;
+    int tail = 0;
+    fail[0] = 0;
+    for (int c = 0; c < num_classes; c++) {
+        int child = next[c];
+        if (child < 0) {
+            next[c] = 0;
+        } else {
+            fail[child] = 0;
+            queue[tail++] = child;
+        }
+    }
+    while (head < tail) {
+        int state = queue[head++];
+        for (int c = 0; c < num_classes; c++) {
+            int child = next[state * num_classes + c];
+            int fallback = next[fail[state] * num_classes + c];
+            if (child < 0) {
+                next[state * num_classes + c] = fallback;
+            } else {
+                fail[child] = fallback;
+                queue[tail++] = child;
+            }
+        }
+    }
+
+	//outputs of a state are its own targets followed by the ones of its fail state
+    int32_t *out_count = calloc(num_states, sizeof(int32_t));
+    if (out_count == NULL) {
+        return build_failed(automaton, next, fail, terminal, same_end, queue, NULL);
+    }
+    for (int i = 0; i < tail; i++) {
+        int state = queue[i];
+        for (int p = terminal[state]; p >= 0; p = same_end[p]) {
+            out_count[state]++;
+        }
+        out_count[state] += out_count[fail[state]];
+    }
+    automaton->out_start = malloc((num_states + 1) * sizeof(int32_t));
+    if (automaton->out_start == NULL) {
+        return build_failed(automaton, next, fail, terminal, same_end, queue, out_count);
+    }
+    automaton->out_start[0] = 0;
+    for (int s = 0; s < num_states; s++) {
+        automaton->out_start[s + 1] = automaton->out_start[s] + out_count[s];
+    }
+    automaton->out_list = malloc((automaton->out_start[num_states] + 1) * sizeof(int32_t));
+    if (automaton->out_list == NULL) {
+        return build_failed(automaton, next, fail, terminal, same_end, queue, out_count);
+    }
+    for (int i = 0; i < tail; i++) {
+        int state = queue[i];
+        int32_t *out = automaton->out_list + automaton->out_start[state];
+        for (int p = terminal[state]; p >= 0; p = same_end[p]) {
+            *out++ = p;
+        }
+        int inherited = fail[state];
+        memcpy(out, automaton->out_list + automaton->out_start[inherited], out_count[inherited] * sizeof(int32_t));
+    }
+
+    int32_t *shrunk = realloc(next, (size_t)num_states * num_classes * sizeof(int32_t));
+    if (shrunk == NULL) {
+        return build_failed(automaton, next, fail, terminal, same_end, queue, out_count);
+    }
+    automaton->num_states = num_states;
+    automaton->next = shrunk;
+    free(out_count);
+    free(queue);
+    free(fail);
+    free(terminal);
+    free(same_end);
+    return 1;
+}
+
+void automaton_free(Automaton *automaton) {
+    free(automaton->lengths);
+    free(automaton->next);
+    free(automaton->out_start);
+    free(automaton->out_list);
+    memset(automaton, 0, sizeof(*automaton));
+}
+
+int automaton_counts_init(AutomatonCounts *counts, int num_patterns) {
+    counts->counts = calloc(num_patterns, sizeof(size_t));
+    counts->first_match = malloc(num_patterns * sizeof(size_t));
+    counts->last_end = calloc(num_patterns, sizeof(size_t));
+    return counts->counts != NULL && counts->first_match != NULL && counts->last_end != NULL;
+}
+
+void automaton_counts_free(AutomatonCounts *counts) {
+    free(counts->counts);
+    free(counts->first_match);
+    free(counts->last_end);
+}
+
+void automaton_scan(const Automaton *automaton, const char *data, size_t size, size_t begin, size_t end, size_t limit, AutomatonCounts *counts) {
+    int whole_word = automaton->flags & SCAN_WHOLE_WORD;
+    const int32_t *next = automaton->next;
+    const uint8_t *byte_class = automaton->byte_class;
+    int num_classes = automaton->num_classes;
+    for (int p = 0; p < automaton->num_patterns; p++) {
+        counts->counts[p] = 0;
+        counts->first_match[p] = SIZE_MAX;
+    }
+    int state = 0;
+    for (size_t pos = begin; pos < limit; pos++) {
+        state = next[state * num_classes + byte_class[(uint8_t)data[pos]]];
+        int out = automaton->out_start[state];
+        int out_end = automaton->out_start[state + 1];
+        for (; out < out_end; out++) {
+            int p = automaton->out_list[out];
+            size_t start = pos + 1 - automaton->lengths[p];
+			//owned by the next range, or overlapping the previous match of this target
+            if (start >= end || start < counts->last_end[p]) {
+                continue;
+            }
+            if (whole_word && ((start > 0 && scan_is_word_byte((uint8_t)data[start - 1])) || (pos + 1 < size && scan_is_word_byte((uint8_t)data[pos + 1])))) {
+                continue;
+            }
+            if (counts->first_match[p] == SIZE_MAX) {
+                counts->first_match[p] = start;
+            }
+            counts->counts[p]++;
+            counts->last_end[p] = pos + 1;
+            INSTRUMENT_ADD(matches, 1);
+        }
+    }
+    INSTRUMENT_ADD(bytes, limit > begin ? limit - begin : 0);
+}
@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include "file_tree.h"
+#ifndef _WIN32
+#include <glob.h>
+#endif
+#ifndef TF_NO_ZLIB
+#include <zlib.h>
+#endif
+
+static char *join_path(const char *dir, const char *name) {
+    size_t dir_len = strlen(dir);
+    size_t name_len = strlen(name);
+    char *path = malloc(dir_len + name_len + 2);
+    if (path == NULL) {
+        return NULL;
+    }
+    memcpy(path, dir, dir_len);
+	//no double slash after "/" or "dir/"
+    if (dir_len > 0 && dir[dir_len - 1] != '/') {
+        path[dir_len++] = '/';
+    }
+    memcpy(path + dir_len, name, name_len + 1);
+    return path;
+}
+
+//Append path if it is a regular file or a directory, follow_links for command line paths
+static int add_entry(const char *path, int follow_links, TreeEntry **entries, int *num_entries, int *capacity) {
+    struct stat st;
+#ifndef _WIN32
+    int failed = follow_links ? stat(path, &st) : lstat(path, &st);
+#else
+    (void)follow_links;
+    int failed = stat(path, &st);
+#endif
+    if (failed != 0) {
+        perror(path);
+        return 0;
+    }
+    if (!S_ISREG(st.st_mode) && !S_ISDIR(st.st_mode)) {
+        return 1;
+    }
+    if (*num_entries == *capacity) {
+        *capacity = (*capacity == 0) ? 16 : *capacity * 2;
+        TreeEntry *grown = realloc(*entries, *capacity * sizeof(TreeEntry));
+        if (grown == NULL) {
+            return 0;
+        }
+        *entries = grown;
+    }
+    TreeEntry *entry = &(*entries)[*num_entries];
+    entry->path = strdup(path);
+    entry->size = (size_t)st.st_size;
+    entry->is_dir = S_ISDIR(st.st_mode);
+    if (entry->path == NULL) {
+        return 0;
+    }
+    (*num_entries)++;
+    return 1;
+}
+
+int tree_expand(const char *pattern, TreeEntry **entries, int *num_entries) {
+    int capacity = 0;
+    *entries = NULL;
+    *num_entries = 0;
+#ifndef _WIN32
+    if (strpbrk(pattern, "*?[") != NULL) {
+        glob_t matches;
+        int result = glob(pattern, 0, NULL, &matches);
+        if (result == GLOB_NOMATCH) {
+            fprintf(stderr, "No file matches %s\n", pattern);
+            return 0;
+        }
+        if (result != 0) {
+            fprintf(stderr, "Error expanding %s\n", pattern);
+            return 0;
+        }
+        for (size_t i = 0; i < matches.gl_pathc; i++) {
+            add_entry(matches.gl_pathv[i], 1, entries, num_entries, &capacity);
+        }
+        globfree(&matches);
+        return *num_entries > 0;
+    }
+#endif
+    return add_entry(pattern, 1, entries, num_entries, &capacity);
+}
+
+int tree_read_dir(const char *dir, TreeEntry **entries, int *num_entries) {
+    int capacity = 0;
+    *entries = NULL;
+    *num_entries = 0;
+    DIR *handle = opendir(dir);
+    if (handle == NULL) {
+        perror(dir);
+        return 0;
+    }
+    struct dirent *item;
+    while ((item = readdir(handle)) != NULL) {
+        if (strcmp(item->d_name, ".") == 0 || strcmp(item->d_name, "..") == 0) {
+            continue;
+        }
+        char *path = join_path(dir, item->d_name);
+        if (path != NULL) {
+            add_entry(path, 0, entries, num_entries, &capacity);
+        }
+        free(path);
+    }
+    closedir(handle);
+    return 1;
+}
+
+void tree_entries_free(TreeEntry *entries, int num_entries) {
+    for (int i = 0; i < num_entries; i++) {
+        free(entries[i].path);
+    }
+    free(entries);
+}
+
+TreeFile *tree_list_add(TreeList *list, const char *path, size_t size) {
+    if (list->num_files == list->capacity) {
+        int capacity = (list->capacity == 0) ? 64 : list->capacity * 2;
+        TreeFile **grown = realloc(list->files, capacity * sizeof(TreeFile *));
+        if (grown == NULL) {
+            return NULL;
+        }
+        list->files = grown;
+        list->capacity = capacity;
+    }
+    TreeFile *file = calloc(1, sizeof(TreeFile));
+    if (file == NULL || (file->path = strdup(path)) == NULL) {
+        free(file);
+        return NULL;
+    }
+    file->size = size;
+    list->files[list->num_files++] = file;
+    return file;
+}
+
+static int compare_files(const void *a, const void *b) {
+    return strcmp((*(TreeFile *const *)a)->path, (*(TreeFile *const *)b)->path);
+}
+
+void tree_list_sort(TreeList *list) {
+    qsort(list->files, list->num_files, sizeof(TreeFile *), compare_files);
+}
+
+size_t tree_list_report(const TreeList *list, int print) {
+    size_t total = 0;
+    for (int i = 0; i < list->num_files; i++) {
+        const TreeFile *file = list->files[i];
+        if (print && file->failed) {
+            printf("%s: unreadable\n", file->path);
+        } else if (print) {
+            printf("%s: %zu\n", file->path, file->count);
+        }
+        total += file->count;
+    }
+    return total;
+}
+
+void tree_list_free(TreeList *list) {
+    for (int i = 0; i < list->num_files; i++) {
+        free(list->files[i]->path);
+        free(list->files[i]);
+    }
+    free(list->files);
+    list->files = NULL;
+    list->num_files = 0;
+    list->capacity = 0;
+}
+
+int tree_count_file(const ScanPattern *pattern, TreeFile *file) {
+    FILE *fp = fopen(file->path, "rb");
+    if (fp == NULL) {
+        perror(file->path);
+        file->failed = 1;
+        return 0;
+    }
+    char *data = malloc(file->size > 0 ? file->size : 1);
+	//the file may have shrunk since the walk, count what is there
+    size_t size = data != NULL ? fread(data, 1, file->size, fp) : 0;
+    if (data == NULL || ferror(fp)) {
+        perror(file->path);
+        file->failed = 1;
+    } else {
+        file->count = scan_count(pattern, data, size);
+    }
+    free(data);
+    fclose(fp);
+    return !file->failed;
+}
+
+int file_is_gzip(const char *path) {
+#ifndef TF_NO_ZLIB
+    unsigned char magic[2];
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return 0;
+    }
+    int is_gzip = fread(magic, 1, 2, fp) == 2 && magic[0] == 0x1f && magic[1] == 0x8b;
+    fclose(fp);
+    return is_gzip;
+#else
+    (void)path;
+    return 0;
+#endif
+}
+
+#ifndef TF_NO_ZLIB
+static double seconds_since(const struct timeval *start) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) / 1000000.0;
+}
+#endif
+
+int tree_count_gzip(const ScanPattern *pattern, TreeFile *file, double *inflate_time, double *scan_time) {
+#ifndef TF_NO_ZLIB
+	//same block edges as the streaming ring: the tail of the previous block (pad
+	//bytes, plus one byte of word boundary context) is kept in front of the next
+    size_t context = (pattern->flags & SCAN_WHOLE_WORD) ? 1 : 0;
+    size_t pad = pattern->len - 1 + context;
+    size_t keep = pad + context;
+    size_t block_size = GZIP_BLOCK_SIZE > 2 * keep ? GZIP_BLOCK_SIZE : 2 * keep;
+    gzFile gz = gzopen(file->path, "rb");
+    char *buffer = malloc(keep + block_size);
+    if (gz == NULL || buffer == NULL) {
+        perror(file->path);
+        if (gz != NULL) {
+            gzclose(gz);
+        }
+        free(buffer);
+        file->failed = 1;
+        return 0;
+    }
+    gzbuffer(gz, 256 * 1024);
+    size_t kept = 0;     //bytes of the previous block at the start of buffer
+    size_t offset = 0;   //stream offset of buffer[0]
+    size_t carry = 0;    //stream offset right after the last counted match
+    for (;;) {
+        struct timeval start;
+        gettimeofday(&start, NULL);
+        int got = gzread(gz, buffer + kept, (unsigned int)block_size);
+        *inflate_time += seconds_since(&start);
+        if (got < 0) {
+            int error;
+            fprintf(stderr, "%s: %s\n", file->path, gzerror(gz, &error));
+            file->failed = 1;
+            break;
+        }
+		//gzread only returns a short block at the end of the last member
+        int last = (size_t)got < block_size;
+        size_t len = kept + (size_t)got;
+        size_t owned_begin = kept > pad ? kept - pad : 0;
+        size_t owned_end = last ? len : len - pad;
+        size_t from = carry > offset + owned_begin ? carry - offset : owned_begin;
+        gettimeofday(&start, NULL);
+        if (from < owned_end) {
+            size_t first_match, last_end;
+            size_t found = scan_count_owned(pattern, buffer, len, from, owned_end, &first_match, &last_end);
+            if (found > 0) {
+                file->count += found;
+                carry = offset + last_end;
+            }
+        }
+        *scan_time += seconds_since(&start);
+        if (last) {
+            break;
+        }
+        kept = len < keep ? len : keep;
+        memmove(buffer, buffer + len - kept, kept);
+        offset += len - kept;
+    }
+    gzclose(gz);
+    free(buffer);
+    return !file->failed;
+#else
+    (void)inflate_time;
+    (void)scan_time;
+    return tree_count_file(pattern, file);
+#endif
+}
@@ -0,0 +1,206 @@
+#include "instrument.h"
+
+#ifdef TF_INSTRUMENT
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+#if defined(TF_PERF_EVENTS) && defined(__linux__)
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#define INSTRUMENT_PERF 1
+#define NUM_COUNTERS 3
+#endif
+
+__thread ThreadStats *instrument_current = NULL;
+
+static ThreadStats *slots = NULL;
+static int num_slots = 0;
+static int counters_opened = 0;
+
+//Start values of the open enter/leave pair of this thread
+static __thread double enter_time;
+static __thread long enter_faults;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static long major_faults(void) {
+#ifdef RUSAGE_THREAD
+    struct rusage usage;
+    if (getrusage(RUSAGE_THREAD, &usage) == 0) {
+        return usage.ru_majflt;
+    }
+#endif
+    return 0;
+}
+
+#ifdef INSTRUMENT_PERF
+//Counters are opened once per thread (pool and OpenMP threads live long) and
+//closed by the key destructor when the thread exits
+static __thread int perf_fds[NUM_COUNTERS] = {-1, -1, -1};
+static __thread int perf_state; //0 not tried yet, 1 open, -1 unavailable
+static __thread uint64_t enter_counters[NUM_COUNTERS];
+static pthread_key_t perf_key;
+static pthread_once_t perf_key_once = PTHREAD_ONCE_INIT;
+
+static void close_counters(void *arg) {
+    (void)arg;
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+        if (perf_fds[i] >= 0) {
+            close(perf_fds[i]);
+            perf_fds[i] = -1;
+        }
+    }
+}
+
+static void create_perf_key(void) {
+    pthread_key_create(&perf_key, close_counters);
+}
+
+static void open_counters(void) {
+    static const uint64_t configs[NUM_COUNTERS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES};
+    perf_state = -1;
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[i];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        perf_fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (perf_fds[i] >= 0) {
+            perf_state = 1;
+        }
+    }
+    if (perf_state == 1) {
+        __sync_fetch_and_add(&counters_opened, 1);
+        pthread_once(&perf_key_once, create_perf_key);
+        pthread_setspecific(perf_key, (void *)1);
+    }
+}
+
+static void read_counters(uint64_t *values) {
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+        values[i] = 0;
+        if (perf_fds[i] >= 0 && read(perf_fds[i], &values[i], sizeof(uint64_t)) != sizeof(uint64_t)) {
+            values[i] = 0;
+        }
+    }
+}
+#endif
+
+void instrument_begin(int count) {
+    free(slots);
+    slots = calloc(count, sizeof(ThreadStats));
+    num_slots = slots != NULL ? count : 0;
+}
+
+void instrument_enter(int slot) {
+    if (slot < 0 || slot >= num_slots) {
+        instrument_current = NULL;
+        return;
+    }
+    instrument_current = &slots[slot];
+    instrument_current->active = 1;
+    enter_faults = major_faults();
+#ifdef INSTRUMENT_PERF
+    if (perf_state == 0) {
+        open_counters();
+    }
+    if (perf_state == 1) {
+        read_counters(enter_counters);
+    }
+#endif
+    enter_time = now_seconds();
+}
+
+void instrument_leave(void) {
+    ThreadStats *stats = instrument_current;
+    if (stats == NULL) {
+        return;
+    }
+    stats->wall += now_seconds() - enter_time;
+    stats->major_faults += major_faults() - enter_faults;
+#ifdef INSTRUMENT_PERF
+    if (perf_state == 1) {
+        uint64_t values[NUM_COUNTERS];
+        read_counters(values);
+        stats->cycles += values[0] - enter_counters[0];
+        stats->instructions += values[1] - enter_counters[1];
+        stats->llc_misses += values[2] - enter_counters[2];
+    }
+#endif
+    instrument_current = NULL;
+}
+
+void instrument_io_wait(double seconds) {
+    if (instrument_current != NULL) {
+        instrument_current->io_wait += seconds;
+    }
+}
+
+void instrument_report(FILE *out, const char *engine) {
+    ThreadStats total;
+    memset(&total, 0, sizeof(total));
+    double max_wall = 0.0;
+    uint64_t max_bytes = 0;
+    int slowest = -1;
+    int active = 0;
+    fprintf(out, "\nPer-thread statistics (%s):\n", engine);
+    fprintf(out, "%6s %14s %12s %10s %10s %10s %7s", "thread", "bytes", "candidates", "matches", "wall s", "io wait s", "majflt");
+#ifdef INSTRUMENT_PERF
+    fprintf(out, " %14s %14s %6s %12s", "cycles", "instructions", "IPC", "LLC misses");
+#endif
+    fprintf(out, "\n");
+    for (int i = 0; i < num_slots; i++) {
+        const ThreadStats *s = &slots[i];
+        if (!s->active) {
+            continue;
+        }
+        active++;
+        fprintf(out, "%6d %14llu %12llu %10llu %10.6f %10.6f %7llu", i, (unsigned long long)s->bytes, (unsigned long long)s->candidates, (unsigned long long)s->matches, s->wall, s->io_wait, (unsigned long long)s->major_faults);
+#ifdef INSTRUMENT_PERF
+        fprintf(out, " %14llu %14llu %6.2f %12llu", (unsigned long long)s->cycles, (unsigned long long)s->instructions, s->cycles > 0 ? (double)s->instructions / s->cycles : 0.0, (unsigned long long)s->llc_misses);
+#endif
+        fprintf(out, "\n");
+        total.bytes += s->bytes;
+        total.candidates += s->candidates;
+        total.matches += s->matches;
+        total.wall += s->wall;
+        total.io_wait += s->io_wait;
+        if (s->wall > max_wall) {
+            max_wall = s->wall;
+            slowest = i;
+        }
+        if (s->bytes > max_bytes) {
+            max_bytes = s->bytes;
+        }
+    }
+    if (active == 0) {
+        fprintf(out, "No instrumented work.\n");
+        return;
+    }
+	//1.00 is a perfect balance, the run lasts as long as the slowest thread
+    double mean_wall = total.wall / active;
+    double mean_bytes = (double)total.bytes / active;
+    fprintf(out, "Load imbalance: %d threads, wall max/mean %.2f, bytes max/mean %.2f, slowest thread %d (%.6f s, mean %.6f s), io wait %.1f%% of thread time\n",
+            active, mean_wall > 0 ? max_wall / mean_wall : 1.0, mean_bytes > 0 ? max_bytes / mean_bytes : 1.0, slowest, max_wall, mean_wall,
+            total.wall > 0 ? 100.0 * total.io_wait / total.wall : 0.0);
+    fprintf(out, "Totals: %llu bytes, %llu candidates, %llu matches\n", (unsigned long long)total.bytes, (unsigned long long)total.candidates, (unsigned long long)total.matches);
+#ifdef INSTRUMENT_PERF
+    if (counters_opened == 0) {
+        fprintf(out, "Hardware counters unavailable (perf_event_open failed, check /proc/sys/kernel/perf_event_paranoid).\n");
+    }
+#endif
+}
+
+#endif
@@ -0,0 +1,68 @@
+#include "mapped_file.h"
+
+//Map the whole file read-only, no per-line copies are made
+int map_file(const char *file_name, MappedFile *file) {
+    file->data = NULL;
+    file->size = 0;
+    file->is_mapped = 0;
+#ifndef _WIN32
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
+        perror("Error opening file");
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror("Error reading file size");
+        close(fd);
+        return 0;
+    }
+    file->size = (size_t)st.st_size;
+    if (file->size > 0) {
+        void *data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            perror("Error mapping file");
+            close(fd);
+            return 0;
+        }
+        //the ranges are read front to back, let the kernel read ahead
+        madvise(data, file->size, MADV_SEQUENTIAL);
+        file->data = data;
+        file->is_mapped = 1;
+    }
+    close(fd);
+#else
+    //no mmap here, fall back to one single read of the whole file
+    FILE *fp = fopen(file_name, "rb");
+    if (fp == NULL) {
+        perror("Error opening file");
+        return 0;
+    }
+    fseek(fp, 0, SEEK_END);
+    file->size = (size_t)ftell(fp);
+    rewind(fp);
+    char *data = malloc(file->size + 1);
+    if (data == NULL || fread(data, 1, file->size, fp) != file->size) {
+        perror("Error reading file");
+        free(data);
+        fclose(fp);
+        return 0;
+    }
+    fclose(fp);
+    file->data = data;
+#endif
+    return 1;
+}
+
+void unmap_file(MappedFile *file) {
+#ifndef _WIN32
+    if (file->is_mapped) {
+        munmap((void *)file->data, file->size);
+    }
+#else
+    free((void *)file->data);
+#endif
+    file->data = NULL;
+    file->size = 0;
+    file->is_mapped = 0;
+}
@@ -0,0 +1,199 @@
+#include <stdlib.h>
+#include <string.h>
+#include "matches.h"
+#include "instrument.h"
+
+#define BINARY_MAGIC "TFMATCH1"
+
+void match_buffer_grow(MatchBuffer *buffer) {
+    size_t capacity = (buffer->capacity == 0) ? 1024 : buffer->capacity * 2;
+    MatchRecord *records = realloc(buffer->records, capacity * sizeof(MatchRecord));
+    if (records == NULL) {
+        perror("Error growing match buffer");
+        exit(1);
+    }
+    buffer->records = records;
+    buffer->capacity = capacity;
+}
+
+void match_buffer_free(MatchBuffer *buffer) {
+    free(buffer->records);
+    buffer->records = NULL;
+    buffer->count = 0;
+    buffer->capacity = 0;
+}
+
+size_t scan_collect_owned(const ScanPattern *pattern, const char *data, size_t size, size_t from, size_t end, size_t *first_match, size_t *last_end, MatchBuffer *matches) {
+    size_t limit = end + pattern->len - 1;
+    if (limit > size) {
+        limit = size;
+    }
+    size_t count = 0;
+    size_t pos = from;
+    *first_match = SIZE_MAX;
+    *last_end = pos;
+    while (pos < end && pos + pattern->len <= limit) {
+        const char *hit = scan_find(pattern, data + pos, limit - pos);
+        if (hit == NULL || (size_t)(hit - data) >= end) {
+            break;
+        }
+        size_t offset = hit - data;
+        if ((pattern->flags & SCAN_WHOLE_WORD) && !scan_word_match(pattern, data, size, offset)) {
+            pos = offset + 1;
+            continue;
+        }
+        if (*first_match == SIZE_MAX) {
+            *first_match = offset;
+        }
+        match_buffer_push(matches, offset);
+        count++;
+        pos = offset + pattern->len;
+        *last_end = pos;
+    }
+    INSTRUMENT_ADD(matches, count);
+    return count;
+}
+
+void match_buffer_locate(MatchBuffer *buffer, const char *data, size_t begin, size_t end, size_t *newlines, size_t *last_newline) {
+    size_t line = 0;
+    size_t line_start = begin;
+    size_t counted_to = begin;
+    *last_newline = SIZE_MAX;
+    for (size_t i = 0; i < buffer->count; i++) {
+        MatchRecord *record = &buffer->records[i];
+		//advance the line counter up to the match
+        const char *newline;
+        while ((newline = memchr(data + counted_to, '\n', record->offset - counted_to)) != NULL) {
+            line++;
+            *last_newline = newline - data;
+            counted_to = *last_newline + 1;
+            line_start = counted_to;
+        }
+        counted_to = record->offset;
+        record->line = line;
+        record->column = record->offset - line_start;
+    }
+	//rest of the chunk, for the line numbers of the next chunks
+    const char *newline;
+    while ((newline = memchr(data + counted_to, '\n', end - counted_to)) != NULL) {
+        line++;
+        *last_newline = newline - data;
+        counted_to = *last_newline + 1;
+    }
+    *newlines = line;
+}
+
+void file_position_advance(FilePosition *position, size_t begin, size_t end, size_t newlines, size_t last_newline) {
+    position->line += newlines;
+    if (last_newline == SIZE_MAX) {
+        position->column += end - begin;
+    } else {
+        position->column = end - last_newline - 1;
+    }
+}
+
+int parse_report_format(const char *name, ReportFormat *format) {
+    if (strcmp(name, "text") == 0) {
+        *format = REPORT_TEXT;
+    } else if (strcmp(name, "csv") == 0) {
+        *format = REPORT_CSV;
+    } else if (strcmp(name, "binary") == 0) {
+        *format = REPORT_BINARY;
+    } else {
+        fprintf(stderr, "Unknown report format: %s (text, csv or binary)\n", name);
+        return 0;
+    }
+    return 1;
+}
+
+static void writer_flush(MatchWriter *writer) {
+    if (writer->used > 0) {
+        fwrite(writer->buffer, 1, writer->used, writer->file);
+        writer->used = 0;
+    }
+}
+
+static void writer_append(MatchWriter *writer, const char *bytes, size_t len) {
+    if (writer->used + len > WRITER_BUFFER_SIZE) {
+        writer_flush(writer);
+    }
+    memcpy(writer->buffer + writer->used, bytes, len);
+    writer->used += len;
+}
+
+//Decimal digits of value, written backwards from the end of out
+static char *format_number(char *out_end, uint64_t value) {
+    do {
+        *--out_end = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+    return out_end;
+}
+
+int match_writer_open(MatchWriter *writer, const char *path, ReportFormat format) {
+    memset(writer, 0, sizeof(*writer));
+    writer->format = format;
+    if (strcmp(path, "-") == 0) {
+        writer->file = stdout;
+    } else {
+        writer->file = fopen(path, format == REPORT_BINARY ? "wb" : "w");
+        writer->close_file = 1;
+    }
+    if (writer->file == NULL) {
+        perror("Error opening report file");
+        return 0;
+    }
+    writer->buffer = malloc(WRITER_BUFFER_SIZE);
+    if (writer->buffer == NULL) {
+        perror("Error allocating report buffer");
+        if (writer->close_file) {
+            fclose(writer->file);
+        }
+        return 0;
+    }
+    if (format == REPORT_CSV) {
+        writer_append(writer, "line,column,offset\n", 19);
+    } else if (format == REPORT_BINARY) {
+        writer_append(writer, BINARY_MAGIC, 8);
+    }
+    return 1;
+}
+
+//Lines and columns are written 1-based, like the old per-match printf
+void match_writer_write(MatchWriter *writer, const MatchBuffer *buffer, const FilePosition *start) {
+    for (size_t i = 0; i < buffer->count; i++) {
+        const MatchRecord *record = &buffer->records[i];
+        MatchRecord global;
+        global.offset = record->offset;
+        global.line = start->line + record->line + 1;
+        global.column = (record->line == 0 ? start->column : 0) + record->column + 1;
+        if (writer->format == REPORT_BINARY) {
+            writer_append(writer, (const char *)&global, sizeof(global));
+        } else {
+            char text[96];
+            char *end = text + sizeof(text);
+            char *pos = end;
+            const char *separator = writer->format == REPORT_CSV ? "," : ":";
+            *--pos = '\n';
+            pos = format_number(pos, global.offset);
+            *--pos = separator[0];
+            pos = format_number(pos, global.column);
+            *--pos = separator[0];
+            pos = format_number(pos, global.line);
+            writer_append(writer, pos, end - pos);
+        }
+    }
+    writer->written += buffer->count;
+}
+
+int match_writer_close(MatchWriter *writer) {
+    writer_flush(writer);
+    int ok = !ferror(writer->file);
+    if (writer->close_file) {
+        ok = (fclose(writer->file) == 0) && ok;
+    } else {
+        fflush(writer->file);
+    }
+    free(writer->buffer);
+    return ok;
+}
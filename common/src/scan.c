@@ -0,0 +1,368 @@
+#include "scan.h"
+#include "instrument.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+typedef const char *(*find_function)(const ScanPattern *, const char *, size_t);
+
+//ASCII lower case of every byte
+static uint8_t fold_table[256];
+
+static int equal_folded(const char *a, const char *b, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (fold_table[(uint8_t)a[i]] != fold_table[(uint8_t)b[i]]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+//Plain C search: memchr for the first byte, memcmp for the rest
+static const char *find_scalar(const ScanPattern *pattern, const char *buf, size_t len) {
+    const char *end = buf + len;
+    while ((size_t)(end - buf) >= pattern->len) {
+        const char *pos = memchr(buf, pattern->text[0], (end - buf) - pattern->len + 1);
+        if (pos == NULL) {
+            return NULL;
+        }
+        INSTRUMENT_ADD(candidates, 1);
+        if (memcmp(pos + 1, pattern->text + 1, pattern->len - 1) == 0) {
+            return pos;
+        }
+        buf = pos + 1;
+    }
+    return NULL;
+}
+
+//Case-insensitive scalar search, there is no case-insensitive memchr
+static const char *find_scalar_fold(const ScanPattern *pattern, const char *buf, size_t len) {
+    uint8_t first = fold_table[(uint8_t)pattern->text[0]];
+    for (size_t i = 0; i + pattern->len <= len; i++) {
+        if (fold_table[(uint8_t)buf[i]] == first) {
+            INSTRUMENT_ADD(candidates, 1);
+            if (equal_folded(buf + i + 1, pattern->text + 1, pattern->len - 1)) {
+                return buf + i;
+            }
+        }
+    }
+    return NULL;
+}
+
+#ifdef SCAN_X86
+//The vector kernels compare the first and the last byte of the target at every
+//position of a block, only the positions where both match are verified with memcmp.
+//Positions too close to the end for a full block are left to the scalar search.
+
+//Candidate positions are rare, keeping the memcmp calls out of line stops the
+//compiler from spilling the vector registers in the block loops
+__attribute__((noinline))
+static const char *verify_candidates(const ScanPattern *pattern, const char *block, unsigned long long mask) {
+    while (mask != 0) {
+        unsigned bit = __builtin_ctzll(mask);
+        INSTRUMENT_ADD(candidates, 1);
+        if (pattern->len <= 2 || memcmp(block + bit + 1, pattern->text + 1, pattern->len - 2) == 0) {
+            return block + bit;
+        }
+        mask &= mask - 1;
+    }
+    return NULL;
+}
+
+__attribute__((noinline))
+static const char *verify_candidates_fold(const ScanPattern *pattern, const char *block, unsigned long long mask) {
+    while (mask != 0) {
+        unsigned bit = __builtin_ctzll(mask);
+        INSTRUMENT_ADD(candidates, 1);
+        if (pattern->len <= 2 || equal_folded(block + bit + 1, pattern->text + 1, pattern->len - 2)) {
+            return block + bit;
+        }
+        mask &= mask - 1;
+    }
+    return NULL;
+}
+
+//Case folding in the filter: a letter of the target is compared with the block
+//byte OR 0x20, which is its lower case. Some non-letters fold onto a letter too
+//('@' onto '`'), those extra candidates are rejected by the verification.
+static uint8_t fold_bit(char c) {
+    return ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') ? 0x20 : 0;
+}
+
+__attribute__((target("sse2")))
+static const char *find_sse2(const ScanPattern *pattern, const char *buf, size_t len) {
+    size_t n = pattern->len;
+    const __m128i first = _mm_set1_epi8(pattern->text[0]);
+    const __m128i last = _mm_set1_epi8(pattern->text[n - 1]);
+    size_t i = 0;
+    for (; i + n - 1 + 16 <= len; i += 16) {
+        __m128i block_first = _mm_loadu_si128((const __m128i *)(buf + i));
+        __m128i block_last = _mm_loadu_si128((const __m128i *)(buf + i + n - 1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last)));
+        if (mask != 0) {
+            const char *hit = verify_candidates(pattern, buf + i, mask);
+            if (hit != NULL) {
+                return hit;
+            }
+        }
+    }
+    return find_scalar(pattern, buf + i, len - i);
+}
+
+__attribute__((target("sse2")))
+static const char *find_sse2_fold(const ScanPattern *pattern, const char *buf, size_t len) {
+    size_t n = pattern->len;
+    const __m128i first = _mm_set1_epi8(fold_table[(uint8_t)pattern->text[0]]);
+    const __m128i last = _mm_set1_epi8(fold_table[(uint8_t)pattern->text[n - 1]]);
+    const __m128i first_bit = _mm_set1_epi8(fold_bit(pattern->text[0]));
+    const __m128i last_bit = _mm_set1_epi8(fold_bit(pattern->text[n - 1]));
+    size_t i = 0;
+    for (; i + n - 1 + 16 <= len; i += 16) {
+        __m128i block_first = _mm_or_si128(_mm_loadu_si128((const __m128i *)(buf + i)), first_bit);
+        __m128i block_last = _mm_or_si128(_mm_loadu_si128((const __m128i *)(buf + i + n - 1)), last_bit);
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last)));
+        if (mask != 0) {
+            const char *hit = verify_candidates_fold(pattern, buf + i, mask);
+            if (hit != NULL) {
+                return hit;
+            }
+        }
+    }
+    return find_scalar_fold(pattern, buf + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static const char *find_avx2(const ScanPattern *pattern, const char *buf, size_t len) {
+    size_t n = pattern->len;
+    const __m256i first = _mm256_set1_epi8(pattern->text[0]);
+    const __m256i last = _mm256_set1_epi8(pattern->text[n - 1]);
+    size_t i = 0;
+    for (; i + n - 1 + 32 <= len; i += 32) {
+        __m256i block_first = _mm256_loadu_si256((const __m256i *)(buf + i));
+        __m256i block_last = _mm256_loadu_si256((const __m256i *)(buf + i + n - 1));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, block_first), _mm256_cmpeq_epi8(last, block_last)));
+        if (mask != 0) {
+            const char *hit = verify_candidates(pattern, buf + i, mask);
+            if (hit != NULL) {
+                return hit;
+            }
+        }
+    }
+    return find_sse2(pattern, buf + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static const char *find_avx2_fold(const ScanPattern *pattern, const char *buf, size_t len) {
+    size_t n = pattern->len;
+    const __m256i first = _mm256_set1_epi8(fold_table[(uint8_t)pattern->text[0]]);
+    const __m256i last = _mm256_set1_epi8(fold_table[(uint8_t)pattern->text[n - 1]]);
+    const __m256i first_bit = _mm256_set1_epi8(fold_bit(pattern->text[0]));
+    const __m256i last_bit = _mm256_set1_epi8(fold_bit(pattern->text[n - 1]));
+    size_t i = 0;
+    for (; i + n - 1 + 32 <= len; i += 32) {
+        __m256i block_first = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(buf + i)), first_bit);
+        __m256i block_last = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(buf + i + n - 1)), last_bit);
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, block_first), _mm256_cmpeq_epi8(last, block_last)));
+        if (mask != 0) {
+            const char *hit = verify_candidates_fold(pattern, buf + i, mask);
+            if (hit != NULL) {
+                return hit;
+            }
+        }
+    }
+    return find_sse2_fold(pattern, buf + i, len - i);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static const char *find_avx512(const ScanPattern *pattern, const char *buf, size_t len) {
+    size_t n = pattern->len;
+    const __m512i first = _mm512_set1_epi8(pattern->text[0]);
+    const __m512i last = _mm512_set1_epi8(pattern->text[n - 1]);
+    size_t i = 0;
+    for (; i + n - 1 + 64 <= len; i += 64) {
+        __m512i block_first = _mm512_loadu_si512((const void *)(buf + i));
+        __m512i block_last = _mm512_loadu_si512((const void *)(buf + i + n - 1));
+        unsigned long long mask = _mm512_cmpeq_epi8_mask(first, block_first) & _mm512_cmpeq_epi8_mask(last, block_last);
+        if (mask != 0) {
+            const char *hit = verify_candidates(pattern, buf + i, mask);
+            if (hit != NULL) {
+                return hit;
+            }
+        }
+    }
+    return find_avx2(pattern, buf + i, len - i);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static const char *find_avx512_fold(const ScanPattern *pattern, const char *buf, size_t len) {
+    size_t n = pattern->len;
+    const __m512i first = _mm512_set1_epi8(fold_table[(uint8_t)pattern->text[0]]);
+    const __m512i last = _mm512_set1_epi8(fold_table[(uint8_t)pattern->text[n - 1]]);
+    const __m512i first_bit = _mm512_set1_epi8(fold_bit(pattern->text[0]));
+    const __m512i last_bit = _mm512_set1_epi8(fold_bit(pattern->text[n - 1]));
+    size_t i = 0;
+    for (; i + n - 1 + 64 <= len; i += 64) {
+        __m512i block_first = _mm512_or_si512(_mm512_loadu_si512((const void *)(buf + i)), first_bit);
+        __m512i block_last = _mm512_or_si512(_mm512_loadu_si512((const void *)(buf + i + n - 1)), last_bit);
+        unsigned long long mask = _mm512_cmpeq_epi8_mask(first, block_first) & _mm512_cmpeq_epi8_mask(last, block_last);
+        if (mask != 0) {
+            const char *hit = verify_candidates_fold(pattern, buf + i, mask);
+            if (hit != NULL) {
+                return hit;
+            }
+        }
+    }
+    return find_avx2_fold(pattern, buf + i, len - i);
+}
+#endif
+
+static find_function active_find = NULL;
+static find_function active_find_fold = NULL;
+static const char *active_name = "scalar";
+
+static void set_kernel(find_function find, find_function find_fold, const char *name) {
+    for (int c = 0; c < 256; c++) {
+        fold_table[c] = (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+    }
+    active_find_fold = find_fold;
+    active_name = name;
+    active_find = find;
+}
+
+//Pick the widest kernel the CPU supports
+static void scan_dispatch(void) {
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw")) {
+        set_kernel(find_avx512, find_avx512_fold, "avx512");
+        return;
+    } else if (__builtin_cpu_supports("avx2")) {
+        set_kernel(find_avx2, find_avx2_fold, "avx2");
+        return;
+    } else if (__builtin_cpu_supports("sse2")) {
+        set_kernel(find_sse2, find_sse2_fold, "sse2");
+        return;
+    }
+#endif
+    set_kernel(find_scalar, find_scalar_fold, "scalar");
+}
+
+int scan_use_kernel(const char *name) {
+    if (strcmp(name, "auto") == 0) {
+        scan_dispatch();
+        return 1;
+    }
+    if (strcmp(name, "scalar") == 0) {
+        set_kernel(find_scalar, find_scalar_fold, "scalar");
+        return 1;
+    }
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2")) {
+        set_kernel(find_sse2, find_sse2_fold, "sse2");
+        return 1;
+    }
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        set_kernel(find_avx2, find_avx2_fold, "avx2");
+        return 1;
+    }
+    if (strcmp(name, "avx512") == 0 && __builtin_cpu_supports("avx512bw")) {
+        set_kernel(find_avx512, find_avx512_fold, "avx512");
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+const char *scan_kernel_name(void) {
+    if (active_find == NULL) {
+        scan_dispatch();
+    }
+    return active_name;
+}
+
+//Resolving the kernel here keeps the dispatch out of the search loops
+void scan_pattern_init(ScanPattern *pattern, const char *text, size_t len) {
+    scan_pattern_init_flags(pattern, text, len, 0);
+}
+
+void scan_pattern_init_flags(ScanPattern *pattern, const char *text, size_t len, int flags) {
+    if (active_find == NULL) {
+        scan_dispatch();
+    }
+    pattern->text = text;
+    pattern->len = len;
+    pattern->flags = flags;
+}
+
+int scan_word_match(const ScanPattern *pattern, const char *data, size_t size, size_t offset) {
+    if (offset > 0 && scan_is_word_byte((uint8_t)data[offset - 1])) {
+        return 0;
+    }
+    size_t after = offset + pattern->len;
+    return after >= size || !scan_is_word_byte((uint8_t)data[after]);
+}
+
+const char *scan_find(const ScanPattern *pattern, const char *buf, size_t len) {
+    if (pattern->len == 0 || len < pattern->len) {
+        return NULL;
+    }
+    find_function find = (pattern->flags & SCAN_IGNORE_CASE) ? active_find_fold : active_find;
+#ifdef TF_INSTRUMENT
+    const char *hit = find(pattern, buf, len);
+    INSTRUMENT_ADD(bytes, hit != NULL ? (size_t)(hit - buf) + pattern->len : len);
+    return hit;
+#else
+    return find(pattern, buf, len);
+#endif
+}
+
+size_t scan_count(const ScanPattern *pattern, const char *buf, size_t len) {
+    size_t count = 0;
+    const char *end = buf + len;
+    const char *pos = buf;
+    while ((pos = scan_find(pattern, pos, end - pos)) != NULL) {
+        if ((pattern->flags & SCAN_WHOLE_WORD) && !scan_word_match(pattern, buf, len, pos - buf)) {
+            pos++;
+            continue;
+        }
+		//continue after the match, matches do not overlap
+        pos += pattern->len;
+        count++;
+    }
+    return count;
+}
+
+size_t scan_count_owned(const ScanPattern *pattern, const char *data, size_t size, size_t from, size_t end, size_t *first_match, size_t *last_end) {
+    size_t limit = end + pattern->len - 1;
+    if (limit > size) {
+        limit = size;
+    }
+    size_t count = 0;
+    size_t pos = from;
+    *first_match = SIZE_MAX;
+    *last_end = pos;
+    while (pos < end && pos + pattern->len <= limit) {
+        const char *hit = scan_find(pattern, data + pos, limit - pos);
+        if (hit == NULL || (size_t)(hit - data) >= end) {
+            break;
+        }
+        size_t offset = hit - data;
+		//a candidate inside a longer word is skipped, the next one may start in it
+        if ((pattern->flags & SCAN_WHOLE_WORD) && !scan_word_match(pattern, data, size, offset)) {
+            pos = offset + 1;
+            continue;
+        }
+        if (*first_match == SIZE_MAX) {
+            *first_match = offset;
+        }
+        count++;
+		//continue after the match, matches do not overlap
+        pos = offset + pattern->len;
+        *last_end = pos;
+    }
+    INSTRUMENT_ADD(matches, count);
+    return count;
+}
@@ -0,0 +1,264 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include "tuner.h"
+#include "scan.h"
+#include "file_tree.h"
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#define CALIBRATION_VERSION 1
+#define CALIBRATION_BYTES (64 * 1024 * 1024)
+#define SPAWN_ROUNDS 64
+//Work units per thread, so dynamic scheduling / stealing can even out the threads
+#define CHUNKS_PER_THREAD 8
+#define MIN_TUNED_CHUNK (64 * 1024)
+#define MAX_TUNED_CHUNK (4 * 1024 * 1024)
+//More threads must save at least this much of the single thread time
+#define MIN_GAIN 0.10
+
+typedef struct {
+    const ScanPattern *pattern;
+    const char *data;
+    size_t size;
+} CalibrationSlice;
+
+static double now_seconds(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static int online_cores(void) {
+#ifndef _WIN32
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+#else
+    const char *env = getenv("NUMBER_OF_PROCESSORS");
+    long cores = env != NULL ? atol(env) : 1;
+#endif
+    return cores > 0 ? (int)cores : 1;
+}
+
+static void calibration_path(char *path, size_t size) {
+    const char *env = getenv("TEXTFINDER_CALIBRATION");
+    const char *home = getenv("HOME");
+    if (env != NULL && env[0] != '\0') {
+        snprintf(path, size, "%s", env);
+    } else {
+        snprintf(path, size, "%s/.textfinder_calibration", home != NULL ? home : ".");
+    }
+}
+
+static int load_calibration(TunerCalibration *calibration) {
+    FILE *fp = fopen(calibration->path, "r");
+    if (fp == NULL) {
+        return 0;
+    }
+    char line[256];
+    int version = 0;
+    int cores = 0;
+    char kernel[16] = "";
+    while (fgets(line, sizeof(line), fp)) {
+        sscanf(line, "version=%d", &version);
+        sscanf(line, "cores=%d", &cores);
+        sscanf(line, "kernel=%15s", kernel);
+        sscanf(line, "scan_bandwidth=%lf", &calibration->scan_bandwidth);
+        sscanf(line, "parallel_bandwidth=%lf", &calibration->parallel_bandwidth);
+        sscanf(line, "spawn_seconds=%lf", &calibration->spawn_seconds);
+    }
+    fclose(fp);
+    return version == CALIBRATION_VERSION && cores == calibration->cores && strcmp(kernel, calibration->kernel) == 0
+        && calibration->scan_bandwidth > 0 && calibration->parallel_bandwidth > 0 && calibration->spawn_seconds > 0;
+}
+
+static void save_calibration(const TunerCalibration *calibration) {
+    FILE *fp = fopen(calibration->path, "w");
+    if (fp == NULL) {
+        perror("Warning: cannot save the calibration");
+        return;
+    }
+    fprintf(fp, "# text finder calibration, delete the file to measure again\n");
+    fprintf(fp, "version=%d\ncores=%d\nkernel=%s\n", CALIBRATION_VERSION, calibration->cores, calibration->kernel);
+    fprintf(fp, "scan_bandwidth=%.0f\nparallel_bandwidth=%.0f\nspawn_seconds=%.9f\n", calibration->scan_bandwidth, calibration->parallel_bandwidth, calibration->spawn_seconds);
+    fclose(fp);
+}
+
+static void *scan_slice(void *arg) {
+    CalibrationSlice *slice = (CalibrationSlice *)arg;
+    scan_count(slice->pattern, slice->data, slice->size);
+    return NULL;
+}
+
+static void *empty_thread(void *arg) {
+    return arg;
+}
+
+//Best of a few runs of scan_count over a buffer larger than the caches, on one
+//thread and on every core, and the cost of starting and joining a thread
+static int measure_calibration(TunerCalibration *calibration) {
+    char *buffer = malloc(CALIBRATION_BYTES);
+    if (buffer == NULL) {
+        perror("Error allocating calibration buffer");
+        return 0;
+    }
+	//lorem-like text, a small LCG keeps it the same on every platform
+    uint32_t seed = 42;
+    for (size_t i = 0; i < CALIBRATION_BYTES; i++) {
+        seed = seed * 1103515245u + 12345u;
+        uint32_t r = seed >> 16;
+        buffer[i] = (r % 6 == 0) ? ' ' : 'a' + (r / 6) % 26;
+    }
+    ScanPattern pattern;
+    scan_pattern_init(&pattern, "QzXjQ", 5);
+    int cores = calibration->cores;
+    pthread_t *threads = malloc(cores * sizeof(pthread_t));
+    CalibrationSlice *slices = malloc(cores * sizeof(CalibrationSlice));
+    if (threads == NULL || slices == NULL) {
+        free(buffer);
+        free(threads);
+        free(slices);
+        return 0;
+    }
+    double single = 0.0;
+    double parallel = 0.0;
+    for (int round = 0; round < 3; round++) {
+        double start = now_seconds();
+        scan_count(&pattern, buffer, CALIBRATION_BYTES);
+        double elapsed = now_seconds() - start;
+        single = (round == 0 || elapsed < single) ? elapsed : single;
+        start = now_seconds();
+        for (int t = 0; t < cores; t++) {
+            slices[t].pattern = &pattern;
+            slices[t].data = buffer + (size_t)CALIBRATION_BYTES * t / cores;
+            slices[t].size = (size_t)CALIBRATION_BYTES * (t + 1) / cores - (size_t)CALIBRATION_BYTES * t / cores;
+            pthread_create(&threads[t], NULL, scan_slice, &slices[t]);
+        }
+        for (int t = 0; t < cores; t++) {
+            pthread_join(threads[t], NULL);
+        }
+        elapsed = now_seconds() - start;
+        parallel = (round == 0 || elapsed < parallel) ? elapsed : parallel;
+    }
+	//average cost of one pthread_create + pthread_join pair
+    double start = now_seconds();
+    for (int round = 0; round < SPAWN_ROUNDS; round++) {
+        pthread_t thread;
+        pthread_create(&thread, NULL, empty_thread, NULL);
+        pthread_join(thread, NULL);
+    }
+    calibration->spawn_seconds = (now_seconds() - start) / SPAWN_ROUNDS;
+    calibration->scan_bandwidth = CALIBRATION_BYTES / single;
+    calibration->parallel_bandwidth = CALIBRATION_BYTES / parallel;
+    if (calibration->parallel_bandwidth < calibration->scan_bandwidth) {
+        calibration->parallel_bandwidth = calibration->scan_bandwidth;
+    }
+    free(buffer);
+    free(threads);
+    free(slices);
+    return 1;
+}
+
+int tuner_calibrate(TunerCalibration *calibration) {
+    memset(calibration, 0, sizeof(*calibration));
+    calibration->cores = online_cores();
+    snprintf(calibration->kernel, sizeof(calibration->kernel), "%s", scan_kernel_name());
+    calibration_path(calibration->path, sizeof(calibration->path));
+    if (load_calibration(calibration)) {
+        calibration->cached = 1;
+        return 1;
+    }
+    fprintf(stderr, "Calibrating scan bandwidth and thread start cost (once, saved to %s)...\n", calibration->path);
+    if (!measure_calibration(calibration)) {
+        return 0;
+    }
+    save_calibration(calibration);
+    return 1;
+}
+
+//Scan time of size bytes on n threads: the threads share the memory bandwidth
+//measured with all cores, and every thread costs one start
+static double predict(const TunerCalibration *calibration, size_t size, int n) {
+    double bandwidth = n * calibration->scan_bandwidth;
+    if (bandwidth > calibration->parallel_bandwidth) {
+        bandwidth = calibration->parallel_bandwidth;
+    }
+    return size / bandwidth + n * calibration->spawn_seconds;
+}
+
+int tuner_plan(const char *path, int requested_threads, TunerPlan *plan) {
+    memset(plan, 0, sizeof(*plan));
+    plan->requested = requested_threads;
+    if (!tuner_calibrate(&plan->calibration)) {
+        return 0;
+    }
+    const TunerCalibration *calibration = &plan->calibration;
+    plan->online_cores = online_cores();
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+		//a directory or glob pattern: many files, the size is not known up front
+        plan->threads = requested_threads > 0 ? requested_threads : plan->online_cores;
+        plan->chunk_size = MAX_TUNED_CHUNK;
+        plan->reason = "directory or glob pattern, one thread per online core";
+        return 1;
+    }
+    plan->input_size = (size_t)st.st_size;
+    size_t size = plan->input_size;
+    plan->predicted_single = predict(calibration, size, 1);
+    if (requested_threads > 0) {
+        plan->threads = requested_threads;
+        plan->reason = "thread count given on the command line";
+    } else if (file_is_gzip(path)) {
+		//one thread inflates, scanning is several times faster than that
+        plan->threads = plan->online_cores < 2 ? 1 : 2;
+        plan->reason = "gzip input, decompression limits the speed";
+    } else {
+		//the fewest threads within 3% of the best prediction, more only add contention
+        int best = 1;
+        for (int n = 2; n <= plan->online_cores; n++) {
+            if (predict(calibration, size, n) < predict(calibration, size, best)) {
+                best = n;
+            }
+        }
+        int chosen = best;
+        for (int n = 1; n < best; n++) {
+            if (predict(calibration, size, n) <= predict(calibration, size, best) * 1.03) {
+                chosen = n;
+                break;
+            }
+        }
+        if (predict(calibration, size, chosen) > plan->predicted_single * (1.0 - MIN_GAIN)) {
+            plan->threads = 1;
+            plan->reason = "input too small to gain from more threads";
+        } else {
+            plan->threads = chosen;
+            plan->reason = chosen == best && chosen == plan->online_cores ? "every online core pays off"
+                         : "more threads would be limited by memory bandwidth or thread start cost";
+        }
+    }
+    plan->predicted = predict(calibration, size, plan->threads);
+    size_t chunk = size / ((size_t)plan->threads * CHUNKS_PER_THREAD) + 1;
+    if (chunk < MIN_TUNED_CHUNK) {
+        chunk = MIN_TUNED_CHUNK;
+    }
+    if (chunk > MAX_TUNED_CHUNK) {
+        chunk = MAX_TUNED_CHUNK;
+    }
+    plan->chunk_size = chunk;
+    return 1;
+}
+
+void tuner_explain(FILE *out, const TunerPlan *plan) {
+    const TunerCalibration *calibration = &plan->calibration;
+    fprintf(out, "Plan: %d thread%s, %zu kB chunks (%s)\n", plan->threads, plan->threads == 1 ? "" : "s", plan->chunk_size / 1024, plan->reason);
+    fprintf(out, "  input: %zu bytes, online cores: %d\n", plan->input_size, plan->online_cores);
+    fprintf(out, "  calibration (%s, %s): scan %.2f GB/s on one thread, %.2f GB/s on %d, thread start %.1f us\n",
+            calibration->path, calibration->cached ? "cached" : "measured now", calibration->scan_bandwidth / 1e9,
+            calibration->parallel_bandwidth / 1e9, calibration->cores, calibration->spawn_seconds * 1e6);
+    if (plan->input_size > 0) {
+        fprintf(out, "  predicted scan time: %.6f seconds (%.6f seconds on one thread)\n", plan->predicted, plan->predicted_single);
+    }
+}
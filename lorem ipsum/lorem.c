@@ -1,59 +1,426 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-
-int main(int argc, char *argv[]) {
-	//invalid args check
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <target_kB>\n", argv[0]);
-        return EXIT_FAILURE;
-    }
-	
-	int LINE_PER_kB = 12;
-	
-	int targetNum = LINE_PER_kB * atoi(argv[1]);
-	//2 rows ~ 1 kilobyte
-	
-	long fl_size;
-    char * buffer;
-    size_t res;
-	FILE *fl = fopen("LoremIpsumBase.txt", "r");
-    if (fl == NULL) {
-        perror("Error opening base file. (LoremIpsumBase.txt)");
-        return 0;
-    }
-	fseek(fl , 0 , SEEK_END);
-    fl_size = ftell (fl);
-    rewind(fl);
-
-    buffer = (char*) malloc (sizeof(char)*fl_size);
-    res = fread(buffer,1,fl_size,fl);
-    char * strtok_res;
-    strtok_res = strtok(buffer, "*");
-	char *quotes[660] = { };
-	int temp = 0;
-    while (strtok_res != NULL)
-    {
-        quotes[temp] = strtok_res;
-		strtok_res = strtok (NULL, "*");
-		temp++;
-    }
-    fclose(fl);
-    free(buffer);
-	//got 660 sentences
-	
-	char *textArray[100000];
-	int arraySize = 0;
-	for (int i = 0; i < targetNum; i++)
-	{
-		arraySize++;
-		textArray[i] = quotes[rand() % 660];
-	}
-	FILE *file = fopen("output.txt", "w");
-    
-    for (size_t i = 0; i < arraySize; i++) {
-        fprintf(file, "%s ", textArray[i]);
-    }
-    fclose(file);
-	return 0;
-}
+#define _FILE_OFFSET_BITS 64
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/time.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+//The output is made of fixed-size blocks, each generated from its own seed, so
+//the file is the same for a given seed whatever the number of threads
+#define BLOCK_SIZE (8 * 1024 * 1024)
+#define MAX_NEEDLES 64
+
+typedef struct {
+    const char *text;
+    size_t len;
+    size_t count;       //planted copies in the whole output
+} Needle;
+
+typedef struct {
+    size_t offset;      //planted once the block reaches this offset
+    int needle;
+} Plant;
+
+//Everything the threads share, read-only except next_block and failed (both
+//only touched with __sync builtins)
+typedef struct {
+    char **quotes;
+    size_t *quote_lens;
+    int num_quotes;
+    Needle needles[MAX_NEEDLES];
+    int num_needles;
+    uint64_t seed;
+    size_t size;
+    size_t num_blocks;
+    size_t next_block;
+    const char *output_name;
+#ifndef _WIN32
+    int fd;
+#endif
+    int failed;
+} Generator;
+
+//Any thread can stop the others after an error
+static void mark_failed(Generator *gen) {
+    __sync_fetch_and_or(&gen->failed, 1);
+}
+
+static int has_failed(Generator *gen) {
+    return __sync_fetch_and_or(&gen->failed, 0);
+}
+
+static double now_seconds(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+//splitmix64: tiny state, any seed is a good one
+static uint64_t next_random(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static size_t block_length(const Generator *gen, size_t block) {
+    size_t begin = block * (size_t)BLOCK_SIZE;
+    return gen->size - begin < BLOCK_SIZE ? gen->size - begin : BLOCK_SIZE;
+}
+
+//Copies of a needle planted in a block: the count is spread evenly over the blocks
+static size_t block_plants(const Generator *gen, const Needle *needle, size_t block) {
+    return needle->count * (block + 1) / gen->num_blocks - needle->count * block / gen->num_blocks;
+}
+
+static int compare_plants(const void *a, const void *b) {
+    const Plant *x = (const Plant *)a;
+    const Plant *y = (const Plant *)b;
+    return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+//Whole sentences separated by spaces, the needles between them with a space on
+//both sides, and spaces after the last sentence that fits
+static void generate_block(const Generator *gen, size_t block, char *buffer, Plant *plants) {
+    size_t len = block_length(gen, block);
+    uint64_t state = gen->seed ^ (block * 0xD1B54A32D192ED03ull);
+    size_t num_plants = 0;
+    size_t reserve = 0; //bytes still needed by the needles not planted yet
+    for (int n = 0; n < gen->num_needles; n++) {
+        size_t count = block_plants(gen, &gen->needles[n], block);
+        for (size_t i = 0; i < count; i++) {
+            plants[num_plants].offset = next_random(&state) % len;
+            plants[num_plants].needle = n;
+            num_plants++;
+            reserve += gen->needles[n].len + 2;
+        }
+    }
+    qsort(plants, num_plants, sizeof(Plant), compare_plants);
+    size_t pos = 0;
+    size_t next_plant = 0;
+    for (;;) {
+        if (next_plant < num_plants && pos >= plants[next_plant].offset) {
+            const Needle *needle = &gen->needles[plants[next_plant++].needle];
+            if (pos > 0 && buffer[pos - 1] != ' ') {
+                buffer[pos++] = ' ';
+            }
+            memcpy(buffer + pos, needle->text, needle->len);
+            pos += needle->len;
+            buffer[pos++] = ' ';
+            reserve -= needle->len + 2;
+            continue;
+        }
+        int quote = (int)(next_random(&state) % gen->num_quotes);
+        size_t quote_len = gen->quote_lens[quote];
+        if (pos + quote_len + 1 + reserve > len) {
+            break;
+        }
+        memcpy(buffer + pos, gen->quotes[quote], quote_len);
+        pos += quote_len;
+        buffer[pos++] = ' ';
+    }
+	//needles whose offset fell into the padding, the reserve keeps room for them
+    while (next_plant < num_plants) {
+        const Needle *needle = &gen->needles[plants[next_plant++].needle];
+        if (pos > 0 && buffer[pos - 1] != ' ') {
+            buffer[pos++] = ' ';
+        }
+        memcpy(buffer + pos, needle->text, needle->len);
+        pos += needle->len;
+        buffer[pos++] = ' ';
+    }
+    memset(buffer + pos, ' ', len - pos);
+}
+
+//Each block goes straight to its own offset of the output file
+static int write_block(Generator *gen, size_t block, const char *buffer, void *out) {
+    size_t len = block_length(gen, block);
+    size_t offset = block * (size_t)BLOCK_SIZE;
+#ifndef _WIN32
+    (void)out;
+    size_t written = 0;
+    while (written < len) {
+        ssize_t n = pwrite(gen->fd, buffer + written, len - written, (off_t)(offset + written));
+        if (n <= 0) {
+            perror("Error writing output");
+            return 0;
+        }
+        written += (size_t)n;
+    }
+    return 1;
+#else
+    FILE *fp = (FILE *)out;
+    if (_fseeki64(fp, (long long)offset, SEEK_SET) != 0 || fwrite(buffer, 1, len, fp) != len) {
+        perror("Error writing output");
+        return 0;
+    }
+    return 1;
+#endif
+}
+
+static void *generator_thread(void *arg) {
+    Generator *gen = (Generator *)arg;
+    char *buffer = malloc(BLOCK_SIZE);
+    size_t max_plants = 1;
+    for (int n = 0; n < gen->num_needles; n++) {
+        max_plants += block_plants(gen, &gen->needles[n], 0) + 1;
+    }
+    Plant *plants = malloc(max_plants * sizeof(Plant));
+    void *out = NULL;
+#ifdef _WIN32
+    out = fopen(gen->output_name, "r+b");
+#else
+    out = gen;
+#endif
+    if (buffer == NULL || plants == NULL || out == NULL) {
+        perror("Error starting generator thread");
+        mark_failed(gen);
+    }
+    while (!has_failed(gen)) {
+        size_t block = __sync_fetch_and_add(&gen->next_block, 1);
+        if (block >= gen->num_blocks) {
+            break;
+        }
+        generate_block(gen, block, buffer, plants);
+        if (!write_block(gen, block, buffer, out)) {
+            mark_failed(gen);
+        }
+    }
+#ifdef _WIN32
+    if (out != NULL) {
+        fclose((FILE *)out);
+    }
+#endif
+    free(buffer);
+    free(plants);
+    return NULL;
+}
+
+//Sentences of the base file, separated by '*'. The base stays allocated, the
+//quotes point into it.
+static int load_quotes(const char *base_name, Generator *gen, char **base) {
+    FILE *fl = fopen(base_name, "rb");
+    if (fl == NULL) {
+        perror("Error opening base file");
+        return 0;
+    }
+    fseek(fl, 0, SEEK_END);
+    long fl_size = ftell(fl);
+    rewind(fl);
+    *base = malloc(fl_size + 1);
+    if (*base == NULL || fread(*base, 1, fl_size, fl) != (size_t)fl_size) {
+        perror("Error reading base file");
+        fclose(fl);
+        return 0;
+    }
+    fclose(fl);
+    (*base)[fl_size] = '\0';
+    gen->quotes = malloc((fl_size / 2 + 1) * sizeof(char *));
+    gen->quote_lens = malloc((fl_size / 2 + 1) * sizeof(size_t));
+    gen->num_quotes = 0;
+    if (gen->quotes == NULL || gen->quote_lens == NULL) {
+        perror("Error allocating quotes");
+        return 0;
+    }
+    for (char *quote = strtok(*base, "*"); quote != NULL; quote = strtok(NULL, "*")) {
+        gen->quotes[gen->num_quotes] = quote;
+        gen->quote_lens[gen->num_quotes] = strlen(quote);
+        gen->num_quotes++;
+    }
+    if (gen->num_quotes == 0) {
+        fprintf(stderr, "The base file has no sentences.\n");
+        return 0;
+    }
+    return 1;
+}
+
+//A planted count is the exact number of matches only if the needle cannot come
+//up by chance: it must use a byte the base text never does, and no whitespace.
+//Then every match lies inside a planted copy, which has spaces on both sides.
+static int check_needles(const Generator *gen, const char *base, size_t base_len) {
+    int used[256] = {0};
+    for (size_t i = 0; i < base_len; i++) {
+        used[(unsigned char)base[i]] = 1;
+    }
+    for (int n = 0; n < gen->num_needles; n++) {
+        const Needle *needle = &gen->needles[n];
+        int rare = 0;
+        for (size_t i = 0; i < needle->len; i++) {
+            unsigned char c = (unsigned char)needle->text[i];
+            if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+                fprintf(stderr, "Needle '%s' must not contain whitespace.\n", needle->text);
+                return 0;
+            }
+            rare |= !used[c];
+        }
+        if (!rare) {
+            fprintf(stderr, "Needle '%s' only uses characters of the base text, it could match by chance. Add a digit or a symbol.\n", needle->text);
+            return 0;
+        }
+        for (int m = 0; m < gen->num_needles; m++) {
+            if (m != n && strstr(gen->needles[m].text, needle->text) != NULL) {
+                fprintf(stderr, "Needle '%s' is part of '%s', its count would not be exact.\n", needle->text, gen->needles[m].text);
+                return 0;
+            }
+        }
+    }
+	//at most half of every block is needles
+    for (size_t block = 0; block < gen->num_blocks; block++) {
+        size_t bytes = 0;
+        for (int n = 0; n < gen->num_needles; n++) {
+            bytes += block_plants(gen, &gen->needles[n], block) * (gen->needles[n].len + 2);
+        }
+        if (bytes > block_length(gen, block) / 2) {
+            fprintf(stderr, "Too many needles for %zu bytes of output.\n", gen->size);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+//Size in kB, or with a K, M, G or T suffix
+static size_t parse_size(const char *text) {
+    char *end;
+    double value = strtod(text, &end);
+    switch (*end) {
+        case 'T': case 't': return (size_t)(value * 1024.0 * 1024 * 1024 * 1024);
+        case 'G': case 'g': return (size_t)(value * 1024.0 * 1024 * 1024);
+        case 'M': case 'm': return (size_t)(value * 1024.0 * 1024);
+        default: return (size_t)(value * 1024.0);
+    }
+}
+
+static int online_cores(void) {
+#ifndef _WIN32
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+#else
+    const char *env = getenv("NUMBER_OF_PROCESSORS");
+    long cores = env != NULL ? atol(env) : 1;
+#endif
+    return cores > 0 ? (int)cores : 1;
+}
+
+int main(int argc, char *argv[]) {
+    Generator gen;
+    memset(&gen, 0, sizeof(gen));
+    gen.seed = 1;
+    gen.output_name = "output.txt";
+    const char *base_name = "LoremIpsumBase.txt";
+    int num_threads = online_cores();
+    const char *size_arg = NULL;
+	//switches and the size
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            num_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            gen.seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            gen.output_name = argv[++i];
+        } else if (strcmp(argv[i], "--base") == 0 && i + 1 < argc) {
+            base_name = argv[++i];
+        } else if (strcmp(argv[i], "--plant") == 0 && i + 2 < argc && gen.num_needles < MAX_NEEDLES) {
+            Needle *needle = &gen.needles[gen.num_needles++];
+            needle->text = argv[++i];
+            needle->len = strlen(needle->text);
+            needle->count = strtoull(argv[++i], NULL, 10);
+            if (needle->len == 0) {
+                fprintf(stderr, "Needles must not be empty.\n");
+                return EXIT_FAILURE;
+            }
+        } else if (size_arg == NULL && argv[i][0] != '-') {
+            size_arg = argv[i];
+        } else {
+            size_arg = NULL;
+            break;
+        }
+    }
+	//invalid args check
+    if (size_arg == NULL || num_threads <= 0) {
+        fprintf(stderr, "Usage: %s [--threads N] [--seed S] [--output file] [--base file] [--plant needle count]... <size in kB, or with K/M/G/T suffix>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    gen.size = parse_size(size_arg);
+    if (gen.size == 0) {
+        fprintf(stderr, "The size must be greater than 0.\n");
+        return EXIT_FAILURE;
+    }
+    gen.num_blocks = (gen.size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    if ((size_t)num_threads > gen.num_blocks) {
+        num_threads = (int)gen.num_blocks;
+    }
+    char *base = NULL;
+    if (!load_quotes(base_name, &gen, &base)) {
+        free(gen.quotes);
+        free(gen.quote_lens);
+        free(base);
+        return EXIT_FAILURE;
+    }
+    size_t base_len = 0;
+    for (int q = 0; q < gen.num_quotes; q++) {
+        base_len = (size_t)(gen.quotes[q] - base) + gen.quote_lens[q];
+    }
+    if (!check_needles(&gen, base, base_len)) {
+        return EXIT_FAILURE;
+    }
+	//the file gets its final size first, the threads fill their blocks in any order
+#ifndef _WIN32
+    gen.fd = open(gen.output_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (gen.fd < 0 || ftruncate(gen.fd, (off_t)gen.size) != 0) {
+        perror("Error creating output");
+        return EXIT_FAILURE;
+    }
+#else
+    FILE *create = fopen(gen.output_name, "wb");
+    if (create == NULL || _fseeki64(create, (long long)gen.size - 1, SEEK_SET) != 0 || fputc(' ', create) == EOF) {
+        perror("Error creating output");
+        return EXIT_FAILURE;
+    }
+    fclose(create);
+#endif
+    double start = now_seconds();
+    pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+    if (threads == NULL) {
+        perror("Error allocating threads");
+        num_threads = 0;
+        gen.failed = 1;
+    }
+	//a thread that cannot start stops the others, its blocks would stay holes
+    int started = 0;
+    while (started < num_threads) {
+        int error = pthread_create(&threads[started], NULL, generator_thread, &gen);
+        if (error != 0) {
+            fprintf(stderr, "Error creating generator thread %d: %s\n", started, strerror(error));
+            mark_failed(&gen);
+            break;
+        }
+        started++;
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+#ifndef _WIN32
+    if (close(gen.fd) != 0) {
+        perror("Error closing output");
+        gen.failed = 1;
+    }
+#endif
+    double elapsed = now_seconds() - start;
+    free(threads);
+    free(gen.quotes);
+    free(gen.quote_lens);
+    free(base);
+    if (gen.failed) {
+        return EXIT_FAILURE;
+    }
+    printf("Generated %zu bytes into %s in %.3f seconds (%.1f MB/s, %d threads, seed %llu)\n", gen.size, gen.output_name, elapsed,
+           elapsed > 0 ? gen.size / elapsed / 1e6 : 0.0, num_threads, (unsigned long long)gen.seed);
+    for (int n = 0; n < gen.num_needles; n++) {
+        printf("Planted '%s': %zu\n", gen.needles[n].text, gen.needles[n].count);
+    }
+    return EXIT_SUCCESS;
+}
@@ -7,10 +7,46 @@
 #include <string.h>
 #include <omp.h>
 #include <sys/time.h>
+#include <stdint.h>
+#include "mapped_file.h"
+#include "scan.h"
+#include "matches.h"
+#include "instrument.h"
+#include "file_tree.h"
+#include "tuner.h"
 
 #define MAX_LINE_LENGTH 1024
+//Bounds of the byte ranges handed out by the work-sharing loop
+#define MIN_CHUNK_SIZE (64 * 1024)
+#define MAX_CHUNK_SIZE (4 * 1024 * 1024)
 
-void search_file(const char *target, const char *filename, int num_threads);
+//Result of one chunk of the work-sharing loop
+typedef struct {
+    size_t begin;
+    size_t end;
+    int count;
+    size_t first_match; //offset of the first counted match, SIZE_MAX if none
+    size_t last_end;    //offset right after the last counted match
+    MatchBuffer matches; //report mode only
+    size_t newlines;
+    size_t last_newline;
+} ChunkResult;
+
+//Command line switches, parsed out of argv before the positional arguments
+typedef struct {
+    const char *report_file; //write every match here ("-" is stdout)
+    ReportFormat report_format;
+    int scan_flags;          //SCAN_IGNORE_CASE, SCAN_WHOLE_WORD
+    int recursive;           //TextFile is a directory or glob pattern
+    int explain;             //print the thread count / chunk size plan
+    size_t chunk_size;       //picked by the tuner for "auto", 0 derives it from the thread count
+} SearchOptions;
+
+int parse_options(int *argc, char *argv[], SearchOptions *options);
+void search_chunk(const ScanPattern *pattern, const MappedFile *file, ChunkResult *chunk, size_t from, int report);
+void search_file(const char *target, const char *filename, int num_threads, const SearchOptions *options);
+void search_gzip(const char *target, const char *filename, int num_threads, const SearchOptions *options);
+void search_tree(const char *target, const char *root_pattern, int num_threads, const SearchOptions *options);
 
 
 
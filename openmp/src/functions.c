@@ -1,58 +1,143 @@
-#include "functions.h"
-
-void search_file(const char *target, const char *filename, int num_threads) {
-	//open file
-    FILE *file = fopen(filename, "r");
-    if (file == NULL) {
-        perror("Error opening file");
-        exit(1);
-    }
-    //initialize variables
-    int instances_per_thread[num_threads];
-    memset(instances_per_thread, 0, num_threads * sizeof(int));
-    //use gettimeofday to get timestamp
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    long long start_millis = tv.tv_sec * 1000LL + tv.tv_usec / 1000;
-	//open mp parallel pragma
-    #pragma omp parallel num_threads(num_threads) shared(file, instances_per_thread)
-    {
-		//thread variables
-        int thread_id = omp_get_thread_num();
-        char line[MAX_LINE_LENGTH];
-        int line_num = 0;
-		//loop through lines
-        while (fgets(line, sizeof(line), file) != NULL) {
-            line_num++;
-            char *pos = line;
-			//search in given line
-            while ((pos = strstr(pos, target)) != NULL) {
-                int position = pos - line + 1;
-				//critical pragma so threads cant write to the console at the same time
-                #pragma omp critical
-                {
-					//log text found
-                    gettimeofday(&tv, NULL);
-                    long long current_millis = tv.tv_sec * 1000LL + tv.tv_usec / 1000;
-                    //printf("%.2d:%.2d:%.2d.%.3ld Thread %d has found '%s' at line %d position %d\n", (int)(current_millis / 3600000) % 24, (int)(current_millis / 60000) % 60,(int)(current_millis / 1000) % 60,(long)(current_millis) % 1000,thread_id, target, line_num, position);
-                }
-				//move cursor to end of currently found target text
-                pos += strlen(target);
-                #pragma omp atomic
-                instances_per_thread[thread_id]++;
-            }
-        }
-    }
-	//close target file
-    fclose(file);
-    //show thread finish messages
-    for (int i = 0; i < num_threads; ++i) {
-        //printf("Thread %d has finished running. Found %d instances.\n", i, instances_per_thread[i]);
-    }
-    //calc total instances found, show summary
-    int total_instances = 0;
-    for (int i = 0; i < num_threads; ++i) {
-        total_instances += instances_per_thread[i];
-    }
-    printf("Total instances found: %d\n", total_instances);
-}
\ No newline at end of file
+#include "functions.h"
+
+//Strip "--switch" arguments out of argv so the positional ones keep their indexes
+int parse_options(int *argc, char *argv[], SearchOptions *options) {
+    memset(options, 0, sizeof(*options));
+    int kept = 1;
+    for (int i = 1; i < *argc; i++) {
+        if (strncmp(argv[i], "--", 2) != 0) {
+            argv[kept++] = argv[i];
+        } else if (strcmp(argv[i], "--report") == 0 && i + 1 < *argc) {
+            options->report_file = argv[++i];
+        } else if (strcmp(argv[i], "--report-format") == 0 && i + 1 < *argc) {
+            if (!parse_report_format(argv[++i], &options->report_format)) {
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--recursive") == 0) {
+            options->recursive = 1;
+        } else if (strcmp(argv[i], "--explain") == 0) {
+            options->explain = 1;
+        } else if (strcmp(argv[i], "--ignore-case") == 0) {
+            options->scan_flags |= SCAN_IGNORE_CASE;
+        } else if (strcmp(argv[i], "--word") == 0) {
+            options->scan_flags |= SCAN_WHOLE_WORD;
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return 0;
+        }
+    }
+    argv[kept] = NULL;
+    *argc = kept;
+    return 1;
+}
+
+//Count (and in report mode collect) the matches that start inside a chunk
+void search_chunk(const ScanPattern *pattern, const MappedFile *file, ChunkResult *chunk, size_t from, int report) {
+    if (report) {
+        chunk->matches.count = 0;
+        chunk->count = (int)scan_collect_owned(pattern, file->data, file->size, from, chunk->end, &chunk->first_match, &chunk->last_end, &chunk->matches);
+		//newlines per chunk, the ordered merge turns them into global line numbers
+        match_buffer_locate(&chunk->matches, file->data, chunk->begin, chunk->end, &chunk->newlines, &chunk->last_newline);
+    } else {
+        chunk->count = (int)scan_count_owned(pattern, file->data, file->size, from, chunk->end, &chunk->first_match, &chunk->last_end);
+    }
+}
+
+void search_file(const char *target, const char *filename, int num_threads, const SearchOptions *options) {
+	//map file, the threads read their own byte ranges instead of sharing a FILE*
+    double load_start = omp_get_wtime();
+    MappedFile file;
+    if (!map_file(filename, &file)) {
+        exit(1);
+    }
+    printf("Time taken for mapping file: %.6f seconds.\n", omp_get_wtime() - load_start);
+    double search_start = omp_get_wtime();
+    int report = options->report_file != NULL;
+	//prepare the target once, not in every thread
+    ScanPattern pattern;
+    scan_pattern_init_flags(&pattern, target, strlen(target), options->scan_flags);
+	//pre-computed chunk offsets: several chunks per thread so dynamic scheduling can balance
+    size_t chunk_size = options->chunk_size > 0 ? options->chunk_size : file.size / ((size_t)num_threads * 8) + 1;
+    if (chunk_size < MIN_CHUNK_SIZE) {
+        chunk_size = MIN_CHUNK_SIZE;
+    }
+    if (chunk_size > MAX_CHUNK_SIZE) {
+        chunk_size = MAX_CHUNK_SIZE;
+    }
+    long num_chunks = (long)((file.size + chunk_size - 1) / chunk_size);
+    ChunkResult *chunks = calloc(num_chunks + 1, sizeof(ChunkResult));
+    if (chunks == NULL) {
+        perror("Error allocating chunks");
+        unmap_file(&file);
+        exit(1);
+    }
+    for (long c = 0; c < num_chunks; c++) {
+        chunks[c].begin = c * chunk_size;
+        chunks[c].end = chunks[c].begin + chunk_size < file.size ? chunks[c].begin + chunk_size : file.size;
+    }
+    int instances_per_thread[num_threads];
+    memset(instances_per_thread, 0, num_threads * sizeof(int));
+
+	//every chunk counts the matches that start inside it
+    int total_instances = 0;
+    INSTRUMENT_BEGIN(num_threads);
+    #pragma omp parallel num_threads(num_threads)
+    {
+		//thread variables
+        int thread_id = omp_get_thread_num();
+        int thread_instances = 0;
+        INSTRUMENT_ENTER(thread_id);
+		//no barrier after the loop, the reduction is complete at the end of the region
+        #pragma omp for schedule(dynamic) reduction(+:total_instances) nowait
+        for (long c = 0; c < num_chunks; c++) {
+            search_chunk(&pattern, &file, &chunks[c], chunks[c].begin, report);
+            total_instances += chunks[c].count;
+            thread_instances += chunks[c].count;
+        }
+        INSTRUMENT_LEAVE();
+        instances_per_thread[thread_id] = thread_instances;
+    }
+
+	//a self-overlapping target (e.g. "aa") can end past a chunk border and hide the
+	//first matches of the next chunk, those chunks are recounted from the real end
+    size_t carry = 0;
+    for (long c = 0; c < num_chunks; c++) {
+        if (chunks[c].first_match != SIZE_MAX && chunks[c].first_match < carry) {
+            int counted = chunks[c].count;
+            search_chunk(&pattern, &file, &chunks[c], carry, report);
+            total_instances += chunks[c].count - counted;
+        }
+        if (chunks[c].first_match != SIZE_MAX) {
+            carry = chunks[c].last_end;
+        }
+    }
+    printf("Time taken for searching: %.6f seconds.\n", omp_get_wtime() - search_start);
+	//merge the per-chunk match buffers in file order into one buffered writer
+    if (report) {
+        double write_start = omp_get_wtime();
+        MatchWriter writer;
+        int success = match_writer_open(&writer, options->report_file, options->report_format);
+        FilePosition position = {0, 0};
+        for (long c = 0; c < num_chunks; c++) {
+            if (success) {
+                match_writer_write(&writer, &chunks[c].matches, &position);
+            }
+            file_position_advance(&position, chunks[c].begin, chunks[c].end, chunks[c].newlines, chunks[c].last_newline);
+            match_buffer_free(&chunks[c].matches);
+        }
+        if (success && !match_writer_close(&writer)) {
+            perror("Error writing report file");
+        }
+        printf("Time taken for writing matches: %.4f seconds.\n", omp_get_wtime() - write_start);
+    }
+	//unmap target file
+    free(chunks);
+    unmap_file(&file);
+    //show thread finish messages
+    for (int i = 0; i < num_threads; ++i) {
+        //printf("Thread %d has finished running. Found %d instances.\n", i, instances_per_thread[i]);
+    }
+    //show summary
+    printf("Total instances found: %d\n", total_instances);
+    INSTRUMENT_REPORT("openmp");
+}
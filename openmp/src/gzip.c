@@ -0,0 +1,139 @@
+#include "functions.h"
+
+#ifndef TF_NO_ZLIB
+#include <zlib.h>
+
+//One decompressed block. data starts with the tail of the previous block (pad
+//bytes, plus the context byte in word mode) so matches across the edge are seen.
+typedef struct {
+    char *data;
+    size_t len;
+    size_t offset;      //stream offset of data[0]
+    size_t owned_begin; //matches starting in [owned_begin, owned_end) belong to this block
+    size_t owned_end;
+    int count;
+    size_t first_match;
+    size_t last_end;
+} GzipBlock;
+
+//Blocks are retired in stream order, with the usual recount after a match that
+//ran over the edge
+static void retire_block(const ScanPattern *pattern, GzipBlock *block, size_t *carry, size_t *total) {
+    if (block->first_match != SIZE_MAX && block->offset + block->first_match < *carry) {
+        block->count = (int)scan_count_owned(pattern, block->data, block->len, *carry - block->offset, block->owned_end, &block->first_match, &block->last_end);
+    }
+    if (block->first_match != SIZE_MAX) {
+        *carry = block->offset + block->last_end;
+    }
+    *total += block->count;
+}
+
+//Pipelined search of a .gz file: one thread inflates fixed-size blocks into a
+//bounded set of slots and spawns a scan task for each, the other threads run them
+void search_gzip(const char *target, const char *filename, int num_threads, const SearchOptions *options) {
+    ScanPattern pattern;
+    scan_pattern_init_flags(&pattern, target, strlen(target), options->scan_flags);
+    size_t context = (options->scan_flags & SCAN_WHOLE_WORD) ? 1 : 0;
+    size_t pad = pattern.len - 1 + context;
+    size_t keep = pad + context;
+    size_t block_size = GZIP_BLOCK_SIZE > 2 * keep ? GZIP_BLOCK_SIZE : 2 * keep;
+	//two slots per thread, so the inflating thread runs ahead of the scans
+    int num_slots = num_threads * 2;
+    GzipBlock *slots = calloc(num_slots, sizeof(GzipBlock));
+    gzFile gz = gzopen(filename, "rb");
+    if (slots == NULL || gz == NULL) {
+        perror("Error opening gzip file");
+        exit(1);
+    }
+    for (int i = 0; i < num_slots; i++) {
+        slots[i].data = malloc(keep + block_size);
+        if (slots[i].data == NULL) {
+            perror("Error allocating gzip blocks");
+            exit(1);
+        }
+    }
+    gzbuffer(gz, 256 * 1024);
+    double search_start = omp_get_wtime();
+    double inflate_time = 0.0;
+    double scan_time = 0.0;
+    size_t bytes_out = 0;
+    size_t total_instances = 0;
+    size_t carry = 0;
+    int failed = 0;
+    INSTRUMENT_BEGIN(num_threads);
+    #pragma omp parallel num_threads(num_threads)
+    {
+        #pragma omp single
+        {
+            size_t offset = 0; //stream offset of the next inflated byte
+            long retired = 0;
+            for (long seq = 0;; seq++) {
+                GzipBlock *block = &slots[seq % num_slots];
+				//reusing a slot: wait for the scan of its last block only and retire that
+				//block, the oldest one, while the scans in the other slots keep running
+                if (seq >= num_slots) {
+                    #pragma omp taskwait depend(in: *block)
+                    retire_block(&pattern, block, &carry, &total_instances);
+                    retired++;
+                }
+                size_t prefix_len = offset < keep ? offset : keep;
+                if (seq > 0) {
+                    GzipBlock *previous = &slots[(seq - 1) % num_slots];
+                    memcpy(block->data, previous->data + previous->len - prefix_len, prefix_len);
+                }
+                double inflate_start = omp_get_wtime();
+                int got = gzread(gz, block->data + prefix_len, (unsigned int)block_size);
+                inflate_time += omp_get_wtime() - inflate_start;
+                if (got < 0) {
+                    int error;
+                    fprintf(stderr, "Error decompressing file: %s\n", gzerror(gz, &error));
+                    failed = 1;
+                    got = 0;
+                }
+                int last = (size_t)got < block_size;
+                block->offset = offset - prefix_len;
+                block->len = prefix_len + (size_t)got;
+                block->owned_begin = prefix_len > pad ? prefix_len - pad : 0;
+                block->owned_end = last ? block->len : block->len - pad;
+                offset += (size_t)got;
+                bytes_out += (size_t)got;
+                #pragma omp task firstprivate(block) depend(out: *block)
+                {
+                    INSTRUMENT_ENTER(omp_get_thread_num());
+                    double scan_start = omp_get_wtime();
+                    block->count = (int)scan_count_owned(&pattern, block->data, block->len, block->owned_begin, block->owned_end, &block->first_match, &block->last_end);
+                    double seconds = omp_get_wtime() - scan_start;
+                    #pragma omp atomic
+                    scan_time += seconds;
+                    INSTRUMENT_LEAVE();
+                }
+                if (last) {
+                    #pragma omp taskwait
+                    for (; retired <= seq; retired++) {
+                        retire_block(&pattern, &slots[retired % num_slots], &carry, &total_instances);
+                    }
+                    break;
+                }
+            }
+        }
+    }
+    double search_time = omp_get_wtime() - search_start;
+    gzclose(gz);
+    for (int i = 0; i < num_slots; i++) {
+        free(slots[i].data);
+    }
+    free(slots);
+    printf("Time taken for decompressing: %.6f seconds (%zu bytes out, %.1f MB/s).\n", inflate_time, bytes_out, inflate_time > 0 ? bytes_out / inflate_time / 1e6 : 0.0);
+    printf("Time taken for scanning: %.6f seconds (summed over the tasks).\n", scan_time);
+    printf("Time taken for searching: %.6f seconds.\n", search_time);
+    printf("Total instances found: %zu\n", total_instances);
+    INSTRUMENT_REPORT("openmp, gzip pipeline");
+    if (failed) {
+        exit(1);
+    }
+}
+#else
+void search_gzip(const char *target, const char *filename, int num_threads, const SearchOptions *options) {
+    search_file(target, filename, num_threads, options);
+}
+#endif
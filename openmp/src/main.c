@@ -1,26 +1,56 @@
 #include "functions.h"
 
 int main(int argc, char *argv[]) {
+	//pull out the switches, the rest are positional arguments
+	SearchOptions options;
+	if (!parse_options(&argc, argv, &options)) {
+        return 1;
+    }
 	//check args
     if (argc != 4) {
-        printf("Usage: %s <TargetText> <NumberOfThreads> <TextFile>\n", argv[0]);
+        printf("Usage: %s [--recursive] [--explain] [--ignore-case] [--word] [--report file [--report-format text|csv|binary]] <TargetText> <NumberOfThreads|auto> <TextFile|Directory|Glob>\n", argv[0]);
         return 1;
     }
 	//pass args to variables
     char *target = argv[1];
     int num_threads = atoi(argv[2]);
     char *filename = argv[3];
+	//"auto" threads: picked from the input size and the cached calibration
+    if (strcmp(argv[2], "auto") == 0 || options.explain) {
+        TunerPlan plan;
+        if (!tuner_plan(filename, num_threads > 0 ? num_threads : 0, &plan)) {
+            return 1;
+        }
+        if (options.explain) {
+            tuner_explain(stdout, &plan);
+        }
+        if (num_threads <= 0) {
+            num_threads = plan.threads;
+            options.chunk_size = plan.chunk_size;
+        }
+    }
 	//check number of threads
     if (num_threads <= 0) {
         printf("Number of threads must be greater than 0.\n");
         return 1;
+    }
+    int gzip = !options.recursive && file_is_gzip(filename);
+    if ((options.recursive || gzip) && options.report_file != NULL) {
+        printf("--report works with a single uncompressed text file only.\n");
+        return 1;
     }
 	//log start
     printf("Searching for '%s' in file '%s' using %d threads...\n", target, filename, num_threads);
 	//start measuring time
     double start_time = omp_get_wtime();
 	//call search function
-    search_file(target, filename, num_threads);
+    if (options.recursive) {
+        search_tree(target, filename, num_threads, &options);
+    } else if (gzip) {
+        search_gzip(target, filename, num_threads, &options);
+    } else {
+        search_file(target, filename, num_threads, &options);
+    }
 	//end time measuremenet
     double end_time = omp_get_wtime();
     printf("Search complete. Time taken: %.4f seconds.\n", end_time - start_time);
@@ -0,0 +1,156 @@
+#include "functions.h"
+
+//Shared state of a recursive search
+typedef struct {
+    ScanPattern pattern;
+    TreeList list;
+    int num_threads;
+    int num_gzip;
+    double inflate_time; //summed over the tasks of .gz files
+    double scan_time;
+} TreeSearch;
+
+//Map a large file and search its chunks as child tasks, idle threads pick them up
+static void search_large_file(TreeSearch *search, TreeFile *file) {
+    if (!map_file(file->path, &file->map)) {
+        file->failed = 1;
+        return;
+    }
+    size_t chunk_size = file->map.size / ((size_t)search->num_threads * 8) + 1;
+    if (chunk_size < MIN_CHUNK_SIZE) {
+        chunk_size = MIN_CHUNK_SIZE;
+    }
+    if (chunk_size > MAX_CHUNK_SIZE) {
+        chunk_size = MAX_CHUNK_SIZE;
+    }
+    int num_chunks = (int)((file->map.size + chunk_size - 1) / chunk_size);
+    ChunkResult *chunks = calloc(num_chunks > 0 ? num_chunks : 1, sizeof(ChunkResult));
+    if (chunks == NULL) {
+        unmap_file(&file->map);
+        file->failed = 1;
+        return;
+    }
+    file->chunks = chunks;
+    file->num_chunks = num_chunks;
+    for (int c = 0; c < num_chunks; c++) {
+        chunks[c].begin = c * chunk_size;
+        chunks[c].end = chunks[c].begin + chunk_size < file->map.size ? chunks[c].begin + chunk_size : file->map.size;
+        ChunkResult *chunk = &chunks[c];
+        #pragma omp task firstprivate(chunk)
+        {
+            INSTRUMENT_ENTER(omp_get_thread_num());
+            search_chunk(&search->pattern, &file->map, chunk, chunk->begin, 0);
+            INSTRUMENT_LEAVE();
+        }
+    }
+}
+
+//Directories become tasks too, so the walk runs in parallel with the search
+static void walk_entry(TreeSearch *search, const TreeEntry *entry) {
+    if (entry->is_dir) {
+        char *path = strdup(entry->path);
+        #pragma omp task firstprivate(path)
+        {
+            TreeEntry *entries;
+            int num_entries;
+            if (path != NULL && tree_read_dir(path, &entries, &num_entries)) {
+                for (int i = 0; i < num_entries; i++) {
+                    walk_entry(search, &entries[i]);
+                }
+                tree_entries_free(entries, num_entries);
+            }
+            free(path);
+        }
+        return;
+    }
+    TreeFile *file;
+    #pragma omp critical(tree_list)
+    file = tree_list_add(&search->list, entry->path, entry->size);
+    if (file == NULL) {
+        return;
+    }
+	//small files are one task each, large ones are split into chunks, a .gz
+	//file is inflated and searched block by block in its task
+    #pragma omp task firstprivate(file)
+    {
+        if (file_is_gzip(file->path)) {
+            double inflate_time = 0.0;
+            double scan_time = 0.0;
+            INSTRUMENT_ENTER(omp_get_thread_num());
+            tree_count_gzip(&search->pattern, file, &inflate_time, &scan_time);
+            INSTRUMENT_LEAVE();
+            #pragma omp critical(tree_list)
+            {
+                search->num_gzip++;
+                search->inflate_time += inflate_time;
+                search->scan_time += scan_time;
+            }
+        } else if (file->size > TREE_SPLIT_SIZE) {
+            search_large_file(search, file);
+        } else {
+            INSTRUMENT_ENTER(omp_get_thread_num());
+            tree_count_file(&search->pattern, file);
+            INSTRUMENT_LEAVE();
+        }
+    }
+}
+
+void search_tree(const char *target, const char *root_pattern, int num_threads, const SearchOptions *options) {
+    double search_start = omp_get_wtime();
+    TreeSearch search;
+    memset(&search, 0, sizeof(search));
+    search.num_threads = num_threads;
+    scan_pattern_init_flags(&search.pattern, target, strlen(target), options->scan_flags);
+    TreeEntry *roots;
+    int num_roots;
+    if (!tree_expand(root_pattern, &roots, &num_roots)) {
+        exit(1);
+    }
+	//one thread starts the walk, the barrier at the end of the region waits for every task
+    INSTRUMENT_BEGIN(num_threads);
+    #pragma omp parallel num_threads(num_threads)
+    {
+        #pragma omp single
+        {
+            for (int i = 0; i < num_roots; i++) {
+                walk_entry(&search, &roots[i]);
+            }
+        }
+    }
+    tree_entries_free(roots, num_roots);
+	//chunks of a large file get the usual border fix-up, in file order
+    size_t total_bytes = 0;
+    int num_split = 0;
+    for (int i = 0; i < search.list.num_files; i++) {
+        TreeFile *file = search.list.files[i];
+        ChunkResult *chunks = (ChunkResult *)file->chunks;
+        size_t carry = 0;
+        for (int c = 0; c < file->num_chunks; c++) {
+            if (chunks[c].first_match != SIZE_MAX && chunks[c].first_match < carry) {
+                search_chunk(&search.pattern, &file->map, &chunks[c], carry, 0);
+            }
+            if (chunks[c].first_match != SIZE_MAX) {
+                carry = chunks[c].last_end;
+            }
+            file->count += chunks[c].count;
+        }
+        if (file->map.is_mapped || file->chunks != NULL) {
+            num_split++;
+            unmap_file(&file->map);
+            free(file->chunks);
+            file->chunks = NULL;
+        }
+        total_bytes += file->size;
+    }
+    tree_list_sort(&search.list);
+    double search_time = omp_get_wtime() - search_start;
+    size_t total_instances = tree_list_report(&search.list, 1);
+    printf("Files searched: %d (%zu bytes, %d of them split into chunks)\n", search.list.num_files, total_bytes, num_split);
+    if (search.num_gzip > 0) {
+        printf("gzip files: %d, time taken for decompressing: %.6f seconds, scanning: %.6f seconds (summed over the tasks).\n", search.num_gzip, search.inflate_time, search.scan_time);
+    }
+    printf("Time taken for searching: %.6f seconds.\n", search_time);
+    printf("Total instances found: %zu\n", total_instances);
+    INSTRUMENT_REPORT("openmp, recursive");
+    tree_list_free(&search.list);
+}
@@ -8,22 +8,265 @@
 #include <pthread.h>
 #include <sys/time.h>
 #include <time.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include "mapped_file.h"
+#include "scan.h"
+#include "automaton.h"
+#include "matches.h"
+#include "instrument.h"
+#include "file_tree.h"
+#include "tuner.h"
 
 #define MAX_LINE_LENGTH 1024
+#define DEFAULT_BUFFER_MB 64
+#define MIN_STREAM_BLOCK (64 * 1024)
+#define POOL_CHUNK_SIZE (256 * 1024)
+#define INDEX_CHUNK_SIZE (32 * 1024)
+
+//Where the worker threads run: --pin=compact fills the hardware threads and
+//cores of one node first, --pin=scatter spreads them over the nodes and cores
+typedef enum {
+    PIN_NONE,
+    PIN_COMPACT,
+    PIN_SCATTER
+} PinMode;
+
+typedef struct {
+    int cpu;
+    int node;
+    int package;
+    int core;
+    int sibling;   //index among the hardware threads of the core
+    int core_rank; //index of the core within its node
+} CpuInfo;
+
+//Allowed cpus in placement order, thread i runs on cpus[i % num_cpus]
+typedef struct {
+    PinMode mode;
+    CpuInfo *cpus;
+    int num_cpus;
+    int num_cores;
+    int num_packages;
+    int num_nodes;
+    int use_libnuma;  //more than one node and libnuma is there: thread local memory is bound to the node
+} Placement;
 
 //Structure for containing thread data
 typedef struct {
     int thread_id;
     char *target_text;
+    const ScanPattern *pattern;
     char **lines;
     int num_lines;
     int *found_counts;
     int *total_found;
     int number_of_threads;
+    const Placement *placement;  //pinned: the thread copies its lines to its own node first
+    pthread_barrier_t *placed;   //pinned: every thread has its copy, the timed search starts
 } ThreadData;
 
+//Structure for containing thread data of the byte range search
+typedef struct {
+    int thread_id;
+    const ScanPattern *pattern;
+    const char *data;
+    size_t size;
+    size_t begin;       //first byte owned by the thread
+    size_t end;         //one past the last byte owned by the thread
+    size_t scan_from;   //where scanning starts (begin, or later when re-synced)
+    size_t first_match; //offset of the first counted match, SIZE_MAX if none
+    size_t last_end;    //offset right after the last counted match
+    int found_count;
+    const Automaton *automaton;   //multi-target mode only
+    AutomatonCounts multi_counts; //multi-target mode only
+    int collect;                  //match report mode: keep the matches, not just count them
+    MatchBuffer matches;
+    size_t newlines;
+    size_t last_newline;
+} ChunkData;
+
+//One slot of the streaming ring. data holds the last bytes of the previous block
+//(pad of them, plus the context byte in word mode) followed by the block itself.
+typedef struct {
+    char *data;
+    size_t len;
+    size_t file_offset; //file offset of data[0]
+    size_t owned_begin; //matches starting in data[owned_begin, owned_end) belong to this block,
+    size_t owned_end;   //owned_begin is 1 when data[0] is only word boundary context
+    int done;
+    int found_count;
+    size_t first_match; //offsets relative to data
+    size_t last_end;
+} StreamBlock;
+
+//Ring of fixed-size buffers between the reader thread and the search threads.
+//Blocks are numbered; a slot is reused only after its block is retired in order.
+typedef struct {
+    StreamBlock *slots;
+    int num_slots;
+    size_t block_size;
+    size_t pad;         //bytes read past the owned range of a block
+    size_t context;     //bytes kept before the owned range of a block
+    int fd;
+    size_t file_size;
+    const ScanPattern *pattern;
+    long next_fill;
+    long next_scan;
+    long next_retire;
+    int eof;
+    int read_error;
+    size_t carry;       //file offset right after the last retired match
+    int total_found;
+    void *gz;           //gzFile of a .gz input, NULL when the file is read with pread
+    size_t bytes_out;   //bytes delivered to the search threads
+    double read_time;   //time the reader spent inside pread or inflating
+    double scan_time;   //time the search threads spent scanning, summed
+    double wait_time;   //time the search threads spent waiting for data
+    int num_threads;    //search threads, the reader is counted after them
+    int next_slot;      //instrumentation slot of the next search thread
+    pthread_mutex_t lock;
+    pthread_cond_t can_fill;
+    pthread_cond_t can_scan;
+} StreamRing;
+
+//Unit of work for the thread pool
+typedef void (*TaskFunction)(void *arg, int worker_id);
+
+typedef struct {
+    TaskFunction function;
+    void *arg;
+} Task;
+
+//Per worker deque: the owner pushes and pops at the tail, thieves take from the head
+typedef struct {
+    Task *tasks;
+    int capacity;
+    int head;
+    int tail;
+    pthread_mutex_t lock;
+    struct ThreadPool *pool;
+    int worker_id;
+} WorkDeque;
+
+//Worker threads created once and reused by every search
+typedef struct ThreadPool {
+    int num_workers;
+    pthread_t *threads;
+    WorkDeque *deques;
+    int next_deque;     //round robin target of pool_submit without a hint
+    long queued;        //tasks sitting in a deque
+    long pending;       //tasks submitted and not finished yet
+    int stop;
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t all_done;
+} ThreadPool;
+
+//Trigram index file layout: the header, num_entries entries sorted by trigram,
+//then the posting lists (chunk ids, delta + varint coded) the entries point into
+typedef struct {
+    char magic[8];
+    uint64_t file_size;  //size and mtime of the indexed file, to detect a stale index
+    int64_t file_mtime;
+    uint32_t chunk_size;
+    uint32_t num_chunks;
+    uint64_t num_entries;
+    uint64_t postings_size;
+} IndexHeader;
+
+typedef struct {
+    uint32_t trigram; //three bytes, first byte highest
+    uint32_t count;   //number of chunks in the posting list
+    uint64_t offset;  //posting list start, relative to the end of the entries
+} IndexEntry;
+
+//Daemon protocol over a Unix socket, in native byte order (the client runs on the
+//same host). A request is a RequestHeader followed by num_queries targets, each a
+//uint32 length and the bytes. The answer is a ResponseHeader followed by one
+//uint64 count per target, in request order. A connection carries any number of
+//requests one after the other.
+#define SERVER_REQUEST_MAGIC 0x31515446  //"FTQ1"
+#define SERVER_RESPONSE_MAGIC 0x31525446 //"FTR1"
+#define SERVER_MAX_QUERIES 65536
+#define SERVER_MAX_QUERY_LEN 4096
+
+enum {
+    SERVER_OK = 0,
+    SERVER_BAD_REQUEST = 1, //unknown flags, empty target or a target with a NUL byte
+    SERVER_NO_CORPUS = 2,
+    SERVER_FAILED = 3
+};
+
+typedef struct {
+    uint32_t magic;
+    uint32_t corpus;      //index of the text file in the server's command line
+    uint32_t flags;       //SCAN_IGNORE_CASE, SCAN_WHOLE_WORD
+    uint32_t num_queries;
+} RequestHeader;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t status;
+    uint32_t num_queries;
+    uint32_t batched_requests; //requests answered by the same shared scan
+    uint64_t scan_usec;        //time of that scan
+} ResponseHeader;
+
+//Command line switches, parsed out of argv before the positional arguments
+typedef struct {
+    int use_mmap;
+    int multi_pattern; //targetText names a file with one target per line
+    int use_stream;
+    int buffer_mb;     //memory cap of the streaming ring
+    int use_pool;
+    ThreadPool *pool;  //created once in main when --pool is given
+    const char *report_file; //write every match here ("-" is stdout)
+    ReportFormat report_format;
+    const char *build_index_file; //build a trigram index of textFile and stop
+    const char *index_file;       //answer the search through this index
+    int scan_flags;               //SCAN_IGNORE_CASE, SCAN_WHOLE_WORD
+    const char *serve_socket;     //run as a daemon listening on this socket
+    const char *query_socket;     //send the targets to the daemon on this socket
+    const char *loadgen_socket;   //load test the daemon on this socket
+    int corpus;                   //text file of the daemon to search (--corpus N)
+    int recursive;                //textFile is a directory or glob pattern, searched on the pool
+    int explain;                  //print the thread and chunk plan (numberOfThreads may be "auto")
+    size_t chunk_size;            //pool task size, POOL_CHUNK_SIZE unless tuned
+    PinMode pin_mode;             //--pin=compact|scatter|none
+    const Placement *placement;   //cpus of the worker threads, NULL when unpinned
+} SearchOptions;
+
 void get_current_time(char *time_str);
+int parse_options(int *argc, char *argv[], SearchOptions *options);
+void scan_range(ChunkData *chunk);
+void scan_range_task(void *arg, int worker_id);
+void *search_in_range(void *arg);
+void *search_in_range_multi(void *arg);
+void multi_merge(ChunkData *chunks, int num_chunks, const Automaton *automaton, const char *data, size_t size, size_t *totals);
 void *search_in_lines(void *arg);
-int text_finder(char *argv[]);
+void *stream_reader(void *arg);
+void *stream_searcher(void *arg);
+int stream_finder(const char *target_text, int number_of_threads, const char *text_file_name, int logToFile, int buffer_mb, int scan_flags);
+int pool_create(ThreadPool *pool, int num_workers, const Placement *placement);
+void pool_submit(ThreadPool *pool, int worker_hint, TaskFunction function, void *arg);
+void pool_wait(ThreadPool *pool);
+void pool_destroy(ThreadPool *pool);
+int build_index(const char *index_file_name, const char *text_file_name, ThreadPool *pool);
+int index_finder(const char *target_text, const char *text_file_name, int logToFile, const SearchOptions *options);
+int tree_finder(const char *target_text, const char *root_pattern, int logToFile, const SearchOptions *options);
+int text_finder(char *argv[], const SearchOptions *options);
+int parse_pin_mode(const char *name, PinMode *mode);
+int placement_init(Placement *placement, PinMode mode);
+void placement_free(Placement *placement);
+void placement_report(const Placement *placement, int num_threads);
+int placement_thread_create(pthread_t *thread, const Placement *placement, int thread_index, void *(*function)(void *), void *arg);
+void *placement_alloc_local(const Placement *placement, size_t size);
+void placement_free_local(const Placement *placement, void *data, size_t size);
+int socket_read_full(int fd, void *buffer, size_t len);
+int socket_write_full(int fd, const void *buffer, size_t len);
+int server_run(const char *socket_path, int number_of_threads, char **text_file_names, int num_files);
+int client_query(const char *socket_path, const SearchOptions *options, char **targets, int num_targets);
+int client_loadgen(const char *socket_path, const SearchOptions *options, int clients, int requests, int batch, const char *pattern_file_name);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,16 @@
+#!/bin/sh
+# Query latency through the trigram index vs a full scan of the same file.
+# Usage: ./measureIndex.sh [textFile] [numberOfThreads]
+TEXT=${1:-indexText.txt}
+THREADS=${2:-4}
+make || exit 1
+# default corpus: ~256 MB of base64 lines, 64 symbols so a trigram is in ~1/8 of the chunks
+if [ ! -f "$TEXT" ]; then
+    head -c 190000000 /dev/urandom | base64 -w 76 > "$TEXT"
+fi
+./posix --build-index "$TEXT.tfi" "$THREADS" "$TEXT" || exit 1
+for TARGET in "person" "Qzx" "ab" "xkcdwq" "lorem+ipsum"; do
+    INDEX=$(./posix --index "$TEXT.tfi" "$TARGET" "$THREADS" "$TEXT" | awk '/index lookup/ {lookup = $7} /instances/ {found = $4} /^Total time taken:/ {print found, lookup + $4}')
+    SCAN=$(./posix --mmap "$TARGET" "$THREADS" "$TEXT" | awk '/mapping file/ {load = $6} /instances/ {found = $4} /^Total time taken:/ {print found, load + $4}')
+    echo "\"$TARGET\": index $INDEX s, full scan $SCAN s"
+done
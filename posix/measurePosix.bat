@@ -1,14 +0,0 @@
-mingw32-make
-posix.exe "person" 1 "testText.txt" 10
-posix.exe "person" 2 "testText.txt" 10
-posix.exe "person" 3 "testText.txt" 10
-posix.exe "person" 4 "testText.txt" 10
-posix.exe "person" 5 "testText.txt" 10
-posix.exe "person" 6 "testText.txt" 10
-posix.exe "person" 7 "testText.txt" 10
-posix.exe "person" 8 "testText.txt" 10
-posix.exe "person" 9 "testText.txt" 10
-posix.exe "person" 10 "testText.txt" 10
-posix.exe "person" 20 "testText.txt" 10
-posix.exe "person" 50 "testText.txt" 10
-posix.exe "person" 100 "testText.txt" 10
\ No newline at end of file
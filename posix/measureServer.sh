@@ -0,0 +1,31 @@
+#!/bin/sh
+# Queries per second of the resident daemon vs starting the one-shot binary for every request.
+# Usage: ./measureServer.sh [textFile] [numberOfThreads] [clients] [targetsPerRequest]
+TEXT=${1:-testText.txt}
+THREADS=${2:-4}
+CLIENTS=${3:-8}
+BATCH=${4:-4}
+REQUESTS=50
+SOCKET=/tmp/textfinder.$$.sock
+PATTERNS=/tmp/textfinder.$$.patterns
+make || exit 1
+# targets: the distinct words of the first 64 kB of the text
+head -c 65536 "$TEXT" | tr -cs 'A-Za-z' '\n' | awk 'length($0) >= 3' | sort -u | head -200 > "$PATTERNS"
+./posix --serve "$SOCKET" "$THREADS" "$TEXT" > /dev/null &
+SERVER=$!
+while [ ! -S "$SOCKET" ]; do sleep 0.1; done
+echo "daemon, 1 client:"
+./posix --loadgen "$SOCKET" 1 "$REQUESTS" "$BATCH" "$PATTERNS" | grep -E "Throughput|Latency"
+echo "daemon, $CLIENTS clients:"
+./posix --loadgen "$SOCKET" "$CLIENTS" "$REQUESTS" "$BATCH" "$PATTERNS" | grep -E "Throughput|Latency|shared scan"
+kill $SERVER
+wait $SERVER
+# one-shot: a new process maps the file and scans it for every request of BATCH targets
+head -n "$BATCH" "$PATTERNS" > "$PATTERNS.batch"
+START=$(date +%s.%N)
+for i in $(seq 10); do
+    ./posix --mmap --patterns "$PATTERNS.batch" "$THREADS" "$TEXT" > /dev/null
+done
+END=$(date +%s.%N)
+echo "one-shot binary:" $(echo "$START $END $BATCH" | awk '{printf "%.1f requests/s, %.1f queries/s, %.3f ms per request", 10 / ($2 - $1), 10 * $3 / ($2 - $1), 100 * ($2 - $1)}')
+rm -f "$PATTERNS" "$PATTERNS.batch"
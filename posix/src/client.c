@@ -0,0 +1,246 @@
+#include "functions.h"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+
+//State of one load generator connection
+typedef struct {
+    const char *socket_path;
+    const SearchOptions *options;
+    char **patterns;
+    int num_patterns;
+    int client_id;
+    int requests;
+    int batch;
+    double *latencies;    //one per request, in seconds
+    uint64_t batched;     //sum of the batched_requests answers
+    int failed;
+} LoadClient;
+
+static double seconds_since(const struct timeval *start) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+static int connect_server(const char *socket_path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path is too long: %s\n", socket_path);
+        return -1;
+    }
+    strcpy(address.sun_path, socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("Error creating socket");
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        perror("Error connecting to server");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+//Send one request and read the counts back, 0 on a broken connection
+static int send_request(int fd, const SearchOptions *options, char **targets, int num_targets, ResponseHeader *response, uint64_t *counts) {
+    RequestHeader header = {SERVER_REQUEST_MAGIC, (uint32_t)options->corpus, (uint32_t)options->scan_flags, (uint32_t)num_targets};
+    size_t size = sizeof(header);
+    for (int i = 0; i < num_targets; i++) {
+        size += sizeof(uint32_t) + strlen(targets[i]);
+    }
+	//the whole request in one write
+    char *buffer = malloc(size);
+    if (buffer == NULL) {
+        return 0;
+    }
+    char *pos = buffer;
+    memcpy(pos, &header, sizeof(header));
+    pos += sizeof(header);
+    for (int i = 0; i < num_targets; i++) {
+        uint32_t len = (uint32_t)strlen(targets[i]);
+        memcpy(pos, &len, sizeof(len));
+        memcpy(pos + sizeof(len), targets[i], len);
+        pos += sizeof(len) + len;
+    }
+    int ok = socket_write_full(fd, buffer, size) && socket_read_full(fd, response, sizeof(*response))
+            && response->magic == SERVER_RESPONSE_MAGIC && response->num_queries == (uint32_t)num_targets
+            && (response->status != SERVER_OK || socket_read_full(fd, counts, num_targets * sizeof(uint64_t)));
+    free(buffer);
+    return ok;
+}
+
+static const char *status_text(uint32_t status) {
+    switch (status) {
+        case SERVER_BAD_REQUEST: return "bad request (empty target or unknown flags)";
+        case SERVER_NO_CORPUS: return "no such corpus";
+        case SERVER_FAILED: return "search failed on the server";
+        default: return "unknown error";
+    }
+}
+
+//Count the targets in a corpus of a running server
+int client_query(const char *socket_path, const SearchOptions *options, char **targets, int num_targets) {
+    if (num_targets > SERVER_MAX_QUERIES) {
+        fprintf(stderr, "At most %d targets fit in one request.\n", SERVER_MAX_QUERIES);
+        return 0;
+    }
+    int fd = connect_server(socket_path);
+    if (fd < 0) {
+        return 0;
+    }
+    uint64_t *counts = calloc(num_targets, sizeof(uint64_t));
+    ResponseHeader response;
+	//start measuring time
+    struct timeval start;
+    gettimeofday(&start, NULL);
+    int ok = counts != NULL && send_request(fd, options, targets, num_targets, &response, counts);
+    double elapsed_time = seconds_since(&start);
+    close(fd);
+    if (!ok) {
+        fprintf(stderr, "No valid answer from the server.\n");
+    } else if (response.status != SERVER_OK) {
+        fprintf(stderr, "Server error: %s\n", status_text(response.status));
+        ok = 0;
+    } else {
+        uint64_t total_found = 0;
+        printf("\nSummary:\n");
+        for (int i = 0; i < num_targets; i++) {
+            printf("'%s': %llu\n", targets[i], (unsigned long long)counts[i]);
+            total_found += counts[i];
+        }
+        printf("Total instances found: %llu\n", (unsigned long long)total_found);
+        printf("Total time taken: %.6f seconds (shared scan %.6f seconds with %u requests)\n", elapsed_time, response.scan_usec / 1000000.0, response.batched_requests);
+    }
+    free(counts);
+    return ok;
+}
+
+//Load generator connection: random targets, one request after the other
+static void *load_client(void *arg) {
+    LoadClient *client = (LoadClient *)arg;
+    int fd = connect_server(client->socket_path);
+    if (fd < 0) {
+        client->failed = client->requests;
+        return NULL;
+    }
+    char **targets = malloc(client->batch * sizeof(char *));
+    uint64_t *counts = malloc(client->batch * sizeof(uint64_t));
+    unsigned int seed = 1234u + (unsigned int)client->client_id;
+    for (int r = 0; r < client->requests; r++) {
+        for (int i = 0; i < client->batch; i++) {
+            targets[i] = client->patterns[rand_r(&seed) % client->num_patterns];
+        }
+        ResponseHeader response;
+        struct timeval start;
+        gettimeofday(&start, NULL);
+        if (!send_request(fd, client->options, targets, client->batch, &response, counts)) {
+            client->failed += client->requests - r;
+            break;
+        }
+        if (response.status != SERVER_OK) {
+            client->failed++;
+            continue;
+        }
+        client->latencies[r] = seconds_since(&start);
+        client->batched += response.batched_requests;
+    }
+    free(targets);
+    free(counts);
+    close(fd);
+    return NULL;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+//clients connections send requests requests each, every request asks for batch
+//random targets of the pattern file
+int client_loadgen(const char *socket_path, const SearchOptions *options, int clients, int requests, int batch, const char *pattern_file_name) {
+    char **patterns;
+    int num_patterns;
+    if (batch > SERVER_MAX_QUERIES) {
+        fprintf(stderr, "At most %d targets fit in one request.\n", SERVER_MAX_QUERIES);
+        return 0;
+    }
+    if (!load_patterns(pattern_file_name, &patterns, &num_patterns)) {
+        return 0;
+    }
+    LoadClient *load = calloc(clients, sizeof(LoadClient));
+    pthread_t *threads = malloc(clients * sizeof(pthread_t));
+    double *latencies = calloc((size_t)clients * requests, sizeof(double));
+    if (load == NULL || threads == NULL || latencies == NULL) {
+        perror("Error allocating load generator");
+        free(load);
+        free(threads);
+        free(latencies);
+        free_patterns(patterns, num_patterns);
+        return 0;
+    }
+    struct timeval start;
+    gettimeofday(&start, NULL);
+    for (int c = 0; c < clients; c++) {
+        load[c].socket_path = socket_path;
+        load[c].options = options;
+        load[c].patterns = patterns;
+        load[c].num_patterns = num_patterns;
+        load[c].client_id = c;
+        load[c].requests = requests;
+        load[c].batch = batch;
+        load[c].latencies = latencies + (size_t)c * requests;
+        pthread_create(&threads[c], NULL, load_client, &load[c]);
+    }
+    for (int c = 0; c < clients; c++) {
+        pthread_join(threads[c], NULL);
+    }
+    double elapsed_time = seconds_since(&start);
+	//failed requests keep a zero latency, they are left out of the percentiles
+    int failed = 0;
+    uint64_t batched = 0;
+    for (int c = 0; c < clients; c++) {
+        failed += load[c].failed;
+        batched += load[c].batched;
+    }
+    size_t answered = 0;
+    double sum = 0.0;
+    for (size_t i = 0; i < (size_t)clients * requests; i++) {
+        if (latencies[i] > 0.0) {
+            latencies[answered++] = latencies[i];
+            sum += latencies[i];
+        }
+    }
+    qsort(latencies, answered, sizeof(double), compare_doubles);
+    printf("\nLoad test: %d clients x %d requests x %d targets (%d distinct targets in %s)\n", clients, requests, batch, num_patterns, pattern_file_name);
+    printf("Answered requests: %zu, failed: %d\n", answered, failed);
+    printf("Total time taken: %.6f seconds\n", elapsed_time);
+    if (answered > 0) {
+        printf("Throughput: %.1f requests/s, %.1f queries/s\n", answered / elapsed_time, (double)answered * batch / elapsed_time);
+        printf("Latency: mean %.3f ms, p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms\n", 1000.0 * sum / answered,
+               1000.0 * latencies[(answered - 1) * 50 / 100], 1000.0 * latencies[(answered - 1) * 95 / 100],
+               1000.0 * latencies[(answered - 1) * 99 / 100], 1000.0 * latencies[answered - 1]);
+        printf("Requests per shared scan: %.2f on average\n", (double)batched / answered);
+    }
+    free(load);
+    free(threads);
+    free(latencies);
+    free_patterns(patterns, num_patterns);
+    return failed == 0;
+}
+#else
+int client_query(const char *socket_path, const SearchOptions *options, char **targets, int num_targets) {
+    printf("Server mode needs Unix sockets, it is not available on this platform.\n");
+    return 0;
+}
+
+int client_loadgen(const char *socket_path, const SearchOptions *options, int clients, int requests, int batch, const char *pattern_file_name) {
+    printf("Server mode needs Unix sockets, it is not available on this platform.\n");
+    return 0;
+}
+#endif
@@ -1,139 +1,608 @@
-#include "functions.h"
-
-//Get current time in the following format: hh:mm:ss:millisec
-void get_current_time(char *time_str) {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    const time_t tv_sec = tv.tv_sec;
-    struct tm *tm_info = localtime(&tv_sec);
-    snprintf(time_str, 20, "%02d:%02d:%02d:%03ld", tm_info->tm_hour, tm_info->tm_min, tm_info->tm_sec, tv.tv_usec / 1000);
-}
-
-//Search algorythm run by each thread
-void *search_in_lines(void *arg) {
-	//initialize struct
-    ThreadData *data = (ThreadData *)arg;
-    int local_found_count = 0;
-    char *target_text = data->target_text;
-    size_t target_len = strlen(target_text);
-    char time_str[20];
-	//search loop, Each for cycle is a different line
-    for (int i = data->thread_id; i < data->num_lines; i += data->number_of_threads) {
-        char *line = data->lines[i];
-        char *pos = line;
-		//search within line
-        while ((pos = strstr(pos, target_text)) != NULL) {
-            int position = pos - line + 1;
-            get_current_time(time_str);
-            //printf("%s Thread %d has found '%s' at line %d position %d\n", time_str, data->thread_id, target_text, i + 1, position);
-			//put cursor at the end of found string
-            pos += target_len;
-            local_found_count++;
-        }
-    }
-
-    data->found_counts[data->thread_id] = local_found_count;
-    __sync_fetch_and_add(data->total_found, local_found_count); 
-	//atomic add for total count
-	//log: threat ended
-    //printf("Thread %d has finished running.\n", data->thread_id);
-    pthread_exit(NULL);
-}
-
-//run main function logic
-int text_finder(char *argv[]) {
-	
-	//pass args to variables
-    char *target_text = argv[1];
-    int number_of_threads = atoi(argv[2]);
-    char *text_file_name = argv[3];
-	int logToFile = atoi(argv[4]);
-	
-	//open file
-    FILE *file = fopen(text_file_name, "r");
-    if (file == NULL) {
-        perror("Error opening file");
-        return 0;
-    }
-	if (number_of_threads <= 0) {
-        printf("Number of threads must be greater than 0.\n");
-        return 0;
-    }
-    char **lines = NULL;
-    size_t line_count = 0;
-    size_t line_capacity = 0;
-    char buffer[MAX_LINE_LENGTH];
-	//start measuring time
-    struct timeval start, end;
-    gettimeofday(&start, NULL);
-	//splitting up text based on line buffer size
-    while (fgets(buffer, MAX_LINE_LENGTH, file)) {
-        if (line_count >= line_capacity) {
-            line_capacity = (line_capacity == 0) ? 10 : line_capacity * 2;
-            lines = realloc(lines, line_capacity * sizeof(char *));
-        }
-		if (line_count > 1)
-		{
-			char* substr = malloc(strlen(target_text));
-			lines[line_count-1] = strcat(lines[line_count-1], strncpy(substr, buffer, strlen(target_text)-1));
-		}
-        lines[line_count] = strdup(buffer);
-        line_count++;
-    }
-    fclose(file);
-	gettimeofday(&end, NULL);
-	double elapsed_time = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
-	if (logToFile == NULL)
-	{
-		printf("\nTotal time taken for splitting up text: %.6f seconds\n", elapsed_time);
-	}
-	//set up thread variables and initialize threads
-    pthread_t threads[number_of_threads];
-    ThreadData thread_data[number_of_threads];
-    int found_counts[number_of_threads];
-    int total_found = 0;
-    for (int i = 0; i < number_of_threads; i++) {
-        found_counts[i] = 0;
-        thread_data[i].thread_id = i;
-        thread_data[i].target_text = target_text;
-        thread_data[i].lines = lines;
-        thread_data[i].num_lines = line_count;
-        thread_data[i].found_counts = found_counts;
-        thread_data[i].total_found = &total_found;
-        thread_data[i].number_of_threads = number_of_threads;
-        pthread_create(&threads[i], NULL, search_in_lines, (void *)&thread_data[i]);
-    }
-	//measure time again
-    gettimeofday(&start, NULL);
-	//join threads
-    for (int i = 0; i < number_of_threads; i++) {
-        pthread_join(threads[i], NULL);
-    }
-	//stop timer
-    gettimeofday(&end, NULL);
-    elapsed_time = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
-	//print summary
-	if (logToFile == NULL)
-	{
-		printf("\nSummary:\n");
-		for (int i = 0; i < number_of_threads; i++) {
-			//printf("Thread %d found %d instances\n", i, found_counts[i]);
-		}
-		printf("Total instances found: %d\n", total_found);
-		printf("Total time taken: %.6f seconds\n", elapsed_time);
-	}
-	//free mem
-    for (size_t i = 0; i < line_count; i++) {
-        free(lines[i]);
-    }
-    free(lines);
-	
-	if (logToFile != NULL)
-	{
-		FILE *logFile = fopen("results.txt", "a");
-		fprintf(logFile, "%.6f\n", elapsed_time);
-		fclose(logFile);
-	}
-	
-	return 1;
+#include "functions.h"
+
+//Get current time in the following format: hh:mm:ss:millisec
+void get_current_time(char *time_str) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    const time_t tv_sec = tv.tv_sec;
+    struct tm *tm_info = localtime(&tv_sec);
+    snprintf(time_str, 20, "%02d:%02d:%02d:%03ld", tm_info->tm_hour, tm_info->tm_min, tm_info->tm_sec, tv.tv_usec / 1000);
+}
+
+//Strip "--switch" arguments out of argv so the positional ones keep their indexes
+int parse_options(int *argc, char *argv[], SearchOptions *options) {
+    memset(options, 0, sizeof(*options));
+    options->buffer_mb = DEFAULT_BUFFER_MB;
+    options->chunk_size = POOL_CHUNK_SIZE;
+    int kept = 1;
+    for (int i = 1; i < *argc; i++) {
+        if (strncmp(argv[i], "--", 2) != 0) {
+            argv[kept++] = argv[i];
+        } else if (strcmp(argv[i], "--mmap") == 0) {
+            options->use_mmap = 1;
+        } else if (strcmp(argv[i], "--patterns") == 0) {
+            options->multi_pattern = 1;
+        } else if (strcmp(argv[i], "--pool") == 0) {
+            options->use_pool = 1;
+        } else if (strcmp(argv[i], "--report") == 0 && i + 1 < *argc) {
+            options->report_file = argv[++i];
+        } else if (strcmp(argv[i], "--report-format") == 0 && i + 1 < *argc) {
+            if (!parse_report_format(argv[++i], &options->report_format)) {
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--build-index") == 0 && i + 1 < *argc) {
+            options->build_index_file = argv[++i];
+        } else if (strcmp(argv[i], "--index") == 0 && i + 1 < *argc) {
+            options->index_file = argv[++i];
+        } else if (strncmp(argv[i], "--pin=", 6) == 0) {
+            if (!parse_pin_mode(argv[i] + 6, &options->pin_mode)) {
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--explain") == 0) {
+            options->explain = 1;
+        } else if (strcmp(argv[i], "--recursive") == 0) {
+            options->recursive = 1;
+        } else if (strcmp(argv[i], "--ignore-case") == 0) {
+            options->scan_flags |= SCAN_IGNORE_CASE;
+        } else if (strcmp(argv[i], "--word") == 0) {
+            options->scan_flags |= SCAN_WHOLE_WORD;
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < *argc) {
+            options->serve_socket = argv[++i];
+        } else if (strcmp(argv[i], "--query") == 0 && i + 1 < *argc) {
+            options->query_socket = argv[++i];
+        } else if (strcmp(argv[i], "--loadgen") == 0 && i + 1 < *argc) {
+            options->loadgen_socket = argv[++i];
+        } else if (strcmp(argv[i], "--corpus") == 0 && i + 1 < *argc) {
+            options->corpus = atoi(argv[++i]);
+            if (options->corpus < 0) {
+                fprintf(stderr, "--corpus must not be negative.\n");
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            options->use_stream = 1;
+        } else if (strcmp(argv[i], "--buffer-mb") == 0 && i + 1 < *argc) {
+            options->buffer_mb = atoi(argv[++i]);
+            if (options->buffer_mb <= 0) {
+                fprintf(stderr, "--buffer-mb must be greater than 0.\n");
+                return 0;
+            }
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return 0;
+        }
+    }
+    argv[kept] = NULL;
+    *argc = kept;
+    return 1;
+}
+
+//Count the matches owned by the thread's byte range
+void scan_range(ChunkData *chunk) {
+    if (chunk->collect) {
+        chunk->matches.count = 0;
+        chunk->found_count = (int)scan_collect_owned(chunk->pattern, chunk->data, chunk->size, chunk->scan_from, chunk->end, &chunk->first_match, &chunk->last_end, &chunk->matches);
+        match_buffer_locate(&chunk->matches, chunk->data, chunk->begin, chunk->end, &chunk->newlines, &chunk->last_newline);
+        return;
+    }
+    chunk->found_count = (int)scan_count_owned(chunk->pattern, chunk->data, chunk->size, chunk->scan_from, chunk->end, &chunk->first_match, &chunk->last_end);
+}
+
+//Search algorythm run by each thread on its own byte range
+void *search_in_range(void *arg) {
+    INSTRUMENT_ENTER(((ChunkData *)arg)->thread_id);
+    scan_range((ChunkData *)arg);
+    INSTRUMENT_LEAVE();
+    pthread_exit(NULL);
+}
+
+//Chunk task run by the thread pool
+void scan_range_task(void *arg, int worker_id) {
+    (void)worker_id;
+    scan_range((ChunkData *)arg);
+}
+
+//Search a mapped file split into one contiguous byte range per thread, or into
+//small chunk tasks when a thread pool is given
+static int range_finder(const char *target_text, int number_of_threads, const char *text_file_name, int logToFile, const SearchOptions *options) {
+    ThreadPool *pool = options->pool;
+    MappedFile file;
+	//start measuring time
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    if (!map_file(text_file_name, &file)) {
+        return 0;
+    }
+	gettimeofday(&end, NULL);
+	double elapsed_time = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+	if (!logToFile)
+	{
+		printf("\nTotal time taken for mapping file: %.6f seconds\n", elapsed_time);
+	}
+	//set up thread variables, every thread (or task) gets an equal share of bytes
+    int num_chunks = number_of_threads;
+    if (pool != NULL) {
+        size_t chunk_size = options->chunk_size > 0 ? options->chunk_size : POOL_CHUNK_SIZE;
+        num_chunks = (int)((file.size + chunk_size - 1) / chunk_size);
+        if (num_chunks < 1) {
+            num_chunks = 1;
+        }
+    }
+    ChunkData *chunks = calloc(num_chunks, sizeof(ChunkData));
+    if (chunks == NULL) {
+        perror("Error allocating chunks");
+        unmap_file(&file);
+        return 0;
+    }
+    ScanPattern pattern;
+    scan_pattern_init_flags(&pattern, target_text, strlen(target_text), options->scan_flags);
+    gettimeofday(&start, NULL);
+    for (int i = 0; i < num_chunks; i++) {
+        chunks[i].thread_id = i;
+        chunks[i].pattern = &pattern;
+        chunks[i].data = file.data;
+        chunks[i].size = file.size;
+        chunks[i].begin = file.size * i / num_chunks;
+        chunks[i].end = file.size * (i + 1) / num_chunks;
+        chunks[i].scan_from = chunks[i].begin;
+        chunks[i].collect = options->report_file != NULL;
+    }
+    INSTRUMENT_BEGIN(pool != NULL ? pool->num_workers : number_of_threads);
+    if (pool != NULL) {
+		//neighbouring chunks go to the same worker, idle workers steal the rest
+        for (int i = 0; i < num_chunks; i++) {
+            pool_submit(pool, (int)((long)i * pool->num_workers / num_chunks), scan_range_task, &chunks[i]);
+        }
+        pool_wait(pool);
+    } else {
+        pthread_t threads[number_of_threads];
+        for (int i = 0; i < number_of_threads; i++) {
+            placement_thread_create(&threads[i], options->placement, i, search_in_range, (void *)&chunks[i]);
+        }
+        for (int i = 0; i < number_of_threads; i++) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+	//a self-overlapping target (e.g. "aa") can end past a range border and hide the
+	//first matches of the next range, those ranges are rescanned from the real end
+    int total_found = 0;
+    size_t carry = 0;
+    for (int i = 0; i < num_chunks; i++) {
+        if (chunks[i].first_match != SIZE_MAX && chunks[i].first_match < carry) {
+            chunks[i].scan_from = carry;
+            scan_range(&chunks[i]);
+        }
+        if (chunks[i].first_match != SIZE_MAX) {
+            carry = chunks[i].last_end;
+        }
+        total_found += chunks[i].found_count;
+    }
+	//stop timer
+    gettimeofday(&end, NULL);
+    elapsed_time = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+	//merge the per-chunk match buffers in file order into one buffered writer
+    int success = 1;
+    if (options->report_file != NULL) {
+        struct timeval write_start, write_end;
+        gettimeofday(&write_start, NULL);
+        MatchWriter writer;
+        success = match_writer_open(&writer, options->report_file, options->report_format);
+        FilePosition position = {0, 0};
+        for (int i = 0; i < num_chunks; i++) {
+            if (success) {
+                match_writer_write(&writer, &chunks[i].matches, &position);
+            }
+            file_position_advance(&position, chunks[i].begin, chunks[i].end, chunks[i].newlines, chunks[i].last_newline);
+            match_buffer_free(&chunks[i].matches);
+        }
+        if (success) {
+            success = match_writer_close(&writer);
+        }
+        gettimeofday(&write_end, NULL);
+        if (!logToFile)
+        {
+            printf("\nTotal time taken for writing matches: %.6f seconds\n", (write_end.tv_sec - write_start.tv_sec) + (write_end.tv_usec - write_start.tv_usec) / 1000000.0);
+        }
+    }
+	//print summary
+	if (!logToFile)
+	{
+		printf("\nSummary:\n");
+		printf("Total instances found: %d\n", total_found);
+		printf("Total time taken: %.6f seconds\n", elapsed_time);
+		INSTRUMENT_REPORT(pool != NULL ? "pthreads pool" : "pthreads");
+	}
+    free(chunks);
+    unmap_file(&file);
+
+	if (logToFile)
+	{
+		FILE *logFile = fopen("results.txt", "a");
+		fprintf(logFile, "%.6f\n", elapsed_time);
+		fclose(logFile);
+	}
+	return success;
+}
+
+//Multi-target search run by each thread on its own byte range
+void *search_in_range_multi(void *arg) {
+    ChunkData *chunk = (ChunkData *)arg;
+    size_t limit = chunk->end + chunk->automaton->max_len - 1;
+    if (limit > chunk->size) {
+        limit = chunk->size;
+    }
+    INSTRUMENT_ENTER(chunk->thread_id);
+    automaton_scan(chunk->automaton, chunk->data, chunk->size, chunk->begin, chunk->end, limit, &chunk->multi_counts);
+    INSTRUMENT_LEAVE();
+    pthread_exit(NULL);
+}
+
+//Same border fix-up as range_finder, done for every target at once. Adds the
+//counts of the chunks (in file order) to totals and frees them.
+void multi_merge(ChunkData *chunks, int num_chunks, const Automaton *automaton, const char *data, size_t size, size_t *totals) {
+    int num_patterns = automaton->num_patterns;
+    size_t *carry = calloc(num_patterns, sizeof(size_t));
+    for (int i = 0; i < num_chunks; i++) {
+        AutomatonCounts *counts = &chunks[i].multi_counts;
+        int hidden = 0;
+        for (int p = 0; p < num_patterns; p++) {
+            if (counts->first_match[p] != SIZE_MAX && counts->first_match[p] < carry[p]) {
+                hidden = 1;
+                break;
+            }
+        }
+        if (hidden) {
+            memcpy(counts->last_end, carry, num_patterns * sizeof(size_t));
+            size_t limit = chunks[i].end + automaton->max_len - 1;
+            automaton_scan(automaton, data, size, chunks[i].begin, chunks[i].end, limit < size ? limit : size, counts);
+        }
+        for (int p = 0; p < num_patterns; p++) {
+            if (counts->counts[p] > 0) {
+                carry[p] = counts->last_end[p];
+                totals[p] += counts->counts[p];
+            }
+        }
+        automaton_counts_free(counts);
+    }
+    free(carry);
+}
+
+//Count every target of a pattern file in one pass over the mapped file
+static int multi_finder(const char *pattern_file_name, int number_of_threads, const char *text_file_name, int logToFile, int scan_flags, const Placement *placement) {
+    char **patterns;
+    int num_patterns;
+    if (!load_patterns(pattern_file_name, &patterns, &num_patterns)) {
+        return 0;
+    }
+    MappedFile file;
+    Automaton automaton;
+	//start measuring time
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    if (!map_file(text_file_name, &file)) {
+        free_patterns(patterns, num_patterns);
+        return 0;
+    }
+    if (!automaton_build(&automaton, (const char **)patterns, num_patterns, scan_flags)) {
+        unmap_file(&file);
+        free_patterns(patterns, num_patterns);
+        return 0;
+    }
+	gettimeofday(&end, NULL);
+	double elapsed_time = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+	if (!logToFile)
+	{
+		printf("\nTotal time taken for mapping file and building automaton (%d patterns, %d states): %.6f seconds\n", num_patterns, automaton.num_states, elapsed_time);
+	}
+	//same byte range split as the single target search
+    pthread_t threads[number_of_threads];
+    ChunkData chunks[number_of_threads];
+    size_t *totals = calloc(num_patterns, sizeof(size_t));
+    INSTRUMENT_BEGIN(number_of_threads);
+    gettimeofday(&start, NULL);
+    for (int i = 0; i < number_of_threads; i++) {
+        chunks[i].thread_id = i;
+        chunks[i].automaton = &automaton;
+        chunks[i].data = file.data;
+        chunks[i].size = file.size;
+        chunks[i].begin = file.size * i / number_of_threads;
+        chunks[i].end = file.size * (i + 1) / number_of_threads;
+        automaton_counts_init(&chunks[i].multi_counts, num_patterns);
+        placement_thread_create(&threads[i], placement, i, search_in_range_multi, (void *)&chunks[i]);
+    }
+    for (int i = 0; i < number_of_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    multi_merge(chunks, number_of_threads, &automaton, file.data, file.size, totals);
+	//stop timer
+    gettimeofday(&end, NULL);
+    elapsed_time = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+	//print summary
+	if (!logToFile)
+	{
+        size_t total_found = 0;
+		printf("\nSummary:\n");
+		for (int p = 0; p < num_patterns; p++) {
+			printf("'%s': %zu\n", patterns[p], totals[p]);
+            total_found += totals[p];
+		}
+		printf("Total instances found: %zu\n", total_found);
+		printf("Total time taken: %.6f seconds\n", elapsed_time);
+		INSTRUMENT_REPORT("pthreads, multiple targets");
+	}
+    free(totals);
+    automaton_free(&automaton);
+    unmap_file(&file);
+    free_patterns(patterns, num_patterns);
+
+	if (logToFile)
+	{
+		FILE *logFile = fopen("results.txt", "a");
+		fprintf(logFile, "%.6f\n", elapsed_time);
+		fclose(logFile);
+	}
+	return 1;
+}
+
+//Search algorythm run by each thread
+void *search_in_lines(void *arg) {
+	//initialize struct
+    ThreadData *data = (ThreadData *)arg;
+    int local_found_count = 0;
+    const ScanPattern *pattern = data->pattern;
+    size_t target_len = pattern->len;
+    char time_str[20];
+	//the main thread read (and first touched) every line, a pinned thread copies
+	//its own lines into memory on its node before the timed search
+    char **lines = data->lines;
+    int first = data->thread_id;
+    int step = data->number_of_threads;
+    int num_lines = data->num_lines;
+    char *local = NULL;
+    size_t local_size = 0;
+    if (data->placement != NULL) {
+        int num_local = 0;
+        for (int i = data->thread_id; i < data->num_lines; i += data->number_of_threads) {
+            local_size += strlen(data->lines[i]) + 1;
+            num_local++;
+        }
+        local_size += num_local * sizeof(char *);
+        local = placement_alloc_local(data->placement, local_size > 0 ? local_size : 1);
+        if (local != NULL) {
+            char **local_lines = (char **)local;
+            char *text = local + num_local * sizeof(char *);
+            num_local = 0;
+            for (int i = data->thread_id; i < data->num_lines; i += data->number_of_threads) {
+                size_t len = strlen(data->lines[i]) + 1;
+                memcpy(text, data->lines[i], len);
+                local_lines[num_local++] = text;
+                text += len;
+            }
+            lines = local_lines;
+            first = 0;
+            step = 1;
+            num_lines = num_local;
+        }
+        pthread_barrier_wait(data->placed);
+    }
+    INSTRUMENT_ENTER(data->thread_id);
+	//search loop, Each for cycle is a different line
+    for (int i = first; i < num_lines; i += step) {
+        const char *line = lines[i];
+        const char *line_end = line + strlen(line);
+        const char *pos = line;
+		//search within line
+        while ((pos = scan_find(pattern, pos, line_end - pos)) != NULL) {
+            int position = pos - line + 1;
+            get_current_time(time_str);
+            //printf("%s Thread %d has found '%s' at line %d position %d\n", time_str, data->thread_id, data->target_text, i + 1, position);
+			//put cursor at the end of found string
+            pos += target_len;
+            local_found_count++;
+        }
+    }
+
+    INSTRUMENT_ADD(matches, local_found_count);
+    INSTRUMENT_LEAVE();
+    if (local != NULL) {
+        placement_free_local(data->placement, local, local_size > 0 ? local_size : 1);
+    }
+    data->found_counts[data->thread_id] = local_found_count;
+    __sync_fetch_and_add(data->total_found, local_found_count); 
+	//atomic add for total count
+	//log: threat ended
+    //printf("Thread %d has finished running.\n", data->thread_id);
+    pthread_exit(NULL);
+}
+
+//run main function logic
+int text_finder(char *argv[], const SearchOptions *options) {
+	
+	//pass args to variables
+    char *target_text = argv[1];
+    int number_of_threads = atoi(argv[2]);
+    char *text_file_name = argv[3];
+	int logToFile = argv[4] != NULL ? atoi(argv[4]) : 0;
+	
+	if (number_of_threads <= 0) {
+        printf("Number of threads must be greater than 0.\n");
+        return 0;
+    }
+	if (target_text[0] == '\0') {
+        printf("Target text must not be empty.\n");
+        return 0;
+    }
+	if (options->report_file != NULL && (options->use_stream || options->multi_pattern || options->index_file != NULL)) {
+        printf("--report works with the byte range search only (--mmap or --pool).\n");
+        return 0;
+    }
+	if (options->recursive && (options->use_stream || options->multi_pattern || options->index_file != NULL || options->report_file != NULL)) {
+        printf("--recursive counts a single target, it does not combine with --stream, --patterns, --index or --report.\n");
+        return 0;
+    }
+	if (options->recursive) {
+        return tree_finder(target_text, text_file_name, logToFile, options);
+    }
+	//compressed input is always streamed, the reader stage inflates it
+	if (!options->use_stream && file_is_gzip(text_file_name)) {
+        if (options->multi_pattern || options->index_file != NULL || options->report_file != NULL) {
+            printf("gzip input goes through the streaming search, it does not combine with --patterns, --index or --report.\n");
+            return 0;
+        }
+        return stream_finder(target_text, number_of_threads, text_file_name, logToFile, options->buffer_mb, options->scan_flags);
+    }
+	if (options->multi_pattern) {
+        return multi_finder(target_text, number_of_threads, text_file_name, logToFile, options->scan_flags, options->placement);
+    }
+	if (options->index_file != NULL) {
+        return index_finder(target_text, text_file_name, logToFile, options);
+    }
+	if (options->use_stream) {
+        return stream_finder(target_text, number_of_threads, text_file_name, logToFile, options->buffer_mb, options->scan_flags);
+    }
+	//--word needs the bytes around a match, the line split cuts lines longer than
+	//MAX_LINE_LENGTH mid-word, so whole-word search always runs on byte ranges
+	if (options->use_mmap || options->pool != NULL || options->report_file != NULL || (options->scan_flags & SCAN_WHOLE_WORD)) {
+        return range_finder(target_text, number_of_threads, text_file_name, logToFile, options);
+    }
+	//open file
+    FILE *file = fopen(text_file_name, "r");
+    if (file == NULL) {
+        perror("Error opening file");
+        return 0;
+    }
+    char **lines = NULL;
+    size_t line_count = 0;
+    size_t line_capacity = 0;
+    char buffer[MAX_LINE_LENGTH];
+	//start measuring time
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+	//splitting up text based on line buffer size
+    int loaded = 1;
+    while (fgets(buffer, MAX_LINE_LENGTH, file)) {
+        if (line_count >= line_capacity) {
+            size_t new_capacity = (line_capacity == 0) ? 10 : line_capacity * 2;
+            char **grown = realloc(lines, new_capacity * sizeof(char *));
+            if (grown == NULL) {
+                loaded = 0;
+                break;
+            }
+            lines = grown;
+            line_capacity = new_capacity;
+        }
+		if (line_count > 1)
+		{
+			//the previous line grows by the first target length - 1 bytes of this one,
+			//strcat into the strdup-ed line used to write past its end
+			size_t old_len = strlen(lines[line_count-1]);
+			size_t add_len = strnlen(buffer, strlen(target_text) - 1);
+			char *joined = realloc(lines[line_count-1], old_len + add_len + 1);
+			if (joined == NULL) {
+                loaded = 0;
+                break;
+            }
+			memcpy(joined + old_len, buffer, add_len);
+			joined[old_len + add_len] = '\0';
+			lines[line_count-1] = joined;
+		}
+        lines[line_count] = strdup(buffer);
+        if (lines[line_count] == NULL) {
+            loaded = 0;
+            break;
+        }
+        line_count++;
+    }
+	//on failure the lines read so far are still owned by lines
+    if (!loaded) {
+        perror("Error allocating lines");
+    }
+    fclose(file);
+    if (!loaded) {
+        for (size_t i = 0; i < line_count; i++) {
+            free(lines[i]);
+        }
+        free(lines);
+        return 0;
+    }
+	gettimeofday(&end, NULL);
+	double elapsed_time = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+	if (!logToFile)
+	{
+		printf("\nTotal time taken for splitting up text: %.6f seconds\n", elapsed_time);
+	}
+	//set up thread variables and initialize threads
+    pthread_t threads[number_of_threads];
+    ThreadData thread_data[number_of_threads];
+    int found_counts[number_of_threads];
+    int total_found = 0;
+    ScanPattern pattern;
+    scan_pattern_init_flags(&pattern, target_text, strlen(target_text), options->scan_flags);
+    pthread_barrier_t placed;
+    if (options->placement != NULL) {
+        pthread_barrier_init(&placed, NULL, number_of_threads + 1);
+    }
+    for (int i = 0; i < number_of_threads; i++) {
+        found_counts[i] = 0;
+        thread_data[i].thread_id = i;
+        thread_data[i].target_text = target_text;
+        thread_data[i].pattern = &pattern;
+        thread_data[i].lines = lines;
+        thread_data[i].num_lines = line_count;
+        thread_data[i].found_counts = found_counts;
+        thread_data[i].total_found = &total_found;
+        thread_data[i].number_of_threads = number_of_threads;
+        thread_data[i].placement = options->placement;
+        thread_data[i].placed = &placed;
+        if (i == 0) {
+            INSTRUMENT_BEGIN(number_of_threads);
+        }
+        placement_thread_create(&threads[i], options->placement, i, search_in_lines, (void *)&thread_data[i]);
+    }
+	//pinned threads copy their lines first, the search is timed from when all are done
+    if (options->placement != NULL) {
+        gettimeofday(&start, NULL);
+        pthread_barrier_wait(&placed);
+        gettimeofday(&end, NULL);
+        if (!logToFile)
+        {
+            printf("\nTotal time taken for copying the lines to the threads' nodes: %.6f seconds\n", (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0);
+        }
+    }
+	//measure time again
+    gettimeofday(&start, NULL);
+	//join threads
+    for (int i = 0; i < number_of_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+	//stop timer
+    gettimeofday(&end, NULL);
+    elapsed_time = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+    if (options->placement != NULL) {
+        pthread_barrier_destroy(&placed);
+    }
+	//print summary
+	if (!logToFile)
+	{
+		printf("\nSummary:\n");
+		for (int i = 0; i < number_of_threads; i++) {
+			//printf("Thread %d found %d instances\n", i, found_counts[i]);
+		}
+		printf("Total instances found: %d\n", total_found);
+		printf("Total time taken: %.6f seconds\n", elapsed_time);
+		INSTRUMENT_REPORT("pthreads, line split");
+	}
+	//free mem
+    for (size_t i = 0; i < line_count; i++) {
+        free(lines[i]);
+    }
+    free(lines);
+	
+	if (logToFile)
+	{
+		FILE *logFile = fopen("results.txt", "a");
+		fprintf(logFile, "%.6f\n", elapsed_time);
+		fclose(logFile);
+	}
+	
+	return 1;
 }
\ No newline at end of file
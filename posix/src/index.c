@@ -0,0 +1,566 @@
+#include "functions.h"
+
+#define INDEX_MAGIC "TFIDX001"
+#define NUM_TRIGRAMS (1 << 24)
+
+//Chunks are indexed in batches of INDEX_BATCH_CHUNKS. Within a batch the
+//(trigram, chunk) pairs are radix sorted by trigram, so every batch adds one
+//run of ascending chunk ids to a posting list instead of scattered single ids.
+#define INDEX_BATCH_CHUNKS 64
+
+typedef struct {
+    uint32_t *trigrams; //distinct trigrams of the batch, ascending
+    uint32_t *counts;   //chunks of the batch containing each of them
+    uint64_t *offsets;  //where the run goes in the posting array
+    size_t num_runs;
+} IndexBatch;
+
+//Shared state of an index build, the phases run as pool tasks over batch or entry ranges
+typedef struct {
+    const char *data;
+    size_t size;
+    uint32_t num_chunks;
+    IndexBatch *batches;
+    uint32_t num_batches;
+    uint32_t *postings; //raw chunk ids, grouped by trigram
+    IndexEntry *entries;
+    uint64_t *list_start; //first posting of each entry
+    uint64_t num_entries;
+    uint8_t *blob;      //delta + varint encoded posting lists
+} IndexBuild;
+
+typedef struct {
+    IndexBuild *build;
+    int phase;
+    uint64_t first;
+    uint64_t last;
+} IndexTask;
+
+static double seconds_since(const struct timeval *start) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+static inline uint32_t trigram_at(const char *p) {
+    return ((uint32_t)(uint8_t)p[0] << 16) | ((uint32_t)(uint8_t)p[1] << 8) | (uint8_t)p[2];
+}
+
+static size_t varint_size(uint64_t value) {
+    size_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+static uint8_t *varint_write(uint8_t *out, uint64_t value) {
+    while (value >= 0x80) {
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+    return out;
+}
+
+//Reads no further than end, NULL if the varint runs past it or is too long
+static const uint8_t *varint_read(const uint8_t *in, const uint8_t *end, uint64_t *value) {
+    uint64_t result = 0;
+    int shift = 0;
+    while (in < end && (*in & 0x80)) {
+        if (shift > 56) {
+            return NULL;
+        }
+        result |= (uint64_t)(*in++ & 0x7f) << shift;
+        shift += 7;
+    }
+    if (in == end) {
+        return NULL;
+    }
+    *value = result | ((uint64_t)*in++ << shift);
+    return in;
+}
+
+//Distinct trigrams of every chunk of the batch (a trigram belongs to the chunk
+//it starts in) as trigram << 8 | chunk in batch, sorted by trigram, stable in
+//chunk order. Returns the number of keys, which end up in keys.
+static size_t batch_keys(const IndexBuild *build, uint32_t batch, uint8_t *seen, uint32_t **keys, uint32_t **scratch) {
+    size_t num_keys = 0;
+    uint32_t first_chunk = batch * INDEX_BATCH_CHUNKS;
+    for (uint32_t c = first_chunk; c < build->num_chunks && c < first_chunk + INDEX_BATCH_CHUNKS; c++) {
+        size_t begin = (size_t)c * INDEX_CHUNK_SIZE;
+        size_t end = begin + INDEX_CHUNK_SIZE < build->size ? begin + INDEX_CHUNK_SIZE : build->size;
+        size_t last_start = build->size >= 2 ? build->size - 2 : 0;
+        if (end > last_start) {
+            end = last_start;
+        }
+        size_t chunk_first_key = num_keys;
+        for (size_t p = begin; p < end; p++) {
+            uint32_t key = trigram_at(build->data + p);
+            if (seen[key >> 3] & (1 << (key & 7))) {
+                continue;
+            }
+            seen[key >> 3] |= 1 << (key & 7);
+            (*keys)[num_keys++] = (key << 8) | (c - first_chunk);
+        }
+        for (size_t i = chunk_first_key; i < num_keys; i++) {
+            seen[(*keys)[i] >> 11] = 0;
+        }
+    }
+	//two 12 bit counting sort passes over the trigram bits
+    for (int shift = 8; shift < 32; shift += 12) {
+        size_t bucket[4097];
+        memset(bucket, 0, sizeof(bucket));
+        for (size_t i = 0; i < num_keys; i++) {
+            bucket[((*keys)[i] >> shift & 0xfff) + 1]++;
+        }
+        for (int k = 1; k <= 4096; k++) {
+            bucket[k] += bucket[k - 1];
+        }
+        for (size_t i = 0; i < num_keys; i++) {
+            (*scratch)[bucket[(*keys)[i] >> shift & 0xfff]++] = (*keys)[i];
+        }
+        uint32_t *swap = *keys;
+        *keys = *scratch;
+        *scratch = swap;
+    }
+    return num_keys;
+}
+
+//Phase 0 collects the runs of every batch, phase 1 sorts the batch again and
+//copies the chunk ids of each run to its place in the posting array
+static void index_batches_task(void *arg, int worker_id) {
+    (void)worker_id;
+    IndexTask *task = (IndexTask *)arg;
+    IndexBuild *build = task->build;
+    uint8_t *seen = calloc(NUM_TRIGRAMS / 8, 1);
+    uint32_t *keys = malloc(INDEX_BATCH_CHUNKS * INDEX_CHUNK_SIZE * sizeof(uint32_t));
+    uint32_t *scratch = malloc(INDEX_BATCH_CHUNKS * INDEX_CHUNK_SIZE * sizeof(uint32_t));
+    if (seen == NULL || keys == NULL || scratch == NULL) {
+        perror("Error allocating index buffers");
+        exit(1);
+    }
+    for (uint64_t b = task->first; b < task->last; b++) {
+        IndexBatch *batch = &build->batches[b];
+        size_t num_keys = batch_keys(build, (uint32_t)b, seen, &keys, &scratch);
+        if (task->phase == 0) {
+            size_t num_runs = 0;
+            for (size_t i = 0; i < num_keys; i++) {
+                num_runs += (i == 0 || keys[i] >> 8 != keys[i - 1] >> 8);
+            }
+            batch->trigrams = malloc((num_runs + 1) * sizeof(uint32_t));
+            batch->counts = calloc(num_runs + 1, sizeof(uint32_t));
+            batch->offsets = malloc((num_runs + 1) * sizeof(uint64_t));
+            if (batch->trigrams == NULL || batch->counts == NULL || batch->offsets == NULL) {
+                perror("Error allocating index runs");
+                exit(1);
+            }
+            size_t run = 0;
+            for (size_t i = 0; i < num_keys; i++) {
+                if (i > 0 && keys[i] >> 8 != keys[i - 1] >> 8) {
+                    run++;
+                }
+                batch->trigrams[run] = keys[i] >> 8;
+                batch->counts[run]++;
+            }
+            batch->num_runs = num_runs;
+        } else {
+            uint32_t first_chunk = (uint32_t)b * INDEX_BATCH_CHUNKS;
+            size_t i = 0;
+            for (size_t run = 0; run < batch->num_runs; run++) {
+                uint32_t *out = build->postings + batch->offsets[run];
+                for (uint32_t k = 0; k < batch->counts[run]; k++) {
+                    out[k] = first_chunk + (keys[i++] & 0xff);
+                }
+            }
+        }
+    }
+    free(scratch);
+    free(keys);
+    free(seen);
+}
+
+//Phase 2 measures the encoded posting lists, phase 3 encodes them
+static void index_entries_task(void *arg, int worker_id) {
+    (void)worker_id;
+    IndexTask *task = (IndexTask *)arg;
+    IndexBuild *build = task->build;
+    for (uint64_t i = task->first; i < task->last; i++) {
+        IndexEntry *entry = &build->entries[i];
+        const uint32_t *list = build->postings + build->list_start[i];
+        uint32_t previous = 0;
+        if (task->phase == 2) {
+            uint64_t size = 0;
+            for (uint32_t k = 0; k < entry->count; k++) {
+                size += varint_size(list[k] - previous);
+                previous = list[k];
+            }
+            entry->offset = size;
+        } else {
+            uint8_t *out = build->blob + entry->offset;
+            for (uint32_t k = 0; k < entry->count; k++) {
+                out = varint_write(out, list[k] - previous);
+                previous = list[k];
+            }
+        }
+    }
+}
+
+//Split [0, count) into tasks, run them on the pool and wait
+static void run_phase(ThreadPool *pool, IndexBuild *build, int phase, uint64_t count, TaskFunction function) {
+    int num_tasks = pool->num_workers * 4;
+    IndexTask tasks[num_tasks];
+    for (int i = 0; i < num_tasks; i++) {
+        tasks[i].build = build;
+        tasks[i].phase = phase;
+        tasks[i].first = count * i / num_tasks;
+        tasks[i].last = count * (i + 1) / num_tasks;
+        pool_submit(pool, i, function, &tasks[i]);
+    }
+    pool_wait(pool);
+}
+
+static void free_build(IndexBuild *build) {
+    for (uint32_t b = 0; build->batches != NULL && b < build->num_batches; b++) {
+        free(build->batches[b].trigrams);
+        free(build->batches[b].counts);
+        free(build->batches[b].offsets);
+    }
+    free(build->batches);
+    free(build->postings);
+    free(build->entries);
+    free(build->list_start);
+    free(build->blob);
+}
+
+//Parallel pass over the text that writes an mmap-able trigram -> chunk list file:
+//header, entries sorted by trigram, then the delta + varint coded chunk ids
+int build_index(const char *index_file_name, const char *text_file_name, ThreadPool *pool) {
+    MappedFile file;
+    if (!map_file(text_file_name, &file)) {
+        return 0;
+    }
+    struct stat st;
+    if (stat(text_file_name, &st) != 0) {
+        perror("Error reading the file status");
+        unmap_file(&file);
+        return 0;
+    }
+    struct timeval start;
+    gettimeofday(&start, NULL);
+
+    IndexBuild build;
+    memset(&build, 0, sizeof(build));
+    build.data = file.data;
+    build.size = file.size;
+    build.num_chunks = (uint32_t)((file.size + INDEX_CHUNK_SIZE - 1) / INDEX_CHUNK_SIZE);
+    build.num_batches = (build.num_chunks + INDEX_BATCH_CHUNKS - 1) / INDEX_BATCH_CHUNKS;
+    build.batches = calloc(build.num_batches + 1, sizeof(IndexBatch));
+    uint64_t *cursor = calloc(NUM_TRIGRAMS, sizeof(uint64_t));
+    if (build.batches == NULL || cursor == NULL) {
+        perror("Error allocating index tables");
+        free(cursor);
+        free_build(&build);
+        unmap_file(&file);
+        return 0;
+    }
+    run_phase(pool, &build, 0, build.num_batches, index_batches_task);
+
+	//posting lists are laid out in trigram order, the runs of a list in batch order
+    for (uint32_t b = 0; b < build.num_batches; b++) {
+        for (size_t r = 0; r < build.batches[b].num_runs; r++) {
+            cursor[build.batches[b].trigrams[r]] += build.batches[b].counts[r];
+        }
+    }
+    uint64_t total_postings = 0;
+    for (uint32_t key = 0; key < NUM_TRIGRAMS; key++) {
+        build.num_entries += cursor[key] > 0;
+    }
+    build.entries = malloc((build.num_entries + 1) * sizeof(IndexEntry));
+    build.list_start = malloc((build.num_entries + 1) * sizeof(uint64_t));
+    uint64_t e = 0;
+    for (uint32_t key = 0; key < NUM_TRIGRAMS; key++) {
+        if (cursor[key] > 0) {
+            build.entries[e].trigram = key;
+            build.entries[e].count = (uint32_t)cursor[key];
+            build.list_start[e] = total_postings;
+            e++;
+        }
+        uint64_t count = cursor[key];
+        cursor[key] = total_postings;
+        total_postings += count;
+    }
+    for (uint32_t b = 0; b < build.num_batches; b++) {
+        for (size_t r = 0; r < build.batches[b].num_runs; r++) {
+            build.batches[b].offsets[r] = cursor[build.batches[b].trigrams[r]];
+            cursor[build.batches[b].trigrams[r]] += build.batches[b].counts[r];
+        }
+    }
+    free(cursor);
+    build.postings = malloc((total_postings + 1) * sizeof(uint32_t));
+    if (build.entries == NULL || build.list_start == NULL || build.postings == NULL) {
+        perror("Error allocating posting lists");
+        free_build(&build);
+        unmap_file(&file);
+        return 0;
+    }
+    run_phase(pool, &build, 1, build.num_batches, index_batches_task);
+
+    run_phase(pool, &build, 2, build.num_entries, index_entries_task);
+    uint64_t blob_size = 0;
+    for (e = 0; e < build.num_entries; e++) {
+        uint64_t size = build.entries[e].offset;
+        build.entries[e].offset = blob_size;
+        blob_size += size;
+    }
+    build.blob = malloc(blob_size + 1);
+    if (build.blob == NULL) {
+        perror("Error allocating posting lists");
+        free_build(&build);
+        unmap_file(&file);
+        return 0;
+    }
+    run_phase(pool, &build, 3, build.num_entries, index_entries_task);
+
+    IndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, 8);
+    header.file_size = file.size;
+    header.file_mtime = (int64_t)st.st_mtime;
+    header.chunk_size = INDEX_CHUNK_SIZE;
+    header.num_chunks = build.num_chunks;
+    header.num_entries = build.num_entries;
+    header.postings_size = blob_size;
+    FILE *index_file = fopen(index_file_name, "wb");
+    int success = index_file != NULL;
+    if (success) {
+        success = fwrite(&header, sizeof(header), 1, index_file) == 1
+            && fwrite(build.entries, sizeof(IndexEntry), build.num_entries, index_file) == build.num_entries
+            && fwrite(build.blob, 1, blob_size, index_file) == blob_size;
+        success = (fclose(index_file) == 0) && success;
+    }
+    if (!success) {
+        perror("Error writing index file");
+    } else {
+        printf("Index of %zu bytes built in %.6f seconds: %llu trigrams, %llu postings in %u chunks, %llu bytes\n", file.size, seconds_since(&start), (unsigned long long)build.num_entries, (unsigned long long)total_postings, build.num_chunks, (unsigned long long)(sizeof(header) + build.num_entries * sizeof(IndexEntry) + blob_size));
+    }
+    free_build(&build);
+    unmap_file(&file);
+    return success;
+}
+
+//Add the chunks of the posting list of a trigram to a bitmap. A list that runs
+//past the postings or names a chunk beyond num_chunks stops there.
+static void decode_postings(const IndexHeader *header, const IndexEntry *entry, uint64_t *bitmap) {
+    if (entry == NULL || entry->offset >= header->postings_size) {
+        return;
+    }
+    const uint8_t *postings = (const uint8_t *)(((const IndexEntry *)(header + 1)) + header->num_entries);
+    const uint8_t *end = postings + header->postings_size;
+    const uint8_t *in = postings + entry->offset;
+    uint64_t chunk = 0;
+    for (uint32_t k = 0; k < entry->count; k++) {
+        uint64_t delta;
+        in = varint_read(in, end, &delta);
+        if (in == NULL || delta >= header->num_chunks - chunk) {
+            return;
+        }
+        chunk += delta;
+        bitmap[chunk / 64] |= 1ULL << (chunk % 64);
+    }
+}
+
+static const IndexEntry *find_entry(const IndexHeader *header, uint32_t trigram) {
+    const IndexEntry *entries = (const IndexEntry *)(header + 1);
+    uint64_t low = 0;
+    uint64_t high = header->num_entries;
+    while (low < high) {
+        uint64_t middle = (low + high) / 2;
+        if (entries[middle].trigram < trigram) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return (low < header->num_entries && entries[low].trigram == trigram) ? &entries[low] : NULL;
+}
+
+static void index_scan_task(void *arg, int worker_id) {
+    (void)worker_id;
+    scan_range((ChunkData *)arg);
+}
+
+//Chunks containing the trigram at text. The index is case-sensitive, with
+//SCAN_IGNORE_CASE the lists of every case variant are merged.
+static void trigram_chunks(const IndexHeader *header, const char *text, int flags, uint64_t *bitmap) {
+    memset(bitmap, 0, ((header->num_chunks + 63) / 64) * sizeof(uint64_t));
+    for (int variant = 0; variant < 8; variant++) {
+        char bytes[3];
+        int valid = 1;
+        for (int i = 0; i < 3; i++) {
+            bytes[i] = text[i];
+            if (variant & (1 << i)) {
+                int letter = ((text[i] | 0x20) >= 'a' && (text[i] | 0x20) <= 'z');
+                valid = valid && letter && (flags & SCAN_IGNORE_CASE);
+                bytes[i] ^= 0x20;
+            }
+        }
+        if (valid) {
+            decode_postings(header, find_entry(header, trigram_at(bytes)), bitmap);
+        }
+    }
+}
+
+//The header must describe a file that fits in size bytes: chunks covering
+//file_size, and the entries and postings inside the mapping
+static int index_header_valid(const IndexHeader *header, size_t size) {
+    if (size < sizeof(IndexHeader) || memcmp(header->magic, INDEX_MAGIC, 8) != 0) {
+        return 0;
+    }
+    if (header->chunk_size == 0 || header->num_chunks != (header->file_size + header->chunk_size - 1) / header->chunk_size) {
+        return 0;
+    }
+    uint64_t rest = size - sizeof(IndexHeader);
+    if (header->num_entries > rest / sizeof(IndexEntry)) {
+        return 0;
+    }
+    return header->postings_size <= rest - header->num_entries * sizeof(IndexEntry);
+}
+
+static inline int bit_set(const uint64_t *bitmap, uint64_t bit, uint64_t num_bits) {
+    return bit < num_bits && (bitmap[bit / 64] >> (bit % 64)) & 1;
+}
+
+//Answer a query through the index: intersect the posting lists of the target's
+//trigrams, then run the exact matcher on the candidate chunks only
+int index_finder(const char *target_text, const char *text_file_name, int logToFile, const SearchOptions *options) {
+    ThreadPool *pool = options->pool;
+    MappedFile index;
+    MappedFile file;
+    struct timeval start;
+    gettimeofday(&start, NULL);
+    if (!map_file(options->index_file, &index)) {
+        return 0;
+    }
+    const IndexHeader *header = (const IndexHeader *)index.data;
+    struct stat st;
+    if (!index_header_valid(header, index.size)) {
+        printf("%s is not an index file.\n", options->index_file);
+        unmap_file(&index);
+        return 0;
+    }
+    if (stat(text_file_name, &st) != 0 || (uint64_t)st.st_size != header->file_size || (int64_t)st.st_mtime != header->file_mtime) {
+        printf("Index %s does not match %s, rebuild it with --build-index.\n", options->index_file, text_file_name);
+        unmap_file(&index);
+        return 0;
+    }
+    if (!map_file(text_file_name, &file)) {
+        unmap_file(&index);
+        return 0;
+    }
+    ScanPattern pattern;
+    scan_pattern_init_flags(&pattern, target_text, strlen(target_text), options->scan_flags);
+    uint64_t num_chunks = header->num_chunks;
+    uint64_t words = (num_chunks + 63) / 64;
+    uint64_t *candidates = malloc((words + 1) * sizeof(uint64_t));
+    uint64_t *postings = malloc((words + 1) * sizeof(uint64_t));
+    if (candidates == NULL || postings == NULL) {
+        perror("Error allocating index bitmaps");
+        free(candidates);
+        free(postings);
+        unmap_file(&file);
+        unmap_file(&index);
+        return 0;
+    }
+
+	//a match starting in chunk c has its trigram k starting in chunk
+	//c + k / size or c + (size - 1 + k) / size
+    if (pattern.len < 3) {
+        memset(candidates, 0xff, words * sizeof(uint64_t));
+    } else {
+        trigram_chunks(header, target_text, options->scan_flags, candidates);
+        for (size_t k = 1; k + 3 <= pattern.len; k++) {
+            trigram_chunks(header, target_text + k, options->scan_flags, postings);
+            uint64_t low = k / header->chunk_size;
+            uint64_t high = (header->chunk_size - 1 + k) / header->chunk_size;
+            for (uint64_t c = 0; c < num_chunks; c++) {
+                if (bit_set(candidates, c, num_chunks) && !bit_set(postings, c + low, num_chunks) && !bit_set(postings, c + high, num_chunks)) {
+                    candidates[c / 64] &= ~(1ULL << (c % 64));
+                }
+            }
+        }
+    }
+    int num_candidates = 0;
+    for (uint64_t c = 0; c < num_chunks; c++) {
+        num_candidates += bit_set(candidates, c, num_chunks);
+    }
+    ChunkData *chunks = calloc(num_candidates + 1, sizeof(ChunkData));
+    if (chunks == NULL) {
+        perror("Error allocating chunks");
+        free(candidates);
+        free(postings);
+        unmap_file(&file);
+        unmap_file(&index);
+        return 0;
+    }
+    int n = 0;
+    for (uint64_t c = 0; c < num_chunks; c++) {
+        if (bit_set(candidates, c, num_chunks)) {
+            chunks[n].thread_id = n;
+            chunks[n].pattern = &pattern;
+            chunks[n].data = file.data;
+            chunks[n].size = file.size;
+            chunks[n].begin = c * header->chunk_size;
+            chunks[n].end = chunks[n].begin + header->chunk_size < file.size ? chunks[n].begin + header->chunk_size : file.size;
+            chunks[n].scan_from = chunks[n].begin;
+            n++;
+        }
+    }
+    double lookup_time = seconds_since(&start);
+	if (!logToFile)
+	{
+		printf("\nTotal time taken for index lookup: %.6f seconds (%d of %llu chunks are candidates)\n", lookup_time, num_candidates, (unsigned long long)num_chunks);
+	}
+
+	//exact search of the candidates, chunks without a candidate hold no match
+    INSTRUMENT_BEGIN(pool->num_workers);
+    gettimeofday(&start, NULL);
+    for (int i = 0; i < num_candidates; i++) {
+        pool_submit(pool, (int)((long)i * pool->num_workers / num_candidates), index_scan_task, &chunks[i]);
+    }
+    pool_wait(pool);
+    int total_found = 0;
+    size_t carry = 0;
+    for (int i = 0; i < num_candidates; i++) {
+        if (chunks[i].first_match != SIZE_MAX && chunks[i].first_match < carry) {
+            chunks[i].scan_from = carry;
+            scan_range(&chunks[i]);
+        }
+        if (chunks[i].first_match != SIZE_MAX) {
+            carry = chunks[i].last_end;
+        }
+        total_found += chunks[i].found_count;
+    }
+    double elapsed_time = seconds_since(&start);
+	if (!logToFile)
+	{
+		printf("\nSummary:\n");
+		printf("Total instances found: %d\n", total_found);
+		printf("Total time taken: %.6f seconds\n", elapsed_time);
+		INSTRUMENT_REPORT("pthreads pool, index candidates");
+	}
+    free(chunks);
+    free(candidates);
+    free(postings);
+    unmap_file(&file);
+    unmap_file(&index);
+
+	if (logToFile)
+	{
+		FILE *logFile = fopen("results.txt", "a");
+		fprintf(logFile, "%.6f\n", lookup_time + elapsed_time);
+		fclose(logFile);
+	}
+	return 1;
+}
@@ -1,10 +1,92 @@
 #include "functions.h"
 
 int main(int argc, char *argv[]) {
+	//pull out the switches, the rest are positional arguments
+	SearchOptions options;
+	if (!parse_options(&argc, argv, &options)) {
+        return EXIT_FAILURE;
+    }
+	//index build: <numberOfThreads> <textFile>
+	if (options.build_index_file != NULL) {
+        ThreadPool build_pool;
+        if (argc != 3 || atoi(argv[1]) <= 0) {
+            fprintf(stderr, "Usage: %s --build-index indexFile <numberOfThreads> <textFile>\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+        if (!pool_create(&build_pool, atoi(argv[1]), NULL)) {
+            fprintf(stderr, "Failed to start the thread pool.\n");
+            return EXIT_FAILURE;
+        }
+        int built = build_index(options.build_index_file, argv[2], &build_pool);
+        pool_destroy(&build_pool);
+        return built ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+	//daemon: <numberOfThreads> <textFile> [textFile ...], the files are corpus 0, 1, ...
+	if (options.serve_socket != NULL) {
+        if (argc < 3 || atoi(argv[1]) <= 0) {
+            fprintf(stderr, "Usage: %s --serve socketPath <numberOfThreads> <textFile> [textFile ...]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+        return server_run(options.serve_socket, atoi(argv[1]), argv + 2, argc - 2) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+	//client: <targetText> [targetText ...]
+	if (options.query_socket != NULL) {
+        if (argc < 2) {
+            fprintf(stderr, "Usage: %s --query socketPath [--corpus N] [--ignore-case] [--word] <targetText> [targetText ...]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+        return client_query(options.query_socket, &options, argv + 1, argc - 1) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+	//load generator: <clients> <requestsPerClient> <targetsPerRequest> <patternFile>
+	if (options.loadgen_socket != NULL) {
+        if (argc != 5 || atoi(argv[1]) <= 0 || atoi(argv[2]) <= 0 || atoi(argv[3]) <= 0) {
+            fprintf(stderr, "Usage: %s --loadgen socketPath [--corpus N] [--ignore-case] [--word] <clients> <requestsPerClient> <targetsPerRequest> <patternFile>\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+        return client_loadgen(options.loadgen_socket, &options, atoi(argv[1]), atoi(argv[2]), atoi(argv[3]), argv[4]) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 	//invalid args check
     if (argc < 4) {
-        fprintf(stderr, "Usage: %s <targetText> <numberOfThreads> <textFile>\n", argv[0]);
+        fprintf(stderr, "Usage: %s [--mmap | --pool | --stream [--buffer-mb N] | --index indexFile] [--patterns] [--recursive] [--ignore-case] [--word] [--report file [--report-format text|csv|binary]] [--explain] [--pin=compact|scatter|none] <targetText|patternFile> <numberOfThreads|auto> <textFile|directory|glob> [repeatCount]\n", argv[0]);
         return EXIT_FAILURE;
+    }
+	//"auto" threads: picked from the input size and the cached calibration
+	char auto_threads[16];
+	if (strcmp(argv[2], "auto") == 0 || options.explain) {
+        TunerPlan plan;
+        int requested = strcmp(argv[2], "auto") == 0 ? 0 : atoi(argv[2]);
+        if (!tuner_plan(argv[3], requested > 0 ? requested : 0, &plan)) {
+            return EXIT_FAILURE;
+        }
+        if (options.explain) {
+            tuner_explain(stdout, &plan);
+        }
+        if (requested <= 0) {
+            snprintf(auto_threads, sizeof(auto_threads), "%d", plan.threads);
+            argv[2] = auto_threads;
+            options.chunk_size = plan.chunk_size;
+        }
+    }
+	//--pin: every worker thread gets its own cpu, the topology is printed once
+	Placement placement;
+	if (options.pin_mode != PIN_NONE) {
+        if (!placement_init(&placement, options.pin_mode)) {
+            return EXIT_FAILURE;
+        }
+        if (placement.mode != PIN_NONE) {
+            placement_report(&placement, atoi(argv[2]));
+            options.placement = &placement;
+        }
+    }
+	//with --pool the workers are started once and reused by every repetition,
+	//index queries and recursive searches run their tasks on the pool too
+	ThreadPool pool;
+	if (options.use_pool || options.index_file != NULL || options.recursive) {
+        if (atoi(argv[2]) <= 0 || !pool_create(&pool, atoi(argv[2]), options.placement)) {
+            fprintf(stderr, "Failed to start the thread pool.\n");
+            return EXIT_FAILURE;
+        }
+        options.pool = &pool;
     }
 	int success = 1;
 	if (argc == 5)
@@ -17,12 +99,18 @@ int main(int argc, char *argv[]) {
 		printf("Repeating function %i times. Execution times will be stored in results.txt.", repeatCount);
 		for (int i = 0; i < repeatCount; i++) 
 		{
-			success = text_finder(argv);
+			success = text_finder(argv, &options);
 		}
 	}
 	else{
-		success = text_finder(argv);
+		success = text_finder(argv, &options);
 	}
+	if (options.pool != NULL) {
+        pool_destroy(options.pool);
+    }
+    if (options.placement != NULL) {
+        placement_free(&placement);
+    }
 	//end
 	if(success == 1)
 	{
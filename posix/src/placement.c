@@ -0,0 +1,236 @@
+#define _GNU_SOURCE //sched_getaffinity, pthread_attr_setaffinity_np
+#include "functions.h"
+#ifdef __linux__
+#include <sched.h>
+#include <dirent.h>
+#endif
+#ifdef TF_NUMA
+#include <numa.h>
+#endif
+
+int parse_pin_mode(const char *name, PinMode *mode) {
+    if (strcmp(name, "none") == 0) {
+        *mode = PIN_NONE;
+    } else if (strcmp(name, "compact") == 0) {
+        *mode = PIN_COMPACT;
+    } else if (strcmp(name, "scatter") == 0) {
+        *mode = PIN_SCATTER;
+    } else {
+        fprintf(stderr, "Unknown placement: %s (compact, scatter or none)\n", name);
+        return 0;
+    }
+    return 1;
+}
+
+#ifdef __linux__
+static int read_sys_int(const char *path, int fallback) {
+    FILE *fp = fopen(path, "r");
+    int value;
+    if (fp == NULL) {
+        return fallback;
+    }
+    if (fscanf(fp, "%d", &value) != 1) {
+        value = fallback;
+    }
+    fclose(fp);
+    return value;
+}
+
+//NUMA node of every cpu from /sys/devices/system/node/node*/cpuN, all of them
+//are node 0 on kernels without NUMA support
+static void read_sys_nodes(int *node_of_cpu, int max_cpus) {
+    DIR *dir = opendir("/sys/devices/system/node");
+    if (dir == NULL) {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        int node;
+        if (sscanf(entry->d_name, "node%d", &node) != 1) {
+            continue;
+        }
+        char path[300];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/%s", entry->d_name);
+        DIR *node_dir = opendir(path);
+        if (node_dir == NULL) {
+            continue;
+        }
+        struct dirent *cpu_entry;
+        while ((cpu_entry = readdir(node_dir)) != NULL) {
+            int cpu;
+            if (sscanf(cpu_entry->d_name, "cpu%d", &cpu) == 1 && cpu >= 0 && cpu < max_cpus) {
+                node_of_cpu[cpu] = node;
+            }
+        }
+        closedir(node_dir);
+    }
+    closedir(dir);
+}
+#endif
+
+static int compare_compact(const void *a, const void *b) {
+    const CpuInfo *x = (const CpuInfo *)a;
+    const CpuInfo *y = (const CpuInfo *)b;
+    if (x->node != y->node) return x->node - y->node;
+    if (x->package != y->package) return x->package - y->package;
+    if (x->core != y->core) return x->core - y->core;
+    return x->cpu - y->cpu;
+}
+
+//Scatter: one core of every node in turn, the second hardware threads of the
+//cores only after every core has a thread
+static int compare_scatter(const void *a, const void *b) {
+    const CpuInfo *x = (const CpuInfo *)a;
+    const CpuInfo *y = (const CpuInfo *)b;
+    if (x->sibling != y->sibling) return x->sibling - y->sibling;
+    if (x->core_rank != y->core_rank) return x->core_rank - y->core_rank;
+    if (x->node != y->node) return x->node - y->node;
+    return x->cpu - y->cpu;
+}
+
+//The cpus this process may run on (taskset / cgroup limits included), their
+//node, socket and core, sorted in the order threads are placed on them
+int placement_init(Placement *placement, PinMode mode) {
+    memset(placement, 0, sizeof(*placement));
+    placement->mode = mode;
+#ifdef __linux__
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        perror("Error reading the cpu affinity");
+        return 0;
+    }
+    placement->cpus = calloc(CPU_COUNT(&allowed), sizeof(CpuInfo));
+    int *node_of_cpu = calloc(CPU_SETSIZE, sizeof(int));
+    if (placement->cpus == NULL || node_of_cpu == NULL) {
+        free(placement->cpus);
+        free(node_of_cpu);
+        return 0;
+    }
+    read_sys_nodes(node_of_cpu, CPU_SETSIZE);
+#ifdef TF_NUMA
+	//libnuma only places memory when there is more than one node
+    placement->use_libnuma = numa_available() >= 0 && numa_max_node() > 0;
+#endif
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed)) {
+            continue;
+        }
+        CpuInfo *info = &placement->cpus[placement->num_cpus++];
+        char path[128];
+        info->cpu = cpu;
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+        info->package = read_sys_int(path, 0);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+        info->core = read_sys_int(path, cpu);
+        info->node = node_of_cpu[cpu];
+#ifdef TF_NUMA
+        if (placement->use_libnuma) {
+            info->node = numa_node_of_cpu(cpu);
+        }
+#endif
+    }
+    free(node_of_cpu);
+    qsort(placement->cpus, placement->num_cpus, sizeof(CpuInfo), compare_compact);
+	//in compact order the hardware threads of a core are neighbours, and a
+	//node's cores come one after the other
+    for (int i = 0; i < placement->num_cpus; i++) {
+        CpuInfo *info = &placement->cpus[i];
+        CpuInfo *previous = i > 0 ? &placement->cpus[i - 1] : NULL;
+        int same_core = previous != NULL && previous->node == info->node && previous->package == info->package && previous->core == info->core;
+        int same_node = previous != NULL && previous->node == info->node;
+        info->sibling = same_core ? previous->sibling + 1 : 0;
+        info->core_rank = same_core ? previous->core_rank : (same_node ? previous->core_rank + 1 : 0);
+        placement->num_cores += !same_core;
+        placement->num_nodes += !same_node;
+        int new_package = 1;
+        for (int j = 0; j < i && new_package; j++) {
+            new_package = placement->cpus[j].package != info->package;
+        }
+        placement->num_packages += new_package;
+    }
+    if (mode == PIN_SCATTER) {
+        qsort(placement->cpus, placement->num_cpus, sizeof(CpuInfo), compare_scatter);
+    }
+    return placement->num_cpus > 0;
+#else
+    fprintf(stderr, "Warning: --pin needs Linux, the threads run unpinned.\n");
+    placement->mode = PIN_NONE;
+    return 1;
+#endif
+}
+
+void placement_free(Placement *placement) {
+    free(placement->cpus);
+    placement->cpus = NULL;
+    placement->num_cpus = 0;
+}
+
+static const CpuInfo *placement_slot(const Placement *placement, int thread_index) {
+    if (placement == NULL || placement->mode == PIN_NONE || placement->num_cpus == 0) {
+        return NULL;
+    }
+    return &placement->cpus[thread_index % placement->num_cpus];
+}
+
+void placement_report(const Placement *placement, int num_threads) {
+    if (placement == NULL || placement->mode == PIN_NONE) {
+        return;
+    }
+    printf("Topology: %d cpus, %d cores, %d socket%s, %d NUMA node%s, memory placement: %s\n", placement->num_cpus, placement->num_cores,
+           placement->num_packages, placement->num_packages == 1 ? "" : "s", placement->num_nodes, placement->num_nodes == 1 ? "" : "s",
+           placement->num_nodes <= 1 ? "not needed (single node)" : placement->use_libnuma ? "libnuma" : "first touch");
+    printf("Placement (%s):", placement->mode == PIN_COMPACT ? "compact" : "scatter");
+    for (int i = 0; i < num_threads; i++) {
+        const CpuInfo *info = placement_slot(placement, i);
+        printf(" %d->cpu%d/node%d", i, info->cpu, info->node);
+    }
+    printf("\n");
+}
+
+//pthread_create with the thread bound to its cpu from the start, so its stack and
+//everything it touches first lands on its own node
+int placement_thread_create(pthread_t *thread, const Placement *placement, int thread_index, void *(*function)(void *), void *arg) {
+    const CpuInfo *info = placement_slot(placement, thread_index);
+#ifdef __linux__
+    if (info != NULL) {
+        pthread_attr_t attr;
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(info->cpu, &cpus);
+        pthread_attr_init(&attr);
+        pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+        int result = pthread_create(thread, &attr, function, arg);
+        pthread_attr_destroy(&attr);
+        return result;
+    }
+#else
+    (void)info;
+#endif
+    return pthread_create(thread, NULL, function, arg);
+}
+
+//Memory for the calling (pinned) thread: bound to its node with libnuma, else
+//plain malloc, the caller writes it first so the pages land on its node anyway
+void *placement_alloc_local(const Placement *placement, size_t size) {
+#ifdef TF_NUMA
+    if (placement != NULL && placement->use_libnuma) {
+        return numa_alloc_local(size);
+    }
+#else
+    (void)placement;
+#endif
+    return malloc(size);
+}
+
+void placement_free_local(const Placement *placement, void *data, size_t size) {
+#ifdef TF_NUMA
+    if (placement != NULL && placement->use_libnuma) {
+        numa_free(data, size);
+        return;
+    }
+#else
+    (void)placement;
+#endif
+    (void)size;
+    free(data);
+}
@@ -0,0 +1,179 @@
+#include "functions.h"
+
+//Returns 0 when the deque cannot grow, it is left as it was
+static int deque_push(WorkDeque *deque, Task task) {
+    pthread_mutex_lock(&deque->lock);
+    if (deque->tail == deque->capacity) {
+        if (deque->head > 0) {
+			//reuse the room left by stolen tasks
+            memmove(deque->tasks, deque->tasks + deque->head, (deque->tail - deque->head) * sizeof(Task));
+            deque->tail -= deque->head;
+            deque->head = 0;
+        } else {
+            int capacity = (deque->capacity == 0) ? 64 : deque->capacity * 2;
+            Task *tasks = realloc(deque->tasks, capacity * sizeof(Task));
+            if (tasks == NULL) {
+                pthread_mutex_unlock(&deque->lock);
+                return 0;
+            }
+            deque->tasks = tasks;
+            deque->capacity = capacity;
+        }
+    }
+    deque->tasks[deque->tail++] = task;
+    pthread_mutex_unlock(&deque->lock);
+    return 1;
+}
+
+//Owner side: newest task first, its data is the most likely to be in cache
+static int deque_pop(WorkDeque *deque, Task *task) {
+    int found = 0;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->tail > deque->head) {
+        *task = deque->tasks[--deque->tail];
+        found = 1;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+//Thief side: oldest task, the farthest from what the owner is working on
+static int deque_steal(WorkDeque *deque, Task *task) {
+    int found = 0;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->tail > deque->head) {
+        *task = deque->tasks[deque->head++];
+        found = 1;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+//Loop run by each worker until the pool is destroyed
+static void *pool_worker(void *arg) {
+    WorkDeque *own = (WorkDeque *)arg;
+    ThreadPool *pool = own->pool;
+    int id = own->worker_id;
+    for (;;) {
+        Task task;
+        int found = deque_pop(own, &task);
+        for (int i = 1; !found && i < pool->num_workers; i++) {
+            found = deque_steal(&pool->deques[(id + i) % pool->num_workers], &task);
+        }
+        if (found) {
+            __sync_fetch_and_sub(&pool->queued, 1);
+            INSTRUMENT_ENTER(id);
+            task.function(task.arg, id);
+            INSTRUMENT_LEAVE();
+            pthread_mutex_lock(&pool->lock);
+            if (--pool->pending == 0) {
+                pthread_cond_broadcast(&pool->all_done);
+            }
+            pthread_mutex_unlock(&pool->lock);
+            continue;
+        }
+		//nothing to run or steal, sleep until new tasks are submitted
+        pthread_mutex_lock(&pool->lock);
+        while (pool->queued == 0 && !pool->stop) {
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+        }
+        int stop = pool->stop && pool->queued == 0;
+        pthread_mutex_unlock(&pool->lock);
+        if (stop) {
+            break;
+        }
+    }
+    pthread_exit(NULL);
+}
+
+//Worker i runs on the placement's i-th cpu when one is given, neighbouring
+//chunks are submitted to the same worker so they stay on one node
+int pool_create(ThreadPool *pool, int num_workers, const Placement *placement) {
+    memset(pool, 0, sizeof(*pool));
+    pool->num_workers = num_workers;
+    pool->threads = malloc(num_workers * sizeof(pthread_t));
+    pool->deques = calloc(num_workers, sizeof(WorkDeque));
+    if (pool->threads == NULL || pool->deques == NULL) {
+        free(pool->threads);
+        free(pool->deques);
+        return 0;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->all_done, NULL);
+    for (int i = 0; i < num_workers; i++) {
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+        pool->deques[i].pool = pool;
+        pool->deques[i].worker_id = i;
+    }
+    for (int i = 0; i < num_workers; i++) {
+        if (placement_thread_create(&pool->threads[i], placement, i, pool_worker, (void *)&pool->deques[i]) != 0) {
+            fprintf(stderr, "Error creating pool worker %d\n", i);
+			//stop and join the workers already running, the other deques were never used
+            for (int j = i; j < num_workers; j++) {
+                pthread_mutex_destroy(&pool->deques[j].lock);
+            }
+            pool->num_workers = i;
+            pool_destroy(pool);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+//Queue a task on a worker's deque, worker_hint < 0 picks the deques in turn.
+//Tasks may submit tasks: the new one is pending and queued before anyone can
+//steal it, so pool_wait cannot see zero while its parent is still running and
+//queued never drops below zero. A task that does not fit in the deque runs here.
+void pool_submit(ThreadPool *pool, int worker_hint, TaskFunction function, void *arg) {
+    Task task = {function, arg};
+    if (worker_hint < 0) {
+        worker_hint = __sync_fetch_and_add(&pool->next_deque, 1);
+    }
+    int worker = (unsigned int)worker_hint % pool->num_workers;
+    pthread_mutex_lock(&pool->lock);
+    pool->pending++;
+    __sync_fetch_and_add(&pool->queued, 1);
+    pthread_mutex_unlock(&pool->lock);
+    if (deque_push(&pool->deques[worker], task)) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_broadcast(&pool->work_ready);
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+    __sync_fetch_and_sub(&pool->queued, 1);
+    task.function(task.arg, worker);
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->pending == 0) {
+        pthread_cond_broadcast(&pool->all_done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+//Block until every submitted task has finished
+void pool_wait(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending > 0) {
+        pthread_cond_wait(&pool->all_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_destroy(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->num_workers; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    for (int i = 0; i < pool->num_workers; i++) {
+        pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques[i].tasks);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_cond_destroy(&pool->all_done);
+    free(pool->threads);
+    free(pool->deques);
+}
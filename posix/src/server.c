@@ -0,0 +1,526 @@
+#include "functions.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+//A text file kept mapped for the whole life of the daemon, split once into
+//byte ranges that every scan reuses
+typedef struct {
+    const char *name;
+    MappedFile file;
+    int num_chunks;
+    ChunkData *chunks;
+} Corpus;
+
+//One request waiting for the scanner thread, owned by its connection thread
+typedef struct PendingRequest {
+    RequestHeader header;
+    char **queries;
+    uint64_t *counts;
+    uint32_t status;
+    uint32_t batched_requests;
+    uint64_t scan_usec;
+    int grouped;
+    int done;
+    struct PendingRequest *next;
+    struct PendingRequest *group_next;
+} PendingRequest;
+
+//Target of a shared scan and where its count goes
+typedef struct {
+    const char *text;
+    uint64_t *count;
+} GroupQuery;
+
+typedef struct {
+    Corpus *corpora;
+    int num_corpora;
+    ThreadPool pool;
+    PendingRequest *head;
+    PendingRequest *tail;
+    int stop;
+    long requests;
+    long queries;
+    long scans;
+    pthread_mutex_t lock;
+    pthread_cond_t has_work;
+    pthread_cond_t finished;
+} Server;
+
+typedef struct {
+    Server *server;
+    int fd;
+} Connection;
+
+static volatile sig_atomic_t server_stopping = 0;
+
+static void stop_server(int signal_number) {
+    (void)signal_number;
+    server_stopping = 1;
+}
+
+int socket_read_full(int fd, void *buffer, size_t len) {
+    char *pos = (char *)buffer;
+    while (len > 0) {
+        ssize_t got = read(fd, pos, len);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return 0;
+        }
+        pos += got;
+        len -= (size_t)got;
+    }
+    return 1;
+}
+
+int socket_write_full(int fd, const void *buffer, size_t len) {
+    const char *pos = (const char *)buffer;
+    while (len > 0) {
+        ssize_t sent = write(fd, pos, len);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return 0;
+        }
+        pos += sent;
+        len -= (size_t)sent;
+    }
+    return 1;
+}
+
+static void server_multi_task(void *arg, int worker_id) {
+    (void)worker_id;
+    ChunkData *chunk = (ChunkData *)arg;
+    size_t limit = chunk->end + chunk->automaton->max_len - 1;
+    automaton_scan(chunk->automaton, chunk->data, chunk->size, chunk->begin, chunk->end, limit < chunk->size ? limit : chunk->size, &chunk->multi_counts);
+}
+
+//Map a text file and read every page once, so no query waits for the disk
+static int load_corpus(Corpus *corpus, const char *name, int num_workers) {
+    corpus->name = name;
+    if (!map_file(name, &corpus->file)) {
+        return 0;
+    }
+    volatile char sink = 0;
+    for (size_t i = 0; i < corpus->file.size; i += 4096) {
+        sink ^= corpus->file.data[i];
+    }
+    (void)sink;
+	//a few ranges per worker: enough for work stealing, few enough that the
+	//per-range counters of a scan with thousands of targets stay small
+    size_t by_size = (corpus->file.size + POOL_CHUNK_SIZE - 1) / POOL_CHUNK_SIZE;
+    corpus->num_chunks = by_size < (size_t)num_workers * 4 ? (int)by_size : num_workers * 4;
+    if (corpus->num_chunks < 1) {
+        corpus->num_chunks = 1;
+    }
+    corpus->chunks = calloc(corpus->num_chunks, sizeof(ChunkData));
+    if (corpus->chunks == NULL) {
+        perror("Error allocating chunks");
+        unmap_file(&corpus->file);
+        return 0;
+    }
+    for (int i = 0; i < corpus->num_chunks; i++) {
+        corpus->chunks[i].thread_id = i;
+        corpus->chunks[i].data = corpus->file.data;
+        corpus->chunks[i].size = corpus->file.size;
+        corpus->chunks[i].begin = corpus->file.size * i / corpus->num_chunks;
+        corpus->chunks[i].end = corpus->file.size * (i + 1) / corpus->num_chunks;
+    }
+    return 1;
+}
+
+static int compare_queries(const void *a, const void *b) {
+    return strcmp(((const GroupQuery *)a)->text, ((const GroupQuery *)b)->text);
+}
+
+//One target: the SIMD scan with the usual border fix-up
+static uint64_t scan_single(Server *server, Corpus *corpus, const char *target, int flags) {
+    ScanPattern pattern;
+    scan_pattern_init_flags(&pattern, target, strlen(target), flags);
+    for (int i = 0; i < corpus->num_chunks; i++) {
+        corpus->chunks[i].pattern = &pattern;
+        corpus->chunks[i].scan_from = corpus->chunks[i].begin;
+        pool_submit(&server->pool, (int)((long)i * server->pool.num_workers / corpus->num_chunks), scan_range_task, &corpus->chunks[i]);
+    }
+    pool_wait(&server->pool);
+    uint64_t total = 0;
+    size_t carry = 0;
+    for (int i = 0; i < corpus->num_chunks; i++) {
+        ChunkData *chunk = &corpus->chunks[i];
+        if (chunk->first_match != SIZE_MAX && chunk->first_match < carry) {
+            chunk->scan_from = carry;
+            scan_range(chunk);
+        }
+        if (chunk->first_match != SIZE_MAX) {
+            carry = chunk->last_end;
+        }
+        total += chunk->found_count;
+    }
+    return total;
+}
+
+//Many targets: one Aho-Corasick pass over the corpus counts all of them
+static int scan_multi(Server *server, Corpus *corpus, const char **targets, int num_targets, int flags, size_t *totals) {
+    Automaton automaton;
+    if (!automaton_build(&automaton, targets, num_targets, flags)) {
+        return 0;
+    }
+    for (int i = 0; i < corpus->num_chunks; i++) {
+        if (!automaton_counts_init(&corpus->chunks[i].multi_counts, num_targets)) {
+            for (int j = 0; j < i; j++) {
+                automaton_counts_free(&corpus->chunks[j].multi_counts);
+            }
+            automaton_free(&automaton);
+            return 0;
+        }
+        corpus->chunks[i].automaton = &automaton;
+        pool_submit(&server->pool, (int)((long)i * server->pool.num_workers / corpus->num_chunks), server_multi_task, &corpus->chunks[i]);
+    }
+    pool_wait(&server->pool);
+    multi_merge(corpus->chunks, corpus->num_chunks, &automaton, corpus->file.data, corpus->file.size, totals);
+    automaton_free(&automaton);
+    return 1;
+}
+
+//Answer every request of a group (same corpus, same flags) with one scan.
+//Repeated targets are counted once.
+static void scan_group(Server *server, PendingRequest *group) {
+    Corpus *corpus = &server->corpora[group->header.corpus];
+    int flags = (int)group->header.flags;
+    size_t total = 0;
+    for (PendingRequest *r = group; r != NULL; r = r->group_next) {
+        total += r->header.num_queries;
+    }
+    GroupQuery *queries = malloc(total * sizeof(GroupQuery));
+    const char **targets = malloc(total * sizeof(char *));
+    size_t *totals = calloc(total, sizeof(size_t));
+    int ok = queries != NULL && targets != NULL && totals != NULL;
+    if (ok) {
+        size_t n = 0;
+        for (PendingRequest *r = group; r != NULL; r = r->group_next) {
+            for (uint32_t q = 0; q < r->header.num_queries; q++) {
+                queries[n].text = r->queries[q];
+                queries[n].count = &r->counts[q];
+                n++;
+            }
+        }
+        qsort(queries, total, sizeof(GroupQuery), compare_queries);
+        int num_targets = 0;
+        for (size_t i = 0; i < total; i++) {
+            if (i == 0 || strcmp(queries[i].text, queries[i - 1].text) != 0) {
+                targets[num_targets++] = queries[i].text;
+            }
+        }
+        if (num_targets == 1) {
+            totals[0] = scan_single(server, corpus, targets[0], flags);
+        } else {
+            ok = scan_multi(server, corpus, targets, num_targets, flags, totals);
+        }
+        for (size_t i = 0, t = 0; ok && i < total; i++) {
+            if (i > 0 && strcmp(queries[i].text, queries[i - 1].text) != 0) {
+                t++;
+            }
+            *queries[i].count = totals[t];
+        }
+        server->queries += total;
+    }
+    if (!ok) {
+        fprintf(stderr, "Shared scan of %zu targets failed.\n", total);
+        for (PendingRequest *r = group; r != NULL; r = r->group_next) {
+            r->status = SERVER_FAILED;
+        }
+    }
+    free(queries);
+    free(targets);
+    free(totals);
+}
+
+//Takes every request queued since the last scan and answers them together:
+//the longer a scan takes, the more requests the next one shares
+static void *server_scanner(void *arg) {
+    Server *server = (Server *)arg;
+    for (;;) {
+        pthread_mutex_lock(&server->lock);
+        while (server->head == NULL && !server->stop) {
+            pthread_cond_wait(&server->has_work, &server->lock);
+        }
+        PendingRequest *batch = server->head;
+        server->head = server->tail = NULL;
+        pthread_mutex_unlock(&server->lock);
+        if (batch == NULL) {
+            break;
+        }
+        struct timeval start, end;
+        gettimeofday(&start, NULL);
+        uint32_t batched = 0;
+        for (PendingRequest *r = batch; r != NULL; r = r->next) {
+            batched++;
+        }
+        for (PendingRequest *r = batch; r != NULL; r = r->next) {
+            if (r->grouped) {
+                continue;
+            }
+            PendingRequest *last = r;
+            for (PendingRequest *other = r->next; other != NULL; other = other->next) {
+                if (!other->grouped && other->header.corpus == r->header.corpus && other->header.flags == r->header.flags) {
+                    other->grouped = 1;
+                    last->group_next = other;
+                    last = other;
+                }
+            }
+            r->grouped = 1;
+            scan_group(server, r);
+            server->scans++;
+        }
+        gettimeofday(&end, NULL);
+        uint64_t usec = (uint64_t)(end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec);
+        pthread_mutex_lock(&server->lock);
+        for (PendingRequest *r = batch; r != NULL; r = r->next) {
+            r->batched_requests = batched;
+            r->scan_usec = usec;
+            r->done = 1;
+        }
+        server->requests += batched;
+        pthread_cond_broadcast(&server->finished);
+        pthread_mutex_unlock(&server->lock);
+    }
+    return NULL;
+}
+
+//Read one request, the connection is dropped when it is not well-formed
+static int read_request(Server *server, int fd, PendingRequest *request) {
+    memset(request, 0, sizeof(*request));
+    if (!socket_read_full(fd, &request->header, sizeof(request->header))
+            || request->header.magic != SERVER_REQUEST_MAGIC || request->header.num_queries > SERVER_MAX_QUERIES) {
+        return 0;
+    }
+    uint32_t num_queries = request->header.num_queries;
+    request->queries = calloc(num_queries ? num_queries : 1, sizeof(char *));
+    request->counts = calloc(num_queries ? num_queries : 1, sizeof(uint64_t));
+    if (request->queries == NULL || request->counts == NULL) {
+        return 0;
+    }
+    for (uint32_t q = 0; q < num_queries; q++) {
+        uint32_t len;
+        if (!socket_read_full(fd, &len, sizeof(len)) || len > SERVER_MAX_QUERY_LEN) {
+            return 0;
+        }
+        request->queries[q] = malloc(len + 1);
+        if (request->queries[q] == NULL || !socket_read_full(fd, request->queries[q], len)) {
+            return 0;
+        }
+        request->queries[q][len] = '\0';
+        if (len == 0 || memchr(request->queries[q], '\0', len) != NULL) {
+            request->status = SERVER_BAD_REQUEST;
+        }
+    }
+    if (request->header.flags & ~(uint32_t)(SCAN_IGNORE_CASE | SCAN_WHOLE_WORD)) {
+        request->status = SERVER_BAD_REQUEST;
+    }
+    if (request->status == SERVER_OK && request->header.corpus >= (uint32_t)server->num_corpora) {
+        request->status = SERVER_NO_CORPUS;
+    }
+    return 1;
+}
+
+static void free_request(PendingRequest *request) {
+    if (request->queries != NULL) {
+        for (uint32_t q = 0; q < request->header.num_queries; q++) {
+            free(request->queries[q]);
+        }
+    }
+    free(request->queries);
+    free(request->counts);
+}
+
+//Connection thread: queue each request for the scanner and send back the counts
+static void *server_connection(void *arg) {
+    Connection *connection = (Connection *)arg;
+    Server *server = connection->server;
+    int fd = connection->fd;
+    free(connection);
+    for (;;) {
+        PendingRequest request;
+        if (!read_request(server, fd, &request)) {
+            free_request(&request);
+            break;
+        }
+        if (request.status == SERVER_OK && request.header.num_queries > 0) {
+            pthread_mutex_lock(&server->lock);
+            if (server->tail != NULL) {
+                server->tail->next = &request;
+            } else {
+                server->head = &request;
+            }
+            server->tail = &request;
+            pthread_cond_signal(&server->has_work);
+            while (!request.done) {
+                pthread_cond_wait(&server->finished, &server->lock);
+            }
+            pthread_mutex_unlock(&server->lock);
+        }
+        ResponseHeader response = {SERVER_RESPONSE_MAGIC, request.status, request.header.num_queries, request.batched_requests, request.scan_usec};
+        int sent = socket_write_full(fd, &response, sizeof(response))
+                && (request.status != SERVER_OK || socket_write_full(fd, request.counts, request.header.num_queries * sizeof(uint64_t)));
+        free_request(&request);
+        if (!sent) {
+            break;
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+static void free_server(Server *server) {
+    pool_destroy(&server->pool);
+    for (int i = 0; i < server->num_corpora; i++) {
+        free(server->corpora[i].chunks);
+        unmap_file(&server->corpora[i].file);
+    }
+    free(server->corpora);
+}
+
+//Only a socket nobody listens on is removed from the path, anything else there
+//(a live server, a mistyped regular file) makes the start fail
+static int remove_stale_socket(const char *socket_path, const struct sockaddr_un *address) {
+    struct stat st;
+    if (lstat(socket_path, &st) != 0) {
+        if (errno == ENOENT) {
+            return 1;
+        }
+        perror("Error checking the socket path");
+        return 0;
+    }
+    if (!S_ISSOCK(st.st_mode)) {
+        fprintf(stderr, "%s exists and is not a socket.\n", socket_path);
+        return 0;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("Error creating socket");
+        return 0;
+    }
+    int live = connect(fd, (const struct sockaddr *)address, sizeof(*address)) == 0 || errno != ECONNREFUSED;
+    close(fd);
+    if (live) {
+        fprintf(stderr, "A server is already listening on %s.\n", socket_path);
+        return 0;
+    }
+    return unlink(socket_path) == 0 || errno == ENOENT;
+}
+
+//Keep the text files mapped and the pool running, answer requests until SIGINT or SIGTERM
+int server_run(const char *socket_path, int number_of_threads, char **text_file_names, int num_files) {
+    Server server;
+    memset(&server, 0, sizeof(server));
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path is too long: %s\n", socket_path);
+        return 0;
+    }
+    strcpy(address.sun_path, socket_path);
+	//start measuring time
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    if (!pool_create(&server.pool, number_of_threads, NULL)) {
+        fprintf(stderr, "Failed to start the thread pool.\n");
+        return 0;
+    }
+    server.corpora = calloc(num_files, sizeof(Corpus));
+    for (int i = 0; i < num_files; i++) {
+        if (server.corpora == NULL || !load_corpus(&server.corpora[i], text_file_names[i], number_of_threads)) {
+            free_server(&server);
+            return 0;
+        }
+        server.num_corpora++;
+    }
+	gettimeofday(&end, NULL);
+    double elapsed_time = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+    printf("Total time taken for loading %d text files: %.6f seconds\n", num_files, elapsed_time);
+    for (int i = 0; i < num_files; i++) {
+        printf("Corpus %d: %s (%zu bytes, %d ranges)\n", i, server.corpora[i].name, server.corpora[i].file.size, server.corpora[i].num_chunks);
+    }
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        perror("Error creating socket");
+        free_server(&server);
+        return 0;
+    }
+    if (!remove_stale_socket(socket_path, &address)) {
+        close(listen_fd);
+        free_server(&server);
+        return 0;
+    }
+    if (bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listen_fd, 128) != 0) {
+        perror("Error listening on socket");
+        close(listen_fd);
+        free_server(&server);
+        return 0;
+    }
+	//no SA_RESTART, so the signal also interrupts accept
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop_server;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_cond_init(&server.has_work, NULL);
+    pthread_cond_init(&server.finished, NULL);
+    pthread_t scanner;
+    pthread_create(&scanner, NULL, server_scanner, &server);
+    printf("Listening on %s with %d threads.\n", socket_path, number_of_threads);
+    fflush(stdout);
+
+    while (!server_stopping) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EINTR) {
+                perror("Error accepting connection");
+            }
+            continue;
+        }
+        Connection *connection = malloc(sizeof(Connection));
+        pthread_t thread;
+        if (connection == NULL) {
+            close(fd);
+            continue;
+        }
+        connection->server = &server;
+        connection->fd = fd;
+        if (pthread_create(&thread, NULL, server_connection, connection) != 0) {
+            close(fd);
+            free(connection);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+	//the scanner finishes the queued requests first. Connection threads still
+	//blocked in read end with the process, so the locks are left alone
+    close(listen_fd);
+    unlink(socket_path);
+    pthread_mutex_lock(&server.lock);
+    server.stop = 1;
+    pthread_cond_broadcast(&server.has_work);
+    pthread_mutex_unlock(&server.lock);
+    pthread_join(scanner, NULL);
+    printf("\nServed %ld requests (%ld targets) in %ld shared scans.\n", server.requests, server.queries, server.scans);
+    free_server(&server);
+    return 1;
+}
+#else
+int server_run(const char *socket_path, int number_of_threads, char **text_file_names, int num_files) {
+    printf("Server mode needs Unix sockets, it is not available on this platform.\n");
+    return 0;
+}
+#endif
@@ -0,0 +1,285 @@
+#include "functions.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#ifndef TF_NO_ZLIB
+#include <zlib.h>
+#endif
+
+static double seconds_since(const struct timeval *start) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+//Reader stage: fills the ring in file order with large pread calls
+void *stream_reader(void *arg) {
+    StreamRing *ring = (StreamRing *)arg;
+    size_t pad = ring->pad;
+    size_t offset = 0;
+    double read_time = 0.0;
+    INSTRUMENT_ENTER(ring->num_threads);
+    for (long seq = 0;; seq++) {
+		//wait for a free slot, slots are freed in block order
+        pthread_mutex_lock(&ring->lock);
+        while (ring->next_fill - ring->next_retire >= ring->num_slots) {
+            pthread_cond_wait(&ring->can_fill, &ring->lock);
+        }
+        pthread_mutex_unlock(&ring->lock);
+
+        StreamBlock *block = &ring->slots[seq % ring->num_slots];
+		//the previous slot is not refilled before this one, so its tail is still there
+        size_t prefix_len = offset < pad + ring->context ? offset : pad + ring->context;
+        if (seq > 0) {
+            StreamBlock *previous = &ring->slots[(seq - 1) % ring->num_slots];
+            memcpy(block->data, previous->data + previous->len - prefix_len, prefix_len);
+        }
+        struct timeval start;
+        gettimeofday(&start, NULL);
+        size_t got = 0;
+#ifndef TF_NO_ZLIB
+		//gzip input: the reader stage inflates, gzread fills the block unless the last member ends
+        if (ring->gz != NULL) {
+            int n = gzread((gzFile)ring->gz, block->data + prefix_len, (unsigned int)ring->block_size);
+            if (n < 0) {
+                int error;
+                fprintf(stderr, "Error decompressing file: %s\n", gzerror((gzFile)ring->gz, &error));
+                ring->read_error = 1;
+            }
+            got = n > 0 ? (size_t)n : 0;
+        }
+#endif
+        while (ring->gz == NULL && got < ring->block_size) {
+            ssize_t n = pread(ring->fd, block->data + prefix_len + got, ring->block_size - got, offset + got);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                perror("Error reading file");
+                ring->read_error = 1;
+            }
+            if (n <= 0) {
+                break;
+            }
+            got += n;
+        }
+        double seconds = seconds_since(&start);
+        read_time += seconds;
+        INSTRUMENT_IO_WAIT(seconds);
+
+        block->file_offset = offset - prefix_len;
+        block->len = prefix_len + got;
+        offset += got;
+		//a short read is the end of the file, the last block owns every remaining start
+        int last = got < ring->block_size;
+        block->owned_begin = prefix_len > pad ? prefix_len - pad : 0;
+        block->owned_end = last ? block->len : block->len - pad;
+        block->done = 0;
+
+        pthread_mutex_lock(&ring->lock);
+        ring->next_fill++;
+        ring->bytes_out += got;
+        if (last) {
+            ring->eof = 1;
+            ring->read_time = read_time;
+        }
+        pthread_cond_broadcast(&ring->can_scan);
+        pthread_mutex_unlock(&ring->lock);
+        if (last) {
+            break;
+        }
+    }
+    INSTRUMENT_LEAVE();
+    pthread_exit(NULL);
+}
+
+//Search stage: scans whole blocks and retires the finished ones in file order
+void *stream_searcher(void *arg) {
+    StreamRing *ring = (StreamRing *)arg;
+    const ScanPattern *pattern = ring->pattern;
+    INSTRUMENT_ENTER(__sync_fetch_and_add(&ring->next_slot, 1));
+    pthread_mutex_lock(&ring->lock);
+    for (;;) {
+        if (ring->next_scan == ring->next_fill && !ring->eof) {
+            struct timeval start;
+            gettimeofday(&start, NULL);
+            while (ring->next_scan == ring->next_fill && !ring->eof) {
+                pthread_cond_wait(&ring->can_scan, &ring->lock);
+            }
+            double seconds = seconds_since(&start);
+            ring->wait_time += seconds;
+            INSTRUMENT_IO_WAIT(seconds);
+        }
+        if (ring->next_scan == ring->next_fill) {
+            break;
+        }
+        StreamBlock *block = &ring->slots[ring->next_scan % ring->num_slots];
+        ring->next_scan++;
+        pthread_mutex_unlock(&ring->lock);
+
+        struct timeval start;
+        gettimeofday(&start, NULL);
+        block->found_count = (int)scan_count_owned(pattern, block->data, block->len, block->owned_begin, block->owned_end, &block->first_match, &block->last_end);
+        double seconds = seconds_since(&start);
+
+        pthread_mutex_lock(&ring->lock);
+        ring->scan_time += seconds;
+        block->done = 1;
+		//a self-overlapping target can end past a block border and hide the first
+		//matches of the next block, those blocks are recounted from the real end
+        while (ring->next_retire < ring->next_scan && ring->slots[ring->next_retire % ring->num_slots].done) {
+            StreamBlock *retired = &ring->slots[ring->next_retire % ring->num_slots];
+            if (retired->first_match != SIZE_MAX && retired->file_offset + retired->first_match < ring->carry) {
+                size_t from = ring->carry - retired->file_offset;
+                retired->found_count = (int)scan_count_owned(pattern, retired->data, retired->len, from, retired->owned_end, &retired->first_match, &retired->last_end);
+            }
+            if (retired->first_match != SIZE_MAX) {
+                ring->carry = retired->file_offset + retired->last_end;
+            }
+            ring->total_found += retired->found_count;
+            retired->done = 0;
+            ring->next_retire++;
+            pthread_cond_signal(&ring->can_fill);
+        }
+    }
+    pthread_mutex_unlock(&ring->lock);
+    INSTRUMENT_LEAVE();
+    pthread_exit(NULL);
+}
+
+//Search a file of any size through a ring of buffer_mb megabytes: one reader
+//thread reads ahead while the search threads scan the blocks already read
+int stream_finder(const char *target_text, int number_of_threads, const char *text_file_name, int logToFile, int buffer_mb, int scan_flags) {
+    ScanPattern pattern;
+    scan_pattern_init_flags(&pattern, target_text, strlen(target_text), scan_flags);
+    StreamRing ring;
+    memset(&ring, 0, sizeof(ring));
+    ring.pattern = &pattern;
+    ring.fd = open(text_file_name, O_RDONLY);
+    if (ring.fd < 0) {
+        perror("Error opening file");
+        return 0;
+    }
+    posix_fadvise(ring.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    struct stat st;
+    size_t file_size = fstat(ring.fd, &st) == 0 ? (size_t)st.st_size : 0;
+#ifndef TF_NO_ZLIB
+    if (file_is_gzip(text_file_name)) {
+        ring.gz = gzdopen(dup(ring.fd), "rb");
+        if (ring.gz == NULL) {
+            perror("Error opening gzip stream");
+            close(ring.fd);
+            return 0;
+        }
+        gzbuffer((gzFile)ring.gz, 256 * 1024);
+    }
+#endif
+
+	//two slots per search thread so the reader can stay ahead, fewer if the
+	//cap would make the blocks too small
+	//a block reads pad bytes past its owned range, in word mode the byte after a
+	//match and the one before it (context) are needed for the boundary check
+    ring.context = (scan_flags & SCAN_WHOLE_WORD) ? 1 : 0;
+    ring.pad = pattern.len - 1 + ring.context;
+    size_t pad = ring.pad + ring.context;
+    size_t budget = (size_t)buffer_mb * 1024 * 1024;
+    ring.num_slots = number_of_threads * 2;
+    while (ring.num_slots > 2 && budget / ring.num_slots < MIN_STREAM_BLOCK + pad) {
+        ring.num_slots--;
+    }
+    if (ring.num_slots < 2) {
+        ring.num_slots = 2;
+    }
+    ring.block_size = budget / ring.num_slots > pad ? budget / ring.num_slots - pad : 0;
+    if (ring.block_size < MIN_STREAM_BLOCK) {
+        ring.block_size = MIN_STREAM_BLOCK;
+    }
+    if (ring.block_size <= pad) {
+        ring.block_size = pad + 1;
+    }
+    ring.slots = calloc(ring.num_slots, sizeof(StreamBlock));
+    for (int i = 0; i < ring.num_slots; i++) {
+        ring.slots[i].data = malloc(ring.block_size + pad);
+        if (ring.slots[i].data == NULL) {
+            perror("Error allocating stream buffers");
+            for (int j = 0; j < i; j++) {
+                free(ring.slots[j].data);
+            }
+            free(ring.slots);
+#ifndef TF_NO_ZLIB
+            if (ring.gz != NULL) {
+                gzclose((gzFile)ring.gz);
+            }
+#endif
+            close(ring.fd);
+            return 0;
+        }
+    }
+    pthread_mutex_init(&ring.lock, NULL);
+    pthread_cond_init(&ring.can_fill, NULL);
+    pthread_cond_init(&ring.can_scan, NULL);
+	if (!logToFile)
+	{
+		printf("\nStreaming %sthrough %d buffers of %zu kB (%d MB cap)\n", ring.gz != NULL ? "gzip input " : "", ring.num_slots, (ring.block_size + pad) / 1024, buffer_mb);
+	}
+
+	//start measuring time, reading and searching overlap so there is one timer
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    pthread_t reader;
+    pthread_t threads[number_of_threads];
+    ring.num_threads = number_of_threads;
+    INSTRUMENT_BEGIN(number_of_threads + 1);
+    pthread_create(&reader, NULL, stream_reader, (void *)&ring);
+    for (int i = 0; i < number_of_threads; i++) {
+        pthread_create(&threads[i], NULL, stream_searcher, (void *)&ring);
+    }
+    pthread_join(reader, NULL);
+    for (int i = 0; i < number_of_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+	//stop timer
+    gettimeofday(&end, NULL);
+    double elapsed_time = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+	//print summary
+	if (!logToFile)
+	{
+		printf("\nSummary:\n");
+		printf("Total instances found: %d\n", ring.total_found);
+		if (ring.gz != NULL) {
+            printf("Time spent decompressing: %.6f seconds (%zu bytes into %zu, %.1f MB/s out)\n", ring.read_time, file_size, ring.bytes_out, ring.read_time > 0 ? ring.bytes_out / ring.read_time / 1e6 : 0.0);
+        } else {
+            printf("Time spent reading: %.6f seconds\n", ring.read_time);
+        }
+		printf("Time spent scanning: %.6f seconds (summed over %d threads), search threads waiting for data: %.6f seconds\n", ring.scan_time, number_of_threads, ring.wait_time);
+		printf("Total time taken: %.6f seconds\n", elapsed_time);
+		INSTRUMENT_REPORT("pthreads stream, last slot is the reader");
+	}
+    for (int i = 0; i < ring.num_slots; i++) {
+        free(ring.slots[i].data);
+    }
+    free(ring.slots);
+    pthread_mutex_destroy(&ring.lock);
+    pthread_cond_destroy(&ring.can_fill);
+    pthread_cond_destroy(&ring.can_scan);
+#ifndef TF_NO_ZLIB
+    if (ring.gz != NULL) {
+        gzclose((gzFile)ring.gz);
+    }
+#endif
+    close(ring.fd);
+
+	if (logToFile)
+	{
+		FILE *logFile = fopen("results.txt", "a");
+		fprintf(logFile, "%.6f\n", elapsed_time);
+		fclose(logFile);
+	}
+	return !ring.read_error;
+}
+#else
+int stream_finder(const char *target_text, int number_of_threads, const char *text_file_name, int logToFile, int buffer_mb, int scan_flags) {
+    printf("Streaming mode needs pread, it is not available on this platform.\n");
+    return 0;
+}
+#endif
@@ -0,0 +1,195 @@
+#include "functions.h"
+
+//Shared state of a recursive search, the pool's deques are its work queue
+typedef struct {
+    ThreadPool *pool;
+    ScanPattern pattern;
+    size_t chunk_size;   //range size of a large file
+    TreeList list;
+    int num_gzip;
+    double inflate_time; //summed over the tasks of .gz files
+    double scan_time;
+    pthread_mutex_t lock;
+} TreeSearch;
+
+typedef struct {
+    TreeSearch *search;
+    char *path;      //directory tasks
+    TreeFile *file;  //file tasks
+} TreeTask;
+
+static void submit_entry(TreeSearch *search, const TreeEntry *entry, int worker_hint);
+
+static void small_file_task(void *arg, int worker_id) {
+    (void)worker_id;
+    TreeTask *task = (TreeTask *)arg;
+    tree_count_file(&task->search->pattern, task->file);
+    free(task);
+}
+
+//A .gz file is inflated and searched block by block in one task, several
+//files decompress in parallel
+static void gzip_file_task(void *arg, int worker_id) {
+    (void)worker_id;
+    TreeTask *task = (TreeTask *)arg;
+    TreeSearch *search = task->search;
+    double inflate_time = 0.0;
+    double scan_time = 0.0;
+    tree_count_gzip(&search->pattern, task->file, &inflate_time, &scan_time);
+    pthread_mutex_lock(&search->lock);
+    search->num_gzip++;
+    search->inflate_time += inflate_time;
+    search->scan_time += scan_time;
+    pthread_mutex_unlock(&search->lock);
+    free(task);
+}
+
+//Map a large file and queue its ranges on this worker, idle workers steal them
+static void large_file_task(void *arg, int worker_id) {
+    TreeTask *task = (TreeTask *)arg;
+    TreeSearch *search = task->search;
+    TreeFile *file = task->file;
+    free(task);
+    if (!map_file(file->path, &file->map)) {
+        file->failed = 1;
+        return;
+    }
+    size_t chunk_size = search->chunk_size;
+    int num_chunks = (int)((file->map.size + chunk_size - 1) / chunk_size);
+    ChunkData *chunks = calloc(num_chunks > 0 ? num_chunks : 1, sizeof(ChunkData));
+    if (chunks == NULL) {
+        unmap_file(&file->map);
+        file->failed = 1;
+        return;
+    }
+    file->chunks = chunks;
+    file->num_chunks = num_chunks;
+    for (int i = 0; i < num_chunks; i++) {
+        chunks[i].thread_id = i;
+        chunks[i].pattern = &search->pattern;
+        chunks[i].data = file->map.data;
+        chunks[i].size = file->map.size;
+        chunks[i].begin = (size_t)i * chunk_size;
+        chunks[i].end = chunks[i].begin + chunk_size < file->map.size ? chunks[i].begin + chunk_size : file->map.size;
+        chunks[i].scan_from = chunks[i].begin;
+        pool_submit(search->pool, worker_id, scan_range_task, &chunks[i]);
+    }
+}
+
+static void dir_task(void *arg, int worker_id) {
+    TreeTask *task = (TreeTask *)arg;
+    TreeEntry *entries;
+    int num_entries;
+    if (tree_read_dir(task->path, &entries, &num_entries)) {
+        for (int i = 0; i < num_entries; i++) {
+            submit_entry(task->search, &entries[i], worker_id);
+        }
+        tree_entries_free(entries, num_entries);
+    }
+    free(task->path);
+    free(task);
+}
+
+//Directories are walked by tasks too, so the walk runs in parallel with the search
+static void submit_entry(TreeSearch *search, const TreeEntry *entry, int worker_hint) {
+    TreeTask *task = calloc(1, sizeof(TreeTask));
+    if (task == NULL) {
+        return;
+    }
+    task->search = search;
+    if (entry->is_dir) {
+        task->path = strdup(entry->path);
+        pool_submit(search->pool, worker_hint, dir_task, task);
+        return;
+    }
+    pthread_mutex_lock(&search->lock);
+    task->file = tree_list_add(&search->list, entry->path, entry->size);
+    pthread_mutex_unlock(&search->lock);
+    if (task->file == NULL) {
+        free(task);
+        return;
+    }
+    if (file_is_gzip(entry->path)) {
+        pool_submit(search->pool, worker_hint, gzip_file_task, task);
+        return;
+    }
+    pool_submit(search->pool, worker_hint, entry->size > TREE_SPLIT_SIZE ? large_file_task : small_file_task, task);
+}
+
+//Search every file under a directory or glob pattern: small files are one task
+//each, large files are split into ranges. Counts are printed sorted by path.
+int tree_finder(const char *target_text, const char *root_pattern, int logToFile, const SearchOptions *options) {
+    TreeSearch search;
+    memset(&search, 0, sizeof(search));
+    search.pool = options->pool;
+    search.chunk_size = options->chunk_size > 0 ? options->chunk_size : POOL_CHUNK_SIZE;
+    pthread_mutex_init(&search.lock, NULL);
+    scan_pattern_init_flags(&search.pattern, target_text, strlen(target_text), options->scan_flags);
+	//start measuring time
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    TreeEntry *roots;
+    int num_roots;
+    if (!tree_expand(root_pattern, &roots, &num_roots)) {
+        pthread_mutex_destroy(&search.lock);
+        return 0;
+    }
+    INSTRUMENT_BEGIN(search.pool->num_workers);
+    for (int i = 0; i < num_roots; i++) {
+        submit_entry(&search, &roots[i], -1);
+    }
+    tree_entries_free(roots, num_roots);
+    pool_wait(search.pool);
+	//ranges of a large file get the usual border fix-up, in file order
+    size_t total_bytes = 0;
+    int num_split = 0;
+    for (int i = 0; i < search.list.num_files; i++) {
+        TreeFile *file = search.list.files[i];
+        ChunkData *chunks = (ChunkData *)file->chunks;
+        size_t carry = 0;
+        for (int c = 0; c < file->num_chunks; c++) {
+            if (chunks[c].first_match != SIZE_MAX && chunks[c].first_match < carry) {
+                chunks[c].scan_from = carry;
+                scan_range(&chunks[c]);
+            }
+            if (chunks[c].first_match != SIZE_MAX) {
+                carry = chunks[c].last_end;
+            }
+            file->count += chunks[c].found_count;
+        }
+        if (file->map.is_mapped || file->chunks != NULL) {
+            num_split++;
+            unmap_file(&file->map);
+            free(file->chunks);
+            file->chunks = NULL;
+        }
+        total_bytes += file->size;
+    }
+    tree_list_sort(&search.list);
+	//stop timer
+    gettimeofday(&end, NULL);
+    double elapsed_time = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+	//print summary
+    size_t total_found = tree_list_report(&search.list, !logToFile);
+	if (!logToFile)
+	{
+		printf("\nSummary:\n");
+		printf("Files searched: %d (%zu bytes, %d of them split into ranges)\n", search.list.num_files, total_bytes, num_split);
+		if (search.num_gzip > 0) {
+            printf("gzip files: %d, time spent decompressing: %.6f seconds, scanning: %.6f seconds (summed over the tasks)\n", search.num_gzip, search.inflate_time, search.scan_time);
+        }
+		printf("Total instances found: %zu\n", total_found);
+		printf("Total time taken: %.6f seconds\n", elapsed_time);
+		INSTRUMENT_REPORT("pthreads pool, recursive");
+	}
+    tree_list_free(&search.list);
+    pthread_mutex_destroy(&search.lock);
+
+	if (logToFile)
+	{
+		FILE *logFile = fopen("results.txt", "a");
+		fprintf(logFile, "%.6f\n", elapsed_time);
+		fclose(logFile);
+	}
+	return 1;
+}